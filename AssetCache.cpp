@@ -0,0 +1,109 @@
+#include "AssetCache.h"
+#include <filesystem>
+
+namespace SoftwareRasterizer
+{
+    /*!
+    *  \brief Cache key of a file: its canonical path and modification time. Empty if the file
+    *         does not exist.
+    */
+    static std::string assetKey(const std::string& path)
+    {
+        std::error_code ec;
+        std::filesystem::path canonical = std::filesystem::canonical(path, ec);
+        if (ec)
+            return std::string();
+        std::filesystem::file_time_type mtime = std::filesystem::last_write_time(canonical, ec);
+        if (ec)
+            return std::string();
+        return canonical.string() + "|" + std::to_string((long long)mtime.time_since_epoch().count());
+    }
+
+    AssetCache& AssetCache::Instance()
+    {
+        static AssetCache cache;
+        return cache;
+    }
+
+    template<class T, class LoadFn>
+    std::shared_ptr<const T> AssetCache::Get(std::unordered_map<std::string, Entry<T>>& entries,
+        const std::string& path, std::atomic<unsigned int>& loads, LoadFn load)
+    {
+        std::string key = assetKey(path);
+        if (key.empty())
+            return load();
+        std::promise<std::shared_ptr<const T>> loading;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            Entry<T>& entry = entries[key];
+            if (std::shared_ptr<const T> cached = entry.asset.lock())
+                return cached;
+            if (entry.pending.valid())
+            {
+                std::shared_future<std::shared_ptr<const T>> pending = entry.pending;
+                lock.unlock();
+                return pending.get();
+            }
+            entry.pending = loading.get_future().share();
+        }
+
+        std::shared_ptr<const T> loaded;
+        try
+        {
+            loaded = load();
+        }
+        catch (...)
+        {
+            // Waiting threads get the same exception, and the next request tries again.
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                entries[key].pending = std::shared_future<std::shared_ptr<const T>>();
+            }
+            loading.set_exception(std::current_exception());
+            throw;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (loaded)
+                loads++;
+            Entry<T>& entry = entries[key];
+            entry.asset = loaded;
+            entry.pending = std::shared_future<std::shared_ptr<const T>>();
+
+            // Drop entries whose assets have all been released.
+            for (auto it = entries.begin(); it != entries.end();)
+            {
+                if (it->second.asset.expired() && !it->second.pending.valid() && it->first != key)
+                    it = entries.erase(it);
+                else
+                    ++it;
+            }
+            if (!loaded)
+                entries.erase(key);
+        }
+        loading.set_value(loaded);
+        return loaded;
+    }
+
+    std::shared_ptr<const Texture> AssetCache::LoadTexture(const std::string& path, bool preview)
+    {
+        return Get(preview ? m_TexturePreviews : m_Textures, path, textureLoads, [&path, preview]() {
+            cv::Mat img = cv::imread(path, preview ? cv::IMREAD_REDUCED_COLOR_8 : cv::IMREAD_COLOR);
+            if (img.empty())
+                return std::shared_ptr<const Texture>();
+            std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+            texture->Create(img);
+            return std::shared_ptr<const Texture>(texture);
+        });
+    }
+
+    std::shared_ptr<const MaterialSet> AssetCache::LoadMaterials(const std::string& path)
+    {
+        return Get(m_MaterialSets, path, materialLoads, [&path]() {
+            std::shared_ptr<MaterialSet> set = std::make_shared<MaterialSet>();
+            set->Load(path);
+            return std::shared_ptr<const MaterialSet>(set);
+        });
+    }
+}
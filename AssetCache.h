@@ -0,0 +1,67 @@
+/*
+*	AssetCache.h -- process-wide cache of decoded textures and parsed material files. Models
+*					share them through reference-counted handles instead of loading their own
+*					copies. Entries are keyed by the file's canonical path and modification time,
+*					so a file edited on disk is loaded again, and an entry goes away with the last
+*					handle to it.
+*/
+
+#pragma once
+#include "Texture.h"
+#include "Material.h"
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace SoftwareRasterizer
+{
+    class AssetCache
+    {
+    public:
+        static AssetCache& Instance();
+
+        /*!
+        *  \brief Decoded, mipmapped texture for an image file, or nullptr if it cannot be read.
+        *         A preview is decoded at 1/8 of the resolution, which for JPEG files skips
+        *         most of the decoding work; previews are cached apart from full textures.
+        */
+        std::shared_ptr<const Texture> LoadTexture(const std::string& path, bool preview = false);
+
+        /*!
+        *  \brief Parsed material file. Throws like MaterialSet::Load() if it cannot be read.
+        */
+        std::shared_ptr<const MaterialSet> LoadMaterials(const std::string& path);
+
+        // Files actually read so far, for checking that sharing works.
+        unsigned int TextureLoads() const { return textureLoads; }
+        unsigned int MaterialLoads() const { return materialLoads; }
+
+    private:
+        AssetCache() : textureLoads(0), materialLoads(0) {}
+
+        /**
+        *  \brief A cached asset, and while it is being loaded, the load other threads wait on.
+        */
+        template<class T>
+        struct Entry
+        {
+            std::weak_ptr<const T> asset;
+            std::shared_future<std::shared_ptr<const T>> pending;
+        };
+
+        // Loading happens outside the lock so that separate files load in parallel. Threads
+        // missing on a file that is already loading wait for that load instead of repeating it.
+        template<class T, class LoadFn>
+        std::shared_ptr<const T> Get(std::unordered_map<std::string, Entry<T>>& entries,
+            const std::string& path, std::atomic<unsigned int>& loads, LoadFn load);
+
+        std::mutex m_Mutex;
+        std::unordered_map<std::string, Entry<Texture>> m_Textures;
+        std::unordered_map<std::string, Entry<Texture>> m_TexturePreviews;
+        std::unordered_map<std::string, Entry<MaterialSet>> m_MaterialSets;
+        std::atomic<unsigned int> textureLoads, materialLoads;
+    };
+}
@@ -0,0 +1,91 @@
+#include "Clipper.h"
+#include <algorithm>
+
+namespace SoftwareRasterizer
+{
+    void guardBandScale(int w, int h, float& guardX, float& guardY)
+    {
+        guardX = GUARD_BAND_PIXELS / (0.5f * w);
+        guardY = GUARD_BAND_PIXELS / (0.5f * h);
+    }
+
+    // Signed distance of a clip-space position to one clip plane, positive inside.
+    static float planeDistance(const glm::vec4& p, unsigned int plane, float guardX, float guardY)
+    {
+        switch (plane)
+        {
+        case CLIP_NEAR: return p.z + p.w;
+        case CLIP_FAR: return p.w - p.z;
+        case CLIP_GUARD_LEFT: return p.x + guardX * p.w;
+        case CLIP_GUARD_RIGHT: return guardX * p.w - p.x;
+        case CLIP_GUARD_BOTTOM: return p.y + guardY * p.w;
+        default: return guardY * p.w - p.y;
+        }
+    }
+
+    static ClipVertex lerp(const ClipVertex& a, const ClipVertex& b, float t, int varyingCount)
+    {
+        ClipVertex v;
+        v.position = a.position + (b.position - a.position) * t;
+        v.texcoord = a.texcoord + (b.texcoord - a.texcoord) * t;
+        v.normal = a.normal + (b.normal - a.normal) * t;
+        for (int k = 0; k < varyingCount; ++k)
+            v.varyings[k] = a.varyings[k] + (b.varyings[k] - a.varyings[k]) * t;
+        return v;
+    }
+
+    int clipPolygon(ClipVertex* poly, int count, unsigned int planes, float guardX, float guardY,
+        int varyingCount)
+    {
+        // Sutherland-Hodgman, one plane at a time.
+        ClipVertex buffer[MAX_CLIP_VERTICES];
+        for (unsigned int plane = CLIP_NEAR; plane <= CLIP_GUARD_TOP && count > 0; plane <<= 1)
+        {
+            if (!(planes & plane))
+                continue;
+
+            int n = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                const ClipVertex& a = poly[i];
+                const ClipVertex& b = poly[(i + 1) % count];
+                float da = planeDistance(a.position, plane, guardX, guardY);
+                float db = planeDistance(b.position, plane, guardX, guardY);
+                if (da >= 0)
+                    buffer[n++] = a;
+                if ((da >= 0) != (db >= 0))
+                    buffer[n++] = lerp(a, b, da / (da - db), varyingCount);
+            }
+            for (int i = 0; i < n; ++i)
+                poly[i] = buffer[i];
+            count = n;
+        }
+        return count < 3 ? 0 : count;
+    }
+
+    bool clipLine(glm::vec4& a, glm::vec4& b, unsigned int planes, float guardX, float guardY)
+    {
+        // Liang-Barsky: narrow the parameter range [t0, t1] of the segment plane by plane.
+        float t0 = 0.0f, t1 = 1.0f;
+        for (unsigned int plane = CLIP_NEAR; plane <= CLIP_GUARD_TOP; plane <<= 1)
+        {
+            if (!(planes & plane))
+                continue;
+            float da = planeDistance(a, plane, guardX, guardY);
+            float db = planeDistance(b, plane, guardX, guardY);
+            if (da < 0 && db < 0)
+                return false;
+            if (da < 0)
+                t0 = std::max(t0, da / (da - db));
+            else if (db < 0)
+                t1 = std::min(t1, da / (da - db));
+        }
+        if (t0 > t1)
+            return false;
+
+        glm::vec4 d = b - a;
+        b = a + d * t1;
+        a = a + d * t0;
+        return true;
+    }
+}
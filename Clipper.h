@@ -0,0 +1,77 @@
+/*
+*	Clipper.h -- homogeneous clip-space clipping. Vertices get an outcode of the view volume
+*				 planes they are outside of. Triangles entirely outside one plane are dropped;
+*				 the rest are only clipped against the near and far planes, and against the
+*				 guard band, a region far larger than the viewport that the rasterizer can
+*				 still handle exactly. Everything between the viewport and the guard band is
+*				 left to the rasterizer's viewport-clamped bounding box. Wireframe line segments
+*				 are handled the same way.
+*/
+
+#pragma once
+#include "Vertex.h"
+#include <glm/glm.hpp>
+
+namespace SoftwareRasterizer
+{
+    // Outcode bits. The first six are the view volume planes, -w <= x, y, z <= w.
+    const unsigned int CLIP_LEFT = 1 << 0;
+    const unsigned int CLIP_RIGHT = 1 << 1;
+    const unsigned int CLIP_BOTTOM = 1 << 2;
+    const unsigned int CLIP_TOP = 1 << 3;
+    const unsigned int CLIP_NEAR = 1 << 4;
+    const unsigned int CLIP_FAR = 1 << 5;
+    const unsigned int CLIP_GUARD_LEFT = 1 << 6;
+    const unsigned int CLIP_GUARD_RIGHT = 1 << 7;
+    const unsigned int CLIP_GUARD_BOTTOM = 1 << 8;
+    const unsigned int CLIP_GUARD_TOP = 1 << 9;
+
+    // A triangle whose three outcodes share one of these bits is invisible.
+    const unsigned int CLIP_VIEW_PLANES = CLIP_LEFT | CLIP_RIGHT | CLIP_BOTTOM | CLIP_TOP | CLIP_NEAR | CLIP_FAR;
+
+    // A triangle with any of these bits in any outcode has to be clipped geometrically.
+    const unsigned int CLIP_REQUIRED_PLANES = CLIP_NEAR | CLIP_FAR | CLIP_GUARD_LEFT | CLIP_GUARD_RIGHT |
+        CLIP_GUARD_BOTTOM | CLIP_GUARD_TOP;
+
+    // Half-size of the guard band in pixels, measured from the viewport center. Keeping screen
+    // positions within it keeps the rasterizer's snapped edge coefficients exact in float.
+    const float GUARD_BAND_PIXELS = 16384.0f;
+
+    // A triangle clipped by all six clip planes has at most this many vertices.
+    const int MAX_CLIP_VERTICES = 9;
+
+    /** \brief Clip-space vertex with the attributes that are interpolated along clipped edges. */
+    struct ClipVertex
+    {
+        glm::vec4 position;
+        glm::vec3 texcoord;
+        glm::vec3 normal;
+        float varyings[MAX_VARYINGS];
+    };
+
+    /*!
+    *  \brief Guard band extent in clip space units of w, for a viewport of w x h pixels.
+    *         x is inside the guard band while |x| <= guardX * w, likewise for y.
+    */
+    void guardBandScale(int w, int h, float& guardX, float& guardY);
+
+    /*!
+    *  \brief Clips a convex polygon against the clip planes set in planes (only
+    *         CLIP_REQUIRED_PLANES bits are used). The first varyingCount varyings of new
+    *         vertices are interpolated along with the other attributes.
+    *
+    * \param [in,out] poly Polygon vertices in order, room for MAX_CLIP_VERTICES.
+    * \return Number of vertices left in poly, 0 if the polygon was clipped away.
+    */
+    int clipPolygon(ClipVertex* poly, int count, unsigned int planes, float guardX, float guardY,
+        int varyingCount = 0);
+
+    /*!
+    *  \brief Clips the clip-space line segment from a to b against the clip planes set in
+    *         planes (only CLIP_REQUIRED_PLANES bits are used), moving a and b onto the part
+    *         that is left.
+    *
+    * \return False if the segment was clipped away.
+    */
+    bool clipLine(glm::vec4& a, glm::vec4& b, unsigned int planes, float guardX, float guardY);
+}
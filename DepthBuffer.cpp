@@ -0,0 +1,179 @@
+#include "DepthBuffer.h"
+
+namespace SoftwareRasterizer
+{
+    DepthBuffer::DepthBuffer() : w(0), h(0), format(DEPTH_FORMAT::FLOAT32), compare(DEPTH_COMPARE::LESS),
+        storedCompare(DEPTH_COMPARE::LESS), reversedZ(false), scale(1.0f), clearValue(1.0f), clearStencil(0) {}
+
+    void DepthBuffer::Create(int w, int h, DEPTH_FORMAT format, DEPTH_COMPARE compare, bool reversedZ)
+    {
+        this->w = w;
+        this->h = h;
+        this->format = format;
+        this->reversedZ = reversedZ;
+        SetCompare(compare);
+
+        int paddedW = (w + 7) & ~7;
+        switch (format)
+        {
+        case DEPTH_FORMAT::FLOAT32:
+            scale = 1.0f;
+            m_Data.create(h, paddedW, CV_32FC1);
+            break;
+        case DEPTH_FORMAT::UNORM24_STENCIL8:
+            scale = float(DEPTH24_MASK);
+            m_Data.create(h, paddedW, CV_32SC1);
+            break;
+        case DEPTH_FORMAT::UNORM16:
+            scale = 65535.0f;
+            m_Data.create(h, paddedW, CV_16UC1);
+            break;
+        }
+    }
+
+    void DepthBuffer::SetCompare(DEPTH_COMPARE compare)
+    {
+        this->compare = compare;
+
+        // Storing 1 - depth reverses the order of stored values, so the test flips with it.
+        storedCompare = compare;
+        if (reversedZ)
+        {
+            switch (compare)
+            {
+            case DEPTH_COMPARE::LESS: storedCompare = DEPTH_COMPARE::GREATER; break;
+            case DEPTH_COMPARE::LEQUAL: storedCompare = DEPTH_COMPARE::GEQUAL; break;
+            case DEPTH_COMPARE::GREATER: storedCompare = DEPTH_COMPARE::LESS; break;
+            case DEPTH_COMPARE::GEQUAL: storedCompare = DEPTH_COMPARE::LEQUAL; break;
+            default: break;
+            }
+        }
+    }
+
+    void DepthBuffer::SetClearValue(float depth, unsigned char stencil)
+    {
+        clearValue = ToStored(depth);
+        clearStencil = stencil;
+    }
+
+    void DepthBuffer::Clear(float depth, unsigned char stencil)
+    {
+        SetClearValue(depth, stencil);
+        ClearRect(cv::Rect(0, 0, w, h));
+    }
+
+    void DepthBuffer::ClearRect(const cv::Rect& region)
+    {
+        // Every pixel gets the same bits, so each row is filled as one run of words.
+        int x0 = region.x;
+        int x1 = region.x + region.width >= w ? m_Data.cols : region.x + region.width;
+        if (format == DEPTH_FORMAT::FLOAT32)
+        {
+            float8 v = set1(clearValue);
+            for (int y = region.y; y < region.y + region.height; ++y)
+            {
+                float* p = m_Data.ptr<float>(y);
+                int x = x0;
+                for (; x + 8 <= x1; x += 8)
+                    storeu8(p + x, v);
+                for (; x < x1; ++x)
+                    p[x] = clearValue;
+            }
+        }
+        else if (format == DEPTH_FORMAT::UNORM24_STENCIL8)
+        {
+            uint32_t v = (uint32_t(clearStencil) << 24) | uint32_t(clearValue);
+            for (int y = region.y; y < region.y + region.height; ++y)
+                std::fill(m_Data.ptr<uint32_t>(y) + x0, m_Data.ptr<uint32_t>(y) + x1, v);
+        }
+        else
+        {
+            uint16_t v = uint16_t(clearValue);
+            for (int y = region.y; y < region.y + region.height; ++y)
+                std::fill(m_Data.ptr<uint16_t>(y) + x0, m_Data.ptr<uint16_t>(y) + x1, v);
+        }
+    }
+
+    float DepthBuffer::Get(int x, int y) const
+    {
+        switch (format)
+        {
+        case DEPTH_FORMAT::FLOAT32: return m_Data.ptr<float>(y)[x];
+        case DEPTH_FORMAT::UNORM24_STENCIL8: return float(m_Data.ptr<uint32_t>(y)[x] & DEPTH24_MASK);
+        default: return float(m_Data.ptr<uint16_t>(y)[x]);
+        }
+    }
+
+    void DepthBuffer::Set(int x, int y, float stored)
+    {
+        switch (format)
+        {
+        case DEPTH_FORMAT::FLOAT32:
+            m_Data.ptr<float>(y)[x] = stored;
+            break;
+        case DEPTH_FORMAT::UNORM24_STENCIL8:
+        {
+            uint32_t& v = m_Data.ptr<uint32_t>(y)[x];
+            v = (v & ~DEPTH24_MASK) | uint32_t(stored);
+            break;
+        }
+        case DEPTH_FORMAT::UNORM16:
+            m_Data.ptr<uint16_t>(y)[x] = uint16_t(stored);
+            break;
+        }
+    }
+
+    unsigned char DepthBuffer::GetStencil(int x, int y) const
+    {
+        if (format != DEPTH_FORMAT::UNORM24_STENCIL8)
+            return 0;
+        return (unsigned char)(m_Data.ptr<uint32_t>(y)[x] >> 24);
+    }
+
+    bool DepthBuffer::Test(float incoming, float stored) const
+    {
+        switch (storedCompare)
+        {
+        case DEPTH_COMPARE::LESS: return incoming < stored;
+        case DEPTH_COMPARE::LEQUAL: return incoming <= stored;
+        case DEPTH_COMPARE::GREATER: return incoming > stored;
+        case DEPTH_COMPARE::GEQUAL: return incoming >= stored;
+        default: return incoming == stored;
+        }
+    }
+
+    bool DepthBuffer::CanPass(float lo, float hi, float zMin, float zMax) const
+    {
+        switch (storedCompare)
+        {
+        case DEPTH_COMPARE::LESS: return lo < zMax;
+        case DEPTH_COMPARE::LEQUAL: return lo <= zMax;
+        case DEPTH_COMPARE::GREATER: return hi > zMin;
+        case DEPTH_COMPARE::GEQUAL: return hi >= zMin;
+        default: return lo <= zMax && hi >= zMin;
+        }
+    }
+
+    bool DepthBuffer::AlwaysPasses(float lo, float hi, float zMin, float zMax) const
+    {
+        switch (storedCompare)
+        {
+        case DEPTH_COMPARE::LESS: return hi < zMin;
+        case DEPTH_COMPARE::LEQUAL: return hi <= zMin;
+        case DEPTH_COMPARE::GREATER: return lo > zMax;
+        case DEPTH_COMPARE::GEQUAL: return lo >= zMax;
+        default: return false;
+        }
+    }
+
+    void DepthBuffer::Visualize(cv::Mat& out) const
+    {
+        out.create(h, w, CV_32FC1);
+        for (int y = 0; y < h; ++y)
+        {
+            float* row = out.ptr<float>(y);
+            for (int x = 0; x < w; ++x)
+                row[x] = ToScene(Get(x, y));
+        }
+    }
+}
@@ -0,0 +1,274 @@
+/*
+*	DepthBuffer.h -- single-channel depth (and optional stencil) target. Depth is kept either as
+*					 32-bit float, as 24-bit unorm packed with an 8-bit stencil, or as 16-bit unorm.
+*					 The rasterizer works on "stored" depth: the value as held in the buffer, scaled
+*					 to integer codes for the unorm formats and flipped for reversed-Z, so tests
+*					 compare stored values directly and never convert the buffer back.
+*/
+
+#pragma once
+#include "SIMD.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace SoftwareRasterizer
+{
+    enum class DEPTH_FORMAT { FLOAT32, UNORM24_STENCIL8, UNORM16 };
+
+    /**
+    *  \brief Test a fragment must pass against the stored depth, in terms of scene depth. EQUAL
+    *         is meant for drawing again over depth laid down by the same geometry.
+    */
+    enum class DEPTH_COMPARE { LESS, LEQUAL, GREATER, GEQUAL, EQUAL };
+
+    class DepthBuffer
+    {
+    public:
+        DepthBuffer();
+
+        /*!
+        *  \brief Allocates a w x h buffer. Rows are padded to a multiple of eight values so the
+        *         rasterizer can always load and store a full block row. With reversedZ set, depth
+        *         d is stored as 1 - d, which puts the far range next to zero where float
+        *         precision is densest; the compare mode keeps its meaning in scene depth.
+        *
+        * \param [in] format Storage format.
+        * \param [in] compare Depth test applied when drawing.
+        * \param [in] reversedZ Store 1 - depth instead of depth.
+        */
+        void Create(int w, int h, DEPTH_FORMAT format, DEPTH_COMPARE compare = DEPTH_COMPARE::LESS,
+            bool reversedZ = false);
+
+        /*!
+        *  \brief Changes the depth test without touching the contents. Copies of a DepthBuffer
+        *         share its storage, so a copy with a different compare mode can draw into the
+        *         same depth while the original keeps its own.
+        */
+        void SetCompare(DEPTH_COMPARE compare);
+
+        /*!
+        *  \brief Sets the values later clears write. Stencil is only kept by the
+        *         UNORM24_STENCIL8 format.
+        */
+        void SetClearValue(float depth, unsigned char stencil = 0);
+
+        /*!
+        *  \brief Sets the clear values and fills the whole buffer, padding included.
+        */
+        void Clear(float depth, unsigned char stencil = 0);
+
+        /*!
+        *  \brief Fills a region with the current clear values. A region reaching the right
+        *         edge also clears the row padding.
+        */
+        void ClearRect(const cv::Rect& region);
+
+        int Width() const { return w; }
+        int Height() const { return h; }
+        bool Empty() const { return m_Data.empty(); }
+        DEPTH_FORMAT Format() const { return format; }
+        DEPTH_COMPARE Compare() const { return compare; }
+        // The compare mode as applied to stored values, i.e. flipped for reversed-Z.
+        DEPTH_COMPARE StoredCompare() const { return storedCompare; }
+        bool ReversedZ() const { return reversedZ; }
+        const cv::Mat& Data() const { return m_Data; }
+
+        // Stored value clears write.
+        float ClearValue() const { return clearValue; }
+
+        /*!
+        *  \brief Converts scene depth to the value the buffer would store for it, and back.
+        *         Unorm formats clamp to [0, 1] and round to the nearest code. Adding 0.5 and
+        *         flooring would push the top 24-bit code past 2^24 in float.
+        */
+        float ToStored(float depth) const
+        {
+            if (reversedZ)
+                depth = 1.0f - depth;
+            if (format == DEPTH_FORMAT::FLOAT32)
+                return depth;
+            return std::nearbyint(std::min(std::max(depth, 0.0f), 1.0f) * scale);
+        }
+        float ToScene(float stored) const
+        {
+            float depth = format == DEPTH_FORMAT::FLOAT32 ? stored : stored / scale;
+            return reversedZ ? 1.0f - depth : depth;
+        }
+        SR_FORCEINLINE float8 ToStored8(float8 depth) const
+        {
+            if (reversedZ)
+                depth = set1(1.0f) - depth;
+            return Quantize8(depth);
+        }
+
+        /*!
+        *  \brief ToStored8() without the reversal: rounds depths that are already in stored
+        *         order to the format's codes.
+        */
+        SR_FORCEINLINE float8 Quantize8(float8 depth) const
+        {
+            switch (format)
+            {
+            case DEPTH_FORMAT::FLOAT32: return Quantize8T<DEPTH_FORMAT::FLOAT32>(depth);
+            case DEPTH_FORMAT::UNORM24_STENCIL8: return Quantize8T<DEPTH_FORMAT::UNORM24_STENCIL8>(depth);
+            default: return Quantize8T<DEPTH_FORMAT::UNORM16>(depth);
+            }
+        }
+
+        /*!
+        *  \brief Stored values of pixels (x, y) .. (x + 7, y). Lanes past the right edge read
+        *         the row padding.
+        */
+        SR_FORCEINLINE float8 Load8(int x, int y) const
+        {
+            switch (format)
+            {
+            case DEPTH_FORMAT::FLOAT32: return Load8T<DEPTH_FORMAT::FLOAT32>(x, y);
+            case DEPTH_FORMAT::UNORM24_STENCIL8: return Load8T<DEPTH_FORMAT::UNORM24_STENCIL8>(x, y);
+            default: return Load8T<DEPTH_FORMAT::UNORM16>(x, y);
+            }
+        }
+
+        /*!
+        *  \brief Writes the stored values of the lanes set in mask (bit k = pixel x + k).
+        *         The 24-bit format keeps each pixel's stencil.
+        */
+        SR_FORCEINLINE void Store8(int x, int y, float8 stored, int mask)
+        {
+            switch (format)
+            {
+            case DEPTH_FORMAT::FLOAT32: Store8T<DEPTH_FORMAT::FLOAT32>(x, y, stored, mask); break;
+            case DEPTH_FORMAT::UNORM24_STENCIL8: Store8T<DEPTH_FORMAT::UNORM24_STENCIL8>(x, y, stored, mask); break;
+            default: Store8T<DEPTH_FORMAT::UNORM16>(x, y, stored, mask); break;
+            }
+        }
+
+        /*!
+        *  \brief Quantize8(), Load8() and Store8() for a format fixed at compile time, which
+        *         must be this buffer's. Used by raster kernels specialized per format.
+        */
+        template <DEPTH_FORMAT F>
+        SR_FORCEINLINE float8 Quantize8T(float8 depth) const
+        {
+            if (F == DEPTH_FORMAT::FLOAT32)
+                return depth;
+            const float maxCode = F == DEPTH_FORMAT::UNORM16 ? 65535.0f : float(DEPTH24_MASK);
+            SR_ALIGN(32) float lanes[8];
+            store8(lanes, min8(max8(depth, set1(0.0f)), set1(1.0f)) * maxCode);
+            for (int k = 0; k < 8; ++k)
+                lanes[k] = std::nearbyint(lanes[k]);
+            return load8(lanes);
+        }
+        template <DEPTH_FORMAT F>
+        SR_FORCEINLINE float8 Load8T(int x, int y) const
+        {
+            if (F == DEPTH_FORMAT::FLOAT32)
+                return loadu8(m_Data.ptr<float>(y) + x);
+            SR_ALIGN(32) float lanes[8];
+            if (F == DEPTH_FORMAT::UNORM24_STENCIL8)
+            {
+                const uint32_t* row = m_Data.ptr<uint32_t>(y) + x;
+                for (int k = 0; k < 8; ++k)
+                    lanes[k] = float(row[k] & DEPTH24_MASK);
+            }
+            else
+            {
+                const uint16_t* row = m_Data.ptr<uint16_t>(y) + x;
+                for (int k = 0; k < 8; ++k)
+                    lanes[k] = float(row[k]);
+            }
+            return load8(lanes);
+        }
+        template <DEPTH_FORMAT F>
+        SR_FORCEINLINE void Store8T(int x, int y, float8 stored, int mask)
+        {
+            if (F == DEPTH_FORMAT::FLOAT32)
+            {
+                float* row = m_Data.ptr<float>(y) + x;
+                storeu8(row, select(laneMask(mask), stored, loadu8(row)));
+                return;
+            }
+            SR_ALIGN(32) float lanes[8];
+            store8(lanes, stored);
+            if (F == DEPTH_FORMAT::UNORM24_STENCIL8)
+            {
+                uint32_t* row = m_Data.ptr<uint32_t>(y) + x;
+                for (int k = 0; k < 8; ++k)
+                    if ((mask >> k) & 1)
+                        row[k] = (row[k] & ~DEPTH24_MASK) | uint32_t(lanes[k]);
+            }
+            else
+            {
+                uint16_t* row = m_Data.ptr<uint16_t>(y) + x;
+                for (int k = 0; k < 8; ++k)
+                    if ((mask >> k) & 1)
+                        row[k] = uint16_t(lanes[k]);
+            }
+        }
+
+        float Get(int x, int y) const;
+        void Set(int x, int y, float stored);
+        unsigned char GetStencil(int x, int y) const;
+
+        /*!
+        *  \brief Depth test on stored values. Returns one bit per passing lane.
+        */
+        SR_FORCEINLINE int Test8(float8 incoming, float8 stored) const
+        {
+            switch (storedCompare)
+            {
+            case DEPTH_COMPARE::LESS: return Test8T<DEPTH_COMPARE::LESS>(incoming, stored);
+            case DEPTH_COMPARE::LEQUAL: return Test8T<DEPTH_COMPARE::LEQUAL>(incoming, stored);
+            case DEPTH_COMPARE::GREATER: return Test8T<DEPTH_COMPARE::GREATER>(incoming, stored);
+            case DEPTH_COMPARE::GEQUAL: return Test8T<DEPTH_COMPARE::GEQUAL>(incoming, stored);
+            default: return Test8T<DEPTH_COMPARE::EQUAL>(incoming, stored);
+            }
+        }
+
+        /*!
+        *  \brief Test8() for a compare mode on stored values (see StoredCompare()) fixed at
+        *         compile time.
+        */
+        template <DEPTH_COMPARE C>
+        static SR_FORCEINLINE int Test8T(float8 incoming, float8 stored)
+        {
+            switch (C)
+            {
+            case DEPTH_COMPARE::LESS: return movemask(cmplt(incoming, stored));
+            case DEPTH_COMPARE::LEQUAL: return movemask(cmple(incoming, stored));
+            case DEPTH_COMPARE::GREATER: return movemask(cmpgt(incoming, stored));
+            case DEPTH_COMPARE::GEQUAL: return movemask(cmpge(incoming, stored));
+            default: return movemask(cmpeq(incoming, stored));
+            }
+        }
+        bool Test(float incoming, float stored) const;
+
+        /*!
+        *  \brief Conservative region tests for geometry whose stored depth lies within
+        *         [lo, hi], against a region whose stored depth lies within [zMin, zMax].
+        *         CanPass is false only if no fragment can pass; AlwaysPasses is true only if
+        *         every fragment will.
+        */
+        bool CanPass(float lo, float hi, float zMin, float zMax) const;
+        bool AlwaysPasses(float lo, float hi, float zMin, float zMax) const;
+
+        /*!
+        *  \brief Converts to a single-channel float image of scene depth for display.
+        */
+        void Visualize(cv::Mat& out) const;
+
+    private:
+        static const uint32_t DEPTH24_MASK = 0x00FFFFFFu;
+
+        int w, h;
+        DEPTH_FORMAT format;
+        DEPTH_COMPARE compare, storedCompare;
+        bool reversedZ;
+        float scale;
+        float clearValue;
+        unsigned char clearStencil;
+        cv::Mat m_Data;
+    };
+}
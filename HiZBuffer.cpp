@@ -0,0 +1,115 @@
+#include "HiZBuffer.h"
+#include "Rasterizer.h"
+#include "SIMD.h"
+#include <algorithm>
+#include <limits>
+
+namespace SoftwareRasterizer
+{
+    HiZBuffer::HiZBuffer() : w(0), h(0), blocksX(0), blocksY(0), tilesX(0), tileBlocks(1) {}
+
+    int HiZBuffer::BlockIndex(int x, int y) const
+    {
+        return (y / RASTER_BLOCK_SIZE) * blocksX + x / RASTER_BLOCK_SIZE;
+    }
+
+    int HiZBuffer::TileIndex(int x, int y) const
+    {
+        int tileSize = tileBlocks * RASTER_BLOCK_SIZE;
+        return (y / tileSize) * tilesX + x / tileSize;
+    }
+
+    void HiZBuffer::Reset(int w, int h, int tileSize, float clearDepth)
+    {
+        this->w = w;
+        this->h = h;
+        blocksX = (w + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE;
+        blocksY = (h + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE;
+        tileBlocks = tileSize / RASTER_BLOCK_SIZE;
+        tilesX = (w + tileSize - 1) / tileSize;
+        int tilesY = (h + tileSize - 1) / tileSize;
+
+        m_BlockMin.assign(blocksX * blocksY, clearDepth);
+        m_BlockMax.assign(blocksX * blocksY, clearDepth);
+        m_TileMin.assign(tilesX * tilesY, clearDepth);
+        m_TileMax.assign(tilesX * tilesY, clearDepth);
+        m_TileDirty.assign(tilesX * tilesY, 0);
+    }
+
+    void HiZBuffer::UpdateBlock(const DepthBuffer& depth, int x, int y, int samples)
+    {
+        x -= x % RASTER_BLOCK_SIZE;
+        y -= y % RASTER_BLOCK_SIZE;
+        int y1 = std::min(y + RASTER_BLOCK_SIZE, h);
+
+        // Whole block rows are read, including any row padding past the right edge of the
+        // buffer. That can only widen the range, which keeps every test conservative.
+        float8 zMin = depth.Load8(x, y);
+        float8 zMax = zMin;
+        for (int s = 0; s < samples; ++s)
+        {
+            for (int r = s ? y : y + 1; r < y1; ++r)
+            {
+                float8 z = depth.Load8(x, s * h + r);
+                zMin = min8(zMin, z);
+                zMax = max8(zMax, z);
+            }
+        }
+        SR_ALIGN(32) float lanesMin[8];
+        SR_ALIGN(32) float lanesMax[8];
+        store8(lanesMin, zMin);
+        store8(lanesMax, zMax);
+
+        int b = BlockIndex(x, y);
+        m_BlockMin[b] = *std::min_element(lanesMin, lanesMin + 8);
+        m_BlockMax[b] = *std::max_element(lanesMax, lanesMax + 8);
+        m_TileDirty[TileIndex(x, y)] = 1;
+    }
+
+    void HiZBuffer::DepthRange(const cv::Rect& region, float& zMin, float& zMax)
+    {
+        int bx0 = region.x / RASTER_BLOCK_SIZE;
+        int by0 = region.y / RASTER_BLOCK_SIZE;
+        int bx1 = (region.x + region.width - 1) / RASTER_BLOCK_SIZE;
+        int by1 = (region.y + region.height - 1) / RASTER_BLOCK_SIZE;
+
+        // Regions spanning most of a tile are cheaper to answer from the tile level, which
+        // is refreshed from its blocks only when one of them changed.
+        if ((bx1 - bx0 + 1) * (by1 - by0 + 1) * 2 > tileBlocks * tileBlocks)
+        {
+            int t = TileIndex(region.x, region.y);
+            if (m_TileDirty[t])
+            {
+                int tbx = (region.x / (tileBlocks * RASTER_BLOCK_SIZE)) * tileBlocks;
+                int tby = (region.y / (tileBlocks * RASTER_BLOCK_SIZE)) * tileBlocks;
+                float tMin = std::numeric_limits<float>::max();
+                float tMax = -std::numeric_limits<float>::max();
+                for (int by = tby; by < std::min(tby + tileBlocks, blocksY); ++by)
+                {
+                    for (int bx = tbx; bx < std::min(tbx + tileBlocks, blocksX); ++bx)
+                    {
+                        tMin = std::min(tMin, m_BlockMin[by * blocksX + bx]);
+                        tMax = std::max(tMax, m_BlockMax[by * blocksX + bx]);
+                    }
+                }
+                m_TileMin[t] = tMin;
+                m_TileMax[t] = tMax;
+                m_TileDirty[t] = 0;
+            }
+            zMin = m_TileMin[t];
+            zMax = m_TileMax[t];
+            return;
+        }
+
+        zMin = std::numeric_limits<float>::max();
+        zMax = -std::numeric_limits<float>::max();
+        for (int by = by0; by <= by1; ++by)
+        {
+            for (int bx = bx0; bx <= bx1; ++bx)
+            {
+                zMin = std::min(zMin, m_BlockMin[by * blocksX + bx]);
+                zMax = std::max(zMax, m_BlockMax[by * blocksX + bx]);
+            }
+        }
+    }
+}
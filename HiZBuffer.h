@@ -0,0 +1,59 @@
+/*
+*	HiZBuffer.h -- hierarchical min/max depth kept alongside the depth buffer. Level 0 holds
+*				   the smallest and largest stored depth of every 8x8 raster block, level 1 the
+*				   same for every binning tile. Geometry that cannot pass the depth test against
+*				   a region's range can be rejected without touching any pixels. Values are in
+*				   the depth buffer's stored units.
+*/
+
+#pragma once
+#include "DepthBuffer.h"
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace SoftwareRasterizer
+{
+    class HiZBuffer
+    {
+    public:
+        HiZBuffer();
+
+        /*!
+        *  \brief Sizes the pyramid for a w x h depth buffer split into tiles of tileSize pixels
+        *         (a multiple of the raster block size) and sets every level to clearDepth.
+        */
+        void Reset(int w, int h, int tileSize, float clearDepth);
+
+        /*!
+        *  \brief Smallest and largest depth stored in the raster block whose top-left pixel
+        *         is (x, y).
+        */
+        float BlockMin(int x, int y) const { return m_BlockMin[BlockIndex(x, y)]; }
+        float BlockMax(int x, int y) const { return m_BlockMax[BlockIndex(x, y)]; }
+
+        /*!
+        *  \brief Re-reads one raster block from the depth buffer after pixels in it were
+        *         written. Only the thread that owns the block's tile may call this. With more
+        *         than one sample, depth holds that many sample planes of h rows each (see
+        *         MultisampleTarget) and the block's range covers all of them.
+        */
+        void UpdateBlock(const DepthBuffer& depth, int x, int y, int samples = 1);
+
+        /*!
+        *  \brief Range of depths stored anywhere inside a region lying within a single tile.
+        *         Whole tiles are answered from level 1, smaller regions from level 0.
+        */
+        void DepthRange(const cv::Rect& region, float& zMin, float& zMax);
+
+    private:
+        int w, h;
+        int blocksX, blocksY;
+        int tilesX, tileBlocks;
+        std::vector<float> m_BlockMin, m_BlockMax;
+        std::vector<float> m_TileMin, m_TileMax;
+        std::vector<unsigned char> m_TileDirty;
+
+        int BlockIndex(int x, int y) const;
+        int TileIndex(int x, int y) const;
+    };
+}
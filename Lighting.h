@@ -0,0 +1,224 @@
+/*
+*	Lighting.h -- per-pixel Blinn-Phong shading with any number of directional and point
+*				  lights, as a vertex and fragment shader pair (see Shader.h). Lighting is
+*				  evaluated in world space, eight pixels (two 2x2 quads) per call, and texture
+*				  level of detail and the tangent frame for normal maps come from quad
+*				  derivatives.
+*/
+
+#pragma once
+#include "Shader.h"
+#include "Material.h"
+#include "Texture.h"
+#include "SIMD.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+
+namespace SoftwareRasterizer
+{
+    enum class LIGHT_TYPE { DIRECTIONAL, POINT };
+
+    /**
+    *  \brief A light in world space. Directional lights shine along direction from infinitely
+    *         far away; point lights shine from position, falling off with distance d as
+    *         1 / (1 + attenuation * d^2). color may exceed 1 for bright lights.
+    */
+    struct Light
+    {
+        LIGHT_TYPE type;
+        glm::vec3 position;
+        glm::vec3 direction;
+        glm::vec3 color;
+        float attenuation;
+
+        static Light Directional(const glm::vec3& direction, const glm::vec3& color)
+        {
+            Light l = { LIGHT_TYPE::DIRECTIONAL, glm::vec3(0.0f), glm::normalize(direction), color, 0.0f };
+            return l;
+        }
+
+        static Light Point(const glm::vec3& position, const glm::vec3& color, float attenuation)
+        {
+            Light l = { LIGHT_TYPE::POINT, position, glm::vec3(0.0f), color, attenuation };
+            return l;
+        }
+    };
+
+    // Eight 3-vectors, one per lane.
+    struct float8x3
+    {
+        float8 x, y, z;
+    };
+
+    SR_FORCEINLINE float8 dot3(const float8x3& a, const float8x3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+    SR_FORCEINLINE float8x3 normalize3(const float8x3& a)
+    {
+        float8 s = set1(1.0f) / sqrt8(max8(dot3(a, a), set1(1e-20f)));
+        float8x3 r = { a.x * s, a.y * s, a.z * s };
+        return r;
+    }
+
+    SR_FORCEINLINE float8x3 cross3(const float8x3& a, const float8x3& b)
+    {
+        float8x3 r = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+        return r;
+    }
+
+    /**
+    *  \brief Passes on world-space position (varyings 0-2), normal (3-5) and texture
+    *         coordinates (6-7).
+    */
+    struct BlinnPhongVertexShader
+    {
+        static const int VARYINGS = 8;
+        glm::mat4 MVP, M;
+        glm::mat3 normalMatrix;
+
+        BlinnPhongVertexShader(const glm::mat4& P, const glm::mat4& V, const glm::mat4& M) : MVP(P * V * M), M(M),
+            normalMatrix(glm::transpose(glm::inverse(glm::mat3(M)))) {}
+
+        glm::vec4 Shade(const Vertex& in, float* varyings) const
+        {
+            glm::vec4 world = M * glm::vec4(in.position, 1.0f);
+            glm::vec3 n = normalMatrix * in.normal;
+            varyings[0] = world.x;
+            varyings[1] = world.y;
+            varyings[2] = world.z;
+            varyings[3] = n.x;
+            varyings[4] = n.y;
+            varyings[5] = n.z;
+            varyings[6] = in.texcoord.x;
+            varyings[7] = in.texcoord.y;
+            return MVP * glm::vec4(in.position, 1.0f);
+        }
+    };
+
+    /**
+    *  \brief Blinn-Phong: emission + ambient * Kd + the sum over lights of
+    *         color * (Kd * N.L + Ks * (N.H)^Ns). Kd is modulated by the diffuse map and N is
+    *         perturbed by the normal map (map_Kn, tangent space), if the material has them.
+    *         The specular power uses Schlick's rational approximation x / (n - (n - 1) x),
+    *         and Ns below 1 is taken as 1.
+    */
+    struct BlinnPhongFragmentShader
+    {
+        static const int VARYINGS = BlinnPhongVertexShader::VARYINGS;
+        const Light* lights;
+        int lightCount;
+        glm::vec3 eye;
+        glm::vec3 ambient;
+        TEXTURE_FILTER filter;
+
+        BlinnPhongFragmentShader(const std::vector<Light>& lights, const glm::vec3& eye, const glm::vec3& ambient,
+            TEXTURE_FILTER filter = TEXTURE_FILTER::TRILINEAR)
+            : lights(lights.data()), lightCount((int)lights.size()), eye(eye), ambient(ambient), filter(filter) {}
+
+        SR_FORCEINLINE void Shade(const Fragment8<VARYINGS>& in, float8 color[3]) const
+        {
+            const Material& m = *in.material;
+            const float8* v = in.varyings;
+            float8x3 p = { v[0], v[1], v[2] };
+            float8x3 n = normalize3(float8x3{ v[3], v[4], v[5] });
+            float8 u = v[6], t = v[7];
+
+            // Diffuse color, in the texture's BGR order.
+            float8 kd[3] = { set1(m.diffuse.z), set1(m.diffuse.y), set1(m.diffuse.x) };
+            const Texture* normalMap = m.GetTexture(TEXTURE_TYPE::NORMALS);
+            float8 dudx, dvdx, dudy, dvdy;
+            if (in.texture || normalMap)
+            {
+                dudx = quadDdx(u);
+                dvdx = quadDdx(t);
+                dudy = quadDdy(u);
+                dvdy = quadDdy(t);
+            }
+            if (in.texture)
+            {
+                float8 texel[4];
+                in.texture->Sample8(u, t, in.texture->Lod8(dudx, dvdx, dudy, dvdy), filter, texel);
+                for (int c = 0; c < 3; ++c)
+                    kd[c] = kd[c] * texel[c];
+            }
+            if (normalMap)
+                n = PerturbNormal(*normalMap, n, p, u, t, dudx, dvdx, dudy, dvdy);
+
+            const float8 zero = set1(0.0f), one = set1(1.0f);
+            float8x3 toEye = normalize3(float8x3{ set1(eye.x) - p.x, set1(eye.y) - p.y, set1(eye.z) - p.z });
+            float shininess = std::max(m.roughness, 1.0f);
+            float8 diffuse[3] = { zero, zero, zero }, specular[3] = { zero, zero, zero };
+            for (int i = 0; i < lightCount; ++i)
+            {
+                const Light& light = lights[i];
+                float8x3 l;
+                float8 intensity = one;
+                if (light.type == LIGHT_TYPE::DIRECTIONAL)
+                {
+                    l.x = set1(-light.direction.x);
+                    l.y = set1(-light.direction.y);
+                    l.z = set1(-light.direction.z);
+                }
+                else
+                {
+                    l.x = set1(light.position.x) - p.x;
+                    l.y = set1(light.position.y) - p.y;
+                    l.z = set1(light.position.z) - p.z;
+                    float8 d2 = dot3(l, l);
+                    intensity = one / (one + d2 * light.attenuation);
+                    l = normalize3(l);
+                }
+
+                float8 nDotL = max8(dot3(n, l), zero);
+                float8x3 h = normalize3(float8x3{ l.x + toEye.x, l.y + toEye.y, l.z + toEye.z });
+                float8 nDotH = max8(dot3(n, h), zero);
+                float8 power = nDotH / (set1(shininess) - nDotH * (shininess - 1.0f));
+                float8 d = nDotL * intensity;
+                float8 s = power * intensity & cmpgt(nDotL, zero);
+                const float lightColor[3] = { light.color.z, light.color.y, light.color.x };
+                for (int c = 0; c < 3; ++c)
+                {
+                    diffuse[c] = diffuse[c] + d * lightColor[c];
+                    specular[c] = specular[c] + s * lightColor[c];
+                }
+            }
+
+            const float emission[3] = { m.emission.z, m.emission.y, m.emission.x };
+            const float ks[3] = { m.specular.z, m.specular.y, m.specular.x };
+            const float ambientColor[3] = { ambient.z, ambient.y, ambient.x };
+            for (int c = 0; c < 3; ++c)
+                color[c] = kd[c] * (diffuse[c] + ambientColor[c]) + specular[c] * ks[c] + emission[c];
+        }
+
+    private:
+        /*!
+        *  \brief Normal from a tangent-space normal map, with the tangent frame built from the
+        *         quad derivatives of position and texture coordinates, so meshes need no
+        *         tangents.
+        */
+        SR_FORCEINLINE float8x3 PerturbNormal(const Texture& normalMap, const float8x3& n, const float8x3& p,
+            float8 u, float8 t, float8 dudx, float8 dvdx, float8 dudy, float8 dvdy) const
+        {
+            float8x3 dpdx = { quadDdx(p.x), quadDdx(p.y), quadDdx(p.z) };
+            float8x3 dpdy = { quadDdy(p.x), quadDdy(p.y), quadDdy(p.z) };
+            float8x3 dpdyPerp = cross3(dpdy, n);
+            float8x3 dpdxPerp = cross3(n, dpdx);
+            float8x3 tangent = { dpdyPerp.x * dudx + dpdxPerp.x * dudy, dpdyPerp.y * dudx + dpdxPerp.y * dudy,
+                dpdyPerp.z * dudx + dpdxPerp.z * dudy };
+            float8x3 bitangent = { dpdyPerp.x * dvdx + dpdxPerp.x * dvdy, dpdyPerp.y * dvdx + dpdxPerp.y * dvdy,
+                dpdyPerp.z * dvdx + dpdxPerp.z * dvdy };
+            float8 scale = set1(1.0f) / sqrt8(max8(max8(dot3(tangent, tangent), dot3(bitangent, bitangent)),
+                set1(1e-20f)));
+
+            // Texels are BGR, and map [0, 1] to [-1, 1].
+            float8 texel[4];
+            normalMap.Sample8(u, t, normalMap.Lod8(dudx, dvdx, dudy, dvdy), filter, texel);
+            float8 mx = (texel[2] * 2.0f - 1.0f) * scale;
+            float8 my = (texel[1] * 2.0f - 1.0f) * scale;
+            float8 mz = texel[0] * 2.0f - 1.0f;
+            float8x3 r = { tangent.x * mx + bitangent.x * my + n.x * mz, tangent.y * mx + bitangent.y * my + n.y * mz,
+                tangent.z * mx + bitangent.z * my + n.z * mz };
+            return normalize3(r);
+        }
+    };
+}
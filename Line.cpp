@@ -481,6 +481,87 @@ namespace SoftwareRasterizer
         }
     }
 
+    template <bool IDS>
+    static void rasterizeLineT(const glm::vec3& p1, const glm::vec3& p2, cv::Mat& img, DepthBuffer& depth,
+        const float* col, unsigned int id, const cv::Rect& clip, bool depthTest)
+    {
+        // Step along the major axis u, from the end with the smaller u; v is the minor axis.
+        // Positions are swizzled to (u, v, z).
+        bool steep = std::abs(p2.y - p1.y) > std::abs(p2.x - p1.x);
+        glm::vec3 a = steep ? glm::vec3(p1.y, p1.x, p1.z) : p1;
+        glm::vec3 b = steep ? glm::vec3(p2.y, p2.x, p2.z) : p2;
+        if (b.x < a.x)
+            std::swap(a, b);
+        float length = b.x - a.x;
+        if (length <= 0.0f)
+            return;
+        float slope = (b.y - a.y) / length;
+        float zSlope = (b.z - a.z) / length;
+
+        int uMin = steep ? clip.y : clip.x;
+        int uMax = (steep ? clip.y + clip.height : clip.x + clip.width) - 1;
+        int vMin = steep ? clip.x : clip.y;
+        int vMax = (steep ? clip.x + clip.width : clip.y + clip.height) - 1;
+
+        // Columns with centers in [a.u, b.u) inside the clip, narrowed to those whose row can
+        // fall inside it too, give or take one.
+        int first = std::max(int(std::ceil(a.x - 0.5f)), uMin);
+        int last = std::min(int(std::ceil(b.x - 0.5f)) - 1, uMax);
+        if (slope != 0.0f)
+        {
+            double t0 = (vMin - a.y) / double(slope), t1 = (vMax + 1 - a.y) / double(slope);
+            if (t0 > t1)
+                std::swap(t0, t1);
+            first = int(std::max(double(first), std::min(std::floor(a.x + t0 - 0.5) - 1, double(last) + 1)));
+            last = int(std::min(double(last), std::max(std::ceil(a.x + t1 - 0.5) + 1, double(first) - 1)));
+        }
+        else if (a.y < vMin || a.y >= vMax + 1)
+            return;
+
+        // Eight columns at a time. Every pixel's row and depth come from its own column index,
+        // which float holds exactly, so they do not depend on where the clip starts.
+        bool depthWrite = depth.StoredCompare() != DEPTH_COMPARE::EQUAL;
+        const float8 ramp = ramp8();
+        const float offset = 0.5f - a.x;
+        SR_ALIGN(32) float rows[8];
+        SR_ALIGN(32) float z[8];
+        for (int u = first; u <= last; u += 8)
+        {
+            float8 t = (set1(float(u)) + ramp) + offset;
+            store8(rows, floor8(set1(a.y) + t * slope));
+            store8(z, depth.ToStored8(set1(a.z) + t * zSlope));
+            int count = std::min(8, last - u + 1);
+            for (int k = 0; k < count; ++k)
+            {
+                int v = int(rows[k]);
+                if (v < vMin || v > vMax)
+                    continue;
+                int x = steep ? v : u + k;
+                int y = steep ? u + k : v;
+                if (depthTest)
+                {
+                    if (!depth.Test(z[k], depth.Get(x, y)))
+                        continue;
+                    if (depthWrite)
+                        depth.Set(x, y, z[k]);
+                }
+                if (IDS)
+                    img.ptr<unsigned int>(y)[x] = id;
+                else
+                    img.ptr<cv::Vec3f>(y)[x] = cv::Vec3f(col[0], col[1], col[2]);
+            }
+        }
+    }
+
+    void rasterizeLine(const glm::vec3& p1, const glm::vec3& p2, cv::Mat& img, DepthBuffer& depth,
+        const float* col, unsigned int id, const cv::Rect& clip, bool depthTest)
+    {
+        if (img.type() == CV_32SC1)
+            rasterizeLineT<true>(p1, p2, img, depth, col, id, clip, depthTest);
+        else
+            rasterizeLineT<false>(p1, p2, img, depth, col, id, clip, depthTest);
+    }
+
     void Line::draw(cv::Mat& data, float color[3], unsigned int thickness, LINE_ALGORITHM method) {
         
         // Case: line is a point.
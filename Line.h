@@ -5,6 +5,7 @@
 
 #pragma once
 #include "Point.h"
+#include "DepthBuffer.h"
 #include <opencv2/opencv.hpp>
 #include <glm/glm.hpp>
 
@@ -42,4 +43,20 @@ namespace SoftwareRasterizer
 		void draw(cv::Mat& data, float color[3], unsigned int thickness = 1, 
 			LINE_ALGORITHM method = LINE_ALGORITHM::BRESENHAM);
 	};
+
+	/*!
+	*  \brief Draws a depth-tested line segment between two pixel-coordinate positions with
+	*         [0, 1] window depth, DDA style: one pixel per column (or row, for steep lines)
+	*         whose center lies in [p1, p2), on the row the line crosses there. Depth is
+	*         interpolated linearly in screen space. Each pixel is found from its column alone,
+	*         not by stepping from p1, so drawing a line clipped to adjacent tiles gives exactly
+	*         the pixels of drawing it whole.
+	*
+	* \param [in,out] img CV_32FC3 color image, written with col, or CV_32SC1 visibility
+	*                     buffer, written with id.
+	* \param [in,out] depth Tested against and written if depthTest is set.
+	* \param [in] clip Only pixels inside clip are drawn.
+	*/
+	void rasterizeLine(const glm::vec3& p1, const glm::vec3& p2, cv::Mat& img, DepthBuffer& depth,
+		const float* col, unsigned int id, const cv::Rect& clip, bool depthTest);
 }
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace SoftwareRasterizer
+{
+#ifdef _WIN32
+    MappedFile::MappedFile() : data(nullptr), size(0), file(INVALID_HANDLE_VALUE), mapping(nullptr) {}
+#else
+    MappedFile::MappedFile() : data(nullptr), size(0), fd(-1) {}
+#endif
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+#ifdef _WIN32
+    bool MappedFile::Open(const std::string& filename)
+    {
+        Close();
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize))
+        {
+            Close();
+            return false;
+        }
+        size = size_t(fileSize.QuadPart);
+        if (size == 0)
+            return true;
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+            data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!data)
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        data = nullptr;
+        size = 0;
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+    }
+#else
+    bool MappedFile::Open(const std::string& filename)
+    {
+        Close();
+        fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            Close();
+            return false;
+        }
+        size = size_t(info.st_size);
+        if (size == 0)
+            return true;
+
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            Close();
+            return false;
+        }
+        data = static_cast<const char*>(mapped);
+        // The whole file is read front to back, split among threads.
+        madvise(mapped, size, MADV_WILLNEED);
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+        if (data)
+            munmap(const_cast<char*>(data), size);
+        if (fd >= 0)
+            close(fd);
+        data = nullptr;
+        size = 0;
+        fd = -1;
+    }
+#endif
+}
@@ -0,0 +1,40 @@
+/*
+*	MappedFile.h -- read-only memory mapping of a whole file, so large files can be parsed in
+*					place, by several threads at once, without copying them into buffers.
+*/
+
+#pragma once
+#include <string>
+#include <cstddef>
+
+namespace SoftwareRasterizer
+{
+    class MappedFile
+    {
+    public:
+        MappedFile();
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        /*!
+        *  \brief Maps the file, closing any file mapped before. Returns false if it cannot be
+        *         opened or mapped. An empty file maps to Data() == nullptr and Size() == 0.
+        */
+        bool Open(const std::string& filename);
+        void Close();
+
+        const char* Data() const { return data; }
+        size_t Size() const { return size; }
+
+    private:
+        const char* data;
+        size_t size;
+#ifdef _WIN32
+        void* file;
+        void* mapping;
+#else
+        int fd;
+#endif
+    };
+}
@@ -1,24 +1,174 @@
 #include "Material.h"
+#include "AssetCache.h"
+#include <cstdio>
+#include <cstring>
 
 namespace SoftwareRasterizer
 {
     MaterialTexture::MaterialTexture() : type(TEXTURE_TYPE::NONE), materialIndex(-1) {}
 
-    MaterialTexture::~MaterialTexture()
+    void MaterialTexture::setPath(char* path, TEXTURE_TYPE txtype, unsigned int idx)
     {
-        if (!img.empty())
-            img.deallocate();
+        this->path = path;
+        type = txtype;
+        materialIndex = idx;
     }
 
-    void MaterialTexture::loadTexture(char* path, TEXTURE_TYPE txtype, unsigned int idx)
+    void MaterialTexture::loadTexture(bool preview)
     {
-        img = cv::imread(path);
-        type = txtype;
-        materialIndex = idx;
+        texture = AssetCache::Instance().LoadTexture(path, preview);
     }
 
     Material::Material() : type(2), diffuse(glm::vec3(0.2)), specular(glm::vec3(1)), 
         roughness(9999), ior(0), ambient(glm::vec3(0)), metalness(0), opacity(1), 
         emission(glm::vec3(0))
     {}
+
+    const Texture* Material::GetTexture(TEXTURE_TYPE type) const
+    {
+        for (int i = 0; i < textures.size(); ++i)
+            if (textures[i].type == type && textures[i].texture)
+                return textures[i].texture.get();
+        return nullptr;
+    }
+
+    int MaterialSet::Find(const char* name) const
+    {
+        for (unsigned int i = 0; i < names.size(); ++i)
+            if (strcmp(name, names[i].c_str()) == 0)
+                return i;
+        return -1;
+    }
+
+    void MaterialSet::Load(const std::string& filename, bool preview)
+    {
+        FILE* file = fopen(filename.c_str(), "r");
+        if (!file)
+        {
+            throw std::exception("Failed to open material file!");
+        }
+
+        while (true)
+        {
+            char txpath[256];
+            char buf[128];
+            int res = fscanf(file, "%127s", buf);
+            if (res == EOF)            
+                break;
+            
+            if (strcmp(buf, "newmtl") == 0)
+            {
+                char str[80];
+                fscanf(file, "%79s\n", str);
+                names.push_back(str);
+                materials.push_back(Material());
+            }
+
+            // Handle loading material properties.
+            else if (strcmp(buf, "Kd") == 0)
+            {
+                fscanf(file, "%f %f %f\n", &materials.back().diffuse.x, &materials.back().diffuse.y, &materials.back().diffuse.z);
+            }
+            else if (strcmp(buf, "Ks") == 0)
+            {
+                fscanf(file, "%f %f %f\n", &materials.back().specular.x, &materials.back().specular.y, &materials.back().specular.z);
+            }
+            else if (strcmp(buf, "Ka") == 0)
+            {
+                fscanf(file, "%f %f %f\n", &materials.back().ambient.x, &materials.back().ambient.y, &materials.back().ambient.z);
+            }
+            else if (strcmp(buf, "Ke") == 0)
+            {
+                fscanf(file, "%f %f %f\n", &materials.back().emission.x, &materials.back().emission.y, &materials.back().emission.z);
+            }
+            else if (strcmp(buf, "Ns") == 0)
+            {
+                fscanf(file, "%f\n", &materials.back().roughness);
+            }
+            else if (strcmp(buf, "Ni") == 0)
+            {
+                fscanf(file, "%f\n", &materials.back().ior);
+            }
+            else if (strcmp(buf, "d") == 0)
+            {
+                fscanf(file, "%f\n", &materials.back().opacity);
+            }
+
+            // Handle loading light maps.
+            else if (strcmp(buf, "map_Kd") == 0)
+            {
+                fscanf(file, "%255s\n", txpath);
+                materials.back().textures.push_back(MaterialTexture());
+                materials.back().textures.back().setPath(
+                    txpath, TEXTURE_TYPE::DIFFUSE, materials.size() - 1);
+            }
+            else if (strcmp(buf, "map_Ks") == 0)
+            {
+                fscanf(file, "%255s\n", txpath);
+                materials.back().textures.push_back(MaterialTexture());
+                materials.back().textures.back().setPath(
+                    txpath, TEXTURE_TYPE::SPECULAR, materials.size() - 1);
+            }
+            else if (strcmp(buf, "map_Ka") == 0)
+            {
+                fscanf(file, "%255s\n", txpath);
+                materials.back().textures.push_back(MaterialTexture());
+                materials.back().textures.back().setPath(
+                    txpath, TEXTURE_TYPE::AMBIENT, materials.size() - 1);
+            }
+            else if (strcmp(buf, "map_Ke") == 0)
+            {
+                fscanf(file, "%255s\n", txpath);
+                materials.back().textures.push_back(MaterialTexture());
+                materials.back().textures.back().setPath(
+                    txpath, TEXTURE_TYPE::EMISSIVE, materials.size() - 1);
+            }
+            else if (strcmp(buf, "map_Kn") == 0)
+            {
+                fscanf(file, "%255s\n", txpath);
+                materials.back().textures.push_back(MaterialTexture());
+                materials.back().textures.back().setPath(
+                    txpath, TEXTURE_TYPE::NORMALS, materials.size() - 1);
+            }
+            else if (strcmp(buf, "map_Ns") == 0)
+            {
+                fscanf(file, "%255s\n", txpath);
+                materials.back().textures.push_back(MaterialTexture());
+                materials.back().textures.back().setPath(
+                    txpath, TEXTURE_TYPE::SHININESS, materials.size() - 1);
+            }
+            else if (strcmp(buf, "map_d") == 0)
+            {
+                fscanf(file, "%255s\n", txpath);
+                materials.back().textures.push_back(MaterialTexture());
+                materials.back().textures.back().setPath(
+                    txpath, TEXTURE_TYPE::OPACITY, materials.size() - 1);
+            }
+            else if (strcmp(buf, "map_disp") == 0)
+            {
+                fscanf(file, "%255s\n", txpath);
+                materials.back().textures.push_back(MaterialTexture());
+                materials.back().textures.back().setPath(
+                    txpath, TEXTURE_TYPE::DISPLACEMENT, materials.size() - 1);
+            }
+            else if (strcmp(buf, "refl") == 0)
+            {
+                fscanf(file, "%255s\n", txpath);
+                materials.back().textures.push_back(MaterialTexture());
+                materials.back().textures.back().setPath(
+                    txpath, TEXTURE_TYPE::REFLECTION, materials.size() - 1);
+            }
+        }
+        fclose(file);
+
+        // Decode all texture maps at once. Within a parallel region, such as models loading
+        // side by side, they are decoded one after another.
+        std::vector<MaterialTexture*> maps;
+        for (Material& material : materials)
+            for (MaterialTexture& map : material.textures)
+                maps.push_back(&map);
+#pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < (int)maps.size(); ++i)
+            maps[i]->loadTexture(preview);
+    }
 }
\ No newline at end of file
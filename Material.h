@@ -1,19 +1,75 @@
 #pragma once
+#include "Texture.h"
 #include <glm/glm.hpp>
 #include <opencv2/opencv.hpp>
+#include <vector>
+#include <string>
+#include <memory>
 
 namespace SoftwareRasterizer
 {
+    enum class TEXTURE_TYPE { NONE, DIFFUSE, SPECULAR, AMBIENT, EMISSIVE, NORMALS, SHININESS, OPACITY,
+        DISPLACEMENT, REFLECTION };
+
+    /**
+    *  \brief A texture map of a material, as listed in its .mtl file. The mipmapped texture is
+    *         shared through the asset cache with every other material using the same file, and
+    *         is null if the file could not be loaded.
+    */
+    struct MaterialTexture
+    {
+        std::shared_ptr<const Texture> texture;
+        std::string path;
+        TEXTURE_TYPE type;
+        unsigned int materialIndex;
+
+        MaterialTexture();
+        void setPath(char* path, TEXTURE_TYPE txtype, unsigned int idx);
+
+        /*!
+        *  \brief Decodes the file at path, or with preview its low-resolution preview.
+        */
+        void loadTexture(bool preview = false);
+    };
+
     struct Material
     {
         glm::vec3 diffuse;
         glm::vec3 specular;
+        glm::vec3 ambient;
         glm::vec3 emission;
         unsigned int type;
         float roughness;
         float ior;
-        std::vector<cv::Mat> textures;
+        float metalness;
+        float opacity;
+        std::vector<MaterialTexture> textures;
+
+        Material();
+
+        /*!
+        *  \brief First successfully loaded texture of the given type, or nullptr.
+        */
+        const Texture* GetTexture(TEXTURE_TYPE type) const;
+    };
+
+    /**
+    *  \brief The materials of one .mtl file, in file order, with their names.
+    */
+    struct MaterialSet
+    {
+        std::vector<std::string> names;
+        std::vector<Material> materials;
+
+        /*!
+        *  \brief Parses a .mtl file, loading its texture maps through the asset cache, or
+        *         with preview only their low-resolution previews.
+        */
+        void Load(const std::string& filename, bool preview = false);
 
-        Material() : type(2), diffuse(glm::vec3(0.2)), specular(glm::vec3(1)), roughness(9999), ior(0) {}
+        /*!
+        *  \brief Index of the material with the given name, or -1.
+        */
+        int Find(const char* name) const;
     };
 }
\ No newline at end of file
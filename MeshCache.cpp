@@ -0,0 +1,251 @@
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include "Model.h"
+#include <filesystem>
+#include <random>
+#include <cstring>
+#include <cstdio>
+
+namespace SoftwareRasterizer
+{
+    static const char MESH_CACHE_MAGIC[8] = { 'S', 'R', 'M', 'E', 'S', 'H', 0, 0 };
+    // Bumped whenever the layout, or the way models are built from .OBJ files, changes.
+    static const uint32_t MESH_CACHE_VERSION = 3;
+    static const uint64_t MESH_CACHE_ALIGNMENT = 64;
+
+    /**
+    *  \brief Start of a .srmesh file. The arrays follow at the given byte offsets, and the
+    *         material names, each null terminated, run to the end of the file. Triangle
+    *         materials and edges refer to materials by their index in these names.
+    */
+    struct MeshCacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t vertexSize;
+        uint32_t edgeSize;
+        uint32_t materialCount;
+        MeshCacheSource source;
+        float bounds[6];
+        uint64_t vertexCount, indexCount, edgeCount;
+        uint64_t vertices, indices, triangleMaterials, edges, triangleEdges, materialNames;
+        uint64_t fileSize;
+    };
+
+    uint64_t hashBytes(const char* data, size_t size)
+    {
+        const uint64_t k = 0xFF51AFD7ED558CCDull;
+        uint64_t h = 0x9E3779B97F4A7C15ull ^ size;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            h = (h ^ word) * k;
+            h ^= h >> 29;
+        }
+        uint64_t tail = 0;
+        memcpy(&tail, data + i, size - i);
+        h = (h ^ tail) * k;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static bool sourceStats(const std::string& file, uint64_t& size, int64_t& mtime)
+    {
+        std::error_code error;
+        size = std::filesystem::file_size(file, error);
+        if (error)
+            return false;
+        mtime = std::filesystem::last_write_time(file, error).time_since_epoch().count();
+        return !error;
+    }
+
+    static bool sourceHash(const std::string& file, uint64_t& hash)
+    {
+        MappedFile mapped;
+        if (!mapped.Open(file))
+            return false;
+        hash = hashBytes(mapped.Data(), mapped.Size());
+        return true;
+    }
+
+    std::string meshCachePath(const std::string& objFile)
+    {
+        return std::filesystem::path(objFile).replace_extension(".srmesh").string();
+    }
+
+    bool readMeshCache(const std::string& cacheFile, const std::string& objFile, Model& model)
+    {
+        MappedFile file;
+        if (!file.Open(cacheFile) || file.Size() < sizeof(MeshCacheHeader))
+            return false;
+        const char* data = file.Data();
+        uint64_t fileSize = file.Size();
+        MeshCacheHeader header;
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != MESH_CACHE_VERSION ||
+            header.vertexSize != sizeof(Vertex) || header.edgeSize != sizeof(MeshEdge) || header.fileSize != fileSize ||
+            header.indexCount % 3 != 0)
+            return false;
+
+        // Every array must lie inside the file.
+        auto fits = [fileSize](uint64_t offset, uint64_t count, uint64_t size)
+        {
+            return offset <= fileSize && count <= (fileSize - offset) / size;
+        };
+        if (!fits(header.vertices, header.vertexCount, sizeof(Vertex)) ||
+            !fits(header.indices, header.indexCount, sizeof(unsigned int)) ||
+            !fits(header.triangleMaterials, header.indexCount / 3, sizeof(unsigned int)) ||
+            !fits(header.edges, header.edgeCount, sizeof(MeshEdge)) ||
+            !fits(header.triangleEdges, header.indexCount, sizeof(unsigned int)) ||
+            !fits(header.materialNames, 0, 1))
+            return false;
+
+        // Only hash the source if its time stamp changed.
+        uint64_t size;
+        int64_t mtime;
+        if (!sourceStats(objFile, size, mtime) || size != header.source.size)
+            return false;
+        if (mtime != header.source.mtime)
+        {
+            uint64_t hash;
+            if (!sourceHash(objFile, hash) || hash != header.source.hash)
+                return false;
+        }
+
+        // Cached material indices to indices in the model's current material set.
+        std::vector<unsigned int> materialMap(header.materialCount);
+        const char* name = data + header.materialNames;
+        const char* end = data + fileSize;
+        bool identity = true;
+        for (unsigned int i = 0; i < header.materialCount; ++i)
+        {
+            const char* terminator = static_cast<const char*>(memchr(name, 0, end - name));
+            if (!terminator)
+                return false;
+            // A material renamed or removed since the cache was written would leave its
+            // triangles and edges with none; parse the .OBJ file again instead.
+            int found = model.m_Materials ? model.m_Materials->Find(name) : -1;
+            if (found < 0)
+                return false;
+            materialMap[i] = found;
+            identity &= materialMap[i] == i;
+            name = terminator + 1;
+        }
+
+        const Vertex* vertices = reinterpret_cast<const Vertex*>(data + header.vertices);
+        const unsigned int* indices = reinterpret_cast<const unsigned int*>(data + header.indices);
+        const unsigned int* triangleMaterials = reinterpret_cast<const unsigned int*>(data + header.triangleMaterials);
+        const MeshEdge* edges = reinterpret_cast<const MeshEdge*>(data + header.edges);
+        const unsigned int* triangleEdges = reinterpret_cast<const unsigned int*>(data + header.triangleEdges);
+
+        // A file that is corrupt past its header must not hand out-of-range indices to the
+        // vertex stage or to DrawEdges(). Triangle edges may be ~0u for collapsed corners.
+        for (uint64_t i = 0; i < header.indexCount; ++i)
+            if (indices[i] >= header.vertexCount ||
+                (triangleEdges[i] >= header.edgeCount && triangleEdges[i] != ~0u))
+                return false;
+        for (uint64_t i = 0; i < header.edgeCount; ++i)
+            if (edges[i].v[0] >= header.vertexCount || edges[i].v[1] >= header.vertexCount)
+                return false;
+
+        model.m_Vertices.assign(vertices, vertices + header.vertexCount);
+        model.m_Indices.assign(indices, indices + header.indexCount);
+        model.m_TriangleMaterials.assign(triangleMaterials, triangleMaterials + header.indexCount / 3);
+        model.m_Edges.assign(edges, edges + header.edgeCount);
+        model.m_TriangleEdges.assign(triangleEdges, triangleEdges + header.indexCount);
+        if (!identity)
+        {
+            for (unsigned int& material : model.m_TriangleMaterials)
+                material = material < header.materialCount ? materialMap[material] : -1;
+            for (MeshEdge& edge : model.m_Edges)
+                edge.material = edge.material < header.materialCount ? materialMap[edge.material] : -1;
+        }
+        model.bounds[0] = glm::vec3(header.bounds[0], header.bounds[1], header.bounds[2]);
+        model.bounds[1] = glm::vec3(header.bounds[3], header.bounds[4], header.bounds[5]);
+        return true;
+    }
+
+    bool writeMeshCache(const std::string& cacheFile, const std::string& objFile, const Model& model)
+    {
+        MeshCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+        header.version = MESH_CACHE_VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.edgeSize = sizeof(MeshEdge);
+        if (!sourceStats(objFile, header.source.size, header.source.mtime) || !sourceHash(objFile, header.source.hash))
+            return false;
+        for (int i = 0; i < 3; ++i)
+        {
+            header.bounds[i] = model.bounds[0][i];
+            header.bounds[3 + i] = model.bounds[1][i];
+        }
+        header.vertexCount = model.m_Vertices.size();
+        header.indexCount = model.m_Indices.size();
+        header.edgeCount = model.m_Edges.size();
+
+        std::string names;
+        if (model.m_Materials)
+        {
+            header.materialCount = (uint32_t)model.m_Materials->names.size();
+            for (const std::string& name : model.m_Materials->names)
+                names.append(name.c_str(), name.size() + 1);
+        }
+
+        // Lay the arrays out one after another, each starting on a cache line.
+        uint64_t offset = sizeof(header);
+        auto place = [&offset](uint64_t bytes)
+        {
+            offset = (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+            uint64_t at = offset;
+            offset += bytes;
+            return at;
+        };
+        header.vertices = place(model.m_Vertices.size() * sizeof(Vertex));
+        header.indices = place(model.m_Indices.size() * sizeof(unsigned int));
+        header.triangleMaterials = place(model.m_TriangleMaterials.size() * sizeof(unsigned int));
+        header.edges = place(model.m_Edges.size() * sizeof(MeshEdge));
+        header.triangleEdges = place(model.m_TriangleEdges.size() * sizeof(unsigned int));
+        header.materialNames = place(names.size());
+        header.fileSize = offset;
+
+        // A name of its own for the temporary file, in case another process is writing the
+        // same cache.
+        std::random_device random;
+        std::string temporary = cacheFile + "." + std::to_string(random()) + ".tmp";
+        FILE* file = fopen(temporary.c_str(), "wb");
+        if (!file)
+            return false;
+        uint64_t position = 0;
+        bool written = true;
+        auto put = [&](uint64_t at, const void* bytes, size_t size)
+        {
+            static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+            written &= fwrite(zeros, 1, size_t(at - position), file) == at - position;
+            written &= size == 0 || fwrite(bytes, 1, size, file) == size;
+            position = at + size;
+        };
+        put(0, &header, sizeof(header));
+        put(header.vertices, model.m_Vertices.data(), model.m_Vertices.size() * sizeof(Vertex));
+        put(header.indices, model.m_Indices.data(), model.m_Indices.size() * sizeof(unsigned int));
+        put(header.triangleMaterials, model.m_TriangleMaterials.data(), model.m_TriangleMaterials.size() * sizeof(unsigned int));
+        put(header.edges, model.m_Edges.data(), model.m_Edges.size() * sizeof(MeshEdge));
+        put(header.triangleEdges, model.m_TriangleEdges.data(), model.m_TriangleEdges.size() * sizeof(unsigned int));
+        put(header.materialNames, names.data(), names.size());
+        written &= fclose(file) == 0;
+
+        std::error_code error;
+        if (written)
+            std::filesystem::rename(temporary, cacheFile, error);
+        if (!written || error)
+        {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,56 @@
+/*
+*	MeshCache.h -- binary .srmesh caches of loaded models, written next to the .OBJ file the
+*				   first time it is loaded. A cache holds the model's vertex, index, material
+*				   and edge arrays exactly as they are in memory, each aligned to a cache line,
+*				   so reloading maps the file and copies the arrays out without parsing.
+*/
+
+#pragma once
+#include <string>
+#include <cstdint>
+
+namespace SoftwareRasterizer
+{
+    class Model;
+
+    /**
+    *  \brief What a cache remembers of its source file. A cache is valid if the size matches
+    *         and either the modification time or, failing that, the hash of the contents does,
+    *         so touching or checking out an unchanged file keeps its cache.
+    */
+    struct MeshCacheSource
+    {
+        uint64_t size;
+        int64_t mtime;
+        uint64_t hash;
+    };
+
+    /*!
+    *  \brief The cache file for an .OBJ file: the same path with the extension .srmesh.
+    */
+    std::string meshCachePath(const std::string& objFile);
+
+    /*!
+    *  \brief Fills model's vertices, indices, triangle materials, edges and bounds from the
+    *         cache, if it exists and was made from objFile as it is now. Material indices are
+    *         matched by name to model.m_Materials, which must be loaded already, so editing
+    *         the .mtl file does not invalidate the cache unless it drops a material the cache
+    *         names.
+    *
+    * \return False, leaving model untouched, if there is no valid cache.
+    */
+    bool readMeshCache(const std::string& cacheFile, const std::string& objFile, Model& model);
+
+    /*!
+    *  \brief Writes the cache of a model loaded from objFile. The file is written under a
+    *         temporary name and then renamed, so other processes never read half a cache.
+    *
+    * \return False if the cache could not be written.
+    */
+    bool writeMeshCache(const std::string& cacheFile, const std::string& objFile, const Model& model);
+
+    /*!
+    *  \brief 64-bit hash of size bytes, eight at a time.
+    */
+    uint64_t hashBytes(const char* data, size_t size);
+}
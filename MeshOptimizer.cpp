@@ -0,0 +1,363 @@
+#include "MeshOptimizer.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace SoftwareRasterizer
+{
+    /**
+    *  \brief A least recently used cache of vertex indices, most recent first.
+    */
+    class VertexCache
+    {
+    public:
+        VertexCache(unsigned int size, size_t vertexCount) : size(size), position(vertexCount, -1) {}
+
+        /*!
+        *  \brief Moves a triangle's vertices to the front.
+        *
+        * \return How many of them were missing.
+        */
+        int Add(const unsigned int* triangle)
+        {
+            int misses = 0;
+            next.clear();
+            for (int k = 0; k < 3; ++k)
+            {
+                if (std::find(next.begin(), next.end(), triangle[k]) != next.end())
+                    continue;
+                misses += position[triangle[k]] < 0;
+                next.push_back(triangle[k]);
+            }
+            for (unsigned int v : entries)
+                if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                    next.push_back(v);
+            for (size_t i = size; i < next.size(); ++i)
+            {
+                evicted.push_back(next[i]);
+                position[next[i]] = -1;
+            }
+            next.resize(std::min<size_t>(next.size(), size));
+            for (int i = 0; i < (int)next.size(); ++i)
+                position[next[i]] = i;
+            entries.swap(next);
+            return misses;
+        }
+
+        int Position(unsigned int v) const { return position[v]; }
+        const std::vector<unsigned int>& Entries() const { return entries; }
+        // Vertices pushed out by Add(), for the caller to empty.
+        std::vector<unsigned int> evicted;
+
+    private:
+        unsigned int size;
+        std::vector<unsigned int> entries, next;
+        std::vector<int> position;
+    };
+
+    float averageCacheMissRatio(const unsigned int* indices, size_t triangleCount, size_t vertexCount,
+        const unsigned int* order, unsigned int cacheSize)
+    {
+        if (triangleCount == 0)
+            return 0.0f;
+        VertexCache cache(cacheSize, vertexCount);
+        size_t misses = 0;
+        for (size_t i = 0; i < triangleCount; ++i)
+        {
+            misses += cache.Add(indices + 3 * size_t(order ? order[i] : i));
+            cache.evicted.clear();
+        }
+        return float(misses) / float(triangleCount);
+    }
+
+    // Forsyth's vertex score: recently used vertices score high, the three of the last
+    // triangle a little less so that strips do not turn back on themselves, and vertices
+    // with few triangles left score high so they get finished off.
+    static float vertexScore(int cachePosition, unsigned int remaining)
+    {
+        if (remaining == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = std::pow(1.0f - float(cachePosition - 3) / float(VERTEX_CACHE_SIZE - 3), 1.5f);
+        }
+        return score + 2.0f / std::sqrt(float(remaining));
+    }
+
+    void optimizeVertexCache(std::vector<unsigned int>& order, const unsigned int* indices, size_t triangleCount,
+        size_t vertexCount)
+    {
+        order.clear();
+        order.reserve(triangleCount);
+
+        // The triangles not drawn yet around each vertex.
+        std::vector<unsigned int> remaining(vertexCount, 0), firstTriangle(vertexCount + 1, 0);
+        for (size_t i = 0; i < 3 * triangleCount; ++i)
+            remaining[indices[i]]++;
+        for (size_t v = 0; v < vertexCount; ++v)
+            firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+        std::vector<unsigned int> triangles(3 * triangleCount), filled(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t i = 0; i < 3 * triangleCount; ++i)
+            triangles[filled[indices[i]]++] = (unsigned int)(i / 3);
+
+        std::vector<float> score(vertexCount), triangleScore(triangleCount, 0.0f);
+        for (size_t v = 0; v < vertexCount; ++v)
+            score[v] = vertexScore(-1, remaining[v]);
+        for (size_t t = 0; t < triangleCount; ++t)
+            for (int k = 0; k < 3; ++k)
+                triangleScore[t] += score[indices[3 * t + k]];
+        std::vector<unsigned char> drawn(triangleCount, 0);
+
+        VertexCache cache(VERTEX_CACHE_SIZE, vertexCount);
+        size_t next = 0;
+        long long best = -1;
+        while (order.size() < triangleCount)
+        {
+            // Without a candidate around the cache, start over at the next triangle not drawn.
+            if (best < 0)
+            {
+                while (drawn[next])
+                    next++;
+                best = (long long)next;
+            }
+            unsigned int t = (unsigned int)best;
+            const unsigned int* corners = indices + 3 * size_t(t);
+            order.push_back(t);
+            drawn[t] = 1;
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int v = corners[k];
+                unsigned int* first = &triangles[firstTriangle[v]];
+                unsigned int* last = first + remaining[v];
+                unsigned int* found = std::find(first, last, t);
+                if (found != last)
+                {
+                    *found = *(last - 1);
+                    remaining[v]--;
+                }
+            }
+            cache.Add(corners);
+
+            // Rescore the vertices whose cache position or triangle count changed, then the
+            // triangles around them, and take the best of those next.
+            std::vector<unsigned int> changed = cache.Entries();
+            changed.insert(changed.end(), cache.evicted.begin(), cache.evicted.end());
+            cache.evicted.clear();
+            for (unsigned int v : changed)
+            {
+                float updated = vertexScore(cache.Position(v), remaining[v]);
+                float delta = updated - score[v];
+                score[v] = updated;
+                for (unsigned int i = firstTriangle[v]; i < firstTriangle[v] + remaining[v]; ++i)
+                    triangleScore[triangles[i]] += delta;
+            }
+            best = -1;
+            float bestScore = -1.0f;
+            for (unsigned int v : cache.Entries())
+            {
+                for (unsigned int i = firstTriangle[v]; i < firstTriangle[v] + remaining[v]; ++i)
+                {
+                    unsigned int candidate = triangles[i];
+                    if (triangleScore[candidate] > bestScore)
+                    {
+                        bestScore = triangleScore[candidate];
+                        best = candidate;
+                    }
+                }
+            }
+        }
+    }
+
+    void optimizeOverdraw(std::vector<unsigned int>& order, const unsigned int* indices, const Vertex* vertices,
+        size_t vertexCount, float threshold)
+    {
+        size_t triangleCount = order.size();
+        if (triangleCount == 0)
+            return;
+
+        // Misses of each triangle in the cache optimized order.
+        std::vector<unsigned char> misses(triangleCount);
+        VertexCache cache(VERTEX_CACHE_SIZE, vertexCount);
+        size_t totalMisses = 0;
+        for (size_t i = 0; i < triangleCount; ++i)
+        {
+            misses[i] = (unsigned char)cache.Add(indices + 3 * size_t(order[i]));
+            cache.evicted.clear();
+            totalMisses += misses[i];
+        }
+        float ratio = float(totalMisses) / float(triangleCount);
+
+        // Cut where the cache starts over, and where a cluster of a few cache sizes has used
+        // the cache about as well as the whole order does, so cutting costs little reuse.
+        std::vector<size_t> starts(1, 0);
+        size_t clusterMisses = 0;
+        for (size_t i = 0; i < triangleCount; ++i)
+        {
+            size_t length = i - starts.back();
+            bool restart = length > 0 && misses[i] == 3;
+            bool cheap = length >= 4 * VERTEX_CACHE_SIZE && float(clusterMisses) <= threshold * ratio * float(length);
+            if (restart || cheap)
+            {
+                starts.push_back(i);
+                clusterMisses = 0;
+            }
+            clusterMisses += misses[i];
+        }
+        starts.push_back(triangleCount);
+
+        // Area weighted centroid and normal of every cluster and of the whole mesh.
+        size_t clusterCount = starts.size() - 1;
+        std::vector<glm::vec3> centroid(clusterCount), normal(clusterCount);
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (size_t c = 0; c < clusterCount; ++c)
+        {
+            glm::vec3 sum(0.0f), n(0.0f);
+            float area = 0.0f;
+            for (size_t i = starts[c]; i < starts[c + 1]; ++i)
+            {
+                const unsigned int* corners = indices + 3 * size_t(order[i]);
+                glm::vec3 a = vertices[corners[0]].position, b = vertices[corners[1]].position,
+                    d = vertices[corners[2]].position;
+                glm::vec3 cross = glm::cross(b - a, d - a);
+                float doubleArea = glm::length(cross);
+                sum += (a + b + d) * (doubleArea / 3.0f);
+                n += cross;
+                area += doubleArea;
+            }
+            meshCentroid += sum;
+            meshArea += area;
+            centroid[c] = area > 0.0f ? sum / area : glm::vec3(0.0f);
+            float length = glm::length(n);
+            normal[c] = length > 0.0f ? n / length : glm::vec3(0.0f);
+        }
+        if (meshArea > 0.0f)
+            meshCentroid /= meshArea;
+
+        std::vector<float> key(clusterCount);
+        std::vector<unsigned int> sorted(clusterCount);
+        for (size_t c = 0; c < clusterCount; ++c)
+        {
+            key[c] = glm::dot(centroid[c] - meshCentroid, normal[c]);
+            sorted[c] = (unsigned int)c;
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [&key](unsigned int a, unsigned int b) { return key[a] > key[b]; });
+
+        std::vector<unsigned int> reordered;
+        reordered.reserve(triangleCount);
+        for (unsigned int c : sorted)
+            reordered.insert(reordered.end(), order.begin() + starts[c], order.begin() + starts[c + 1]);
+        order.swap(reordered);
+    }
+
+    void optimizeMeshlets(std::vector<unsigned int>& order, const unsigned int* indices, const Vertex* vertices,
+        size_t vertexCount, unsigned int meshletTriangles)
+    {
+        size_t triangleCount = order.size();
+        if (triangleCount == 0 || meshletTriangles == 0)
+            return;
+
+        // The triangles around each vertex, and every triangle's unit normal and centroid.
+        std::vector<unsigned int> firstTriangle(vertexCount + 1, 0), triangles(3 * triangleCount);
+        for (size_t i = 0; i < 3 * triangleCount; ++i)
+            firstTriangle[indices[i] + 1]++;
+        for (size_t v = 0; v < vertexCount; ++v)
+            firstTriangle[v + 1] += firstTriangle[v];
+        std::vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t i = 0; i < 3 * triangleCount; ++i)
+            triangles[filled[indices[i]]++] = (unsigned int)(i / 3);
+        std::vector<glm::vec3> normal(triangleCount), centroid(triangleCount);
+        double area = 0.0;
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            const unsigned int* corners = indices + 3 * t;
+            glm::vec3 a = vertices[corners[0]].position, b = vertices[corners[1]].position,
+                c = vertices[corners[2]].position;
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float length = glm::length(n);
+            normal[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+            centroid[t] = (a + b + c) / 3.0f;
+            area += 0.5 * length;
+        }
+        // About the width of a compact meshlet, to weigh how far a triangle is from one.
+        float width = (float)std::sqrt(area / triangleCount * meshletTriangles);
+        width = width > 0.0f ? width : 1.0f;
+
+        // Vertices and candidate triangles are marked with the meshlet that reached them.
+        std::vector<unsigned char> taken(triangleCount, 0);
+        std::vector<unsigned int> vertexMeshlet(vertexCount, ~0u), triangleMeshlet(triangleCount, ~0u);
+        std::vector<unsigned int> candidates, reordered;
+        reordered.reserve(triangleCount);
+        size_t next = 0;
+        for (unsigned int meshlet = 0; reordered.size() < triangleCount; ++meshlet)
+        {
+            candidates.clear();
+            glm::vec3 axis(0.0f), sum(0.0f), center(0.0f);
+            size_t first = reordered.size();
+            size_t end = std::min(reordered.size() + meshletTriangles, triangleCount);
+            while (reordered.size() < end)
+            {
+                float axisLength = glm::length(axis);
+                glm::vec3 direction = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f);
+                long long best = -1;
+                float bestScore = -std::numeric_limits<float>::max();
+                for (size_t c = 0; c < candidates.size();)
+                {
+                    unsigned int t = candidates[c];
+                    if (taken[t])
+                    {
+                        candidates[c] = candidates.back();
+                        candidates.pop_back();
+                        continue;
+                    }
+                    int shared = 0;
+                    for (int k = 0; k < 3; ++k)
+                        shared += vertexMeshlet[indices[3 * size_t(t) + k]] == meshlet;
+                    float score = float(shared) + 0.5f * glm::dot(normal[t], direction) -
+                        glm::length(centroid[t] - center) / width;
+                    if (score > bestScore)
+                    {
+                        bestScore = score;
+                        best = t;
+                    }
+                    ++c;
+                }
+                if (best < 0)
+                {
+                    while (taken[order[next]])
+                        next++;
+                    best = order[next];
+                }
+
+                unsigned int t = (unsigned int)best;
+                taken[t] = 1;
+                reordered.push_back(t);
+                axis += normal[t];
+                sum += centroid[t];
+                center = sum / float(reordered.size() - first);
+                for (int k = 0; k < 3; ++k)
+                {
+                    unsigned int v = indices[3 * size_t(t) + k];
+                    if (vertexMeshlet[v] == meshlet)
+                        continue;
+                    vertexMeshlet[v] = meshlet;
+                    for (unsigned int i = firstTriangle[v]; i < firstTriangle[v + 1]; ++i)
+                    {
+                        unsigned int neighbor = triangles[i];
+                        if (!taken[neighbor] && triangleMeshlet[neighbor] != meshlet)
+                        {
+                            triangleMeshlet[neighbor] = meshlet;
+                            candidates.push_back(neighbor);
+                        }
+                    }
+                }
+            }
+        }
+        order.swap(reordered);
+    }
+}
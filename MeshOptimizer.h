@@ -0,0 +1,58 @@
+/*
+*	MeshOptimizer.h -- load-time reordering of a mesh's triangles. Triangles are first put in
+*					   an order that reuses recently used vertices (Forsyth's linear-speed vertex
+*					   cache optimization), so the gathers of triangle setup stay in a small,
+*					   hot set of vertices. That order is then cut into clusters which are sorted
+*					   so that outward-facing clusters on the outside of the mesh come first,
+*					   letting the depth test reject more of what is drawn after them. Last, the
+*					   order is regrouped into compact meshlets that can be culled together.
+*/
+
+#pragma once
+#include "Vertex.h"
+#include <vector>
+#include <cstddef>
+
+namespace SoftwareRasterizer
+{
+    // Vertices the simulated post-transform cache holds.
+    const unsigned int VERTEX_CACHE_SIZE = 32;
+
+    /*!
+    *  \brief Average cache miss ratio: vertices missing from a least recently used cache of
+    *         cacheSize vertices per triangle, when triangles are drawn in the given order
+    *         (or in index order if order is null). Between 0.5 for an ideal regular mesh and 3.
+    */
+    float averageCacheMissRatio(const unsigned int* indices, size_t triangleCount, size_t vertexCount,
+        const unsigned int* order = nullptr, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+    /*!
+    *  \brief Fills order with the triangles 0 to triangleCount - 1, in an order that keeps
+    *         their vertices in the cache as long as they are still needed.
+    */
+    void optimizeVertexCache(std::vector<unsigned int>& order, const unsigned int* indices, size_t triangleCount,
+        size_t vertexCount);
+
+    /*!
+    *  \brief Reorders order, a vertex cache optimized triangle order, for less overdraw. It is
+    *         cut into clusters where the cache starts over, or where a cluster of at least four
+    *         cache sizes of triangles has a miss ratio within threshold times that of the
+    *         whole order. Clusters are then sorted by how far out and outward they face,
+    *         dot(cluster centroid - mesh centroid, cluster normal), largest first. Normals
+    *         follow counter-clockwise winding.
+    */
+    void optimizeOverdraw(std::vector<unsigned int>& order, const unsigned int* indices, const Vertex* vertices,
+        size_t vertexCount, float threshold = 1.05f);
+
+    /*!
+    *  \brief Regroups order into runs of meshletTriangles triangles that are compact and face
+    *         similar ways, so the runs can be culled as a whole (see Meshlet in Model.h).
+    *         Each run starts at the first triangle of order not taken yet and grows across
+    *         shared vertices, preferring triangles that share more vertices with it, lie
+    *         closer to its center and have normals closer to its average. When it has no
+    *         neighbors left it takes the next triangle of order, so every run but the last
+    *         is full.
+    */
+    void optimizeMeshlets(std::vector<unsigned int>& order, const unsigned int* indices, const Vertex* vertices,
+        size_t vertexCount, unsigned int meshletTriangles);
+}
@@ -4,6 +4,11 @@
 #include "Point.h"
 #include "Line.h"
 #include "Material.h"
+#include "Clipper.h"
+#include "AssetCache.h"
+#include "ObjParser.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -12,375 +17,818 @@
 #include <limits>
 #include <ctime>
 #include <stdlib.h>  
+#include <unordered_map>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
 
 namespace SoftwareRasterizer
 {
-    Model::Model(std::string  filename)
+    // Bit pattern of a vertex position, so that exactly equal positions can be welded.
+    struct PositionKey
+    {
+        uint32_t x, y, z;
+        bool operator==(const PositionKey& o) const { return x == o.x && y == o.y && z == o.z; }
+    };
+
+    struct PositionKeyHash
+    {
+        size_t operator()(const PositionKey& k) const
+        {
+            size_t h = k.x;
+            h = h * 0x9E3779B1u + k.y;
+            h = h * 0x9E3779B1u + k.z;
+            return h;
+        }
+    };
+
+    Model::Model() : meshletCulling(true), m_VertexFormat(VERTEX_FORMAT::FLOAT),
+        m_CulledMeshlets(0), m_BackfacingMeshlets(0)
     {
         position = rotation = glm::vec3(0);
         scale = 1;
         bounds[0] = glm::vec3(std::numeric_limits<float>::max());
         bounds[1] = glm::vec3(-std::numeric_limits<float>::max());
-        LoadTriangles(filename);
     }
 
-    void Model::LoadTriangles(std::string  filename)
+    Model::Model(std::string  filename, bool useCache) : meshletCulling(true), m_VertexFormat(VERTEX_FORMAT::FLOAT),
+        m_CulledMeshlets(0), m_BackfacingMeshlets(0)
     {
-        char mtlname[80];
-        memset(mtlname, 0, 80);
-        strncpy(mtlname, filename.c_str(), strlen(filename.c_str()) - 4);
-        strcat(mtlname, ".mtl");
-
-        LoadMaterials(mtlname);
-            
-        std::vector<glm::vec3> positions;
-        std::vector<glm::vec3> normals;
-        std::vector<glm::vec2> texcoords;
-        unsigned int materialIndex = -1;
-        Material currentMaterial;
+        position = rotation = glm::vec3(0);
+        scale = 1;
+        bounds[0] = glm::vec3(std::numeric_limits<float>::max());
+        bounds[1] = glm::vec3(-std::numeric_limits<float>::max());
+        LoadTriangles(filename, useCache);
+    }
+
+    std::string Model::MaterialFile(const std::string& filename)
+    {
+        return filename.substr(0, filename.size() - std::min<size_t>(filename.size(), 4)) + ".mtl";
+    }
+
+    const Material& Model::GetMaterial(unsigned int i) const
+    {
+        static const Material defaultMaterial;
+        return m_Materials && i < m_Materials->materials.size() ? m_Materials->materials[i] : defaultMaterial;
+    }
+
+    void Model::LoadTriangles(std::string  filename, bool useCache)
+    {
+        m_Materials = AssetCache::Instance().LoadMaterials(MaterialFile(filename));
 
-        FILE* file = fopen(filename.c_str(), "r");
-        if (!file)
+        // Use the binary cache if it is up to date, otherwise parse and write a new one.
+        std::string cacheFile = meshCachePath(filename);
+        bool cached = useCache && readMeshCache(cacheFile, filename, *this);
+        if (!cached)
+        {
+            LoadObj(filename);
+            OptimizeTriangleOrder();
+            BuildEdges();
+            if (useCache)
+                writeMeshCache(cacheFile, filename, *this);
+        }
+        BuildPositionStreams();
+        BuildMeshlets();
+
+        std::cout << "Model " + filename + (cached ? " loaded from cache" : " loaded") + ".\nbounds: [" << bounds[0].x <<
+            "," << bounds[1].x << "], [" << bounds[0].y << "," << bounds[1].y << "], [" << bounds[0].z << "," <<
+            bounds[1].z << "]" << std::endl;
+        std::cout << "# faces: " << TriangleCount() << ", # unique vertices: " << m_Vertices.size() <<
+            ", # edges: " << EdgeCount() << std::endl;
+    }
+
+    void Model::LoadObj(const std::string& filename)
+    {
+        ObjData obj;
+        if (!parseObj(filename, obj))
         {
             throw std::exception("Failed to open .OBJ file!");
         }
+        VertexLookup vertexLookup;
+        vertexLookup.reserve(obj.positions.size());
+        unsigned int materialIndex = -1;
+        AddObjFaces(obj, vertexLookup, materialIndex);
+    }
+
+    void Model::AddObjFaces(const ObjData& obj, VertexLookup& vertexLookup, unsigned int& materialIndex)
+    {
+        bounds[0] = glm::min(bounds[0], obj.bounds[0]);
+        bounds[1] = glm::max(bounds[1], obj.bounds[1]);
+        m_Indices.reserve(m_Indices.size() + (obj.corners.size() - std::min<size_t>(obj.corners.size(), 2 * obj.FaceCount())) * 3);
 
-        while (true)
+        // Switches after the last face still count for the faces of later batches.
+        size_t nextSwitch = 0;
+        std::vector<unsigned int> corners;
+        for (unsigned int f = 0; f <= obj.FaceCount(); ++f)
         {
-            char lineHeader[128];
-            int res = fscanf(file, "%s", lineHeader);
-            if (res == EOF)
-            {
-                break;
-            }
-            if (strcmp(lineHeader, "v") == 0)
+            for (; nextSwitch < obj.materialSwitches.size() && obj.materialSwitches[nextSwitch].firstFace <= f; ++nextSwitch)
             {
-                glm::vec3 vertex;
-                fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-                
-                // Update bounding box dimensions.
-                if (vertex.x < bounds[0].x)
-                    bounds[0].x = vertex.x;
-                if (vertex.x > bounds[1].x)
-                    bounds[1].x = vertex.x;
-                if (vertex.y < bounds[0].y)
-                    bounds[0].y = vertex.y;
-                if (vertex.y > bounds[1].y)
-                    bounds[1].y = vertex.y;
-                if (vertex.z < bounds[0].z)
-                    bounds[0].z = vertex.z;
-                if (vertex.z > bounds[1].z)
-                    bounds[1].z = vertex.z;
-
-                positions.push_back(vertex);
+                int found = m_Materials->Find(obj.materialSwitches[nextSwitch].name.c_str());
+                if (found >= 0)
+                    materialIndex = found;
             }
-            else if (strcmp(lineHeader, "vt") == 0)
-            {
-                glm::vec2 uv;
-                fscanf(file, "%f %f\n", &uv.x, &uv.y);
-                texcoords.push_back(uv);
-            }
-            else if (strcmp(lineHeader, "vn") == 0)
-            {
-                glm::vec3 normal;
-                fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-                normals.push_back(normal);
-            }
-            else if (strcmp(lineHeader, "usemtl") == 0)
+            if (f == obj.FaceCount())
+                break;
+
+            unsigned int first = obj.faceStarts[f], count = obj.faceStarts[f + 1] - first;
+            if (count < 3)
+                continue;
+
+            // Look up or add a unique vertex for every corner of the face. Missing texture
+            // coordinates and normals are zero.
+            corners.resize(count);
+            for (unsigned int i = 0; i < count; ++i)
             {
-                char str[80];
-                fscanf(file, "%s\n", str);
-                for (unsigned int i = 0; i < m_MaterialNames.size(); ++i)
+                const ObjCorner& c = obj.corners[first + i];
+                if (c.v < 0 || c.v >= (int)obj.positions.size() || c.t < -1 || c.t >= (int)obj.texcoords.size() ||
+                    c.n < -1 || c.n >= (int)obj.normals.size())
                 {
-                    if (strcmp(str, m_MaterialNames[i].c_str()) == 0)
-                    {
-                        materialIndex = i;
-                        break;
-                    }
+                    throw std::exception("Invalid index in .OBJ face!");
                 }
-            }
-            else if (strcmp(lineHeader, "f") == 0)
-            {               
-                // Tokenize line and parse index values.
-                char linestr[128];
-                fgets(linestr, sizeof(linestr), file);
-                char* tokens = strtok(linestr, " ");
-                std::vector<unsigned int> iv, it, in;
-                while (tokens != NULL)
+                VertexKey key = { (unsigned int)c.v, (unsigned int)c.t, (unsigned int)c.n };
+                auto found = vertexLookup.find(key);
+                if (found == vertexLookup.end())
                 {
-                    if (strlen(tokens) > 1)
-                    {
-                        iv.push_back(0);
-                        it.push_back(0);
-                        in.push_back(0);
-                        sscanf(tokens, "%d/%d/%d", &iv[iv.size() - 1], &it[it.size() - 1], &in[in.size() - 1]);
-                    }
-                    tokens = strtok(NULL, " ");
+                    found = vertexLookup.emplace(key, (unsigned int)m_Vertices.size()).first;
+                    m_Vertices.push_back(Vertex(obj.positions[c.v], c.t >= 0 ? obj.texcoords[c.t] : glm::vec2(0),
+                        c.n >= 0 ? obj.normals[c.n] : glm::vec3(0)));
                 }
+                corners[i] = found->second;
+            }
 
-                // Add all triangles to the array.
-                for (int i = 0; i < iv.size() - 2; ++i)
-                {
-                    int idx1 = i + 0;
-                    int idx2 = i + 1;
-                    int idx3 = i + 2;
-                    m_Triangles.push_back(Triangle(
-                        Vertex(positions[iv[idx1] - 1], texcoords[it[idx1] - 1], normals[in[idx1] - 1]),
-                        Vertex(positions[iv[idx2] - 1], texcoords[it[idx2] - 1], normals[in[idx2] - 1]),
-                        Vertex(positions[iv[idx3] - 1], texcoords[it[idx3] - 1], normals[in[idx3] - 1]),
-                        materialIndex
-                    ));
-                }
-                // Add final triangle, connecting face back to the first vertex.
-                if (iv.size() > 1)
-                {
-                    int idx1 = iv.size() - 2;
-                    int idx2 = iv.size() - 1;
-                    int idx3 = 0;
-                    m_Triangles.push_back(Triangle(
-                        Vertex(positions[iv[idx1] - 1], texcoords[it[idx1] - 1], normals[in[idx1] - 1]),
-                        Vertex(positions[iv[idx2] - 1], texcoords[it[idx2] - 1], normals[in[idx2] - 1]),
-                        Vertex(positions[iv[idx3] - 1], texcoords[it[idx3] - 1], normals[in[idx3] - 1]),
-                        materialIndex
-                    ));
-                }
+            // Add the face as a fan of triangles around its first corner.
+            for (unsigned int i = 1; i + 1 < count; ++i)
+            {
+                m_Indices.push_back(corners[0]);
+                m_Indices.push_back(corners[i]);
+                m_Indices.push_back(corners[i + 1]);
+                m_TriangleMaterials.push_back(materialIndex);
             }
         }
-
-        std::cout << "Model " + filename + " loaded.\nbounds: [" << bounds[0].x << "," << bounds[1].x << "], ["
-            << bounds[0].y << "," << bounds[1].y << "], [" << bounds[0].z << "," << bounds[1].z << "]" << std::endl;
-        std::cout << "# faces: " << m_Triangles.size() << std::endl;
     }
     
-    void Model::Draw(cv::Mat& img, cv::Mat& imgZ, glm::mat4 P, glm::mat4 V, 
-        int w, int h, int frameCount, bool wireframeOn, bool cullFace, bool frontFaceCCW, 
-        bool depthTest, unsigned int& trianglesRendered)
+    glm::mat4 Model::ModelMatrix(int frameCount) const
+    {
+        glm::mat4 M = glm::mat4(1);
+        M = glm::translate(M, this->position);
+        M = glm::scale(M, glm::vec3(1,-1,1) * this->scale);//invert y-axis value to flip image.
+        M = glm::rotate(M, glm::radians(float(frameCount * this->rotation.length())), 
+            glm::normalize(this->rotation));
+        return M;
+    }
+
+    void Model::Draw(TileBinner& binner, glm::mat4 P, glm::mat4 V, 
+        int w, int h, int frameCount, bool cullFace, bool frontFaceCCW, 
+        unsigned int modelID, unsigned int& trianglesRendered)
     {
-            // Apply transforms.
-            glm::mat4 M = glm::mat4(1);
-            M = glm::translate(M, this->position);
-            M = glm::scale(M, glm::vec3(1,-1,1) * this->scale);//invert y-axis value to flip image.
-            M = glm::rotate(M, glm::radians(float(frameCount * this->rotation.length())), 
-                glm::normalize(this->rotation));
-            glm::mat4 MVP = P* V* M;
-
-            // Iterate over triangles, project to screen space, rasterize lines.
+        // Apply transforms.
+        glm::mat4 MVP = P* V* ModelMatrix(frameCount);
+
+        // Transform every unique vertex of the meshlets left after culling once into the
+        // post-transform cache.
+        bool culled = CullMeshlets(MVP, cullFace, frontFaceCCW);
+        const unsigned char* blocks = culled ? m_BlockVisible.data() : nullptr;
+        TransformVertices(MVP, blocks);
+        ProjectVertices(w, h, blocks);
+        m_VertexVaryings.clear();
+        AssembleTriangles(binner, w, h, cullFace, frontFaceCCW, modelID, 0, trianglesRendered,
+            culled ? m_MeshletVisible.data() : nullptr);
+    }
+
+    void Model::DrawEdges(TileBinner& binner, glm::mat4 P, glm::mat4 V,
+        int w, int h, int frameCount, bool cullFace, bool frontFaceCCW,
+        unsigned int modelID, unsigned int& edgesRendered)
+    {
+        glm::mat4 MVP = P * V * ModelMatrix(frameCount);
+        TransformVertices(MVP);
+        ProjectVertices(w, h);
+
+        // With face culling, find the triangles facing the camera, then the edges they have.
+        // A model still loading has no edges yet, nor edges for its triangles.
+        unsigned int triangleCount = (unsigned int)m_TriangleEdges.size() / 3;
+        unsigned int edgeCount = EdgeCount();
+        if (cullFace)
+        {
+            m_FrontFacing.resize(triangleCount);
 #pragma omp parallel for
-            for (int i = 0; i < this->m_Triangles.size(); ++i)
+            for (int i = 0; i < (int)triangleCount; ++i)
             {
-                // Transform to clip space by projection, dividing out z,w values to get (x,y) coord.
-                glm::vec3 v2[3] = 
-                {
-                   glm::vec3(MVP * glm::vec4(this->m_Triangles[i].v[0].position, 1.0f)),
-                   glm::vec3(MVP * glm::vec4(this->m_Triangles[i].v[1].position, 1.0f)),
-                   glm::vec3(MVP * glm::vec4(this->m_Triangles[i].v[2].position, 1.0f))
-                };
-
-                // Normalize by homogenous coordinate to convert from clip space to screen space.
-                // Note that we keep the z coordinate unchanged instead of normalizing it, for 
-                // use in later writing to the depth buffer.
-                for (int r = 0; r < 3; ++r)
+                // Screen positions behind the near plane are meaningless, so triangles
+                // crossing it are kept.
+                const unsigned int* idx = &m_Indices[3 * i];
+                if ((m_ClipCodes[idx[0]] | m_ClipCodes[idx[1]] | m_ClipCodes[idx[2]]) & CLIP_NEAR)
                 {
-                    v2[r].x /= v2[r].z;
-                    v2[r].y /= v2[r].z;
+                    m_FrontFacing[i] = 1;
+                    continue;
                 }
 
-                //// Check whether projected points fit view volume in NDC space.
-                glm::bvec3 inNDC = glm::bvec3(false);
-                for (int i = 0; i < 3; ++i)
-                {
-                    if (v2[i].x >= -1 &&
-                        v2[i].x <= 1 &&
-                        v2[i].y >= -1 &&
-                        v2[i].y <= 1 &&
-                        v2[i].z >= 0 &&
-                        v2[i].z <= 1)
-                    {
-                        inNDC[i] = true;
-                    }
-                }
-                if (!inNDC[0] && !inNDC[1] && !inNDC[2])
+                // The z of the screen-space cross product, as in Triangle::isCCW().
+                float ax = m_ScreenX[idx[1]] - m_ScreenX[idx[0]], ay = m_ScreenY[idx[1]] - m_ScreenY[idx[0]];
+                float bx = m_ScreenX[idx[2]] - m_ScreenX[idx[0]], by = m_ScreenY[idx[2]] - m_ScreenY[idx[0]];
+                m_FrontFacing[i] = ((ax * by - ay * bx) <= 0.0f) == frontFaceCCW;
+            }
+            m_EdgeVisible.assign(edgeCount, 0);
+            for (unsigned int i = 0; i < triangleCount; ++i)
+            {
+                if (!m_FrontFacing[i])
                     continue;
+                for (int e = 0; e < 3; ++e)
+                    if (m_TriangleEdges[3 * i + e] != ~0u)
+                        m_EdgeVisible[m_TriangleEdges[3 * i + e]] = 1;
+            }
+        }
 
-                // Make a copy of the triangle, now projected to clip space.
-                Triangle clipspaceTri = Triangle(
-                    Vertex(v2[0], this->m_Triangles[i].v[0].texcoord, this->m_Triangles[i].v[0].normal),
-                    Vertex(v2[1], this->m_Triangles[i].v[1].texcoord, this->m_Triangles[i].v[1].normal),
-                    Vertex(v2[2], this->m_Triangles[i].v[2].texcoord, this->m_Triangles[i].v[2].normal),
-                    this->m_Triangles[i].materialIndex
-                );
-
-                // Cull faces as necessary.
-                if (cullFace)                
-                    if (clipspaceTri.isCCW() != frontFaceCCW)
-                        continue;                
-
-                // Keep copy of NDC bounds check with clip space triangle for testing.
-                // Somewhat hacky, should be fixed.
-                clipspaceTri.setInNDCbounds(inNDC);
-
-                // Convert clip space coords [-1,1] to integer screen space coords [0,w],[0,h],
-                // which correspond to pixel indices on the output frame.
-                for (int q = 0; q < 3; ++q)
-                {
-                    clipspaceTri.v[q].position.x = int((clipspaceTri.v[q].position.x + 1.0) * 0.5 * w);
-                    clipspaceTri.v[q].position.y = int((clipspaceTri.v[q].position.y + 1.0) * 0.5 * h);
-                }
+        // One binner slot per edge, filled in parallel like the triangle slots in Draw().
+        unsigned int firstSlot = binner.AllocateLines(edgeCount);
+        unsigned int rendered = 0;
+        float guardX, guardY;
+        guardBandScale(w, h, guardX, guardY);
+#pragma omp parallel for reduction(+:rendered)
+        for (int i = 0; i < (int)edgeCount; ++i)
+        {
+            if (cullFace && !m_EdgeVisible[i])
+                continue;
+            const MeshEdge& edge = m_Edges[i];
+            unsigned int codes[2] = { m_ClipCodes[edge.v[0]], m_ClipCodes[edge.v[1]] };
+            if (codes[0] & codes[1] & CLIP_VIEW_PLANES)
+                continue;
 
-                // If every point of triangle is at a depth greater than
-                // that of the current depths in the z-buffer, skip rendering
-                // because the triangle is occluded.
-                int vertexOccluded = 0;
-                if (depthTest)
+            // Edges crossing the near or far plane or leaving the guard band are clipped
+            // right here, as a line costs little to clip.
+            glm::vec3 p[2];
+            if ((codes[0] | codes[1]) & CLIP_REQUIRED_PLANES)
+            {
+                glm::vec4 c[2];
+                for (int q = 0; q < 2; ++q)
+                    c[q] = glm::vec4(m_ClipX[edge.v[q]], m_ClipY[edge.v[q]], m_ClipZ[edge.v[q]], m_ClipW[edge.v[q]]);
+                if (!clipLine(c[0], c[1], codes[0] | codes[1], guardX, guardY))
+                    continue;
+                for (int q = 0; q < 2; ++q)
                 {
-                    float minZ = clipspaceTri.getMinZ();
-                    for (int p = 0; p < 3; ++p)
-                    {
-                        if (clipspaceTri.v[p].position.x >= 0 && 
-                            clipspaceTri.v[p].position.x < imgZ.rows &&
-                            clipspaceTri.v[p].position.y >= 0 && 
-                            clipspaceTri.v[p].position.y < imgZ.cols)
-                        {
-                            // If vertex is occluded, increment occluded vertex counter.
-                            if (minZ > imgZ.at<cv::Vec3f>(clipspaceTri.v[p].position.x,
-                                clipspaceTri.v[p].position.y)[2])                            
-                                    vertexOccluded++;                            
-                        }
-                    }
+                    p[q] = glm::vec3((c[q].x / c[q].w + 1.0f) * 0.5f * w, (c[q].y / c[q].w + 1.0f) * 0.5f * h,
+                        (c[q].z / c[q].w) * 0.5f + 0.5f);
                 }
-                if (vertexOccluded >= 3)
-                    continue;
-
-                // Get diffuse color. Remember that OpenCV requires conversion of values from
-                // BGR -> RGB.
-                Material* material = &this->m_Materials[this->m_Triangles[i].materialIndex];
-                glm::vec3 dif = material->diffuse * 255.f;
-                float col[3] = { material->diffuse.z, material->diffuse.y, material->diffuse.x };
-
-                // Draw rasterized triangle(s) as necessary.
-                clipspaceTri.Draw(img, imgZ, material, col, wireframeOn, depthTest);      
-                trianglesRendered++;
             }
+            else
+            {
+                for (int q = 0; q < 2; ++q)
+                    p[q] = glm::vec3(m_ScreenX[edge.v[q]], m_ScreenY[edge.v[q]], m_ScreenZ[edge.v[q]]);
+            }
+
+            // Diffuse color, in OpenCV's BGR order.
+            const Material& material = GetMaterial(edge.material);
+            float col[3] = { material.diffuse.z, material.diffuse.y, material.diffuse.x };
+            binner.GetLine(firstSlot + i) = BinnedLine(p[0], p[1], col, modelID);
+            rendered++;
+        }
+        edgesRendered += rendered;
     }
 
-    void Model::LoadMaterials(std::string  filename)
+    void Model::AssembleTriangles(TileBinner& binner, int w, int h, bool cullFace, bool frontFaceCCW,
+        unsigned int modelID, int varyingCount, unsigned int& trianglesRendered, const unsigned char* meshlets)
     {
-        FILE* file = fopen(filename.c_str(), "r");
-        if (!file)
-        {
-            throw std::exception("Failed to open material file!");
-        }
+        // Reserve one binner slot per triangle so the vertex stage can run in parallel while
+        // triangles are still rasterized in model order. Culled triangles leave their slot
+        // empty.
+        unsigned int triangleCount = TriangleCount();
+        unsigned int firstSlot = binner.Allocate(triangleCount);
+        unsigned int rendered = 0;
+        m_NeedsClipping.assign(triangleCount, 0);
 
-        while (true)
+        // Assemble triangles from the cache, cull them and queue for rasterization.
+#pragma omp parallel for reduction(+:rendered)
+        for (int i = 0; i < (int)triangleCount; ++i)
         {
-            char txpath[256];
-            char buf[128];
-            int res = fscanf(file, "%s", buf);
-            if (res == EOF)            
-                break;
-            
-            if (strcmp(buf, "newmtl") == 0)
-            {
-                char str[80];
-                fscanf(file, "%s\n", str);
-                m_MaterialNames.push_back(str);
-                m_Materials.push_back(Material());
-            }
+            if (meshlets && !meshlets[i / MESHLET_TRIANGLES])
+                continue;
+            const unsigned int* idx = &m_Indices[3 * i];
+            unsigned int codes[3] = { m_ClipCodes[idx[0]], m_ClipCodes[idx[1]], m_ClipCodes[idx[2]] };
 
-            // Handle loading material properties.
-            else if (strcmp(buf, "Kd") == 0)
-            {
-                fscanf(file, "%f %f %f\n", &m_Materials.back().diffuse.x, &m_Materials.back().diffuse.y, &m_Materials.back().diffuse.z);
-            }
-            else if (strcmp(buf, "Ks") == 0)
+            // Drop triangles lying entirely outside one side of the view volume.
+            if (codes[0] & codes[1] & codes[2] & CLIP_VIEW_PLANES)
+                continue;
+
+            // Triangles crossing the near or far plane or leaving the guard band are set
+            // aside and clipped below. Everything else only needs its bounding box clamped
+            // to the viewport, which the rasterizer does.
+            if ((codes[0] | codes[1] | codes[2]) & CLIP_REQUIRED_PLANES)
             {
-                fscanf(file, "%f %f %f\n", &m_Materials.back().specular.x, &m_Materials.back().specular.y, &m_Materials.back().specular.z);
+                m_NeedsClipping[i] = 1;
+                continue;
             }
-            else if (strcmp(buf, "Ka") == 0)
+
+            // Make a copy of the triangle, at its cached screen position.
+            glm::vec3 p[3];
+            for (int q = 0; q < 3; ++q)
+                p[q] = glm::vec3(m_ScreenX[idx[q]], m_ScreenY[idx[q]], m_ScreenZ[idx[q]]);
+            glm::vec3 t[3], n[3];
+            for (int q = 0; q < 3; ++q)
+                VertexAttributes(idx[q], t[q], n[q]);
+            Triangle screenTri = Triangle(
+                Vertex(p[0], glm::vec2(t[0]), n[0]),
+                Vertex(p[1], glm::vec2(t[1]), n[1]),
+                Vertex(p[2], glm::vec2(t[2]), n[2]),
+                m_TriangleMaterials[i]
+            );
+
+            // Cull faces as necessary.
+            if (cullFace)                
+                if (screenTri.isCCW() != frontFaceCCW)
+                    continue;                
+
+            // Keep copy of NDC bounds check with clip space triangle for testing.
+            // Somewhat hacky, should be fixed.
+            screenTri.setInNDCbounds(glm::bvec3(!(codes[0] & CLIP_VIEW_PLANES),
+                !(codes[1] & CLIP_VIEW_PLANES), !(codes[2] & CLIP_VIEW_PLANES)));
+
+            // Get diffuse color. Remember that OpenCV requires conversion of values from
+            // BGR -> RGB.
+            const Material* material = &GetMaterial(m_TriangleMaterials[i]);
+            float col[3] = { material->diffuse.z, material->diffuse.y, material->diffuse.x };
+
+            // Queue the screen-space triangle. Depth testing against what is already drawn
+            // happens in the binner once all models have been submitted.
+            binner.GetTriangle(firstSlot + i) = BinnedTriangle(screenTri, col, modelID, i, material);
+            if (varyingCount)
             {
-                fscanf(file, "%f %f %f\n", &m_Materials.back().ambient.x, &m_Materials.back().ambient.y, &m_Materials.back().ambient.z);
+                float* varyings = binner.GetVaryings(firstSlot + i);
+                for (int q = 0; q < 3; ++q)
+                {
+                    float* v = varyings + q * (varyingCount + 1);
+                    std::copy_n(&m_VertexVaryings[size_t(idx[q]) * varyingCount], varyingCount, v);
+                    v[varyingCount] = 1.0f / m_ClipW[idx[q]];
+                }
             }
-            else if (strcmp(buf, "Ke") == 0)
+            rendered++;
+        }
+        trianglesRendered += rendered;
+
+        // Clip the triangles set aside above, in order, and queue the pieces after the rest
+        // of the model. Only triangles crossing the near or far plane or reaching beyond the
+        // guard band get here, so this is cheap enough to do on one thread.
+        float guardX, guardY;
+        guardBandScale(w, h, guardX, guardY);
+        for (unsigned int i = 0; i < triangleCount; ++i)
+        {
+            if (!m_NeedsClipping[i])
+                continue;
+
+            const unsigned int* idx = &m_Indices[3 * i];
+            ClipVertex poly[MAX_CLIP_VERTICES];
+            unsigned int planes = 0;
+            for (int q = 0; q < 3; ++q)
             {
-                fscanf(file, "%f %f %f\n", &m_Materials.back().emission.x, &m_Materials.back().emission.y, &m_Materials.back().emission.z);
+                poly[q].position = glm::vec4(m_ClipX[idx[q]], m_ClipY[idx[q]], m_ClipZ[idx[q]], m_ClipW[idx[q]]);
+                VertexAttributes(idx[q], poly[q].texcoord, poly[q].normal);
+                std::copy_n(m_VertexVaryings.data() + size_t(idx[q]) * varyingCount, varyingCount,
+                    poly[q].varyings);
+                planes |= m_ClipCodes[idx[q]];
             }
-            else if (strcmp(buf, "Ns") == 0)
+            int count = clipPolygon(poly, 3, planes, guardX, guardY, varyingCount);
+
+            // Divide by w and map to the viewport, as the vertex stage does.
+            Vertex screen[MAX_CLIP_VERTICES];
+            for (int k = 0; k < count; ++k)
             {
-                fscanf(file, "%f\n", &m_Materials.back().roughness);
+                const glm::vec4& c = poly[k].position;
+                screen[k] = Vertex(glm::vec3((c.x / c.w + 1.0f) * 0.5f * w, (c.y / c.w + 1.0f) * 0.5f * h,
+                    (c.z / c.w) * 0.5f + 0.5f), glm::vec2(poly[k].texcoord), poly[k].normal);
             }
-            else if (strcmp(buf, "Ni") == 0)
+
+            const Material* material = &GetMaterial(m_TriangleMaterials[i]);
+            float col[3] = { material->diffuse.z, material->diffuse.y, material->diffuse.x };
+            bool queued = false;
+            for (int k = 1; k + 1 < count; ++k)
             {
-                fscanf(file, "%f\n", &m_Materials.back().ior);
+                Triangle screenTri(screen[0], screen[k], screen[k + 1], m_TriangleMaterials[i]);
+                if (cullFace && screenTri.isCCW() != frontFaceCCW)
+                    continue;
+                float varyings[3 * (MAX_VARYINGS + 1)];
+                const int corners[3] = { 0, k, k + 1 };
+                for (int q = 0; q < 3; ++q)
+                {
+                    float* v = varyings + q * (varyingCount + 1);
+                    std::copy_n(poly[corners[q]].varyings, varyingCount, v);
+                    v[varyingCount] = 1.0f / poly[corners[q]].position.w;
+                }
+                binner.Submit(screenTri, col, modelID, i, material, varyings);
+                queued = true;
             }
-            else if (strcmp(buf, "d") == 0)
+            if (queued)
+                trianglesRendered++;
+        }
+    }
+
+    void Model::BuildPositionStreams(size_t first)
+    {
+        // Entries before first are already in place; the rest, padding included, are redone.
+        size_t padded = (m_Vertices.size() + 7) & ~size_t(7);
+        m_PositionX.resize(padded);
+        m_PositionY.resize(padded);
+        m_PositionZ.resize(padded);
+        std::fill(m_PositionX.begin() + first, m_PositionX.end(), 0.0f);
+        std::fill(m_PositionY.begin() + first, m_PositionY.end(), 0.0f);
+        std::fill(m_PositionZ.begin() + first, m_PositionZ.end(), 0.0f);
+        for (size_t i = first; i < m_Vertices.size(); ++i)
+        {
+            m_PositionX[i] = m_Vertices[i].position.x;
+            m_PositionY[i] = m_Vertices[i].position.y;
+            m_PositionZ[i] = m_Vertices[i].position.z;
+        }
+    }
+
+    void Model::VertexAttributes(unsigned int i, glm::vec3& texcoord, glm::vec3& normal) const
+    {
+        if (m_VertexFormat == VERTEX_FORMAT::QUANTIZED)
+        {
+            texcoord = glm::vec3(unpackTexcoord(m_PackedVertices[i], m_Quantization), 0.0f);
+            normal = octDecode(m_PackedVertices[i].normal);
+        }
+        else
+        {
+            texcoord = m_Vertices[i].texcoord;
+            normal = m_Vertices[i].normal;
+        }
+    }
+
+    Vertex Model::GetVertex(unsigned int i) const
+    {
+        if (m_VertexFormat == VERTEX_FORMAT::FLOAT)
+            return m_Vertices[i];
+        glm::vec3 p = m_Quantization.positionOffset + glm::vec3(m_PackedX[i], m_PackedY[i], m_PackedZ[i]) *
+            m_Quantization.positionScale;
+        const PackedVertex& packed = m_PackedVertices[i];
+        return Vertex(p, unpackTexcoord(packed, m_Quantization), octDecode(packed.normal));
+    }
+
+    void Model::SetVertexFormat(VERTEX_FORMAT format)
+    {
+        if (format == m_VertexFormat)
+            return;
+
+        if (format == VERTEX_FORMAT::FLOAT)
+        {
+            m_Vertices.resize(m_PackedVertices.size());
+            for (unsigned int i = 0; i < m_Vertices.size(); ++i)
+                m_Vertices[i] = GetVertex(i);
+            m_VertexFormat = format;
+            BuildPositionStreams();
+            m_PackedX = m_PackedY = m_PackedZ = AlignedVector<uint16_t>();
+            m_PackedVertices = std::vector<PackedVertex>();
+            if (!m_Meshlets.empty())
+                BuildMeshlets();
+            return;
+        }
+
+        // Quantize positions within the bounds and texture coordinates within their range.
+        glm::vec2 texcoordMin(0.0f), texcoordMax(0.0f);
+        for (size_t i = 0; i < m_Vertices.size(); ++i)
+        {
+            glm::vec2 t = glm::vec2(m_Vertices[i].texcoord);
+            texcoordMin = i == 0 ? t : glm::min(texcoordMin, t);
+            texcoordMax = i == 0 ? t : glm::max(texcoordMax, t);
+        }
+        m_Quantization.Fit(bounds[0], bounds[1], texcoordMin, texcoordMax);
+
+        size_t padded = (m_Vertices.size() + 7) & ~size_t(7);
+        m_PackedX.assign(padded, 0);
+        m_PackedY.assign(padded, 0);
+        m_PackedZ.assign(padded, 0);
+        m_PackedVertices.resize(m_Vertices.size());
+        const VertexQuantization& q = m_Quantization;
+        for (size_t i = 0; i < m_Vertices.size(); ++i)
+        {
+            const glm::vec3& p = m_Vertices[i].position;
+            m_PackedX[i] = quantize(p.x, q.positionOffset.x, q.positionScale.x);
+            m_PackedY[i] = quantize(p.y, q.positionOffset.y, q.positionScale.y);
+            m_PackedZ[i] = quantize(p.z, q.positionOffset.z, q.positionScale.z);
+            m_PackedVertices[i] = packVertex(m_Vertices[i], q);
+        }
+
+        // The float copies go, which is the point.
+        m_Vertices = std::vector<Vertex>();
+        m_PositionX = m_PositionY = m_PositionZ = AlignedVector<float>();
+        m_VertexFormat = format;
+
+        // Meshlet bounds around the positions as drawn.
+        if (!m_Meshlets.empty())
+            BuildMeshlets();
+    }
+
+    void Model::OptimizeTriangleOrder()
+    {
+        std::vector<unsigned int> order;
+        optimizeVertexCache(order, m_Indices.data(), TriangleCount(), m_Vertices.size());
+        optimizeOverdraw(order, m_Indices.data(), m_Vertices.data(), m_Vertices.size());
+        optimizeMeshlets(order, m_Indices.data(), m_Vertices.data(), m_Vertices.size(), MESHLET_TRIANGLES);
+
+        // Triangles in the new order, with their vertices renumbered by first use so that
+        // consecutive triangles read nearby vertices.
+        std::vector<unsigned int> remap(m_Vertices.size(), ~0u);
+        std::vector<Vertex> vertices;
+        vertices.reserve(m_Vertices.size());
+        std::vector<unsigned int> indices(m_Indices.size()), materials(m_TriangleMaterials.size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            for (int k = 0; k < 3; ++k)
             {
-                fscanf(file, "%f\n", &m_Materials.back().opacity);
+                unsigned int v = m_Indices[3 * size_t(order[i]) + k];
+                if (remap[v] == ~0u)
+                {
+                    remap[v] = (unsigned int)vertices.size();
+                    vertices.push_back(m_Vertices[v]);
+                }
+                indices[3 * i + k] = remap[v];
             }
+            materials[i] = m_TriangleMaterials[order[i]];
+        }
+        for (size_t v = 0; v < m_Vertices.size(); ++v)
+            if (remap[v] == ~0u)
+                vertices.push_back(m_Vertices[v]);
+        m_Vertices.swap(vertices);
+        m_Indices.swap(indices);
+        m_TriangleMaterials.swap(materials);
+    }
+
+    void Model::BuildEdges()
+    {
+        // Weld vertices by position, each to the first vertex found there.
+        std::unordered_map<PositionKey, unsigned int, PositionKeyHash> positionLookup;
+        std::vector<unsigned int> welded(m_Vertices.size());
+        for (unsigned int i = 0; i < m_Vertices.size(); ++i)
+        {
+            PositionKey key;
+            memcpy(&key, &m_Vertices[i].position, sizeof(key));
+            welded[i] = positionLookup.emplace(key, i).first->second;
+        }
 
-            // Handle loading light maps.
-            else if (strcmp(buf, "map_Kd") == 0)
+        // Each welded vertex pair, smaller index first, is one edge.
+        std::unordered_map<uint64_t, unsigned int> edgeLookup;
+        m_Edges.clear();
+        m_TriangleEdges.assign(m_Indices.size(), ~0u);
+        for (unsigned int t = 0; t < TriangleCount(); ++t)
+        {
+            for (int e = 0; e < 3; ++e)
             {
-                fscanf(file, "%s\n", &txpath);
-                m_Materials.back().textures.push_back(MaterialTexture());
-                m_Materials.back().textures.back().loadTexture(
-                    txpath, TEXTURE_TYPE::DIFFUSE, m_Materials.size() - 1);
+                unsigned int a = welded[m_Indices[3 * t + e]];
+                unsigned int b = welded[m_Indices[3 * t + (e + 1) % 3]];
+                if (a == b)
+                    continue;
+                if (a > b)
+                    std::swap(a, b);
+                auto found = edgeLookup.emplace((uint64_t(a) << 32) | b, (unsigned int)m_Edges.size());
+                if (found.second)
+                {
+                    MeshEdge edge = { { a, b }, m_TriangleMaterials[t] };
+                    m_Edges.push_back(edge);
+                }
+                m_TriangleEdges[3 * t + e] = found.first->second;
             }
-            else if (strcmp(buf, "map_Ks") == 0)
+        }
+    }
+
+    void Model::BuildMeshlets()
+    {
+        unsigned int triangleCount = TriangleCount();
+        unsigned int meshletCount = (triangleCount + MESHLET_TRIANGLES - 1) / MESHLET_TRIANGLES;
+        m_Meshlets.resize(meshletCount);
+        m_MeshletBlocks.clear();
+        std::vector<unsigned int> blocks;
+        for (unsigned int m = 0; m < meshletCount; ++m)
+        {
+            Meshlet& meshlet = m_Meshlets[m];
+            unsigned int first = m * MESHLET_TRIANGLES, last = std::min(first + MESHLET_TRIANGLES, triangleCount);
+
+            // Sphere around the bounding box of the triangles, and the blocks they use.
+            glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+            blocks.clear();
+            for (unsigned int i = 3 * first; i < 3 * last; ++i)
             {
-                fscanf(file, "%s\n", &txpath);
-                m_Materials.back().textures.push_back(MaterialTexture());
-                m_Materials.back().textures.back().loadTexture(
-                    txpath, TEXTURE_TYPE::SPECULAR, m_Materials.size() - 1);
+                glm::vec3 p = GetVertex(m_Indices[i]).position;
+                lo = glm::min(lo, p);
+                hi = glm::max(hi, p);
+                blocks.push_back(m_Indices[i] / 8);
             }
-            else if (strcmp(buf, "map_Ka") == 0)
+            meshlet.center = (lo + hi) * 0.5f;
+            float radius = 0.0f;
+            for (unsigned int i = 3 * first; i < 3 * last; ++i)
+                radius = std::max(radius, glm::length(GetVertex(m_Indices[i]).position - meshlet.center));
+            meshlet.radius = radius * 1.0001f + 1e-6f;
+            std::sort(blocks.begin(), blocks.end());
+            blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+            meshlet.firstBlock = (unsigned int)m_MeshletBlocks.size();
+            meshlet.blockCount = (unsigned int)blocks.size();
+            m_MeshletBlocks.insert(m_MeshletBlocks.end(), blocks.begin(), blocks.end());
+
+            // Cone around the unit normals, counter-clockwise winding. Degenerate triangles
+            // draw nothing and are left out.
+            glm::vec3 normals[MESHLET_TRIANGLES];
+            glm::vec3 axis(0.0f);
+            unsigned int count = 0;
+            for (unsigned int t = first; t < last; ++t)
             {
-                fscanf(file, "%s\n", &txpath);
-                m_Materials.back().textures.push_back(MaterialTexture());
-                m_Materials.back().textures.back().loadTexture(
-                    txpath, TEXTURE_TYPE::AMBIENT, m_Materials.size() - 1);
+                glm::vec3 a = GetVertex(m_Indices[3 * t]).position, b = GetVertex(m_Indices[3 * t + 1]).position,
+                    c = GetVertex(m_Indices[3 * t + 2]).position;
+                glm::vec3 n = glm::cross(b - a, c - a);
+                float length = glm::length(n);
+                if (length > 0.0f)
+                {
+                    normals[count] = n / length;
+                    axis += normals[count++];
+                }
             }
-            else if (strcmp(buf, "map_Ke") == 0)
+            float axisLength = glm::length(axis);
+            meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+            float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+            for (unsigned int i = 0; i < count; ++i)
+                minDot = std::min(minDot, glm::dot(normals[i], meshlet.coneAxis));
+            meshlet.coneSine = minDot <= 0.0f ? 1.0f : std::min(1.0f, std::sqrt(1.0f - minDot * minDot) + 1e-4f);
+        }
+    }
+
+    bool Model::CullMeshlets(const glm::mat4& MVP, bool cullFace, bool frontFaceCCW)
+    {
+        m_CulledMeshlets = m_BackfacingMeshlets = 0;
+        unsigned int meshletCount = (unsigned int)m_Meshlets.size();
+        if (!meshletCulling || meshletCount == 0 ||
+            meshletCount != (TriangleCount() + MESHLET_TRIANGLES - 1) / MESHLET_TRIANGLES)
+            return false;
+
+        // The view volume planes in object space, inside where plane . (p, 1) >= 0, scaled
+        // to give distances.
+        glm::vec4 rows[4];
+        for (int r = 0; r < 4; ++r)
+            rows[r] = glm::vec4(MVP[0][r], MVP[1][r], MVP[2][r], MVP[3][r]);
+        glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1],
+            rows[3] + rows[2], rows[3] - rows[2] };
+        for (glm::vec4& plane : planes)
+        {
+            float length = glm::length(glm::vec3(plane));
+            plane = length > 0.0f ? plane / length : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+
+        // A triangle's winding on screen has the sign of dot(n, F + g * p), with n its
+        // counter-clockwise normal and p any point on it, where g and F come from the 3x3
+        // minors of the x, y and w rows of MVP. Triangle::isCCW() is true for the negative
+        // sign, and Draw() culls triangles whose isCCW() differs from frontFaceCCW.
+        auto minor = [&rows](int a, int b, int c)
+        {
+            glm::vec3 u(rows[0][a], rows[1][a], rows[3][a]), v(rows[0][b], rows[1][b], rows[3][b]),
+                t(rows[0][c], rows[1][c], rows[3][c]);
+            return glm::dot(u, glm::cross(v, t));
+        };
+        float g = minor(0, 1, 2);
+        glm::vec3 F(minor(1, 2, 3), -minor(0, 2, 3), minor(0, 1, 3));
+        float facing = frontFaceCCW ? 1.0f : -1.0f;
+
+        m_MeshletVisible.assign(meshletCount, 0);
+#pragma omp parallel for
+        for (int m = 0; m < (int)meshletCount; ++m)
+        {
+            const Meshlet& meshlet = m_Meshlets[m];
+            bool outside = false;
+            for (int p = 0; p < 6 && !outside; ++p)
+                outside = glm::dot(glm::vec3(planes[p]), meshlet.center) + planes[p].w < -meshlet.radius;
+            if (outside)
+                continue;
+
+            // Every triangle is culled if F + g * p, over the sphere, stays within 90 degrees
+            // minus the cone's half angle of the cone axis, on the culled side.
+            if (cullFace && meshlet.coneSine < 1.0f)
             {
-                fscanf(file, "%s\n", &txpath);
-                m_Materials.back().textures.push_back(MaterialTexture());
-                m_Materials.back().textures.back().loadTexture(
-                    txpath, TEXTURE_TYPE::EMISSIVE, m_Materials.size() - 1);
+                glm::vec3 d = (F + g * meshlet.center) * facing;
+                float spread = std::abs(g) * meshlet.radius;
+                if (glm::dot(d, meshlet.coneAxis) - spread > meshlet.coneSine * (glm::length(d) + spread))
+                {
+                    m_MeshletVisible[m] = 2;
+                    continue;
+                }
             }
-            else if (strcmp(buf, "map_Kn") == 0)
+            m_MeshletVisible[m] = 1;
+        }
+
+        m_BlockVisible.assign((VertexCount() + 7) / 8, 0);
+        for (unsigned int m = 0; m < meshletCount; ++m)
+        {
+            if (m_MeshletVisible[m] != 1)
             {
-                fscanf(file, "%s\n", &txpath);
-                m_Materials.back().textures.push_back(MaterialTexture());
-                m_Materials.back().textures.back().loadTexture(
-                    txpath, TEXTURE_TYPE::NORMALS, m_Materials.size() - 1);
+                m_CulledMeshlets++;
+                m_BackfacingMeshlets += m_MeshletVisible[m] == 2;
+                m_MeshletVisible[m] = 0;
+                continue;
             }
-            else if (strcmp(buf, "map_Ns") == 0)
+            const Meshlet& meshlet = m_Meshlets[m];
+            for (unsigned int b = 0; b < meshlet.blockCount; ++b)
+                m_BlockVisible[m_MeshletBlocks[meshlet.firstBlock + b]] = 1;
+        }
+        return true;
+    }
+
+    void Model::ResizeVertexCache()
+    {
+        size_t padded = (VertexCount() + 7) & ~size_t(7);
+        m_ClipX.resize(padded);
+        m_ClipY.resize(padded);
+        m_ClipZ.resize(padded);
+        m_ClipW.resize(padded);
+    }
+
+    void Model::TransformVertices(const glm::mat4& MVP, const unsigned char* blocks)
+    {
+        ResizeVertexCache();
+        size_t padded = m_ClipX.size();
+
+        // Quantized positions are decoded by the transform itself: offset + q * scale is
+        // folded into the matrix, which then takes the 16-bit values as they are.
+        const bool quantized = m_VertexFormat == VERTEX_FORMAT::QUANTIZED;
+        glm::mat4 M = MVP;
+        if (quantized)
+            M = glm::scale(glm::translate(MVP, m_Quantization.positionOffset), m_Quantization.positionScale);
+
+        // Sums are grouped the way glm groups mat4 * vec4, (c0*x + c1*y) + (c2*z + c3).
+        float8 m[4][4];
+        for (int r = 0; r < 4; ++r)
+            for (int c = 0; c < 4; ++c)
+                m[r][c] = set1(M[c][r]);
+
+        // Eight vertices per iteration.
+#pragma omp parallel for
+        for (int i = 0; i < (int)padded; i += 8)
+        {
+            if (blocks && !blocks[i / 8])
+                continue;
+            float8 x, y, z;
+            if (quantized)
             {
-                fscanf(file, "%s\n", &txpath);
-                m_Materials.back().textures.push_back(MaterialTexture());
-                m_Materials.back().textures.back().loadTexture(
-                    txpath, TEXTURE_TYPE::SHININESS, m_Materials.size() - 1);
+                x = load8u16(&m_PackedX[i]);
+                y = load8u16(&m_PackedY[i]);
+                z = load8u16(&m_PackedZ[i]);
             }
-            else if (strcmp(buf, "map_d") == 0)
+            else
             {
-                fscanf(file, "%s\n", &txpath);
-                m_Materials.back().textures.push_back(MaterialTexture());
-                m_Materials.back().textures.back().loadTexture(
-                    txpath, TEXTURE_TYPE::OPACITY, m_Materials.size() - 1);
+                x = load8(&m_PositionX[i]);
+                y = load8(&m_PositionY[i]);
+                z = load8(&m_PositionZ[i]);
             }
-            else if (strcmp(buf, "map_disp") == 0)
+            float8 cx = (m[0][0] * x + m[0][1] * y) + (m[0][2] * z + m[0][3]);
+            float8 cy = (m[1][0] * x + m[1][1] * y) + (m[1][2] * z + m[1][3]);
+            float8 cz = (m[2][0] * x + m[2][1] * y) + (m[2][2] * z + m[2][3]);
+            float8 cw = (m[3][0] * x + m[3][1] * y) + (m[3][2] * z + m[3][3]);
+            store8(&m_ClipX[i], cx);
+            store8(&m_ClipY[i], cy);
+            store8(&m_ClipZ[i], cz);
+            store8(&m_ClipW[i], cw);
+        }
+    }
+
+    void Model::ProjectVertices(int w, int h, const unsigned char* blocks)
+    {
+        size_t padded = m_ClipX.size();
+        m_ScreenX.resize(padded);
+        m_ScreenY.resize(padded);
+        m_ScreenZ.resize(padded);
+        m_ClipCodes.resize(padded);
+
+        const float8 one = set1(1.0f), half = set1(0.5f), zero = set1(0.0f);
+        const float8 halfW = set1(0.5f * w), halfH = set1(0.5f * h);
+        float guardX, guardY;
+        guardBandScale(w, h, guardX, guardY);
+
+        // Eight vertices per iteration: compute the outcode, divide by w and map x and y to
+        // pixels and z to [0, 1] window depth. Vertices that need clipping get meaningless
+        // screen positions, which are never used.
+#pragma omp parallel for
+        for (int i = 0; i < (int)padded; i += 8)
+        {
+            if (blocks && !blocks[i / 8])
+                continue;
+            float8 cx = load8(&m_ClipX[i]);
+            float8 cy = load8(&m_ClipY[i]);
+            float8 cz = load8(&m_ClipZ[i]);
+            float8 cw = load8(&m_ClipW[i]);
+
+            // One bit per lane per plane, in outcode bit order.
+            float8 minusW = zero - cw;
+            int planes[10] =
             {
-                fscanf(file, "%s\n", &txpath);
-                m_Materials.back().textures.push_back(MaterialTexture());
-                m_Materials.back().textures.back().loadTexture(
-                    txpath, TEXTURE_TYPE::DISPLACEMENT, m_Materials.size() - 1);
-            }
-            else if (strcmp(buf, "refl") == 0)
+                movemask(cmplt(cx, minusW)), movemask(cmpgt(cx, cw)),
+                movemask(cmplt(cy, minusW)), movemask(cmpgt(cy, cw)),
+                movemask(cmplt(cz, minusW)), movemask(cmpgt(cz, cw)),
+                movemask(cmplt(cx, minusW * guardX)), movemask(cmpgt(cx, cw * guardX)),
+                movemask(cmplt(cy, minusW * guardY)), movemask(cmpgt(cy, cw * guardY))
+            };
+            for (int k = 0; k < 8; ++k)
             {
-                fscanf(file, "%s\n", &txpath);
-                m_Materials.back().textures.push_back(MaterialTexture());
-                m_Materials.back().textures.back().loadTexture(
-                    txpath, TEXTURE_TYPE::REFLECTION, m_Materials.size() - 1);
+                unsigned short code = 0;
+                for (int p = 0; p < 10; ++p)
+                    code |= ((planes[p] >> k) & 1) << p;
+                m_ClipCodes[i + k] = code;
             }
+
+            float8 invW = one / cw;
+            store8(&m_ScreenX[i], (cx * invW + one) * halfW);
+            store8(&m_ScreenY[i], (cy * invW + one) * halfH);
+            store8(&m_ScreenZ[i], (cz * invW) * half + half);
         }
     }
 }
\ No newline at end of file
@@ -1,29 +1,277 @@
 #pragma once
 #include "Triangle.h"
 #include "Material.h"
+#include "TileBinner.h"
+#include "SIMD.h"
+#include "ObjParser.h"
+#include "PackedVertex.h"
 #include <vector>
+#include <unordered_map>
+#include <memory>
 #include <string>
 
 namespace SoftwareRasterizer
 {
+    /**
+    *  \brief An edge of one or more triangles of a mesh: its two vertex indices and the
+    *         material of the first triangle found with it, which gives the edge its color.
+    */
+    struct MeshEdge
+    {
+        unsigned int v[2];
+        unsigned int material;
+    };
+
+    // Triangles per meshlet; the last meshlet of a model may have fewer.
+    const unsigned int MESHLET_TRIANGLES = 64;
+
+    /**
+    *  \brief A run of consecutive triangles culled as a whole before any of its vertices are
+    *         transformed: a sphere around its triangles, a cone around their normals (axis
+    *         and the sine of its half angle, 1 if the triangles face too many ways to be
+    *         culled together), and the 8-vertex blocks of the position streams it uses, at
+    *         firstBlock in Model::m_MeshletBlocks. All in object space.
+    */
+    struct Meshlet
+    {
+        glm::vec3 center;
+        float radius;
+        glm::vec3 coneAxis;
+        float coneSine;
+        unsigned int firstBlock, blockCount;
+    };
+
+    // Position, texcoord and normal indices of one OBJ face corner.
+    struct VertexKey
+    {
+        unsigned int v, t, n;
+        bool operator==(const VertexKey& o) const { return v == o.v && t == o.t && n == o.n; }
+    };
+
+    struct VertexKeyHash
+    {
+        size_t operator()(const VertexKey& k) const
+        {
+            size_t h = k.v;
+            h = h * 0x9E3779B1u + k.t;
+            h = h * 0x9E3779B1u + k.n;
+            return h;
+        }
+    };
+
+    // Unique vertex of each distinct corner seen so far while building a model from faces.
+    typedef std::unordered_map<VertexKey, unsigned int, VertexKeyHash> VertexLookup;
+
 	class Model
 	{
 	public:
         glm::vec3 position, rotation;
         float scale;
-        std::vector<Triangle> m_Triangles;
-        std::vector<Material> m_Materials;  
+        // Whether Draw() culls whole meshlets against the view volume and, with face culling,
+        // by facing, before transforming their vertices.
+        bool meshletCulling;
+        // Unique vertices and three indices into them per triangle, plus each triangle's
+        // material. m_Vertices is empty while the vertex format is QUANTIZED.
+        std::vector<Vertex> m_Vertices;
+        std::vector<unsigned int> m_Indices;
+        std::vector<unsigned int> m_TriangleMaterials;
+        // Every edge of the triangles once, and for each triangle the indices of its three
+        // edges (~0u where two corners share a position). Vertices at the same position count
+        // as one, so seams in texture coordinates or normals do not split edges.
+        std::vector<MeshEdge> m_Edges;
+        std::vector<unsigned int> m_TriangleEdges;
+        // The triangles in runs of MESHLET_TRIANGLES, and the position stream blocks each
+        // run uses. Empty while the model is loading.
+        std::vector<Meshlet> m_Meshlets;
+        std::vector<unsigned int> m_MeshletBlocks;
+
+        // Vertex positions again as separate x, y and z streams, zero-padded to a multiple of
+        // 8 entries so the transform kernel never needs a scalar tail.
+        AlignedVector<float> m_PositionX, m_PositionY, m_PositionZ;
+        // The vertices again when quantized: 16-bit position streams padded the same way,
+        // the other attributes, and what the quantized values stand for.
+        AlignedVector<uint16_t> m_PackedX, m_PackedY, m_PackedZ;
+        std::vector<PackedVertex> m_PackedVertices;
+        VertexQuantization m_Quantization;
+        // Materials of the model's .mtl file, shared with every model using the same file.
+        std::shared_ptr<const MaterialSet> m_Materials;
         glm::vec3 bounds[2];//bounds[0] = minima, bounds[1] = maxima.
 
-        Model(std::string filename);
-        void Draw(cv::Mat& img, cv::Mat& imgZ, glm::mat4 P, glm::mat4 V,
-            int w, int h, int frameCount, bool wireframeOn, bool cullFace, 
-            bool frontFaceCCW, bool depthTest, unsigned int& trianglesRendered);
+        /*!
+        *  \brief An empty model, to be filled by a ModelLoader.
+        */
+        Model();
+
+        /*!
+        *  \brief Loads an .OBJ file and the .mtl file of the same name. With useCache the
+        *         processed mesh is read from, or else written to, its .srmesh cache (see
+        *         MeshCache.h).
+        */
+        Model(std::string filename, bool useCache = true);
+        /*!
+        *  \brief Transforms the model's vertices to clip space once each, then assembles,
+        *         clips, culls and queues the triangles in the binner. Nothing is rasterized
+        *         until the binner is flushed. Queued triangles are tagged with modelID and
+        *         their index in m_Indices / 3.
+        */
+        void Draw(TileBinner& binner, glm::mat4 P, glm::mat4 V,
+            int w, int h, int frameCount, bool cullFace, bool frontFaceCCW,
+            unsigned int modelID, unsigned int& trianglesRendered);
+
+        /*!
+        *  \brief Same as Draw() above, with positions and varyings computed by a vertex shader
+        *         (see Shader.h) instead of the fixed transform. The binner must have been reset
+        *         for VertexShader::VARYINGS varyings.
+        */
+        template <class VertexShader>
+        void Draw(TileBinner& binner, const VertexShader& shader, int w, int h, bool cullFace,
+            bool frontFaceCCW, unsigned int modelID, unsigned int& trianglesRendered)
+        {
+            const int varyingCount = VertexShader::VARYINGS;
+            bool culled = CullMeshlets(shader.MVP, cullFace, frontFaceCCW);
+            const unsigned char* blocks = culled ? m_BlockVisible.data() : nullptr;
+            ResizeVertexCache();
+            m_VertexVaryings.resize(VertexCount() * varyingCount);
+            const bool quantized = m_VertexFormat == VERTEX_FORMAT::QUANTIZED;
+#pragma omp parallel for
+            for (int i = 0; i < (int)VertexCount(); ++i)
+            {
+                if (blocks && !blocks[i / 8])
+                    continue;
+                float* varyings = m_VertexVaryings.data() + size_t(i) * varyingCount;
+                glm::vec4 c = quantized ? shader.Shade(GetVertex(i), varyings) : shader.Shade(m_Vertices[i], varyings);
+                m_ClipX[i] = c.x;
+                m_ClipY[i] = c.y;
+                m_ClipZ[i] = c.z;
+                m_ClipW[i] = c.w;
+            }
+            ProjectVertices(w, h, blocks);
+            AssembleTriangles(binner, w, h, cullFace, frontFaceCCW, modelID, varyingCount, trianglesRendered,
+                culled ? m_MeshletVisible.data() : nullptr);
+        }
+
+        /*!
+        *  \brief Wireframe counterpart of Draw(): transforms the vertices the same way, then
+        *         clips each unique edge and queues it in the binner as a line, so edges shared
+        *         by two triangles are drawn once. With face culling an edge is kept if either
+        *         of its triangles faces the camera.
+        */
+        void DrawEdges(TileBinner& binner, glm::mat4 P, glm::mat4 V,
+            int w, int h, int frameCount, bool cullFace, bool frontFaceCCW,
+            unsigned int modelID, unsigned int& edgesRendered);
+
+        /*!
+        *  \brief Object to world transform at the given frame, including the model's spin.
+        */
+        glm::mat4 ModelMatrix(int frameCount) const;
+
+        /*!
+        *  \brief The .mtl file that goes with an .OBJ file: the same name, .obj replaced.
+        */
+        static std::string MaterialFile(const std::string& filename);
+
+        /*!
+        *  \brief Switches the model to storing its vertices as FLOAT Vertex structs or in the
+        *         QUANTIZED encoding of PackedVertex.h, which takes a quarter of the memory and
+        *         is decoded by the vertex stage as it transforms. Positions are quantized
+        *         within bounds and texture coordinates within their range, to 16 bits each.
+        *         Going back to FLOAT decodes the quantized values. Only for models that have
+        *         finished loading; the mesh cache and loaders work with FLOAT vertices.
+        */
+        void SetVertexFormat(VERTEX_FORMAT format);
+        VERTEX_FORMAT VertexFormat() const { return m_VertexFormat; }
+
+        /*!
+        *  \brief Vertex i, decoded if the model is quantized.
+        */
+        Vertex GetVertex(unsigned int i) const;
+
+        size_t VertexCount() const { return m_VertexFormat == VERTEX_FORMAT::QUANTIZED ? m_PackedVertices.size() : m_Vertices.size(); }
+        unsigned int TriangleCount() const { return (unsigned int)m_Indices.size() / 3; }
+        unsigned int EdgeCount() const { return (unsigned int)m_Edges.size(); }
+        /*!
+        *  \brief Cuts the triangles into meshlets and bounds them. Done on loading; call it
+        *         again after changing m_Indices or the positions directly.
+        */
+        void BuildMeshlets();
+        // Meshlets the last Draw() culled, and how many it culled by facing.
+        unsigned int CulledMeshlets() const { return m_CulledMeshlets; }
+        unsigned int BackfacingMeshlets() const { return m_BackfacingMeshlets; }
 
     private:
-        std::vector<std::string> m_MaterialNames;
-        void LoadTriangles(std::string  filename);
-        void LoadMaterials(std::string  filename);
+        friend class ModelLoader;
+
+        VERTEX_FORMAT m_VertexFormat;
+
+        // Post-transform cache in the same layout: clip-space position, its clip outcode, and
+        // pixel coordinates with [0, 1] window depth after the divide by w.
+        AlignedVector<float> m_ClipX, m_ClipY, m_ClipZ, m_ClipW;
+        AlignedVector<float> m_ScreenX, m_ScreenY, m_ScreenZ;
+        std::vector<unsigned short> m_ClipCodes;
+
+        // Vertex shader outputs, VertexShader::VARYINGS floats per unique vertex.
+        std::vector<float> m_VertexVaryings;
+
+        // Per-meshlet flag for meshlets that survived culling, a flag per block of 8 vertices
+        // such meshlets use, and counts of what was culled.
+        std::vector<unsigned char> m_MeshletVisible;
+        std::vector<unsigned char> m_BlockVisible;
+        unsigned int m_CulledMeshlets, m_BackfacingMeshlets;
+
+        // Per-triangle flag set by the parallel assembly pass for triangles that need clipping.
+        std::vector<unsigned char> m_NeedsClipping;
+
+        // Per-triangle flag set when drawing edges with face culling, for triangles that face
+        // the camera or cross the near plane, and per-edge flag for edges of such triangles.
+        std::vector<unsigned char> m_FrontFacing;
+        std::vector<unsigned char> m_EdgeVisible;
+
+        void BuildPositionStreams(size_t first = 0);
+
+        /*!
+        *  \brief Reorders the triangles for vertex reuse and less overdraw (see
+        *         MeshOptimizer.h), then the vertices in the order the triangles first use
+        *         them. Comes before BuildEdges(), as it changes the indices.
+        */
+        void OptimizeTriangleOrder();
+        void VertexAttributes(unsigned int i, glm::vec3& texcoord, glm::vec3& normal) const;
+
+        /*!
+        *  \brief Material i of the model's set, or a default one for faces that have none:
+        *         those before any usemtl or naming a material the .mtl file does not have.
+        */
+        const Material& GetMaterial(unsigned int i) const;
+        void BuildEdges();
+        void ResizeVertexCache();
+
+        /*!
+        *  \brief Finds the meshlets that may have triangles in the view volume and, with face
+        *         culling, triangles facing the camera, and the vertex blocks they use, into
+        *         m_MeshletVisible and m_BlockVisible. The tests are conservative, so nothing
+        *         that would be drawn is culled.
+        *
+        * \return False, culling nothing, if meshlet culling is off or the model has no
+        *         meshlets yet.
+        */
+        bool CullMeshlets(const glm::mat4& MVP, bool cullFace, bool frontFaceCCW);
+
+        // Transform and project only blocks of 8 vertices flagged in blocks, or all if null,
+        // and assemble only the triangles of meshlets flagged in meshlets, or all if null.
+        void TransformVertices(const glm::mat4& MVP, const unsigned char* blocks = nullptr);
+        void ProjectVertices(int w, int h, const unsigned char* blocks = nullptr);
+        void AssembleTriangles(TileBinner& binner, int w, int h, bool cullFace, bool frontFaceCCW,
+            unsigned int modelID, int varyingCount, unsigned int& trianglesRendered,
+            const unsigned char* meshlets = nullptr);
+
+        void LoadTriangles(std::string  filename, bool useCache);
+        void LoadObj(const std::string& filename);
+
+        /*!
+        *  \brief Adds the faces of obj as triangles, with their corners' vertices looked up in
+        *         or added to vertexLookup. materialIndex is the material in effect, which obj's
+        *         usemtl statements change.
+        */
+        void AddObjFaces(const ObjData& obj, VertexLookup& vertexLookup, unsigned int& materialIndex);
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "ModelLoader.h"
+#include "AssetCache.h"
+#include "MeshCache.h"
+#include "ObjParser.h"
+#include "ThreadPool.h"
+
+namespace SoftwareRasterizer
+{
+    ModelLoader::ModelLoader(const std::string& filename, bool useCache, size_t chunkBytes)
+        : filename(filename), useCache(useCache), chunkBytes(chunkBytes), cancelled(false), progress(0.0f),
+        done(false), finished(false)
+    {
+        ThreadPool::Loading().Submit([this]() {
+            Run();
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+            finishedChanged.notify_all();
+        });
+    }
+
+    ModelLoader::~ModelLoader()
+    {
+        cancelled = true;
+        std::unique_lock<std::mutex> lock(mutex);
+        finishedChanged.wait(lock, [this]() { return finished; });
+    }
+
+    void ModelLoader::Publish(Batch& batch)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batches.push_back(std::move(batch));
+    }
+
+    void ModelLoader::PublishGeometry(const Model& staging, size_t& vertices, size_t& indices, bool replace)
+    {
+        Batch batch;
+        batch.replace = replace;
+        batch.vertices.assign(staging.m_Vertices.begin() + vertices, staging.m_Vertices.end());
+        batch.indices.assign(staging.m_Indices.begin() + indices, staging.m_Indices.end());
+        batch.triangleMaterials.assign(staging.m_TriangleMaterials.begin() + indices / 3, staging.m_TriangleMaterials.end());
+        batch.bounds[0] = staging.bounds[0];
+        batch.bounds[1] = staging.bounds[1];
+        vertices = staging.m_Vertices.size();
+        indices = staging.m_Indices.size();
+        Publish(batch);
+    }
+
+    void ModelLoader::Run()
+    {
+        if (cancelled)
+            return;
+        try
+        {
+            // Materials with texture previews go first, so that geometry can be drawn.
+            std::string mtlFile = Model::MaterialFile(filename);
+            std::shared_ptr<MaterialSet> preview = std::make_shared<MaterialSet>();
+            preview->Load(mtlFile, true);
+            Batch materials;
+            materials.materials = preview;
+            Publish(materials);
+
+            // The loading thread builds its own copy of the model, for the edges and the
+            // cache at the end, and hands over what each chunk added.
+            Model staging;
+            staging.m_Materials = preview;
+            size_t vertices = 0, indices = 0;
+            std::string cacheFile = meshCachePath(filename);
+            if (useCache && readMeshCache(cacheFile, filename, staging))
+                PublishGeometry(staging, vertices, indices);
+            else
+            {
+                ObjReader reader;
+                if (!reader.Open(filename))
+                    throw std::exception("Failed to open .OBJ file!");
+                ObjData obj;
+                VertexLookup vertexLookup;
+                unsigned int materialIndex = -1;
+                while (!cancelled && reader.Next(obj, chunkBytes))
+                {
+                    staging.AddObjFaces(obj, vertexLookup, materialIndex);
+                    PublishGeometry(staging, vertices, indices);
+                    progress = reader.Progress();
+                }
+                if (cancelled)
+                    return;
+
+                // The whole mesh is reordered once it is all there, and replaces the
+                // pieces handed over so far.
+                staging.OptimizeTriangleOrder();
+                vertices = indices = 0;
+                PublishGeometry(staging, vertices, indices, true);
+                staging.BuildEdges();
+                if (useCache)
+                    writeMeshCache(cacheFile, filename, staging);
+            }
+            staging.BuildMeshlets();
+            progress = 1.0f;
+
+            Batch edges;
+            edges.edges = staging.m_Edges;
+            edges.triangleEdges = staging.m_TriangleEdges;
+            edges.meshlets = staging.m_Meshlets;
+            edges.meshletBlocks = staging.m_MeshletBlocks;
+            Publish(edges);
+
+            // Then the full textures, through the asset cache like any model's.
+            Batch last;
+            if (!cancelled)
+                last.materials = AssetCache::Instance().LoadMaterials(mtlFile);
+            last.last = true;
+            Publish(last);
+        }
+        catch (const std::exception& e)
+        {
+            Batch failed;
+            failed.last = true;
+            failed.error = e.what();
+            Publish(failed);
+        }
+    }
+
+    bool ModelLoader::Update(Model& model)
+    {
+        std::deque<Batch> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.swap(batches);
+        }
+        for (Batch& batch : ready)
+        {
+            if (batch.materials)
+                model.m_Materials = batch.materials;
+            if (batch.replace)
+            {
+                model.m_Vertices.clear();
+                model.m_Indices.clear();
+                model.m_TriangleMaterials.clear();
+            }
+            if (!batch.vertices.empty() || !batch.indices.empty())
+            {
+                size_t first = model.m_Vertices.size();
+                model.m_Vertices.insert(model.m_Vertices.end(), batch.vertices.begin(), batch.vertices.end());
+                model.m_Indices.insert(model.m_Indices.end(), batch.indices.begin(), batch.indices.end());
+                model.m_TriangleMaterials.insert(model.m_TriangleMaterials.end(), batch.triangleMaterials.begin(),
+                    batch.triangleMaterials.end());
+                model.bounds[0] = batch.bounds[0];
+                model.bounds[1] = batch.bounds[1];
+                model.BuildPositionStreams(first);
+            }
+            if (!batch.triangleEdges.empty())
+            {
+                model.m_Edges = std::move(batch.edges);
+                model.m_TriangleEdges = std::move(batch.triangleEdges);
+            }
+            if (!batch.meshlets.empty())
+            {
+                model.m_Meshlets = std::move(batch.meshlets);
+                model.m_MeshletBlocks = std::move(batch.meshletBlocks);
+            }
+            if (batch.last)
+            {
+                done = true;
+                error = batch.error;
+            }
+        }
+        return done;
+    }
+}
@@ -0,0 +1,98 @@
+/*
+*	ModelLoader.h -- loads a model on the loading thread pool while the scene goes on drawing.
+*					 Geometry is handed over a piece at a time as the .OBJ file is parsed, so a
+*					 model appears at once and fills in as it loads. Materials come first with
+*					 low-resolution texture previews and are replaced once the full textures
+*					 are decoded.
+*/
+
+#pragma once
+#include "Model.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+namespace SoftwareRasterizer
+{
+    class ModelLoader
+    {
+    public:
+        // .OBJ bytes parsed between hand-overs by default.
+        static const size_t DEFAULT_CHUNK_BYTES = 4 << 20;
+
+        /*!
+        *  \brief Queues filename for loading on ThreadPool::Loading(), through its .srmesh
+        *         cache with useCache (see Model). Geometry is handed over after every
+        *         chunkBytes of the .OBJ file.
+        */
+        ModelLoader(const std::string& filename, bool useCache = true, size_t chunkBytes = DEFAULT_CHUNK_BYTES);
+
+        /*!
+        *  \brief Stops loading, waiting for the loading task to notice.
+        */
+        ~ModelLoader();
+
+        ModelLoader(const ModelLoader&) = delete;
+        ModelLoader& operator=(const ModelLoader&) = delete;
+
+        /*!
+        *  \brief Moves everything loaded since the last call into model, which must start out
+        *         empty and be the same model every time. Call it between frames from the
+        *         thread drawing model; nothing the model uses changes at any other time.
+        *
+        * \return True once the model is complete or loading failed.
+        */
+        bool Update(Model& model);
+
+        const std::string& Filename() const { return filename; }
+        bool Failed() const { return !error.empty(); }
+        // Why loading failed, once Update() has returned true.
+        const std::string& Error() const { return error; }
+        // Fraction of the .OBJ file parsed so far.
+        float Progress() const { return progress; }
+
+    private:
+        /**
+        *  \brief What the loading thread hands over in one go. Vertices, indices and triangle
+        *         materials are appended to the model's, or replace them if replace is set;
+        *         materials, edges and meshlets replace the model's when present.
+        */
+        struct Batch
+        {
+            std::vector<Vertex> vertices;
+            std::vector<unsigned int> indices;
+            std::vector<unsigned int> triangleMaterials;
+            glm::vec3 bounds[2];
+            std::shared_ptr<const MaterialSet> materials;
+            std::vector<MeshEdge> edges;
+            std::vector<unsigned int> triangleEdges;
+            std::vector<Meshlet> meshlets;
+            std::vector<unsigned int> meshletBlocks;
+            bool replace;
+            // Set on the last batch, with the error if loading failed.
+            bool last;
+            std::string error;
+
+            Batch() : replace(false), last(false) {}
+        };
+
+        void Run();
+        void Publish(Batch& batch);
+        void PublishGeometry(const Model& staging, size_t& vertices, size_t& indices, bool replace = false);
+
+        std::string filename;
+        bool useCache;
+        size_t chunkBytes;
+        std::mutex mutex;
+        std::deque<Batch> batches;
+        std::atomic<bool> cancelled;
+        std::atomic<float> progress;
+        bool done;
+        std::string error;
+        // Set, under mutex, once the loading task has returned.
+        bool finished;
+        std::condition_variable finishedChanged;
+    };
+}
@@ -0,0 +1,74 @@
+#include "Multisample.h"
+#include "SIMD.h"
+
+namespace SoftwareRasterizer
+{
+    static const float PATTERN_1[2] = { 0.0f, 0.0f };
+    static const float PATTERN_4[8] =
+    {
+        -2 / 16.0f, -6 / 16.0f, 6 / 16.0f, -2 / 16.0f, -6 / 16.0f, 2 / 16.0f, 2 / 16.0f, 6 / 16.0f
+    };
+    static const float PATTERN_8[16] =
+    {
+        1 / 16.0f, -3 / 16.0f, -1 / 16.0f, 3 / 16.0f, 5 / 16.0f, 1 / 16.0f, -3 / 16.0f, -5 / 16.0f,
+        -5 / 16.0f, 5 / 16.0f, -7 / 16.0f, -1 / 16.0f, 3 / 16.0f, 7 / 16.0f, 7 / 16.0f, -7 / 16.0f
+    };
+
+    const float* samplePattern(int samples)
+    {
+        if (samples == 8)
+            return PATTERN_8;
+        return samples == 4 ? PATTERN_4 : PATTERN_1;
+    }
+
+    MultisampleTarget::MultisampleTarget() : w(0), h(0), samples(0) {}
+
+    void MultisampleTarget::Create(int w, int h, int samples, DEPTH_FORMAT format, DEPTH_COMPARE compare,
+        bool reversedZ)
+    {
+        this->w = w;
+        this->h = h;
+        this->samples = samples;
+        color.create(h * samples, w, CV_32FC3);
+        depth.Create(w, h * samples, format, compare, reversedZ);
+    }
+
+    void MultisampleTarget::Resolve(cv::Mat& img, const cv::Rect& region) const
+    {
+        // A row of pixels is 3 * width interleaved floats, averaged eight at a time across
+        // the planes regardless of which channel each float is. Planes are summed pairwise,
+        // which is exact when all samples agree, so pixels inside a triangle resolve to the
+        // very color they were shaded with.
+        const float8 scale = set1(1.0f / samples);
+        int count = region.width * 3;
+        for (int y = region.y; y < region.y + region.height; ++y)
+        {
+            float* out = img.ptr<float>(y) + region.x * 3;
+            const float* in[MAX_SAMPLES];
+            for (int s = 0; s < samples; ++s)
+                in[s] = color.ptr<float>(s * h + y) + region.x * 3;
+
+            int i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                float8 sum[MAX_SAMPLES];
+                for (int s = 0; s < samples; ++s)
+                    sum[s] = loadu8(in[s] + i);
+                for (int n = samples / 2; n > 0; n /= 2)
+                    for (int s = 0; s < n; ++s)
+                        sum[s] = sum[s] + sum[s + n];
+                storeu8(out + i, sum[0] * scale);
+            }
+            for (; i < count; ++i)
+            {
+                float sum[MAX_SAMPLES];
+                for (int s = 0; s < samples; ++s)
+                    sum[s] = in[s][i];
+                for (int n = samples / 2; n > 0; n /= 2)
+                    for (int s = 0; s < n; ++s)
+                        sum[s] += sum[s + n];
+                out[i] = sum[0] * (1.0f / samples);
+            }
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/*
+*	Multisample.h -- multisample anti-aliasing targets. Coverage and depth are kept per sample,
+*					 at the standard 4x or 8x sample positions, while each triangle is shaded
+*					 once per pixel and its color copied to the samples it covers. Resolving
+*					 averages the samples of each pixel into an ordinary color image.
+*/
+
+#pragma once
+#include "DepthBuffer.h"
+#include <opencv2/opencv.hpp>
+
+namespace SoftwareRasterizer
+{
+    // Most samples per pixel a target can have.
+    const int MAX_SAMPLES = 8;
+
+    /*!
+    *  \brief Sample positions for 1, 4 or 8 samples per pixel: x, y pairs in pixels relative
+    *         to the pixel center. These are the usual Direct3D standard patterns, on a 1/16
+    *         pixel grid like snapped vertices.
+    */
+    const float* samplePattern(int samples);
+
+    /**
+    *  \brief Color and depth for every sample of a w x h image. Sample s of every pixel lives
+    *         in plane s: rows s * h to (s + 1) * h - 1 of both the color image and the depth
+    *         buffer, so a raster kernel reaches each plane with ordinary row addressing.
+    */
+    class MultisampleTarget
+    {
+    public:
+        MultisampleTarget();
+
+        /*!
+        *  \brief Allocates samples (4 or 8) planes, with depth in the given format and compare
+        *         mode. Contents are undefined until cleared.
+        */
+        void Create(int w, int h, int samples, DEPTH_FORMAT format, DEPTH_COMPARE compare = DEPTH_COMPARE::LESS,
+            bool reversedZ = false);
+
+        int Width() const { return w; }
+        int Height() const { return h; }
+        int Samples() const { return samples; }
+        bool Empty() const { return samples == 0; }
+
+        cv::Mat& Color() { return color; }
+        DepthBuffer& Depth() { return depth; }
+        const DepthBuffer& Depth() const { return depth; }
+
+        /*!
+        *  \brief A region of the image, moved to sample plane s.
+        */
+        cv::Rect SampleRect(int s, const cv::Rect& region) const { return cv::Rect(region.x, region.y + s * h, region.width, region.height); }
+
+        /*!
+        *  \brief Averages the samples of every pixel in region into img (CV_32FC3, w x h).
+        */
+        void Resolve(cv::Mat& img, const cv::Rect& region) const;
+
+    private:
+        int w, h, samples;
+        cv::Mat color;
+        DepthBuffer depth;
+    };
+}
@@ -0,0 +1,423 @@
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace SoftwareRasterizer
+{
+    // Smallest piece of a file worth a chunk of its own.
+    static const size_t MIN_CHUNK_BYTES = 1 << 16;
+
+    enum class OBJ_STATEMENT { POSITION, TEXCOORD, NORMAL, FACE, USEMTL, OTHER };
+
+    /**
+    *  \brief A line-aligned piece of the file, with its attribute line counts, where its
+    *         attributes start in the merged arrays, and its faces.
+    */
+    struct ObjChunk
+    {
+        const char* begin;
+        const char* end;
+        unsigned int positionCount, texcoordCount, normalCount;
+        unsigned int positionBase, texcoordBase, normalBase;
+        std::vector<ObjCorner> corners;
+        std::vector<unsigned int> faceSizes;
+        std::vector<ObjMaterialSwitch> materialSwitches;
+        glm::vec3 bounds[2];
+    };
+
+    static inline bool isBlank(char c) { return c == ' ' || c == '\t'; }
+    static inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    static inline const char* skipBlanks(const char* p, const char* end)
+    {
+        while (p < end && isBlank(*p))
+            ++p;
+        return p;
+    }
+
+    static inline const char* lineEnd(const char* p, const char* end)
+    {
+        const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        return newline ? newline : end;
+    }
+
+    // What the line starting at p (after blanks) says. Keywords must be followed by a blank.
+    static OBJ_STATEMENT statement(const char* p, const char* end)
+    {
+        size_t n = end - p;
+        if (n >= 2 && p[0] == 'v')
+        {
+            if (isBlank(p[1]))
+                return OBJ_STATEMENT::POSITION;
+            if (n >= 3 && isBlank(p[2]))
+            {
+                if (p[1] == 't')
+                    return OBJ_STATEMENT::TEXCOORD;
+                if (p[1] == 'n')
+                    return OBJ_STATEMENT::NORMAL;
+            }
+            return OBJ_STATEMENT::OTHER;
+        }
+        if (n >= 2 && p[0] == 'f' && isBlank(p[1]))
+            return OBJ_STATEMENT::FACE;
+        if (n >= 7 && memcmp(p, "usemtl", 6) == 0 && isBlank(p[6]))
+            return OBJ_STATEMENT::USEMTL;
+        return OBJ_STATEMENT::OTHER;
+    }
+
+    float parseObjFloat(const char*& p, const char* end)
+    {
+        static const double POWERS_OF_10[] =
+        {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        p = skipBlanks(p, end);
+        const char* start = p;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        // Up to 19 significant digits fit a 64-bit mantissa; later integer digits only scale
+        // it and later fraction digits are dropped.
+        uint64_t mantissa = 0;
+        int digits = 0, exponent = 0;
+        bool any = false;
+        for (; p < end && isDigit(*p); ++p)
+        {
+            any = true;
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+            }
+            else
+                exponent++;
+        }
+        if (p < end && *p == '.')
+        {
+            for (++p; p < end && isDigit(*p); ++p)
+            {
+                any = true;
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += mantissa != 0;
+                    exponent--;
+                }
+            }
+        }
+        if (!any)
+        {
+            p = start;
+            return 0.0f;
+        }
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char* q = p + 1;
+            bool negativeExponent = false;
+            if (q < end && (*q == '-' || *q == '+'))
+                negativeExponent = *q++ == '-';
+            if (q < end && isDigit(*q))
+            {
+                int e = 0;
+                for (; q < end && isDigit(*q); ++q)
+                    e = std::min(e * 10 + (*q - '0'), 100000);
+                exponent += negativeExponent ? -e : e;
+                p = q;
+            }
+        }
+
+        // A mantissa below 2^53 times or over an exact power of ten is correctly rounded in
+        // double, which then rounds to float. Anything else goes to the C library.
+        double value;
+        if (mantissa < (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+            value = exponent < 0 ? double(mantissa) / POWERS_OF_10[-exponent] : double(mantissa) * POWERS_OF_10[exponent];
+        else
+        {
+            char buffer[64];
+            size_t length = std::min(size_t(p - start), sizeof(buffer) - 1);
+            memcpy(buffer, start, length);
+            buffer[length] = 0;
+            return strtof(buffer, nullptr);
+        }
+        return float(negative ? -value : value);
+    }
+
+    // Parses a signed integer at p and moves p past it. False if there is none.
+    static inline bool parseIndex(const char*& p, const char* end, int& value)
+    {
+        const char* q = p;
+        bool negative = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negative = *q++ == '-';
+        if (q >= end || !isDigit(*q))
+            return false;
+        int64_t v = 0;
+        for (; q < end && isDigit(*q); ++q)
+            v = std::min<int64_t>(v * 10 + (*q - '0'), std::numeric_limits<int>::max());
+        value = int(negative ? -v : v);
+        p = q;
+        return true;
+    }
+
+    // 1-based index, or negative counting back from the last of count elements, to 0-based.
+    // The invalid index 0 becomes -1, like a missing one.
+    static inline int resolveIndex(int index, unsigned int count)
+    {
+        return index > 0 ? index - 1 : index < 0 ? int(count) + index : -1;
+    }
+
+    static void countChunk(ObjChunk& chunk)
+    {
+        chunk.positionCount = chunk.texcoordCount = chunk.normalCount = 0;
+        for (const char* p = chunk.begin; p < chunk.end; p = lineEnd(p, chunk.end) + 1)
+        {
+            p = skipBlanks(p, chunk.end);
+            if (p >= chunk.end || *p != 'v')
+                continue;
+            switch (statement(p, chunk.end))
+            {
+            case OBJ_STATEMENT::POSITION: chunk.positionCount++; break;
+            case OBJ_STATEMENT::TEXCOORD: chunk.texcoordCount++; break;
+            case OBJ_STATEMENT::NORMAL: chunk.normalCount++; break;
+            default: break;
+            }
+        }
+    }
+
+    static void parseChunk(ObjChunk& chunk, ObjData& out)
+    {
+        unsigned int positions = chunk.positionBase;
+        unsigned int texcoords = chunk.texcoordBase;
+        unsigned int normals = chunk.normalBase;
+        chunk.bounds[0] = glm::vec3(std::numeric_limits<float>::max());
+        chunk.bounds[1] = glm::vec3(-std::numeric_limits<float>::max());
+
+        for (const char* p = chunk.begin; p < chunk.end; )
+        {
+            const char* end = lineEnd(p, chunk.end);
+            p = skipBlanks(p, end);
+            OBJ_STATEMENT type = statement(p, end);
+            switch (type)
+            {
+            case OBJ_STATEMENT::POSITION:
+            {
+                const char* q = p + 1;
+                glm::vec3 v;
+                v.x = parseObjFloat(q, end);
+                v.y = parseObjFloat(q, end);
+                v.z = parseObjFloat(q, end);
+                out.positions[positions++] = v;
+                chunk.bounds[0] = glm::min(chunk.bounds[0], v);
+                chunk.bounds[1] = glm::max(chunk.bounds[1], v);
+                break;
+            }
+            case OBJ_STATEMENT::TEXCOORD:
+            {
+                const char* q = p + 2;
+                glm::vec2 uv;
+                uv.x = parseObjFloat(q, end);
+                uv.y = parseObjFloat(q, end);
+                out.texcoords[texcoords++] = uv;
+                break;
+            }
+            case OBJ_STATEMENT::NORMAL:
+            {
+                const char* q = p + 2;
+                glm::vec3 n;
+                n.x = parseObjFloat(q, end);
+                n.y = parseObjFloat(q, end);
+                n.z = parseObjFloat(q, end);
+                out.normals[normals++] = n;
+                break;
+            }
+            case OBJ_STATEMENT::FACE:
+            {
+                // Corners up to the end of the line or a comment. Relative indices count back
+                // from the attributes read so far.
+                unsigned int count = 0;
+                for (const char* q = p + 1; ; )
+                {
+                    q = skipBlanks(q, end);
+                    if (q >= end || *q == '#' || *q == '\r')
+                        break;
+                    ObjCorner corner = { -1, -1, -1 };
+                    int index;
+                    if (parseIndex(q, end, index))
+                    {
+                        corner.v = resolveIndex(index, positions);
+                        if (q < end && *q == '/')
+                        {
+                            ++q;
+                            if (parseIndex(q, end, index))
+                                corner.t = resolveIndex(index, texcoords);
+                            if (q < end && *q == '/')
+                            {
+                                ++q;
+                                if (parseIndex(q, end, index))
+                                    corner.n = resolveIndex(index, normals);
+                            }
+                        }
+                        chunk.corners.push_back(corner);
+                        count++;
+                    }
+                    while (q < end && !isBlank(*q) && *q != '\r')
+                        ++q;
+                }
+                if (count)
+                    chunk.faceSizes.push_back(count);
+                break;
+            }
+            case OBJ_STATEMENT::USEMTL:
+            {
+                const char* name = skipBlanks(p + 6, end);
+                const char* nameEnd = name;
+                while (nameEnd < end && !isBlank(*nameEnd) && *nameEnd != '\r')
+                    ++nameEnd;
+                ObjMaterialSwitch materialSwitch = { (unsigned int)chunk.faceSizes.size(), std::string(name, nameEnd) };
+                chunk.materialSwitches.push_back(materialSwitch);
+                break;
+            }
+            default:
+                break;
+            }
+            p = end + 1;
+        }
+    }
+
+    /*!
+    *  \brief Parses size bytes of whole lines at data. Vertex attributes are appended to
+    *         out's, and relative indices count back from the end of those; faces and material
+    *         switches replace out's. The bounds grow to include the new positions.
+    */
+    static void parseRange(const char* data, size_t size, ObjData& out)
+    {
+        // Split into chunks ending at line breaks, several per thread to even out the load.
+        int threads = 1;
+#ifdef _OPENMP
+        threads = omp_get_max_threads();
+#endif
+        size_t chunkCount = std::max<size_t>(1, std::min<size_t>(size / MIN_CHUNK_BYTES, size_t(threads) * 8));
+        std::vector<ObjChunk> chunks(chunkCount);
+        const char* begin = data;
+        for (size_t i = 0; i < chunkCount; ++i)
+        {
+            const char* end = data + size * (i + 1) / chunkCount;
+            if (end < begin)
+                end = begin;
+            if (i + 1 < chunkCount)
+                end = std::min(lineEnd(end, data + size) + 1, data + size);
+            chunks[i].begin = begin;
+            chunks[i].end = end;
+            begin = end;
+        }
+
+        // Count attribute lines, then give every chunk its place in the merged arrays.
+#pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < (int)chunkCount; ++i)
+            countChunk(chunks[i]);
+        unsigned int positions = (unsigned int)out.positions.size();
+        unsigned int texcoords = (unsigned int)out.texcoords.size();
+        unsigned int normals = (unsigned int)out.normals.size();
+        for (ObjChunk& chunk : chunks)
+        {
+            chunk.positionBase = positions;
+            chunk.texcoordBase = texcoords;
+            chunk.normalBase = normals;
+            positions += chunk.positionCount;
+            texcoords += chunk.texcoordCount;
+            normals += chunk.normalCount;
+        }
+        out.positions.resize(positions);
+        out.texcoords.resize(texcoords);
+        out.normals.resize(normals);
+
+#pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < (int)chunkCount; ++i)
+            parseChunk(chunks[i], out);
+
+        // Append the faces in file order.
+        size_t cornerCount = 0, faceCount = 0;
+        for (const ObjChunk& chunk : chunks)
+        {
+            cornerCount += chunk.corners.size();
+            faceCount += chunk.faceSizes.size();
+        }
+        out.corners.clear();
+        out.corners.reserve(cornerCount);
+        out.faceStarts.clear();
+        out.faceStarts.reserve(faceCount + 1);
+        out.materialSwitches.clear();
+        for (ObjChunk& chunk : chunks)
+        {
+            unsigned int firstFace = (unsigned int)out.faceStarts.size();
+            for (ObjMaterialSwitch& materialSwitch : chunk.materialSwitches)
+            {
+                materialSwitch.firstFace += firstFace;
+                out.materialSwitches.push_back(std::move(materialSwitch));
+            }
+            unsigned int start = (unsigned int)out.corners.size();
+            for (unsigned int size : chunk.faceSizes)
+            {
+                out.faceStarts.push_back(start);
+                start += size;
+            }
+            out.corners.insert(out.corners.end(), chunk.corners.begin(), chunk.corners.end());
+            out.bounds[0] = glm::min(out.bounds[0], chunk.bounds[0]);
+            out.bounds[1] = glm::max(out.bounds[1], chunk.bounds[1]);
+        }
+        out.faceStarts.push_back((unsigned int)out.corners.size());
+    }
+
+    static void resetObjData(ObjData& out)
+    {
+        out = ObjData();
+        out.bounds[0] = glm::vec3(std::numeric_limits<float>::max());
+        out.bounds[1] = glm::vec3(-std::numeric_limits<float>::max());
+    }
+
+    bool parseObj(const std::string& filename, ObjData& out)
+    {
+        MappedFile file;
+        if (!file.Open(filename))
+            return false;
+        resetObjData(out);
+        parseRange(file.Data(), file.Size(), out);
+        return true;
+    }
+
+    ObjReader::ObjReader() : offset(0) {}
+
+    bool ObjReader::Open(const std::string& filename)
+    {
+        offset = 0;
+        return file.Open(filename);
+    }
+
+    bool ObjReader::Next(ObjData& data, size_t chunkBytes)
+    {
+        if (offset == 0)
+            resetObjData(data);
+        if (offset >= file.Size())
+            return false;
+
+        // Up to the end of the line chunkBytes on, or of the file.
+        const char* begin = file.Data() + offset;
+        const char* end = file.Data() + file.Size();
+        if (chunkBytes < size_t(end - begin))
+            end = std::min(lineEnd(begin + chunkBytes, end) + 1, end);
+        parseRange(begin, end - begin, data);
+        offset = end - file.Data();
+        return true;
+    }
+}
@@ -0,0 +1,102 @@
+/*
+*	ObjParser.h -- Wavefront OBJ parsing. The file is memory mapped and split into chunks at
+*				   line breaks. One pass counts the vertex attribute lines of every chunk, so
+*				   each chunk knows where its attributes go in the merged arrays; a second pass
+*				   parses all chunks in parallel straight into those arrays, resolving relative
+*				   (negative) indices on the way. Faces of each chunk are gathered separately and
+*				   appended in file order at the end.
+*/
+
+#pragma once
+#include "MappedFile.h"
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+namespace SoftwareRasterizer
+{
+    /**
+    *  \brief One face corner: 0-based position, texture coordinate and normal indices, the
+    *         last two -1 if the corner has none. Indices are not range checked.
+    */
+    struct ObjCorner
+    {
+        int v, t, n;
+    };
+
+    /**
+    *  \brief A usemtl statement: the material named applies from face firstFace on.
+    */
+    struct ObjMaterialSwitch
+    {
+        unsigned int firstFace;
+        std::string name;
+    };
+
+    /**
+    *  \brief Everything of an OBJ file that models use. Face f has corners faceStarts[f] to
+    *         faceStarts[f + 1] - 1, so faceStarts has one entry more than there are faces.
+    *         bounds holds the minima and maxima of the positions.
+    */
+    struct ObjData
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texcoords;
+        std::vector<glm::vec3> normals;
+        std::vector<ObjCorner> corners;
+        std::vector<unsigned int> faceStarts;
+        std::vector<ObjMaterialSwitch> materialSwitches;
+        glm::vec3 bounds[2];
+
+        unsigned int FaceCount() const { return faceStarts.empty() ? 0 : (unsigned int)faceStarts.size() - 1; }
+    };
+
+    /*!
+    *  \brief Parses an OBJ file's v, vt, vn, f and usemtl statements; everything else is
+    *         skipped. Face lines may be any length, with corners written as v, v/t, v//n or
+    *         v/t/n.
+    *
+    * \return False if the file cannot be opened.
+    */
+    bool parseObj(const std::string& filename, ObjData& out);
+
+    /**
+    *  \brief Parses an OBJ file a piece at a time, for models that are drawn while they load.
+    *         OBJ faces only refer back to vertices already listed, so every piece is complete
+    *         on its own. Each piece is parsed in parallel like a whole file.
+    */
+    class ObjReader
+    {
+    public:
+        ObjReader();
+
+        /*!
+        *  \brief Maps the file. Returns false if it cannot be opened.
+        */
+        bool Open(const std::string& filename);
+
+        /*!
+        *  \brief Parses the lines up to the end of the one chunkBytes further on. Vertex
+        *         attributes are appended to data's, which the first call clears; faces and
+        *         material switches replace data's, so face and switch numbers count from the
+        *         start of the piece.
+        *
+        * \return False, leaving data as it was, once the whole file has been read.
+        */
+        bool Next(ObjData& data, size_t chunkBytes);
+
+        // Fraction of the file read so far.
+        float Progress() const { return file.Size() ? float(offset) / float(file.Size()) : 1.0f; }
+
+    private:
+        MappedFile file;
+        size_t offset;
+    };
+
+    /*!
+    *  \brief Parses a decimal floating point number at p, no further than end, and moves p
+    *         past it. Leading blanks are skipped. Returns 0 and leaves p after the blanks if
+    *         there is no number.
+    */
+    float parseObjFloat(const char*& p, const char* end);
+}
@@ -0,0 +1,115 @@
+/*
+*	PackedVertex.h -- compact vertex encoding. Positions are 16-bit fixed point within the
+*					  model's bounds, texture coordinates 16-bit fixed point within their own
+*					  range, and normals octahedral-encoded in two 16-bit snorms, so a vertex
+*					  takes 14 bytes instead of the 60 of a Vertex.
+*/
+
+#pragma once
+#include "Vertex.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+namespace SoftwareRasterizer
+{
+    enum class VERTEX_FORMAT { FLOAT, QUANTIZED };
+
+    /**
+    *  \brief Texture coordinates and normal of a quantized vertex. Its position is kept in
+    *         separate x, y and z streams, like float positions, for the transform kernel.
+    */
+    struct PackedVertex
+    {
+        uint16_t texcoord[2];
+        int16_t normal[2];
+    };
+
+    /**
+    *  \brief What quantized values stand for: a position is offset + q * scale, and likewise
+    *         for texture coordinates.
+    */
+    struct VertexQuantization
+    {
+        glm::vec3 positionOffset, positionScale;
+        glm::vec2 texcoordOffset, texcoordScale;
+
+        /*!
+        *  \brief Spreads 0 to 65535 over [min, max] in each dimension.
+        */
+        void Fit(const glm::vec3& positionMin, const glm::vec3& positionMax, const glm::vec2& texcoordMin,
+            const glm::vec2& texcoordMax)
+        {
+            positionOffset = positionMin;
+            positionScale = (positionMax - positionMin) / 65535.0f;
+            texcoordOffset = texcoordMin;
+            texcoordScale = (texcoordMax - texcoordMin) / 65535.0f;
+        }
+    };
+
+    // Nearest step of offset + q * scale to v.
+    inline uint16_t quantize(float v, float offset, float scale)
+    {
+        if (scale <= 0.0f)
+            return 0;
+        return (uint16_t)std::min(std::max(std::round((v - offset) / scale), 0.0f), 65535.0f);
+    }
+
+    inline int16_t quantizeSnorm(float v)
+    {
+        return (int16_t)std::round(std::min(std::max(v, -1.0f), 1.0f) * 32767.0f);
+    }
+
+    /*!
+    *  \brief Octahedral encoding: n is projected onto the octahedron |x| + |y| + |z| = 1,
+    *         whose lower half is folded over the upper, leaving x and y in [-1, 1].
+    */
+    inline void octEncode(const glm::vec3& n, int16_t out[2])
+    {
+        float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if (l1 == 0.0f)
+        {
+            out[0] = out[1] = 0;
+            return;
+        }
+        float x = n.x / l1, y = n.y / l1;
+        if (n.z < 0.0f)
+        {
+            float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = fx;
+            y = fy;
+        }
+        out[0] = quantizeSnorm(x);
+        out[1] = quantizeSnorm(y);
+    }
+
+    inline glm::vec3 octDecode(const int16_t in[2])
+    {
+        glm::vec3 n(in[0] / 32767.0f, in[1] / 32767.0f, 0.0f);
+        n.z = 1.0f - std::abs(n.x) - std::abs(n.y);
+        if (n.z < 0.0f)
+        {
+            float x = n.x;
+            n.x = (1.0f - std::abs(n.y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            n.y = (1.0f - std::abs(x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        float length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+        return length > 0.0f ? n / length : glm::vec3(0.0f);
+    }
+
+    inline PackedVertex packVertex(const Vertex& v, const VertexQuantization& q)
+    {
+        PackedVertex p;
+        p.texcoord[0] = quantize(v.texcoord.x, q.texcoordOffset.x, q.texcoordScale.x);
+        p.texcoord[1] = quantize(v.texcoord.y, q.texcoordOffset.y, q.texcoordScale.y);
+        octEncode(v.normal, p.normal);
+        return p;
+    }
+
+    inline glm::vec2 unpackTexcoord(const PackedVertex& p, const VertexQuantization& q)
+    {
+        return q.texcoordOffset + glm::vec2(p.texcoord[0], p.texcoord[1]) * q.texcoordScale;
+    }
+}
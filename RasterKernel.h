@@ -0,0 +1,652 @@
+/*
+*	RasterKernel.h -- the half-space block kernel as a template over a render state and an
+*					  output. Both are fixed at compile time for every valid combination, so the
+*					  pixel loops carry no flag checks or format and compare switches, and
+*					  whatever an output does per pixel row, including a fragment shader, is
+*					  inlined into them. A RasterKernel picks one instantiation per draw.
+*					  Multisampled drawing has its own traversal, which tests coverage and depth
+*					  per sample but has the output shade each pixel once.
+*/
+
+#pragma once
+#include "Rasterizer.h"
+#include "HiZBuffer.h"
+#include "Multisample.h"
+#include "SIMD.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+
+namespace SoftwareRasterizer
+{
+    struct Material;
+    class Texture;
+
+    /** \brief What a raster kernel writes besides depth. */
+    enum class RASTER_OUTPUT { COLOR, VISIBILITY, DEPTH_ONLY };
+
+    /**
+    *  \brief The state a raster kernel depends on. storedCompare is the depth buffer's test on
+    *         stored values and is ignored without depthTest. samples is 1, or 4 or 8 for
+    *         drawing into a MultisampleTarget's planes.
+    */
+    struct RasterState
+    {
+        RASTER_OUTPUT output;
+        bool wireframeOn;
+        bool depthTest;
+        DEPTH_FORMAT format;
+        DEPTH_COMPARE storedCompare;
+        int samples;
+    };
+
+    /**
+    *  \brief Per-triangle inputs of a raster kernel besides its setup. Each output uses only
+    *         its own: col for COLOR, id for VISIBILITY, and the rest for shaders. texture is
+    *         the material's diffuse map.
+    */
+    struct RasterPrimitive
+    {
+        const float* col;
+        unsigned int id;
+        const float* varyings;      // planes from setupVaryings()
+        const Material* material;
+        const Texture* texture;
+    };
+
+    /**
+    *  \brief A half-space raster kernel chosen once per draw. Every valid RasterState has its
+    *         own instantiation with the state fixed at compile time. The generic kernel reads
+    *         the same state at run time instead and is kept for comparison.
+    */
+    class RasterKernel
+    {
+    public:
+        typedef void (*KernelFunction)(const RasterState& state, const void* shader, const TriangleSetup& setup,
+            cv::Mat* img, DepthBuffer& depth, const cv::Rect& clip, HiZBuffer* hiZ, const RasterPrimitive& prim);
+
+        /*!
+        *  \brief Picks the kernel for drawing into depth (and, for COLOR or VISIBILITY
+        *         output, a CV_32FC3 color or CV_32SC1 visibility image). The kernel is only
+        *         valid while depth keeps its format and compare mode. With more than one
+        *         sample, img and depth are a MultisampleTarget's color and depth, and the
+        *         output must not be VISIBILITY.
+        */
+        RasterKernel(RASTER_OUTPUT output, bool wireframeOn, bool depthTest, const DepthBuffer& depth,
+            bool specialized = true, int samples = 1);
+
+        /*!
+        *  \brief Wraps an already selected kernel, e.g. one running a fragment shader, which
+        *         is passed to it as shader.
+        */
+        RasterKernel(const RasterState& state, KernelFunction kernel, const void* shader)
+            : state(state), kernel(kernel), shader(shader) {}
+
+        /*!
+        *  \brief Same as rasterizeHalfSpace(); img is unused for DEPTH_ONLY output.
+        */
+        void Draw(const TriangleSetup& setup, cv::Mat* img, DepthBuffer& depth, const cv::Rect& clip,
+            HiZBuffer* hiZ, const RasterPrimitive& prim) const
+        {
+            kernel(state, shader, setup, img, depth, clip, hiZ, prim);
+        }
+
+        void Draw(const TriangleSetup& setup, cv::Mat* img, DepthBuffer& depth, const float* col,
+            const cv::Rect& clip, HiZBuffer* hiZ = nullptr, unsigned int id = 0) const
+        {
+            RasterPrimitive prim = { col, id, nullptr, nullptr, nullptr };
+            kernel(state, shader, setup, img, depth, clip, hiZ, prim);
+        }
+
+    private:
+        RasterState state;
+        KernelFunction kernel;
+        const void* shader;
+    };
+
+    /**
+    *  \brief Render state known only at run time, for the generic kernel.
+    */
+    struct GenericRenderState
+    {
+        bool wireframeOn, depthTest, depthWrite;
+
+        GenericRenderState(const RasterState& state) : wireframeOn(state.wireframeOn), depthTest(state.depthTest),
+            depthWrite(!state.depthTest || state.storedCompare != DEPTH_COMPARE::EQUAL) {}
+
+        SR_FORCEINLINE float8 Quantize8(const DepthBuffer& depth, float8 z) const { return depth.Quantize8(z); }
+        SR_FORCEINLINE float8 Load8(const DepthBuffer& depth, int x, int y) const { return depth.Load8(x, y); }
+        SR_FORCEINLINE void Store8(DepthBuffer& depth, int x, int y, float8 z, int mask) const { depth.Store8(x, y, z, mask); }
+        SR_FORCEINLINE int Test8(const DepthBuffer& depth, float8 z, float8 stored) const { return depth.Test8(z, stored); }
+    };
+
+    /**
+    *  \brief The same state fixed at compile time. Members are constants, so every check on
+    *         them in the kernel folds away.
+    */
+    template <bool WIREFRAME, bool DEPTH_TEST, DEPTH_FORMAT FORMAT, DEPTH_COMPARE COMPARE>
+    struct FixedRenderState
+    {
+        static const bool wireframeOn = WIREFRAME;
+        static const bool depthTest = DEPTH_TEST;
+
+        // Passing an equal test leaves depth as it was, so there is nothing to write back.
+        static const bool depthWrite = !DEPTH_TEST || COMPARE != DEPTH_COMPARE::EQUAL;
+
+        FixedRenderState(const RasterState&) {}
+
+        SR_FORCEINLINE float8 Quantize8(const DepthBuffer& depth, float8 z) const { return depth.Quantize8T<FORMAT>(z); }
+        SR_FORCEINLINE float8 Load8(const DepthBuffer& depth, int x, int y) const { return depth.Load8T<FORMAT>(x, y); }
+        SR_FORCEINLINE void Store8(DepthBuffer& depth, int x, int y, float8 z, int mask) const { depth.Store8T<FORMAT>(x, y, z, mask); }
+        SR_FORCEINLINE int Test8(const DepthBuffer&, float8 z, float8 stored) const { return DepthBuffer::Test8T<COMPARE>(z, stored); }
+    };
+
+    /**
+    *  \brief Kernel outputs. WriteBlock() is called once per 8x8 block with the lanes of each
+    *         row that passed the depth test (0 for rows outside the triangle), after the
+    *         block's depth was written. Multisampled kernels call ShadeBlock() instead, with
+    *         the pixels any sample of which passed, to get their colors in an 8x8 array; it
+    *         returns false if the output has no color.
+    */
+    struct ColorOutput
+    {
+        cv::Mat* img;
+        const float* col;
+
+        ColorOutput(const RasterState&, const void*, cv::Mat* img, const RasterPrimitive& prim)
+            : img(img), col(prim.col) {}
+
+        SR_FORCEINLINE void Write(int x, int y, int mask) const
+        {
+            cv::Vec3f* row = img->ptr<cv::Vec3f>(y);
+            for (int k = 0; k < RASTER_BLOCK_SIZE; ++k)
+            {
+                if ((mask >> k) & 1)
+                    row[x + k] = cv::Vec3f(col[0], col[1], col[2]);
+            }
+        }
+
+        SR_FORCEINLINE void WriteBlock(int x, int y, const int* masks) const
+        {
+            for (int r = 0; r < RASTER_BLOCK_SIZE; ++r)
+                if (masks[r])
+                    Write(x, y + r, masks[r]);
+        }
+
+        SR_FORCEINLINE bool ShadeBlock(int, int, const int*, cv::Vec3f* colors) const
+        {
+            std::fill(colors, colors + RASTER_BLOCK_SIZE * RASTER_BLOCK_SIZE, cv::Vec3f(col[0], col[1], col[2]));
+            return true;
+        }
+    };
+
+    struct VisibilityOutput
+    {
+        cv::Mat* img;
+        unsigned int id;
+
+        VisibilityOutput(const RasterState&, const void*, cv::Mat* img, const RasterPrimitive& prim)
+            : img(img), id(prim.id) {}
+
+        SR_FORCEINLINE void Write(int x, int y, int mask) const
+        {
+            unsigned int* row = img->ptr<unsigned int>(y);
+            for (int k = 0; k < RASTER_BLOCK_SIZE; ++k)
+            {
+                if ((mask >> k) & 1)
+                    row[x + k] = id;
+            }
+        }
+
+        SR_FORCEINLINE void WriteBlock(int x, int y, const int* masks) const
+        {
+            for (int r = 0; r < RASTER_BLOCK_SIZE; ++r)
+                if (masks[r])
+                    Write(x, y + r, masks[r]);
+        }
+
+        // Triangle IDs cannot be averaged, so there is no multisampled visibility buffer.
+        SR_FORCEINLINE bool ShadeBlock(int, int, const int*, cv::Vec3f*) const { return false; }
+    };
+
+    struct DepthOnlyOutput
+    {
+        DepthOnlyOutput(const RasterState&, const void*, cv::Mat*, const RasterPrimitive&) {}
+        SR_FORCEINLINE void WriteBlock(int, int, const int*) const {}
+        SR_FORCEINLINE bool ShadeBlock(int, int, const int*, cv::Vec3f*) const { return false; }
+    };
+
+    /** \brief Any of the above, chosen at run time, for the generic kernel. */
+    struct GenericOutput
+    {
+        RASTER_OUTPUT output;
+        ColorOutput color;
+        VisibilityOutput visibility;
+
+        GenericOutput(const RasterState& state, const void* shader, cv::Mat* img, const RasterPrimitive& prim)
+            : output(state.output), color(state, shader, img, prim), visibility(state, shader, img, prim) {}
+
+        SR_FORCEINLINE void WriteBlock(int x, int y, const int* masks) const
+        {
+            if (output == RASTER_OUTPUT::VISIBILITY)
+                visibility.WriteBlock(x, y, masks);
+            else if (output == RASTER_OUTPUT::COLOR)
+                color.WriteBlock(x, y, masks);
+        }
+
+        SR_FORCEINLINE bool ShadeBlock(int x, int y, const int* masks, cv::Vec3f* colors) const
+        {
+            return output == RASTER_OUTPUT::COLOR && color.ShadeBlock(x, y, masks, colors);
+        }
+    };
+
+    /*!
+    *  \brief Block traversal shared by all raster kernels, for one render state and output
+    *         type.
+    */
+    template <class State, class Output>
+    void rasterizeBlocks(const RasterState& rasterState, const void* shader, const TriangleSetup& setup,
+        cv::Mat* img, DepthBuffer& depth, const cv::Rect& clip, HiZBuffer* hiZ, const RasterPrimitive& prim)
+    {
+        const int BLOCK_SIZE = RASTER_BLOCK_SIZE;
+        const State state(rasterState);
+        const Output output(rasterState, shader, img, prim);
+        if (!state.depthTest)
+            hiZ = nullptr;
+
+        int minX = std::max(setup.minX, clip.x);
+        int maxX = std::min(setup.maxX, clip.x + clip.width - 1);
+        int minY = std::max(setup.minY, clip.y);
+        int maxY = std::min(setup.maxY, clip.y + clip.height - 1);
+        if (minX > maxX || minY > maxY)
+            return;
+
+        const float8 ramp = ramp8();
+        float8 stepA[3];
+        double blockMax[3], blockMin[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            stepA[i] = ramp * setup.A[i];
+
+            // Offsets from a block's first sample to the samples where the edge is largest and
+            // smallest, for trivially rejecting or accepting whole blocks.
+            double dA = double(setup.A[i]) * (BLOCK_SIZE - 1);
+            double dB = double(setup.B[i]) * (BLOCK_SIZE - 1);
+            blockMax[i] = std::max(dA, 0.0) + std::max(dB, 0.0);
+            blockMin[i] = std::min(dA, 0.0) + std::min(dB, 0.0);
+        }
+
+        // Per-pixel depth is interpolated on the plane of stored depth, i.e. 1 - depth for
+        // reversed-Z, so kernels only have to quantize it.
+        bool reversed = depth.ReversedZ();
+        float storedZA = reversed ? -setup.zA : setup.zA;
+        float storedZB = reversed ? -setup.zB : setup.zB;
+        double storedZC = reversed ? 1.0 - setup.zC : setup.zC;
+        const float8 stepZ = ramp * storedZA;
+
+        // Range of the depth plane across a block, for bounding the triangle's depth per block.
+        double dZA = double(setup.zA) * (BLOCK_SIZE - 1);
+        double dZB = double(setup.zB) * (BLOCK_SIZE - 1);
+        double blockZMax = std::max(dZA, 0.0) + std::max(dZB, 0.0);
+        double blockZMin = std::min(dZA, 0.0) + std::min(dZB, 0.0);
+
+        // Align blocks to the image grid so that block rows never straddle an 8-pixel boundary.
+        int startX = minX & ~(BLOCK_SIZE - 1);
+        int startY = minY & ~(BLOCK_SIZE - 1);
+        for (int by = startY; by <= maxY; by += BLOCK_SIZE)
+        {
+            int rowBegin = std::max(by, minY);
+            int rowEnd = std::min(by + BLOCK_SIZE - 1, maxY);
+
+            // Edge values at the first sample of the block row, stepped across in double so
+            // that both triangles of a shared edge agree exactly on every sign.
+            double blockE[3];
+            for (int i = 0; i < 3; ++i)
+                blockE[i] = setup.A[i] * (startX + 0.5) + setup.B[i] * (by + 0.5) + setup.C[i];
+
+            for (int bx = startX; bx <= maxX; bx += BLOCK_SIZE)
+            {
+                bool rejected = false;
+                bool accepted = !state.wireframeOn;
+                for (int i = 0; i < 3; ++i)
+                {
+                    rejected |= blockE[i] + blockMax[i] < 0;
+                    accepted &= blockE[i] + blockMin[i] >= 0;
+                }
+                // Hi-Z: skip the block if no depth the triangle has in it can pass against the
+                // range stored there. If instead every depth it has passes against the whole
+                // range, covered pixels are written without reading depth.
+                bool depthTestBlock = state.depthTest;
+                if (hiZ && !rejected)
+                {
+                    double z0 = setup.zA * (bx + 0.5) + setup.zB * (by + 0.5) + setup.zC;
+                    float nearZ = std::max(float(z0 + blockZMin), setup.minZ);
+                    float farZ = std::min(float(z0 + blockZMax), setup.maxZ);
+                    float lo, hi;
+                    storedDepthRange(depth, nearZ, farZ, lo, hi);
+                    rejected = !depth.CanPass(lo, hi, hiZ->BlockMin(bx, by), hiZ->BlockMax(bx, by));
+                    depthTestBlock = !depth.AlwaysPasses(lo, hi, hiZ->BlockMin(bx, by), hiZ->BlockMax(bx, by));
+                }
+                if (rejected)
+                {
+                    for (int i = 0; i < 3; ++i)
+                        blockE[i] += double(setup.A[i]) * BLOCK_SIZE;
+                    continue;
+                }
+                bool written = false;
+                int masks[BLOCK_SIZE] = {};
+
+                // Lanes inside the triangle's (viewport-clamped) horizontal extent.
+                int xBits = 0xFF;
+                if (bx < minX)
+                    xBits &= 0xFF << (minX - bx);
+                if (bx + BLOCK_SIZE - 1 > maxX)
+                    xBits &= 0xFF >> (bx + BLOCK_SIZE - 1 - maxX);
+
+                float8 e[3];
+                for (int i = 0; i < 3; ++i)
+                {
+                    e[i] = set1(float(blockE[i] + double(setup.B[i]) * (rowBegin - by))) + stepA[i];
+                    blockE[i] += double(setup.A[i]) * BLOCK_SIZE;
+                }
+                float8 zRow = set1(float(storedZA * (bx + 0.5) + storedZB * (rowBegin + 0.5) +
+                    storedZC)) + stepZ;
+
+                for (int y = rowBegin; y <= rowEnd; ++y)
+                {
+                    // A sample is outside if any edge value is negative, so the coverage mask is
+                    // the inverted sign bits of the three edges OR'd together.
+                    int mask = xBits;
+                    if (!accepted)
+                    {
+                        mask &= ~movemask(e[0] | e[1] | e[2]);
+
+                        // For wireframe keep only covered pixels with an uncovered 4-neighbor.
+                        if (state.wireframeOn && mask)
+                        {
+                            float8 outside = set1(0.0f);
+                            for (int i = 0; i < 3; ++i)
+                            {
+                                outside = outside | (e[i] - setup.A[i]) | (e[i] + setup.A[i]) |
+                                    (e[i] - setup.B[i]) | (e[i] + setup.B[i]);
+                            }
+                            mask &= movemask(outside);
+                        }
+                    }
+
+                    if (mask)
+                    {
+                        // Depth rows are contiguous and padded to whole blocks, so a block row is
+                        // tested and written with single vector loads and stores.
+                        float8 z = state.Quantize8(depth, zRow);
+                        if (depthTestBlock)
+                            mask &= state.Test8(depth, z, state.Load8(depth, bx, y));
+
+                        if (mask)
+                        {
+                            if (state.depthWrite)
+                            {
+                                written = true;
+                                state.Store8(depth, bx, y, z, mask);
+                            }
+                            masks[y - by] = mask;
+                        }
+                    }
+
+                    for (int i = 0; i < 3; ++i)
+                        e[i] = e[i] + setup.B[i];
+                    zRow = zRow + storedZB;
+                }
+
+                output.WriteBlock(bx, by, masks);
+                if (hiZ && written)
+                    hiZ->UpdateBlock(depth, bx, by);
+            }
+        }
+    }
+
+    /*!
+    *  \brief Block traversal for multisampled targets. Edges and depth are evaluated at each
+    *         of the state's sample positions, and depth is tested and written in each sample's
+    *         plane. The output shades a pixel once if any of its samples passed, and its color
+    *         is copied to those samples only. setup's bounding box must include every pixel
+    *         with a covered sample, not only those with a covered center.
+    */
+    template <class State, class Output>
+    void rasterizeMultisample(const RasterState& rasterState, const void* shader, const TriangleSetup& setup,
+        cv::Mat* img, DepthBuffer& depth, const cv::Rect& clip, HiZBuffer* hiZ, const RasterPrimitive& prim)
+    {
+        const int BLOCK_SIZE = RASTER_BLOCK_SIZE;
+        const State state(rasterState);
+        const Output output(rasterState, shader, img, prim);
+        if (!state.depthTest)
+            hiZ = nullptr;
+        const int samples = rasterState.samples;
+        const float* pattern = samplePattern(samples);
+        const int planeRows = depth.Height() / samples;
+
+        int minX = std::max(setup.minX, clip.x);
+        int maxX = std::min(setup.maxX, clip.x + clip.width - 1);
+        int minY = std::max(setup.minY, clip.y);
+        int maxY = std::min(setup.maxY, clip.y + clip.height - 1);
+        if (minX > maxX || minY > maxY)
+            return;
+
+        // Edge values at each sample are those at the pixel center plus a constant offset.
+        const float8 ramp = ramp8();
+        float8 stepA[3], sampleE[MAX_SAMPLES][3];
+        double blockMax[3], blockMin[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            stepA[i] = ramp * setup.A[i];
+            double offsetMin = 0, offsetMax = 0;
+            for (int s = 0; s < samples; ++s)
+            {
+                double offset = double(setup.A[i]) * pattern[2 * s] + double(setup.B[i]) * pattern[2 * s + 1];
+                sampleE[s][i] = set1(float(offset));
+                offsetMin = s ? std::min(offsetMin, offset) : offset;
+                offsetMax = s ? std::max(offsetMax, offset) : offset;
+            }
+            double dA = double(setup.A[i]) * (BLOCK_SIZE - 1);
+            double dB = double(setup.B[i]) * (BLOCK_SIZE - 1);
+            blockMax[i] = std::max(dA, 0.0) + std::max(dB, 0.0) + offsetMax;
+            blockMin[i] = std::min(dA, 0.0) + std::min(dB, 0.0) + offsetMin;
+        }
+
+        // Depth likewise, on the plane of stored depth.
+        bool reversed = depth.ReversedZ();
+        float storedZA = reversed ? -setup.zA : setup.zA;
+        float storedZB = reversed ? -setup.zB : setup.zB;
+        double storedZC = reversed ? 1.0 - setup.zC : setup.zC;
+        const float8 stepZ = ramp * storedZA;
+        float8 sampleZ[MAX_SAMPLES];
+        double zOffsetMin = 0, zOffsetMax = 0;
+        for (int s = 0; s < samples; ++s)
+        {
+            sampleZ[s] = set1(storedZA * pattern[2 * s] + storedZB * pattern[2 * s + 1]);
+            double offset = double(setup.zA) * pattern[2 * s] + double(setup.zB) * pattern[2 * s + 1];
+            zOffsetMin = std::min(zOffsetMin, offset);
+            zOffsetMax = std::max(zOffsetMax, offset);
+        }
+        double dZA = double(setup.zA) * (BLOCK_SIZE - 1);
+        double dZB = double(setup.zB) * (BLOCK_SIZE - 1);
+        double blockZMax = std::max(dZA, 0.0) + std::max(dZB, 0.0) + zOffsetMax;
+        double blockZMin = std::min(dZA, 0.0) + std::min(dZB, 0.0) + zOffsetMin;
+
+        int startX = minX & ~(BLOCK_SIZE - 1);
+        int startY = minY & ~(BLOCK_SIZE - 1);
+        for (int by = startY; by <= maxY; by += BLOCK_SIZE)
+        {
+            int rowBegin = std::max(by, minY);
+            int rowEnd = std::min(by + BLOCK_SIZE - 1, maxY);
+
+            double blockE[3];
+            for (int i = 0; i < 3; ++i)
+                blockE[i] = setup.A[i] * (startX + 0.5) + setup.B[i] * (by + 0.5) + setup.C[i];
+
+            for (int bx = startX; bx <= maxX; bx += BLOCK_SIZE)
+            {
+                bool rejected = false;
+                bool accepted = !state.wireframeOn;
+                for (int i = 0; i < 3; ++i)
+                {
+                    rejected |= blockE[i] + blockMax[i] < 0;
+                    accepted &= blockE[i] + blockMin[i] >= 0;
+                }
+                bool depthTestBlock = state.depthTest;
+                if (hiZ && !rejected)
+                {
+                    double z0 = setup.zA * (bx + 0.5) + setup.zB * (by + 0.5) + setup.zC;
+                    float nearZ = std::max(float(z0 + blockZMin), setup.minZ);
+                    float farZ = std::min(float(z0 + blockZMax), setup.maxZ);
+                    float lo, hi;
+                    storedDepthRange(depth, nearZ, farZ, lo, hi);
+                    rejected = !depth.CanPass(lo, hi, hiZ->BlockMin(bx, by), hiZ->BlockMax(bx, by));
+                    depthTestBlock = !depth.AlwaysPasses(lo, hi, hiZ->BlockMin(bx, by), hiZ->BlockMax(bx, by));
+                }
+                if (rejected)
+                {
+                    for (int i = 0; i < 3; ++i)
+                        blockE[i] += double(setup.A[i]) * BLOCK_SIZE;
+                    continue;
+                }
+                bool written = false, covered = false;
+                int masks[BLOCK_SIZE] = {};
+                int sampleMasks[MAX_SAMPLES][BLOCK_SIZE] = {};
+
+                int xBits = 0xFF;
+                if (bx < minX)
+                    xBits &= 0xFF << (minX - bx);
+                if (bx + BLOCK_SIZE - 1 > maxX)
+                    xBits &= 0xFF >> (bx + BLOCK_SIZE - 1 - maxX);
+
+                float8 e[3];
+                for (int i = 0; i < 3; ++i)
+                {
+                    e[i] = set1(float(blockE[i] + double(setup.B[i]) * (rowBegin - by))) + stepA[i];
+                    blockE[i] += double(setup.A[i]) * BLOCK_SIZE;
+                }
+                float8 zRow = set1(float(storedZA * (bx + 0.5) + storedZB * (rowBegin + 0.5) +
+                    storedZC)) + stepZ;
+
+                for (int y = rowBegin; y <= rowEnd; ++y)
+                {
+                    // The wireframe outline is found from pixel centers, as without samples,
+                    // and keeps every sample of the pixels on it.
+                    int outline = 0xFF;
+                    if (state.wireframeOn)
+                    {
+                        float8 outside = set1(0.0f);
+                        for (int i = 0; i < 3; ++i)
+                        {
+                            outside = outside | (e[i] - setup.A[i]) | (e[i] + setup.A[i]) |
+                                (e[i] - setup.B[i]) | (e[i] + setup.B[i]);
+                        }
+                        outline = movemask(outside);
+                    }
+
+                    int pixels = 0;
+                    for (int s = 0; s < samples; ++s)
+                    {
+                        int mask = xBits & outline;
+                        if (!accepted)
+                        {
+                            mask &= ~movemask((e[0] + sampleE[s][0]) | (e[1] + sampleE[s][1]) |
+                                (e[2] + sampleE[s][2]));
+                        }
+                        if (mask)
+                        {
+                            int row = s * planeRows + y;
+                            float8 z = state.Quantize8(depth, zRow + sampleZ[s]);
+                            if (depthTestBlock)
+                                mask &= state.Test8(depth, z, state.Load8(depth, bx, row));
+                            if (mask && state.depthWrite)
+                            {
+                                written = true;
+                                state.Store8(depth, bx, row, z, mask);
+                            }
+                        }
+                        sampleMasks[s][y - by] = mask;
+                        pixels |= mask;
+                    }
+                    masks[y - by] = pixels;
+                    covered |= pixels != 0;
+
+                    for (int i = 0; i < 3; ++i)
+                        e[i] = e[i] + setup.B[i];
+                    zRow = zRow + storedZB;
+                }
+
+                cv::Vec3f colors[BLOCK_SIZE * BLOCK_SIZE];
+                if (covered && output.ShadeBlock(bx, by, masks, colors))
+                {
+                    for (int s = 0; s < samples; ++s)
+                    {
+                        for (int r = 0; r < BLOCK_SIZE; ++r)
+                        {
+                            int mask = sampleMasks[s][r];
+                            if (!mask)
+                                continue;
+                            cv::Vec3f* row = img->ptr<cv::Vec3f>(s * planeRows + by + r) + bx;
+                            for (int k = 0; k < BLOCK_SIZE; ++k)
+                            {
+                                if ((mask >> k) & 1)
+                                    row[k] = colors[r * BLOCK_SIZE + k];
+                            }
+                        }
+                    }
+                }
+                if (hiZ && written)
+                    hiZ->UpdateBlock(depth, bx, by, samples);
+            }
+        }
+    }
+
+    /*!
+    *  \brief The traversal for a fixed state and output, with or without samples.
+    */
+    template <class State, class Output>
+    RasterKernel::KernelFunction blockKernel(const RasterState& state)
+    {
+        return state.samples > 1 ? &rasterizeMultisample<State, Output> : &rasterizeBlocks<State, Output>;
+    }
+
+    // Kernel selection walks the state one member at a time, each step fixing one more
+    // template argument, so every valid combination is instantiated exactly once per output.
+    template <class Output, bool WIREFRAME, bool DEPTH_TEST, DEPTH_FORMAT FORMAT>
+    RasterKernel::KernelFunction selectKernel(const RasterState& state)
+    {
+        if (!DEPTH_TEST)
+            return blockKernel<FixedRenderState<WIREFRAME, false, FORMAT, DEPTH_COMPARE::LESS>, Output>(state);
+        switch (state.storedCompare)
+        {
+        case DEPTH_COMPARE::LESS: return blockKernel<FixedRenderState<WIREFRAME, DEPTH_TEST, FORMAT, DEPTH_COMPARE::LESS>, Output>(state);
+        case DEPTH_COMPARE::LEQUAL: return blockKernel<FixedRenderState<WIREFRAME, DEPTH_TEST, FORMAT, DEPTH_COMPARE::LEQUAL>, Output>(state);
+        case DEPTH_COMPARE::GREATER: return blockKernel<FixedRenderState<WIREFRAME, DEPTH_TEST, FORMAT, DEPTH_COMPARE::GREATER>, Output>(state);
+        case DEPTH_COMPARE::GEQUAL: return blockKernel<FixedRenderState<WIREFRAME, DEPTH_TEST, FORMAT, DEPTH_COMPARE::GEQUAL>, Output>(state);
+        default: return blockKernel<FixedRenderState<WIREFRAME, DEPTH_TEST, FORMAT, DEPTH_COMPARE::EQUAL>, Output>(state);
+        }
+    }
+
+    template <class Output, bool WIREFRAME, bool DEPTH_TEST>
+    RasterKernel::KernelFunction selectKernel(const RasterState& state)
+    {
+        switch (state.format)
+        {
+        case DEPTH_FORMAT::FLOAT32: return selectKernel<Output, WIREFRAME, DEPTH_TEST, DEPTH_FORMAT::FLOAT32>(state);
+        case DEPTH_FORMAT::UNORM24_STENCIL8: return selectKernel<Output, WIREFRAME, DEPTH_TEST, DEPTH_FORMAT::UNORM24_STENCIL8>(state);
+        default: return selectKernel<Output, WIREFRAME, DEPTH_TEST, DEPTH_FORMAT::UNORM16>(state);
+        }
+    }
+
+    template <class Output, bool WIREFRAME>
+    RasterKernel::KernelFunction selectKernel(const RasterState& state)
+    {
+        return state.depthTest ? selectKernel<Output, WIREFRAME, true>(state) : selectKernel<Output, WIREFRAME, false>(state);
+    }
+
+    template <class Output>
+    RasterKernel::KernelFunction selectKernel(const RasterState& state)
+    {
+        return state.wireframeOn ? selectKernel<Output, true>(state) : selectKernel<Output, false>(state);
+    }
+}
@@ -0,0 +1,151 @@
+#include "Rasterizer.h"
+#include "RasterKernel.h"
+#include "Triangle.h"
+#include "HiZBuffer.h"
+#include "SIMD.h"
+#include <algorithm>
+#include <cmath>
+
+namespace SoftwareRasterizer
+{
+    static const int BLOCK_SIZE = RASTER_BLOCK_SIZE;
+
+    // Vertex positions are snapped to 1/SUBPIXEL_STEPS of a pixel before edge setup.
+    static const int SUBPIXEL_STEPS = 16;
+
+    bool setupTriangle(const Triangle& tri, int w, int h, TriangleSetup& setup)
+    {
+        // Snap vertices to the sub-pixel grid. This makes every edge function value an exact
+        // multiple of 1/(2 * SUBPIXEL_STEPS^2), which the tie-breaking bias below relies on.
+        glm::dvec3 p[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            p[i].x = std::floor(double(tri.v[i].position.x) * SUBPIXEL_STEPS + 0.5) / SUBPIXEL_STEPS;
+            p[i].y = std::floor(double(tri.v[i].position.y) * SUBPIXEL_STEPS + 0.5) / SUBPIXEL_STEPS;
+            p[i].z = tri.v[i].position.z;
+        }
+
+        // Twice the signed area. Flip to a consistent winding so the interior is where all
+        // three edge functions are positive, whichever way the triangle was submitted.
+        double area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+        if (area == 0)
+            return false;
+        if (area < 0)
+        {
+            std::swap(p[1], p[2]);
+            area = -area;
+        }
+
+        // Bounding box of pixel centers, clamped to the viewport.
+        setup.minX = std::max(int(std::floor(std::min({ p[0].x, p[1].x, p[2].x }) - 0.5)), 0);
+        setup.maxX = std::min(int(std::floor(std::max({ p[0].x, p[1].x, p[2].x }) - 0.5)), w - 1);
+        setup.minY = std::max(int(std::floor(std::min({ p[0].y, p[1].y, p[2].y }) - 0.5)), 0);
+        setup.maxY = std::min(int(std::floor(std::max({ p[0].y, p[1].y, p[2].y }) - 0.5)), h - 1);
+        if (setup.minX > setup.maxX || setup.minY > setup.maxY)
+            return false;
+
+        double zA = 0, zB = 0, zC = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            const glm::dvec3& a = p[i];
+            const glm::dvec3& b = p[(i + 1) % 3];
+            double A = a.y - b.y;
+            double B = b.x - a.x;
+            double C = a.x * b.y - a.y * b.x;
+
+            // E_i / area is the barycentric weight of the vertex opposite edge i.
+            double z = p[(i + 2) % 3].z;
+            zA += A * z;
+            zB += B * z;
+            zC += C * z;
+
+            // Pixel centers exactly on an edge belong to the triangle only if it is a top edge
+            // (horizontal, interior below) or a left edge (interior to the right). Pushing every
+            // other edge in by half a quantization step turns the test into a plain sign check.
+            bool topLeft = A > 0 || (A == 0 && B > 0);
+            setup.A[i] = float(A);
+            setup.B[i] = float(B);
+            setup.C[i] = topLeft ? C : C - 0.5 / (SUBPIXEL_STEPS * SUBPIXEL_STEPS);
+        }
+        setup.zA = float(zA / area);
+        setup.zB = float(zB / area);
+        setup.zC = zC / area;
+        setup.minZ = float(std::min({ p[0].z, p[1].z, p[2].z }));
+        setup.maxZ = float(std::max({ p[0].z, p[1].z, p[2].z }));
+        return true;
+    }
+
+    void setupVaryings(const Triangle& tri, float* varyings, int count)
+    {
+        // Same snapped positions as setupTriangle(), so the planes agree with the edges.
+        glm::dvec2 p[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            p[i].x = std::floor(double(tri.v[i].position.x) * SUBPIXEL_STEPS + 0.5) / SUBPIXEL_STEPS;
+            p[i].y = std::floor(double(tri.v[i].position.y) * SUBPIXEL_STEPS + 0.5) / SUBPIXEL_STEPS;
+        }
+        double area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+
+        // Varyings over w are affine in screen space, like 1/w itself, which goes last.
+        double values[3][MAX_VARYINGS + 1];
+        for (int i = 0; i < 3; ++i)
+        {
+            const float* v = varyings + i * (count + 1);
+            double invW = v[count];
+            for (int k = 0; k < count; ++k)
+                values[i][k] = v[k] * invW;
+            values[i][count] = invW;
+        }
+        for (int k = 0; k <= count; ++k)
+        {
+            double a = 0, b = 0, c = 0;
+            for (int i = 0; i < 3; ++i)
+            {
+                const glm::dvec2& p0 = p[i];
+                const glm::dvec2& p1 = p[(i + 1) % 3];
+                double value = values[(i + 2) % 3][k];
+                a += (p0.y - p1.y) * value;
+                b += (p1.x - p0.x) * value;
+                c += (p0.x * p1.y - p0.y * p1.x) * value;
+            }
+            // A triangle too thin to have an area gets constant varyings. It covers no pixels.
+            varyings[3 * k] = area != 0 ? float(a / area) : 0.0f;
+            varyings[3 * k + 1] = area != 0 ? float(b / area) : 0.0f;
+            varyings[3 * k + 2] = float(area != 0 ? c / area : values[0][k]);
+        }
+    }
+
+    RasterKernel::RasterKernel(RASTER_OUTPUT output, bool wireframeOn, bool depthTest, const DepthBuffer& depth,
+        bool specialized, int samples)
+    {
+        // Depth-only output has no outline to draw.
+        state.output = output;
+        state.wireframeOn = wireframeOn && output != RASTER_OUTPUT::DEPTH_ONLY;
+        state.depthTest = depthTest;
+        state.format = depth.Format();
+        state.storedCompare = depth.StoredCompare();
+        state.samples = samples;
+
+        shader = nullptr;
+        if (!specialized)
+            kernel = blockKernel<GenericRenderState, GenericOutput>(state);
+        else if (output == RASTER_OUTPUT::COLOR)
+            kernel = selectKernel<ColorOutput>(state);
+        else if (output == RASTER_OUTPUT::VISIBILITY)
+            kernel = selectKernel<VisibilityOutput>(state);
+        else
+            kernel = selectKernel<DepthOnlyOutput, false>(state);
+    }
+
+    void rasterizeHalfSpace(const TriangleSetup& setup, cv::Mat& img, DepthBuffer& depth, const float* col,
+        const cv::Rect& clip, bool wireframeOn, bool depthTest, HiZBuffer* hiZ, unsigned int id)
+    {
+        RASTER_OUTPUT output = img.type() == CV_32SC1 ? RASTER_OUTPUT::VISIBILITY : RASTER_OUTPUT::COLOR;
+        RasterKernel(output, wireframeOn, depthTest, depth).Draw(setup, &img, depth, col, clip, hiZ, id);
+    }
+
+    void rasterizeDepthOnly(const TriangleSetup& setup, DepthBuffer& depth, const cv::Rect& clip, HiZBuffer* hiZ)
+    {
+        RasterKernel(RASTER_OUTPUT::DEPTH_ONLY, false, true, depth).Draw(setup, nullptr, depth, nullptr, clip, hiZ);
+    }
+}
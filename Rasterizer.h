@@ -0,0 +1,108 @@
+/*
+*	Rasterizer.h -- half-space (edge function) triangle rasterization. Coverage and depth are
+*					evaluated for 8x8 pixel blocks, one 8-pixel row per SIMD operation.
+*/
+
+#pragma once
+#include "DepthBuffer.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace SoftwareRasterizer
+{
+    class Triangle;
+    class HiZBuffer;
+
+    // Pixels are traversed in square blocks of this many pixels per side. One block row is
+    // exactly one 8-wide SIMD vector.
+    const int RASTER_BLOCK_SIZE = 8;
+
+    enum class RASTER_ALGORITHM {
+        SCANLINE,
+        HALF_SPACE
+    };
+
+    /**
+    *  \brief Per-triangle constants for half-space rasterization, computed once by setupTriangle().
+    *         Edge i runs from vertex i to vertex i+1 and E_i(x,y) = A[i]*x + B[i]*y + C[i] is
+    *         non-negative inside the triangle, with the top-left fill rule folded into C.
+    *         Window depth (z/w after the divide) is affine in screen space, so it is carried
+    *         as the plane Z(x,y) = zA*x + zB*y + zC, and minZ/maxZ bound the depth of every
+    *         pixel the triangle can produce.
+    */
+    struct TriangleSetup
+    {
+        float A[3], B[3];
+        double C[3];
+        float zA, zB;
+        double zC;
+        float minZ, maxZ;
+        int minX, maxX, minY, maxY;
+    };
+
+    /*!
+    *  \brief Builds edge equations and the depth plane for a triangle whose vertex positions
+    *         are already in pixel coordinates with window depth in z. The bounding box is clamped to a w x h
+    *         viewport.
+    *
+    * \return False if the triangle is degenerate or lies entirely outside the viewport.
+    */
+    bool setupTriangle(const Triangle& tri, int w, int h, TriangleSetup& setup);
+
+    /*!
+    *  \brief Turns the values of count varyings at the three vertices of a triangle into plane
+    *         equations over pixel coordinates, in place, for perspective-correct
+    *         interpolation. On input varyings holds count + 1 floats per vertex, vertex after
+    *         vertex: the varyings, then the vertex's 1 / clip w. On output it holds a, b, c per
+    *         varying divided by w, then a, b, c of 1/w, each plane being a*x + b*y + c at
+    *         (x, y). Varying k at a pixel is then plane k over plane count there.
+    */
+    void setupVaryings(const Triangle& tri, float* varyings, int count);
+
+    /*!
+    *  \brief Fills a set-up triangle into the color and depth targets. Pixel centers exactly on
+    *         an edge follow the top-left rule, so triangles sharing an edge neither overlap nor
+    *         leave cracks. Picks a RasterKernel on every call; hold one to draw many triangles.
+    *
+    * \param [in,out] img CV_32FC3 color target, written with col. A CV_32SC1 image is taken
+    *                     as a visibility buffer instead and written with id.
+    * \param [in] clip Only pixels inside this rectangle are touched. Its origin must be a
+    *                  multiple of 8 so results do not depend on how the image is split up.
+    * \param [in] wireframeOn If set, only pixels on the triangle's outline are written.
+    * \param [in] depthTest If set, pixels are written only where they pass the depth buffer's
+    *                       compare mode.
+    * \param [in,out] hiZ Optional hierarchical depth for depth. Blocks the triangle cannot be
+    *                     visible in are skipped, and blocks that were written are refreshed.
+    */
+    void rasterizeHalfSpace(const TriangleSetup& setup, cv::Mat& img, DepthBuffer& depth, const float* col,
+        const cv::Rect& clip, bool wireframeOn, bool depthTest, HiZBuffer* hiZ = nullptr,
+        unsigned int id = 0);
+
+    /*!
+    *  \brief Depth-only variant of rasterizeHalfSpace() for depth pre-passes, shadow maps and
+    *         occlusion buffers. Pixels are always depth tested and only depth is written.
+    */
+    void rasterizeDepthOnly(const TriangleSetup& setup, DepthBuffer& depth, const cv::Rect& clip,
+        HiZBuffer* hiZ = nullptr);
+
+    /*!
+    *  \brief Widens a bound on a triangle's depth by a few float ulps, so that comparing it
+    *         against stored depths stays conservative despite rounding in the per-pixel depth
+    *         interpolation.
+    */
+    inline float conservativeNearDepth(float z) { return z - std::abs(z) * 1e-5f; }
+    inline float conservativeFarDepth(float z) { return z + std::abs(z) * 1e-5f; }
+
+    /*!
+    *  \brief Conservative range [lo, hi] of stored values for geometry whose scene depth lies
+    *         between nearZ and farZ.
+    */
+    inline void storedDepthRange(const DepthBuffer& depth, float nearZ, float farZ, float& lo, float& hi)
+    {
+        float a = depth.ToStored(conservativeNearDepth(nearZ));
+        float b = depth.ToStored(conservativeFarDepth(farZ));
+        lo = std::min(a, b);
+        hi = std::max(a, b);
+    }
+}
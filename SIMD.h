@@ -0,0 +1,226 @@
+/*
+*	SIMD.h -- thin 8-wide float vector used by the raster and vertex kernels. With AVX2 enabled
+*			  a float8 is a single __m256, with SSE2 it is a pair of __m128, otherwise a plain
+*			  array, so kernels are written once in 8-lane terms and the compiler flags decide the
+*			  instruction set.
+*/
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <new>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SR_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SR_SIMD_SSE2 1
+#endif
+
+#if defined(_MSC_VER)
+#define SR_ALIGN(n) __declspec(align(n))
+#define SR_FORCEINLINE __forceinline
+#else
+#define SR_ALIGN(n) __attribute__((aligned(n)))
+#define SR_FORCEINLINE inline __attribute__((always_inline))
+#endif
+
+namespace SoftwareRasterizer
+{
+    // Name of the instruction set the float8 type was compiled against, for logging.
+#if defined(SR_SIMD_AVX2)
+    constexpr const char* SIMD_INSTRUCTION_SET = "AVX2";
+#elif defined(SR_SIMD_SSE2)
+    constexpr const char* SIMD_INSTRUCTION_SET = "SSE2";
+#else
+    constexpr const char* SIMD_INSTRUCTION_SET = "scalar";
+#endif
+
+    /**
+    *  \brief Eight packed floats. Comparison results are lane masks (all bits set or clear) in
+    *         the same type, which may be combined with &, | and andnot() and fed to select().
+    *         movemask() turns a lane mask into one bit per lane and laneMask() turns it back.
+    *         truncate8() rounds toward zero and, like an int cast, is only meaningful for values
+    *         that fit in an int. shuffle8<I>() applies the same 4-lane shuffle to both halves,
+    *         lane j of each half taking lane (I >> 2j) & 3, as _MM_SHUFFLE builds it.
+    *         load8u16() converts eight 16-bit unsigned integers, 16-byte aligned, to floats.
+    */
+    struct float8
+    {
+#if defined(SR_SIMD_AVX2)
+        __m256 v;
+        float8() {}
+        float8(__m256 v_) : v(v_) {}
+#elif defined(SR_SIMD_SSE2)
+        __m128 lo, hi;
+        float8() {}
+        float8(__m128 lo_, __m128 hi_) : lo(lo_), hi(hi_) {}
+#else
+        float f[8];
+        float8() {}
+#endif
+    };
+
+#if defined(SR_SIMD_AVX2)
+
+    SR_FORCEINLINE float8 set1(float a) { return _mm256_set1_ps(a); }
+    SR_FORCEINLINE float8 load8(const float* p) { return _mm256_load_ps(p); }
+    SR_FORCEINLINE float8 loadu8(const float* p) { return _mm256_loadu_ps(p); }
+    SR_FORCEINLINE float8 load8u16(const uint16_t* p)
+    {
+        return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_load_si128((const __m128i*)p)));
+    }
+    SR_FORCEINLINE void store8(float* p, float8 a) { _mm256_store_ps(p, a.v); }
+    SR_FORCEINLINE void storeu8(float* p, float8 a) { _mm256_storeu_ps(p, a.v); }
+    SR_FORCEINLINE float8 operator+(float8 a, float8 b) { return _mm256_add_ps(a.v, b.v); }
+    SR_FORCEINLINE float8 operator-(float8 a, float8 b) { return _mm256_sub_ps(a.v, b.v); }
+    SR_FORCEINLINE float8 operator*(float8 a, float8 b) { return _mm256_mul_ps(a.v, b.v); }
+    SR_FORCEINLINE float8 operator/(float8 a, float8 b) { return _mm256_div_ps(a.v, b.v); }
+    SR_FORCEINLINE float8 operator&(float8 a, float8 b) { return _mm256_and_ps(a.v, b.v); }
+    SR_FORCEINLINE float8 operator|(float8 a, float8 b) { return _mm256_or_ps(a.v, b.v); }
+    SR_FORCEINLINE float8 andnot(float8 a, float8 b) { return _mm256_andnot_ps(a.v, b.v); }// ~a & b
+    SR_FORCEINLINE float8 min8(float8 a, float8 b) { return _mm256_min_ps(a.v, b.v); }
+    SR_FORCEINLINE float8 max8(float8 a, float8 b) { return _mm256_max_ps(a.v, b.v); }
+    SR_FORCEINLINE float8 cmplt(float8 a, float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+    SR_FORCEINLINE float8 cmple(float8 a, float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+    SR_FORCEINLINE float8 cmpgt(float8 a, float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+    SR_FORCEINLINE float8 cmpge(float8 a, float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+    SR_FORCEINLINE float8 cmpeq(float8 a, float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+    SR_FORCEINLINE float8 select(float8 mask, float8 a, float8 b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+    SR_FORCEINLINE int movemask(float8 a) { return _mm256_movemask_ps(a.v); }
+    SR_FORCEINLINE float8 ramp8() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+    SR_FORCEINLINE float8 truncate8(float8 a) { return _mm256_round_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+    SR_FORCEINLINE float8 sqrt8(float8 a) { return _mm256_sqrt_ps(a.v); }
+    template <int I> SR_FORCEINLINE float8 shuffle8(float8 a) { return _mm256_permute_ps(a.v, I); }
+    SR_FORCEINLINE float8 laneMask(int bits)
+    {
+        __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i m = _mm256_and_si256(_mm256_set1_epi32(bits), lanes);
+        return _mm256_castsi256_ps(_mm256_cmpeq_epi32(m, lanes));
+    }
+
+#elif defined(SR_SIMD_SSE2)
+
+    SR_FORCEINLINE float8 set1(float a) { __m128 s = _mm_set1_ps(a); return float8(s, s); }
+    SR_FORCEINLINE float8 load8(const float* p) { return float8(_mm_load_ps(p), _mm_load_ps(p + 4)); }
+    SR_FORCEINLINE float8 loadu8(const float* p) { return float8(_mm_loadu_ps(p), _mm_loadu_ps(p + 4)); }
+    SR_FORCEINLINE float8 load8u16(const uint16_t* p)
+    {
+        __m128i a = _mm_load_si128((const __m128i*)p), zero = _mm_setzero_si128();
+        return float8(_mm_cvtepi32_ps(_mm_unpacklo_epi16(a, zero)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(a, zero)));
+    }
+    SR_FORCEINLINE void store8(float* p, float8 a) { _mm_store_ps(p, a.lo); _mm_store_ps(p + 4, a.hi); }
+    SR_FORCEINLINE void storeu8(float* p, float8 a) { _mm_storeu_ps(p, a.lo); _mm_storeu_ps(p + 4, a.hi); }
+    SR_FORCEINLINE float8 operator+(float8 a, float8 b) { return float8(_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 operator-(float8 a, float8 b) { return float8(_mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 operator*(float8 a, float8 b) { return float8(_mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 operator/(float8 a, float8 b) { return float8(_mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 operator&(float8 a, float8 b) { return float8(_mm_and_ps(a.lo, b.lo), _mm_and_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 operator|(float8 a, float8 b) { return float8(_mm_or_ps(a.lo, b.lo), _mm_or_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 andnot(float8 a, float8 b) { return float8(_mm_andnot_ps(a.lo, b.lo), _mm_andnot_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 min8(float8 a, float8 b) { return float8(_mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 max8(float8 a, float8 b) { return float8(_mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 cmplt(float8 a, float8 b) { return float8(_mm_cmplt_ps(a.lo, b.lo), _mm_cmplt_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 cmple(float8 a, float8 b) { return float8(_mm_cmple_ps(a.lo, b.lo), _mm_cmple_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 cmpgt(float8 a, float8 b) { return float8(_mm_cmpgt_ps(a.lo, b.lo), _mm_cmpgt_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 cmpge(float8 a, float8 b) { return float8(_mm_cmpge_ps(a.lo, b.lo), _mm_cmpge_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 cmpeq(float8 a, float8 b) { return float8(_mm_cmpeq_ps(a.lo, b.lo), _mm_cmpeq_ps(a.hi, b.hi)); }
+    SR_FORCEINLINE float8 select(float8 mask, float8 a, float8 b)
+    {
+        return float8(_mm_or_ps(_mm_and_ps(mask.lo, a.lo), _mm_andnot_ps(mask.lo, b.lo)),
+            _mm_or_ps(_mm_and_ps(mask.hi, a.hi), _mm_andnot_ps(mask.hi, b.hi)));
+    }
+    SR_FORCEINLINE int movemask(float8 a) { return _mm_movemask_ps(a.lo) | (_mm_movemask_ps(a.hi) << 4); }
+    SR_FORCEINLINE float8 ramp8() { return float8(_mm_setr_ps(0, 1, 2, 3), _mm_setr_ps(4, 5, 6, 7)); }
+    SR_FORCEINLINE float8 truncate8(float8 a)
+    {
+        return float8(_mm_cvtepi32_ps(_mm_cvttps_epi32(a.lo)), _mm_cvtepi32_ps(_mm_cvttps_epi32(a.hi)));
+    }
+    SR_FORCEINLINE float8 sqrt8(float8 a) { return float8(_mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi)); }
+    template <int I> SR_FORCEINLINE float8 shuffle8(float8 a) { return float8(_mm_shuffle_ps(a.lo, a.lo, I), _mm_shuffle_ps(a.hi, a.hi, I)); }
+    SR_FORCEINLINE float8 laneMask(int bits)
+    {
+        __m128i b = _mm_set1_epi32(bits);
+        __m128i lanesLo = _mm_setr_epi32(1, 2, 4, 8), lanesHi = _mm_setr_epi32(16, 32, 64, 128);
+        return float8(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(b, lanesLo), lanesLo)),
+            _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(b, lanesHi), lanesHi)));
+    }
+
+#else
+
+    namespace detail
+    {
+        SR_FORCEINLINE float maskLane(bool b) { uint32_t u = b ? 0xFFFFFFFFu : 0u; float f; memcpy(&f, &u, 4); return f; }
+        SR_FORCEINLINE uint32_t bits(float f) { uint32_t u; memcpy(&u, &f, 4); return u; }
+        SR_FORCEINLINE float fromBits(uint32_t u) { float f; memcpy(&f, &u, 4); return f; }
+    }
+
+#define SR_FLOAT8_LANEWISE(expr) float8 r; for (int i = 0; i < 8; ++i) r.f[i] = (expr); return r;
+
+    SR_FORCEINLINE float8 set1(float a) { SR_FLOAT8_LANEWISE(a) }
+    SR_FORCEINLINE float8 load8(const float* p) { SR_FLOAT8_LANEWISE(p[i]) }
+    SR_FORCEINLINE float8 loadu8(const float* p) { SR_FLOAT8_LANEWISE(p[i]) }
+    SR_FORCEINLINE float8 load8u16(const uint16_t* p) { SR_FLOAT8_LANEWISE(float(p[i])) }
+    SR_FORCEINLINE void store8(float* p, float8 a) { for (int i = 0; i < 8; ++i) p[i] = a.f[i]; }
+    SR_FORCEINLINE void storeu8(float* p, float8 a) { for (int i = 0; i < 8; ++i) p[i] = a.f[i]; }
+    SR_FORCEINLINE float8 operator+(float8 a, float8 b) { SR_FLOAT8_LANEWISE(a.f[i] + b.f[i]) }
+    SR_FORCEINLINE float8 operator-(float8 a, float8 b) { SR_FLOAT8_LANEWISE(a.f[i] - b.f[i]) }
+    SR_FORCEINLINE float8 operator*(float8 a, float8 b) { SR_FLOAT8_LANEWISE(a.f[i] * b.f[i]) }
+    SR_FORCEINLINE float8 operator/(float8 a, float8 b) { SR_FLOAT8_LANEWISE(a.f[i] / b.f[i]) }
+    SR_FORCEINLINE float8 operator&(float8 a, float8 b) { SR_FLOAT8_LANEWISE(detail::fromBits(detail::bits(a.f[i]) & detail::bits(b.f[i]))) }
+    SR_FORCEINLINE float8 operator|(float8 a, float8 b) { SR_FLOAT8_LANEWISE(detail::fromBits(detail::bits(a.f[i]) | detail::bits(b.f[i]))) }
+    SR_FORCEINLINE float8 andnot(float8 a, float8 b) { SR_FLOAT8_LANEWISE(detail::fromBits(~detail::bits(a.f[i]) & detail::bits(b.f[i]))) }
+    SR_FORCEINLINE float8 min8(float8 a, float8 b) { SR_FLOAT8_LANEWISE(a.f[i] < b.f[i] ? a.f[i] : b.f[i]) }
+    SR_FORCEINLINE float8 max8(float8 a, float8 b) { SR_FLOAT8_LANEWISE(a.f[i] > b.f[i] ? a.f[i] : b.f[i]) }
+    SR_FORCEINLINE float8 cmplt(float8 a, float8 b) { SR_FLOAT8_LANEWISE(detail::maskLane(a.f[i] < b.f[i])) }
+    SR_FORCEINLINE float8 cmple(float8 a, float8 b) { SR_FLOAT8_LANEWISE(detail::maskLane(a.f[i] <= b.f[i])) }
+    SR_FORCEINLINE float8 cmpgt(float8 a, float8 b) { SR_FLOAT8_LANEWISE(detail::maskLane(a.f[i] > b.f[i])) }
+    SR_FORCEINLINE float8 cmpge(float8 a, float8 b) { SR_FLOAT8_LANEWISE(detail::maskLane(a.f[i] >= b.f[i])) }
+    SR_FORCEINLINE float8 cmpeq(float8 a, float8 b) { SR_FLOAT8_LANEWISE(detail::maskLane(a.f[i] == b.f[i])) }
+    SR_FORCEINLINE float8 select(float8 mask, float8 a, float8 b) { SR_FLOAT8_LANEWISE(detail::bits(mask.f[i]) ? a.f[i] : b.f[i]) }
+    SR_FORCEINLINE int movemask(float8 a) { int m = 0; for (int i = 0; i < 8; ++i) m |= int(detail::bits(a.f[i]) >> 31) << i; return m; }
+    SR_FORCEINLINE float8 ramp8() { SR_FLOAT8_LANEWISE(float(i)) }
+    SR_FORCEINLINE float8 truncate8(float8 a) { SR_FLOAT8_LANEWISE(std::trunc(a.f[i])) }
+    SR_FORCEINLINE float8 sqrt8(float8 a) { SR_FLOAT8_LANEWISE(std::sqrt(a.f[i])) }
+    template <int I> SR_FORCEINLINE float8 shuffle8(float8 a) { SR_FLOAT8_LANEWISE(a.f[(i & 4) | ((I >> (2 * (i & 3))) & 3)]) }
+    SR_FORCEINLINE float8 laneMask(int bits) { SR_FLOAT8_LANEWISE(detail::maskLane((bits >> i) & 1)) }
+
+#undef SR_FLOAT8_LANEWISE
+
+#endif
+
+    SR_FORCEINLINE float8 operator+(float8 a, float b) { return a + set1(b); }
+    SR_FORCEINLINE float8 operator-(float8 a, float b) { return a - set1(b); }
+    SR_FORCEINLINE float8 operator*(float8 a, float b) { return a * set1(b); }
+    SR_FORCEINLINE float8 operator*(float b, float8 a) { return set1(b) * a; }
+
+    // Rounds toward negative infinity, within the same range as truncate8().
+    SR_FORCEINLINE float8 floor8(float8 a)
+    {
+        float8 t = truncate8(a);
+        return t - (cmpgt(t, a) & set1(1.0f));
+    }
+
+    /**
+    *  \brief Allocator for std::vector storage that float8 loads and stores may use directly.
+    */
+    template<class T, size_t Alignment = 32>
+    struct AlignedAllocator
+    {
+        typedef T value_type;
+        template<class U> struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+        AlignedAllocator() {}
+        template<class U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+        T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment))); }
+        void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(Alignment)); }
+        bool operator==(const AlignedAllocator&) const { return true; }
+        bool operator!=(const AlignedAllocator&) const { return false; }
+    };
+
+    template<class T> using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+}
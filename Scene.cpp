@@ -1,13 +1,24 @@
 #include "Scene.h"
 #include "Model.h"
+#include "ModelLoader.h"
 #include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <thread>
 
 namespace SoftwareRasterizer
 {
-    Scene::Scene() : w(0), h(0), frameCount(0), screenshotCount(0), windowClose(false), keyPressed(0),
-        showFPS(false), showDepth(false), wireframeOn(false), cullFace(false), frontFaceCCW(true),
-        depthTest(true), showRenderedTriangleCount(false)
+    Scene::Scene() : w(0), h(0), frameCount(0), screenshotCount(0), windowClose(false), showFPS(false),
+        showDepth(false), cullFace(false), frontFaceCCW(true), wireframeOn(false), visibilityBufferOn(false),
+        depthPrepass(false), specializedKernels(true), shading(SHADING_MODE::FLAT), depthTest(true),
+        showRenderedTriangleCount(false), rasterAlgorithm(RASTER_ALGORITHM::HALF_SPACE),
+        depthFormat(DEPTH_FORMAT::FLOAT32), depthCompare(DEPTH_COMPARE::LESS), reversedZ(false),
+        samples(1), vertexFormat(VERTEX_FORMAT::FLOAT), meshletCulling(true), keyPressed(0)
     {
+        // A key light from the upper left and a warm fill light to the right of the models.
+        lights.push_back(Light::Directional(glm::vec3(0.5f, 0.6f, -1.0f), glm::vec3(0.5f)));
+        lights.push_back(Light::Point(glm::vec3(0.6f, 0.0f, -0.6f), glm::vec3(0.4f, 0.3f, 0.2f), 4.0f));
+        ambientLight = glm::vec3(0.1f);
+
         // Set screenshot count to last value.
         std::string ssname = "screenshot_" + std::to_string(screenshotCount) + ".png";
         while (std::filesystem::exists(ssname))
@@ -21,8 +32,14 @@ namespace SoftwareRasterizer
     {
         if (!frame.empty())
             frame.deallocate();
-        if (!frameZ.empty())
-            frameZ.deallocate();
+    }
+
+    unsigned int Scene::TotalEdges()
+    {
+        unsigned int total = 0;
+        for (int i = 0; i < models.size(); ++i)
+            total += models[i].EdgeCount();
+        return total;
     }
 
     void Scene::AddModel(std::string filename)
@@ -31,11 +48,58 @@ namespace SoftwareRasterizer
         models.push_back(m);
     }
 
+    void Scene::LoadModel(std::string filename)
+    {
+        models.push_back(Model());
+        loaders.resize(models.size());
+        loaders.back().reset(new ModelLoader(filename));
+    }
+
+    void Scene::LoadModels(const std::vector<ModelDescriptor>& descriptors)
+    {
+        for (const ModelDescriptor& descriptor : descriptors)
+        {
+            LoadModel(descriptor.filename);
+            models.back().position = descriptor.position;
+            models.back().rotation = descriptor.rotation;
+            models.back().scale = descriptor.scale;
+        }
+    }
+
+    void Scene::AddModels(const std::vector<ModelDescriptor>& descriptors)
+    {
+        LoadModels(descriptors);
+        while (UpdateLoading())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    bool Scene::UpdateLoading()
+    {
+        bool loading = false;
+        for (int i = 0; i < loaders.size(); ++i)
+        {
+            if (!loaders[i])
+                continue;
+            if (loaders[i]->Update(models[i]))
+            {
+                if (loaders[i]->Failed())
+                    std::cout << "Failed to load model " << loaders[i]->Filename() << ": " << loaders[i]->Error() << std::endl;
+                else
+                    std::cout << "Model " << loaders[i]->Filename() << " loaded.\n# faces: " << models[i].TriangleCount() <<
+                        ", # unique vertices: " << models[i].VertexCount() << ", # edges: " << models[i].EdgeCount() << std::endl;
+                loaders[i].reset();
+            }
+            else
+                loading = true;
+        }
+        return loading;
+    }
+
     unsigned int Scene::TotalTriangles()
     {
         unsigned int total = 0;
         for (int i = 0; i < models.size(); ++i)
-            total += models[i].m_Triangles.size();
+            total += models[i].TriangleCount();
         return total;
     }
 
@@ -59,6 +123,16 @@ namespace SoftwareRasterizer
         std::cout << "'k' - toggle front face CCW or CW" << std::endl;       
         std::cout << "'l' - toggle depth test" << std::endl;       
         std::cout << "';' - display rendered triangle count" << std::endl;       
+        std::cout << "'r' - toggle half-space or scanline rasterizer" << std::endl;
+        std::cout << "'f' - cycle depth buffer format" << std::endl;
+        std::cout << "'g' - toggle reversed-Z depth" << std::endl;
+        std::cout << "'v' - toggle visibility buffer (deferred) shading" << std::endl;
+        std::cout << "'h' - toggle depth pre-pass" << std::endl;
+        std::cout << "'x' - toggle specialized or generic raster kernels" << std::endl;
+        std::cout << "'b' - cycle flat, Blinn-Phong, normal or texture coordinate shading" << std::endl;
+        std::cout << "'m' - cycle 1x, 4x or 8x multisample anti-aliasing" << std::endl;
+        std::cout << "'n' - toggle float or quantized vertices" << std::endl;
+        std::cout << "'t' - toggle meshlet culling" << std::endl;
         std::cout << "***********************" << std::endl;        
         while (!windowClose)
         {
@@ -67,18 +141,10 @@ namespace SoftwareRasterizer
             keyPressed = (char)cv::waitKey(1);
             ProcessInput(keyPressed);
 
-            // Start with a cleared image and z-buffer. Z-buffer cleared value = 1,
-            // farthest depth of view volume in clip space.
-            frame = cv::Mat(h, w, CV_32FC3, cv::Scalar(0,0,0));
-            frameZ = cv::Mat(h, w, CV_32FC3, cv::Scalar(1,1,1));
-
-            // Render all models.
-            unsigned int trianglesRendered = 0;
+            // Take in what background loading has finished, then render all models.
+            UpdateLoading();
             startFrameTime = clock();
-            glm::mat4 V = camera.getViewMatrix();
-#pragma omp parallel for
-            for (int i = 0; i < models.size(); ++i)            
-                models[i].Draw(frame, frameZ, P, V, w, h, frameCount, wireframeOn, cullFace, frontFaceCCW, depthTest, trianglesRendered);
+            unsigned int trianglesRendered = RenderFrame(P);
             endFrameTime = clock();
 
             // Draw text info if necessary.
@@ -91,21 +157,144 @@ namespace SoftwareRasterizer
             }
             if (showRenderedTriangleCount)
             {
-                std::string FPStext = "% triangles rendered: " + std::to_string(
-                    double(trianglesRendered)/double(this->TotalTriangles()));
+                std::string FPStext = wireframeOn ?
+                    "% edges rendered: " + std::to_string(double(trianglesRendered) / double(this->TotalEdges())) :
+                    "% triangles rendered: " + std::to_string(double(trianglesRendered)/double(this->TotalTriangles()));
                 cv::putText(frame, FPStext, cv::Point(10, 50), cv::FONT_HERSHEY_SIMPLEX,
                     0.75, cv::Scalar(255, 255, 255, 255), 2, cv::LINE_AA);
             }
 
+            // Text is drawn behind the binner's back, so the tiles under it need clearing.
+            if (showFPS || showRenderedTriangleCount)
+                binner.Invalidate(cv::Rect(0, 0, w, 64));
+
             // Finally, display results.
             if(showDepth)
-                cv::imshow("Software Rasterizer", frameZ);
+            {
+                // With multisampling the first sample's depth is shown. The binner draws the
+                // scanline rasterizer and the visibility buffer without samples.
+                if (samples > 1 && rasterAlgorithm == RASTER_ALGORITHM::HALF_SPACE && !visibilityBufferOn)
+                {
+                    frameSamples.Depth().Visualize(depthView);
+                    depthView = depthView(cv::Rect(0, 0, w, h));
+                }
+                else
+                    frameZ.Visualize(depthView);
+                cv::imshow("Software Rasterizer", depthView);
+            }
             else
                 cv::imshow("Software Rasterizer", frame);
             frameCount++;
         }
 	}
 
+    template <class VertexShader, class FragmentShader>
+    void Scene::RenderShaded(const glm::mat4& P, const glm::mat4& V, const FragmentShader& shader,
+        bool reallocated, unsigned int& trianglesRendered)
+    {
+        binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), frameZ.ClearValue(), VertexShader::VARYINGS);
+        if (reallocated)
+            binner.Invalidate();
+        for (int i = 0; i < models.size(); ++i)
+        {
+            VertexShader vertexShader(P, V, models[i].ModelMatrix(frameCount));
+            models[i].Draw(binner, vertexShader, w, h, cullFace, frontFaceCCW, i, trianglesRendered);
+        }
+        FragmentProgram program(shader);
+        binner.Rasterize(frame, frameZ, wireframeOn, depthTest, rasterAlgorithm, depthPrepass,
+            visibilityBufferOn ? &frameIDs : nullptr, &program, samples > 1 ? &frameSamples : nullptr);
+    }
+
+    unsigned int Scene::RenderFrame(const glm::mat4& P)
+    {
+        // The image and z-buffer persist across frames and are only reallocated when the
+        // size or depth settings change. The binner clears them tile by tile as it draws.
+        bool reallocated = false;
+        if (frame.rows != h || frame.cols != w || frame.type() != CV_32FC3)
+        {
+            frame.create(h, w, CV_32FC3);
+            reallocated = true;
+        }
+        if (frameZ.Width() != w || frameZ.Height() != h || frameZ.Format() != depthFormat ||
+            frameZ.Compare() != depthCompare || frameZ.ReversedZ() != reversedZ)
+        {
+            frameZ.Create(w, h, depthFormat, depthCompare, reversedZ);
+            reallocated = true;
+        }
+        if (visibilityBufferOn && (frameIDs.rows != h || frameIDs.cols != w))
+        {
+            frameIDs.create(h, w, CV_32SC1);
+            reallocated = true;
+        }
+        if (samples > 1 && (frameSamples.Width() != w || frameSamples.Height() != h ||
+            frameSamples.Samples() != samples || frameSamples.Depth().Format() != depthFormat ||
+            frameSamples.Depth().Compare() != depthCompare || frameSamples.Depth().ReversedZ() != reversedZ))
+        {
+            frameSamples.Create(w, h, samples, depthFormat, depthCompare, reversedZ);
+            reallocated = true;
+        }
+
+        // Z-buffer cleared value = 1, farthest window depth of the view volume, or 0 if the
+        // compare mode keeps farther depths.
+        bool keepNearer = depthCompare == DEPTH_COMPARE::LESS || depthCompare == DEPTH_COMPARE::LEQUAL;
+        frameZ.SetClearValue(keepNearer ? 1.0f : 0.0f);
+        if (samples > 1)
+            frameSamples.Depth().SetClearValue(keepNearer ? 1.0f : 0.0f);
+
+        // Models still loading keep float vertices until they are complete.
+        for (int i = 0; i < models.size(); ++i)
+            if ((i >= loaders.size() || !loaders[i]) && models[i].VertexFormat() != vertexFormat)
+                models[i].SetVertexFormat(vertexFormat);
+        for (Model& model : models)
+            model.meshletCulling = meshletCulling;
+
+        // Models queue their triangles in order, then the binner rasterizes screen tiles
+        // in parallel.
+        unsigned int trianglesRendered = 0;
+        glm::mat4 V = camera.getViewMatrix();
+        binner.SetSpecializedKernels(specializedKernels);
+
+        // Wireframes draw every unique edge once as a flat colored line, whatever the shading.
+        if (wireframeOn)
+        {
+            binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), frameZ.ClearValue());
+            if (reallocated)
+                binner.Invalidate();
+            for (int i = 0; i < models.size(); ++i)
+                models[i].DrawEdges(binner, P, V, w, h, frameCount, cullFace, frontFaceCCW, i, trianglesRendered);
+            binner.Rasterize(frame, frameZ, wireframeOn, depthTest, rasterAlgorithm, depthPrepass,
+                visibilityBufferOn ? &frameIDs : nullptr, nullptr, samples > 1 ? &frameSamples : nullptr);
+            return trianglesRendered;
+        }
+
+        if (shading == SHADING_MODE::BLINN_PHONG)
+        {
+            glm::vec3 eye = glm::vec3(glm::inverse(V)[3]);
+            RenderShaded<BlinnPhongVertexShader>(P, V, BlinnPhongFragmentShader(lights, eye, ambientLight), reallocated,
+                trianglesRendered);
+            return trianglesRendered;
+        }
+        if (shading == SHADING_MODE::NORMALS)
+        {
+            RenderShaded<NormalVertexShader>(P, V, NormalFragmentShader(), reallocated, trianglesRendered);
+            return trianglesRendered;
+        }
+        if (shading == SHADING_MODE::TEXCOORDS)
+        {
+            RenderShaded<TexcoordVertexShader>(P, V, TexcoordFragmentShader(), reallocated, trianglesRendered);
+            return trianglesRendered;
+        }
+
+        binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), frameZ.ClearValue());
+        if (reallocated)
+            binner.Invalidate();
+        for (int i = 0; i < models.size(); ++i)
+            models[i].Draw(binner, P, V, w, h, frameCount, cullFace, frontFaceCCW, i, trianglesRendered);
+        binner.Rasterize(frame, frameZ, wireframeOn, depthTest, rasterAlgorithm, depthPrepass,
+            visibilityBufferOn ? &frameIDs : nullptr, nullptr, samples > 1 ? &frameSamples : nullptr);
+        return trianglesRendered;
+    }
+
     void Scene::ProcessInput(char c)
     {
         if (c == 27)//'ESC' key.
@@ -146,6 +335,60 @@ namespace SoftwareRasterizer
             this->depthTest = !this->depthTest;
         else if (c == ';')
             this->showRenderedTriangleCount = !this->showRenderedTriangleCount;
+        else if (c == 'r')
+        {
+            this->rasterAlgorithm = this->rasterAlgorithm == RASTER_ALGORITHM::HALF_SPACE ?
+                RASTER_ALGORITHM::SCANLINE : RASTER_ALGORITHM::HALF_SPACE;
+            std::cout << (this->rasterAlgorithm == RASTER_ALGORITHM::HALF_SPACE ?
+                "half-space rasterizer" : "scanline rasterizer") << std::endl;
+        }
+        else if (c == 'f')
+        {
+            const char* names[] = { "float32", "24-bit unorm + 8-bit stencil", "16-bit unorm" };
+            this->depthFormat = DEPTH_FORMAT((int(this->depthFormat) + 1) % 3);
+            std::cout << "depth format: " << names[int(this->depthFormat)] << std::endl;
+        }
+        else if (c == 'g')
+        {
+            this->reversedZ = !this->reversedZ;
+            std::cout << "reversed-Z " << (this->reversedZ ? "on" : "off") << std::endl;
+        }
+        else if (c == 'v')
+        {
+            this->visibilityBufferOn = !this->visibilityBufferOn;
+            std::cout << "visibility buffer " << (this->visibilityBufferOn ? "on" : "off") << std::endl;
+        }
+        else if (c == 'h')
+        {
+            this->depthPrepass = !this->depthPrepass;
+            std::cout << "depth pre-pass " << (this->depthPrepass ? "on" : "off") << std::endl;
+        }
+        else if (c == 'b')
+        {
+            const char* names[] = { "flat", "Blinn-Phong", "normal", "texture coordinate" };
+            this->shading = SHADING_MODE((int(this->shading) + 1) % 4);
+            std::cout << names[int(this->shading)] << " shading" << std::endl;
+        }
+        else if (c == 'm')
+        {
+            this->samples = this->samples == 1 ? 4 : this->samples == 4 ? 8 : 1;
+            std::cout << this->samples << "x multisampling" << std::endl;
+        }
+        else if (c == 'n')
+        {
+            this->vertexFormat = this->vertexFormat == VERTEX_FORMAT::FLOAT ? VERTEX_FORMAT::QUANTIZED : VERTEX_FORMAT::FLOAT;
+            std::cout << (this->vertexFormat == VERTEX_FORMAT::FLOAT ? "float" : "quantized") << " vertices" << std::endl;
+        }
+        else if (c == 't')
+        {
+            this->meshletCulling = !this->meshletCulling;
+            std::cout << "meshlet culling " << (this->meshletCulling ? "on" : "off") << std::endl;
+        }
+        else if (c == 'x')
+        {
+            this->specializedKernels = !this->specializedKernels;
+            std::cout << (this->specializedKernels ? "specialized" : "generic") << " raster kernels" << std::endl;
+        }
         else if (c == 'p')
         {
             // Ensure screenshots are not being overwritten.
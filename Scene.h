@@ -1,21 +1,58 @@
 #pragma once
 #include "Camera.h"
+#include "Rasterizer.h"
+#include "TileBinner.h"
+#include "DepthBuffer.h"
+#include "Multisample.h"
+#include "Shader.h"
+#include "Lighting.h"
+#include "PackedVertex.h"
 #include <vector>
+#include <memory>
 #include <filesystem>
 #include <ctime>
+#include <glm/glm.hpp>
 #include <opencv2/opencv.hpp>
 
 namespace SoftwareRasterizer
 {
 	class Camera;
 	class Model;
+	class ModelLoader;
+
+	/**
+	*  \brief How triangles are colored. FLAT fills them with their material's diffuse color
+	*         using the built-in kernels, BLINN_PHONG lights every pixel with the scene's
+	*         lights, and the others are debug views.
+	*/
+	enum class SHADING_MODE { FLAT, BLINN_PHONG, NORMALS, TEXCOORDS };
+
+	/**
+	*  \brief A model file to load and where to put it.
+	*/
+	struct ModelDescriptor
+	{
+		std::string filename;
+		glm::vec3 position;
+		glm::vec3 rotation;
+		float scale;
+
+		ModelDescriptor(const std::string& filename, const glm::vec3& position = glm::vec3(0),
+			const glm::vec3& rotation = glm::vec3(0), float scale = 1.0f)
+			: filename(filename), position(position), rotation(rotation), scale(scale) {}
+	};
 
 	class Scene
 	{
 	public:
 		
-		// Objects for output frame and z-buffer.
-		cv::Mat frame, frameZ;
+		// Objects for output frame and z-buffer, the visibility buffer (CV_32SC1 binner
+		// triangle index + 1 per pixel) used when visibilityBufferOn is set, and the samples
+		// drawn into and resolved to frame with multisampling.
+		cv::Mat frame;
+		DepthBuffer frameZ;
+		cv::Mat frameIDs;
+		MultisampleTarget frameSamples;
 
 		int w, h;
 		Camera camera;
@@ -28,18 +65,82 @@ namespace SoftwareRasterizer
 		bool cullFace;
 		bool frontFaceCCW;
 		bool wireframeOn;
+		bool visibilityBufferOn;
+		bool depthPrepass;
+		bool specializedKernels;
+		SHADING_MODE shading;
+		// World-space lights and ambient light for BLINN_PHONG shading.
+		std::vector<Light> lights;
+		glm::vec3 ambientLight;
 		bool depthTest;
 		bool showRenderedTriangleCount;
+		RASTER_ALGORITHM rasterAlgorithm;
+		DEPTH_FORMAT depthFormat;
+		DEPTH_COMPARE depthCompare;
+		bool reversedZ;
+		// Samples per pixel: 1, or 4 or 8 for multisample anti-aliasing.
+		int samples;
+		// How models that have finished loading store their vertices (see PackedVertex.h).
+		VERTEX_FORMAT vertexFormat;
+		// Cull whole meshlets against the view volume and by facing before transforming them.
+		bool meshletCulling;
 		char keyPressed;
 
 		Scene();
 		~Scene();
 		void AddModel(std::string filename);
+
+		/*!
+		*  \brief Adds an empty model right away and loads it in the background (see
+		*         ModelLoader.h). It fills in as UpdateLoading() hands over what was loaded,
+		*         which Draw() does every frame.
+		*/
+		void LoadModel(std::string filename);
+
+		/*!
+		*  \brief Adds a model per descriptor, in order, with its transform set, and loads
+		*         them all in the background at once. Loading runs on a shared pool with a
+		*         thread per hardware thread, and each model's textures are decoded in
+		*         parallel as well.
+		*/
+		void LoadModels(const std::vector<ModelDescriptor>& descriptors);
+
+		/*!
+		*  \brief Same as LoadModels(), but returns only once every model, including any
+		*         still loading from before, has finished.
+		*/
+		void AddModels(const std::vector<ModelDescriptor>& descriptors);
+
+		/*!
+		*  \brief Moves whatever the background loaders have finished into their models.
+		*
+		* \return True while any model is still loading.
+		*/
+		bool UpdateLoading();
 		void Draw();
+
+		/*!
+		*  \brief Renders the current scene state into frame and frameZ once, without any
+		*         window or input handling. frameZ is (re)created whenever the size or the
+		*         depth settings changed.
+		*
+		* \return Number of triangles that survived culling and were queued for rasterization,
+		*         or in wireframe mode the number of edges.
+		*/
+		unsigned int RenderFrame(const glm::mat4& P);
 		unsigned int TotalTriangles();
+		unsigned int TotalEdges();
 
 	private:
+		// Loader of models[i] while it loads in the background, null otherwise.
+		std::vector<std::unique_ptr<ModelLoader>> loaders;
 		clock_t startFrameTime, endFrameTime;
+		TileBinner binner;
+		cv::Mat depthView;
 		void ProcessInput(char c);
+
+		template <class VertexShader, class FragmentShader>
+		void RenderShaded(const glm::mat4& P, const glm::mat4& V, const FragmentShader& shader,
+			bool reallocated, unsigned int& trianglesRendered);
 	};
 }
\ No newline at end of file
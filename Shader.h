@@ -0,0 +1,339 @@
+/*
+*	Shader.h -- programmable vertex and fragment shading. Shaders are plain types passed as
+*				template arguments, so a draw call compiles them into the vertex loop and the
+*				raster kernel's pixel loop; there is no virtual call or function pointer per
+*				vertex or fragment. Uniforms are the shaders' own members.
+*
+*				A vertex shader runs once per model vertex:
+*
+*					struct MyVertexShader
+*					{
+*						static const int VARYINGS = 3;	// floats passed to the fragment shader
+*						glm::vec4 Shade(const Vertex& in, float* varyings) const;	// clip position
+*					};
+*
+*				and a fragment shader on two 2x2 pixel quads at a time, on the varyings
+*				interpolated across the triangle:
+*
+*					struct MyFragmentShader
+*					{
+*						static const int VARYINGS = 3;	// as written by the vertex shader
+*						void Shade(const Fragment8<VARYINGS>& in, float8 color[3]) const;	// BGR
+*					};
+*
+*				Shading whole quads, including pixels of them the triangle does not cover, makes
+*				screen-space derivatives of anything the shader computes available as plain
+*				differences between lanes (quadDdx() and quadDdy()).
+*/
+
+#pragma once
+#include "RasterKernel.h"
+#include "Material.h"
+#include "Vertex.h"
+#include "SIMD.h"
+#include <glm/glm.hpp>
+
+namespace SoftwareRasterizer
+{
+    // Pixel offsets of the lanes of a Fragment8 from its (x, y): top-left, top-right,
+    // bottom-left and bottom-right of the quad at (x, y), then of the quad at (x + 2, y).
+    SR_ALIGN(32) const float QUAD_OFFSET_X[8] = { 0, 1, 0, 1, 2, 3, 2, 3 };
+    SR_ALIGN(32) const float QUAD_OFFSET_Y[8] = { 0, 0, 1, 1, 0, 0, 1, 1 };
+    SR_ALIGN(32) const float QUAD_SIGN_X[8] = { 1, -1, 1, -1, 1, -1, 1, -1 };
+    SR_ALIGN(32) const float QUAD_SIGN_Y[8] = { 1, 1, -1, -1, 1, 1, -1, -1 };
+
+    /**
+    *  \brief Fragment shader input for two 2x2 quads, in the lane order of QUAD_OFFSET_X/Y.
+    *         Only lanes set in mask are written; the others are helper pixels outside the
+    *         triangle, with varyings extrapolated from its planes, that are shaded only for
+    *         derivatives. texture is the material's diffuse map, if it has one.
+    */
+    template <int N>
+    struct Fragment8
+    {
+        int x, y;
+        int mask;
+        float8 varyings[N > 0 ? N : 1];
+        const Material* material;
+        const Texture* texture;
+    };
+
+    /*!
+    *  \brief Screen-space derivatives of a value shaded on quads: its difference across each
+    *         quad in x or y, the same for all four lanes of the quad.
+    */
+    SR_FORCEINLINE float8 quadDdx(float8 v) { return (shuffle8<0xB1>(v) - v) * load8(QUAD_SIGN_X); }
+    SR_FORCEINLINE float8 quadDdy(float8 v) { return (shuffle8<0x4E>(v) - v) * load8(QUAD_SIGN_Y); }
+
+    /**
+    *  \brief Raster kernel output that interpolates a fragment shader's varyings with
+    *         perspective correction and writes the color it returns. The planes of varyings
+    *         over w and of 1/w are evaluated once per block and stepped from quad to quad.
+    */
+    template <class FragmentShader>
+    struct ShadedOutput
+    {
+        const FragmentShader& shader;
+        cv::Mat* img;
+        const float* planes;
+        const Material* material;
+        const Texture* texture;
+
+        ShadedOutput(const RasterState&, const void* shader, cv::Mat* img, const RasterPrimitive& prim)
+            : shader(*static_cast<const FragmentShader*>(shader)), img(img), planes(prim.varyings),
+            material(prim.material), texture(prim.texture) {}
+
+        /*!
+        *  \brief Shades the two quads at (x, y) and (x + 2, y) and writes the lanes in mask to
+        *         out, which points at pixel (x, y) of an image with stride pixels per row.
+        *         overW holds the varyings over w there, then 1/w.
+        */
+        SR_FORCEINLINE void ShadeQuads(int x, int y, int mask, const float8* overW, cv::Vec3f* out,
+            size_t stride) const
+        {
+            const int N = FragmentShader::VARYINGS;
+            Fragment8<N> in;
+            in.x = x;
+            in.y = y;
+            in.mask = mask;
+            in.material = material;
+            in.texture = texture;
+
+            // One division per eight pixels. Helper lanes may lie beyond the triangle's
+            // horizon, so keep 1/w positive there.
+            if (N > 0)
+            {
+                float8 w = set1(1.0f) / max8(overW[N], set1(1e-30f));
+                for (int k = 0; k < N; ++k)
+                    in.varyings[k] = overW[k] * w;
+            }
+
+            float8 color[3];
+            shader.Shade(in, color);
+            SR_ALIGN(32) float lanes[3][8];
+            for (int c = 0; c < 3; ++c)
+                store8(lanes[c], color[c]);
+            for (int k = 0; k < 8; ++k)
+            {
+                if ((mask >> k) & 1)
+                    out[int(QUAD_OFFSET_Y[k]) * stride + int(QUAD_OFFSET_X[k])] =
+                        cv::Vec3f(lanes[0][k], lanes[1][k], lanes[2][k]);
+            }
+        }
+
+        SR_FORCEINLINE void WriteBlock(int x, int y, const int* masks) const
+        {
+            ShadePixels(x, y, masks, img->ptr<cv::Vec3f>(y) + x, img->step / sizeof(cv::Vec3f));
+        }
+
+        // Multisampled pixels are shaded at their centers, like any other.
+        SR_FORCEINLINE bool ShadeBlock(int x, int y, const int* masks, cv::Vec3f* colors) const
+        {
+            ShadePixels(x, y, masks, colors, RASTER_BLOCK_SIZE);
+            return true;
+        }
+
+        /*!
+        *  \brief Shades the pixels in masks of the 8x8 block at (x, y) into out, which points
+        *         at pixel (x, y) of an image with stride pixels per row.
+        */
+        SR_FORCEINLINE void ShadePixels(int x, int y, const int* masks, cv::Vec3f* out, size_t stride) const
+        {
+            // Planes at the lanes of the block's first two quads, and their steps to the next
+            // two quads to the right and the next row pair down. Without varyings there are
+            // no planes, not even for 1/w.
+            const int N = FragmentShader::VARYINGS;
+            const int planeCount = N > 0 ? N + 1 : 0;
+            const float8 offsetX = load8(QUAD_OFFSET_X), offsetY = load8(QUAD_OFFSET_Y);
+            float8 row[N + 1], stepX[N + 1], stepY[N + 1];
+            for (int k = 0; k < planeCount; ++k)
+            {
+                const float* p = planes + 3 * k;
+                row[k] = set1(p[0] * (x + 0.5f) + p[1] * (y + 0.5f) + p[2]) + offsetX * p[0] + offsetY * p[1];
+                stepX[k] = set1(4.0f * p[0]);
+                stepY[k] = set1(2.0f * p[1]);
+            }
+
+            // Rows pair up into quads, and each half of a row pair holds two quads.
+            for (int r = 0; r < RASTER_BLOCK_SIZE; r += 2)
+            {
+                for (int half = 0; half < 2; ++half)
+                {
+                    int top = (masks[r] >> (4 * half)) & 0xF;
+                    int bottom = (masks[r + 1] >> (4 * half)) & 0xF;
+                    if (top | bottom)
+                    {
+                        int mask = (top & 3) | ((bottom & 3) << 2) | ((top & 0xC) << 2) | ((bottom & 0xC) << 4);
+                        if (half)
+                        {
+                            float8 right[N + 1];
+                            for (int k = 0; k < planeCount; ++k)
+                                right[k] = row[k] + stepX[k];
+                            ShadeQuads(x + 4, y + r, mask, right, out + r * stride + 4, stride);
+                        }
+                        else
+                            ShadeQuads(x, y + r, mask, row, out + r * stride, stride);
+                    }
+                }
+                for (int k = 0; k < planeCount; ++k)
+                    row[k] = row[k] + stepY[k];
+            }
+        }
+    };
+
+    /**
+    *  \brief A fragment shader with its type erased, so the binner can draw with it without
+    *         being a template itself. The shader's kernels are instantiated where the program
+    *         is made, and one is picked per draw. The shader must outlive the program.
+    */
+    class FragmentProgram
+    {
+    public:
+        template <class FragmentShader>
+        explicit FragmentProgram(const FragmentShader& shader) : shader(&shader),
+            varyings(FragmentShader::VARYINGS), select(&selectKernel<ShadedOutput<FragmentShader>>),
+            resolve(&resolveBlock<FragmentShader>)
+        {
+            static_assert(FragmentShader::VARYINGS <= MAX_VARYINGS, "too many varyings");
+        }
+
+        int Varyings() const { return varyings; }
+
+        /*!
+        *  \brief Kernel running the shader for drawing into a CV_32FC3 image and depth, or
+        *         into a MultisampleTarget's color and depth with more than one sample.
+        */
+        RasterKernel Kernel(bool wireframeOn, bool depthTest, const DepthBuffer& depth, int samples = 1) const
+        {
+            RasterState state = { RASTER_OUTPUT::COLOR, wireframeOn, depthTest, depth.Format(), depth.StoredCompare(),
+                samples };
+            return RasterKernel(state, select(state), shader);
+        }
+
+        /*!
+        *  \brief Shades the pixels in masks of the 8x8 block at (x, y) of a CV_32FC3 image as
+        *         prim, in quads, as the kernel would have drawn them. For resolving a
+        *         visibility buffer; depth is not tested or written.
+        */
+        void ShadeBlock(const RasterPrimitive& prim, cv::Mat& img, int x, int y, const int* masks) const
+        {
+            resolve(shader, prim, img, x, y, masks);
+        }
+
+    private:
+        const void* shader;
+        int varyings;
+        RasterKernel::KernelFunction (*select)(const RasterState& state);
+        void (*resolve)(const void* shader, const RasterPrimitive& prim, cv::Mat& img, int x, int y,
+            const int* masks);
+
+        template <class FragmentShader>
+        static void resolveBlock(const void* shader, const RasterPrimitive& prim, cv::Mat& img, int x, int y,
+            const int* masks)
+        {
+            RasterState state = { RASTER_OUTPUT::COLOR, false, false, DEPTH_FORMAT::FLOAT32, DEPTH_COMPARE::LESS, 1 };
+            ShadedOutput<FragmentShader>(state, shader, &img, prim).WriteBlock(x, y, masks);
+        }
+    };
+
+    /**
+    *  \brief Transforms positions by P * V * M and passes nothing on.
+    */
+    struct FlatVertexShader
+    {
+        static const int VARYINGS = 0;
+        glm::mat4 MVP;
+
+        FlatVertexShader(const glm::mat4& P, const glm::mat4& V, const glm::mat4& M) : MVP(P * V * M) {}
+
+        glm::vec4 Shade(const Vertex& in, float*) const { return MVP * glm::vec4(in.position, 1.0f); }
+    };
+
+    /**
+    *  \brief The material's diffuse color, as drawn by the built-in color kernel.
+    */
+    struct FlatFragmentShader
+    {
+        static const int VARYINGS = 0;
+
+        SR_FORCEINLINE void Shade(const Fragment8<VARYINGS>& in, float8 color[3]) const
+        {
+            color[0] = set1(in.material->diffuse.z);
+            color[1] = set1(in.material->diffuse.y);
+            color[2] = set1(in.material->diffuse.x);
+        }
+    };
+
+    /**
+    *  \brief Passes on the world-space normal, for NormalFragmentShader.
+    */
+    struct NormalVertexShader
+    {
+        static const int VARYINGS = 3;
+        glm::mat4 MVP;
+        glm::mat3 normalMatrix;
+
+        NormalVertexShader(const glm::mat4& P, const glm::mat4& V, const glm::mat4& M) : MVP(P * V * M),
+            normalMatrix(glm::transpose(glm::inverse(glm::mat3(M)))) {}
+
+        glm::vec4 Shade(const Vertex& in, float* varyings) const
+        {
+            glm::vec3 n = normalMatrix * in.normal;
+            varyings[0] = n.x;
+            varyings[1] = n.y;
+            varyings[2] = n.z;
+            return MVP * glm::vec4(in.position, 1.0f);
+        }
+    };
+
+    /**
+    *  \brief Debug view of the normal, renormalized per pixel and mapped from [-1, 1] to
+    *         [0, 1] as red (x), green (y) and blue (z).
+    */
+    struct NormalFragmentShader
+    {
+        static const int VARYINGS = 3;
+
+        SR_FORCEINLINE void Shade(const Fragment8<VARYINGS>& in, float8 color[3]) const
+        {
+            const float8* n = in.varyings;
+            float8 scale = set1(0.5f) / sqrt8(max8(n[0] * n[0] + n[1] * n[1] + n[2] * n[2], set1(1e-12f)));
+            color[0] = n[2] * scale + 0.5f;
+            color[1] = n[1] * scale + 0.5f;
+            color[2] = n[0] * scale + 0.5f;
+        }
+    };
+
+    /**
+    *  \brief Passes on the texture coordinates, for TexcoordFragmentShader.
+    */
+    struct TexcoordVertexShader
+    {
+        static const int VARYINGS = 2;
+        glm::mat4 MVP;
+
+        TexcoordVertexShader(const glm::mat4& P, const glm::mat4& V, const glm::mat4& M) : MVP(P * V * M) {}
+
+        glm::vec4 Shade(const Vertex& in, float* varyings) const
+        {
+            varyings[0] = in.texcoord.x;
+            varyings[1] = in.texcoord.y;
+            return MVP * glm::vec4(in.position, 1.0f);
+        }
+    };
+
+    /**
+    *  \brief Debug view of the texture coordinates, wrapped to [0, 1): u in red, v in green.
+    */
+    struct TexcoordFragmentShader
+    {
+        static const int VARYINGS = 2;
+
+        SR_FORCEINLINE void Shade(const Fragment8<VARYINGS>& in, float8 color[3]) const
+        {
+            color[0] = set1(0.0f);
+            color[1] = in.varyings[1] - floor8(in.varyings[1]);
+            color[2] = in.varyings[0] - floor8(in.varyings[0]);
+        }
+    };
+}
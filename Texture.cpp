@@ -0,0 +1,264 @@
+#include "Texture.h"
+#include <algorithm>
+#include <cmath>
+
+namespace SoftwareRasterizer
+{
+    // Spreads the low 16 bits of v out to the even bit positions.
+    static uint32_t spreadBits(uint32_t v)
+    {
+        v &= 0xFFFF;
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+
+    static int nextPowerOfTwo(int v)
+    {
+        int p = 1;
+        while (p < v)
+            p <<= 1;
+        return p;
+    }
+
+    static int log2i(int v)
+    {
+        int l = 0;
+        while ((1 << l) < v)
+            ++l;
+        return l;
+    }
+
+    Texture::Texture() {}
+
+    void Texture::Create(const cv::Mat& img)
+    {
+        m_Levels.clear();
+        m_Texels.clear();
+        m_SwizzleX.clear();
+        m_SwizzleY.clear();
+        if (img.empty())
+            return;
+
+        cv::Mat src = img;
+        int w = nextPowerOfTwo(img.cols), h = nextPowerOfTwo(img.rows);
+        if (w != img.cols || h != img.rows)
+            cv::resize(img, src, cv::Size(w, h), 0, 0, cv::INTER_LINEAR);
+
+        // Pack level 0 row by row, as four channels.
+        std::vector<uint32_t> level(size_t(w) * h);
+        int channels = src.channels();
+        for (int y = 0; y < h; ++y)
+        {
+            const unsigned char* row = src.ptr<unsigned char>(y);
+            for (int x = 0; x < w; ++x)
+            {
+                const unsigned char* p = row + x * channels;
+                uint32_t c0 = p[0];
+                uint32_t c1 = channels >= 3 ? p[1] : p[0];
+                uint32_t c2 = channels >= 3 ? p[2] : p[0];
+                uint32_t c3 = channels == 4 ? p[3] : 255;
+                level[size_t(y) * w + x] = c0 | (c1 << 8) | (c2 << 16) | (c3 << 24);
+            }
+        }
+
+        while (true)
+        {
+            // Swizzle tables. A non-square level is a row or column of square Morton blocks,
+            // so the bits of the longer side above the shorter side's go on top.
+            MipLevel l;
+            l.w = w;
+            l.h = h;
+            l.offset = m_Texels.size();
+            l.swizzleX = m_SwizzleX.size();
+            l.swizzleY = m_SwizzleY.size();
+            int square = std::min(log2i(w), log2i(h));
+            uint32_t low = (1u << square) - 1;
+            for (int x = 0; x < w; ++x)
+                m_SwizzleX.push_back(spreadBits(x & low) | ((uint32_t(x) >> square) << (2 * square)));
+            for (int y = 0; y < h; ++y)
+                m_SwizzleY.push_back((spreadBits(y & low) << 1) | ((uint32_t(y) >> square) << (2 * square)));
+            m_Levels.push_back(l);
+
+            m_Texels.resize(l.offset + level.size());
+            for (int y = 0; y < h; ++y)
+                for (int x = 0; x < w; ++x)
+                    m_Texels[l.offset + (m_SwizzleX[l.swizzleX + x] | m_SwizzleY[l.swizzleY + y])] =
+                        level[size_t(y) * w + x];
+
+            if (w == 1 && h == 1)
+                break;
+
+            // Box filter down to the next level, rounding each channel to nearest.
+            int nw = std::max(w / 2, 1), nh = std::max(h / 2, 1);
+            int sx = w / nw, sy = h / nh;
+            std::vector<uint32_t> next(size_t(nw) * nh);
+            for (int y = 0; y < nh; ++y)
+            {
+                for (int x = 0; x < nw; ++x)
+                {
+                    uint32_t packed = 0;
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        uint32_t sum = 0;
+                        for (int j = 0; j < sy; ++j)
+                            for (int i = 0; i < sx; ++i)
+                                sum += (level[size_t(y * sy + j) * w + x * sx + i] >> (8 * c)) & 0xFF;
+                        uint32_t n = sx * sy;
+                        packed |= ((sum + n / 2) / n) << (8 * c);
+                    }
+                    next[size_t(y) * nw + x] = packed;
+                }
+            }
+            level.swap(next);
+            w = nw;
+            h = nh;
+        }
+    }
+
+    float Texture::Lod(float dudx, float dvdx, float dudy, float dvdy) const
+    {
+        float w = float(m_Levels[0].w), h = float(m_Levels[0].h);
+        float rx = dudx * dudx * w * w + dvdx * dvdx * h * h;
+        float ry = dudy * dudy * w * w + dvdy * dvdy * h * h;
+        return 0.5f * std::log2(std::max(rx, ry));
+    }
+
+    float8 Texture::Lod8(float8 dudx, float8 dvdx, float8 dudy, float8 dvdy) const
+    {
+        float w2 = float(m_Levels[0].w) * float(m_Levels[0].w);
+        float h2 = float(m_Levels[0].h) * float(m_Levels[0].h);
+        float8 rx = dudx * dudx * w2 + dvdx * dvdx * h2;
+        float8 ry = dudy * dudy * w2 + dvdy * dvdy * h2;
+        SR_ALIGN(32) float lanes[8];
+        store8(lanes, max8(rx, ry));
+        for (int k = 0; k < 8; ++k)
+            lanes[k] = 0.5f * std::log2(lanes[k]);
+        return load8(lanes);
+    }
+
+    void Texture::FilterLevel(const float* u, const float* v, const int* level, bool bilinear, int count,
+        float8 out[4]) const
+    {
+        SR_ALIGN(32) float sizeW[8] = {}, sizeH[8] = {};
+        for (int k = 0; k < count; ++k)
+        {
+            sizeW[k] = float(m_Levels[level[k]].w);
+            sizeH[k] = float(m_Levels[level[k]].h);
+        }
+
+        // Texel space coordinates of the sample, relative to texel centers when blending.
+        // Wrapping to [0, 1) first keeps them small enough to convert to int exactly.
+        float8 uu = load8(u), vv = set1(1.0f) - load8(v);
+        uu = uu - floor8(uu);
+        vv = vv - floor8(vv);
+        float8 half = set1(bilinear ? 0.5f : 0.0f);
+        float8 s = uu * load8(sizeW) - half;
+        float8 t = vv * load8(sizeH) - half;
+        float8 s0 = floor8(s), t0 = floor8(t);
+        SR_ALIGN(32) float x0[8], y0[8];
+        store8(x0, s0);
+        store8(y0, t0);
+
+        // Gather the footprint of every lane, unpacked into one vector per corner and channel.
+        SR_ALIGN(32) float texels[4][4][8] = {};
+        int corners = bilinear ? 4 : 1;
+        for (int k = 0; k < count; ++k)
+        {
+            const MipLevel& l = m_Levels[level[k]];
+            int xs[2] = { int(x0[k]) & (l.w - 1), (int(x0[k]) + 1) & (l.w - 1) };
+            int ys[2] = { int(y0[k]) & (l.h - 1), (int(y0[k]) + 1) & (l.h - 1) };
+            for (int c = 0; c < corners; ++c)
+            {
+                uint32_t texel = Fetch(level[k], xs[c & 1], ys[c >> 1]);
+                for (int ch = 0; ch < 4; ++ch)
+                    texels[c][ch][k] = float((texel >> (8 * ch)) & 0xFF);
+            }
+        }
+
+        const float8 scale = set1(1.0f / 255.0f);
+        if (!bilinear)
+        {
+            for (int ch = 0; ch < 4; ++ch)
+                out[ch] = load8(texels[0][ch]) * scale;
+            return;
+        }
+        float8 fx = s - s0, fy = t - t0;
+        for (int ch = 0; ch < 4; ++ch)
+        {
+            float8 c00 = load8(texels[0][ch]), c10 = load8(texels[1][ch]);
+            float8 c01 = load8(texels[2][ch]), c11 = load8(texels[3][ch]);
+            float8 top = c00 + (c10 - c00) * fx;
+            float8 bottom = c01 + (c11 - c01) * fx;
+            out[ch] = (top + (bottom - top) * fy) * scale;
+        }
+    }
+
+    void Texture::Sample(const float* u, const float* v, const float* lod, TEXTURE_FILTER filter, int count,
+        float8 out[4]) const
+    {
+        float maxLevel = float(m_Levels.size() - 1);
+        SR_ALIGN(32) int level[8] = {}, upper[8] = {};
+        SR_ALIGN(32) float blend[8] = {};
+        for (int k = 0; k < count; ++k)
+        {
+            // The second test catches a NaN lod, e.g. from derivatives that are all zero.
+            float l = std::min(std::max(lod[k], 0.0f), maxLevel);
+            if (!(l >= 0.0f))
+                l = 0.0f;
+            if (filter == TEXTURE_FILTER::TRILINEAR)
+            {
+                level[k] = int(l);
+                upper[k] = std::min(level[k] + 1, int(maxLevel));
+                blend[k] = l - float(level[k]);
+            }
+            else
+                level[k] = int(l + 0.5f);
+        }
+
+        FilterLevel(u, v, level, filter != TEXTURE_FILTER::NEAREST, count, out);
+        if (filter == TEXTURE_FILTER::TRILINEAR)
+        {
+            float8 second[4];
+            FilterLevel(u, v, upper, true, count, second);
+            float8 f = load8(blend);
+            for (int ch = 0; ch < 4; ++ch)
+                out[ch] = out[ch] + (second[ch] - out[ch]) * f;
+        }
+    }
+
+    void Texture::Sample8(float8 u, float8 v, float8 lod, TEXTURE_FILTER filter, float8 out[4]) const
+    {
+        SR_ALIGN(32) float uLanes[8], vLanes[8], lodLanes[8];
+        store8(uLanes, u);
+        store8(vLanes, v);
+        store8(lodLanes, lod);
+        Sample(uLanes, vLanes, lodLanes, filter, 8, out);
+    }
+
+    cv::Vec4f Texture::Sample(float u, float v, float lod, TEXTURE_FILTER filter) const
+    {
+        SR_ALIGN(32) float uLanes[8] = { u }, vLanes[8] = { v }, lodLanes[8] = { lod };
+        float8 out[4];
+        Sample(uLanes, vLanes, lodLanes, filter, 1, out);
+        SR_ALIGN(32) float lanes[8];
+        cv::Vec4f result;
+        for (int ch = 0; ch < 4; ++ch)
+        {
+            store8(lanes, out[ch]);
+            result[ch] = lanes[0];
+        }
+        return result;
+    }
+
+    cv::Vec4f Texture::Texel(int level, int x, int y) const
+    {
+        uint32_t texel = Fetch(level, x, y);
+        cv::Vec4f result;
+        for (int ch = 0; ch < 4; ++ch)
+            result[ch] = float((texel >> (8 * ch)) & 0xFF) * (1.0f / 255.0f);
+        return result;
+    }
+}
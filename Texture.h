@@ -0,0 +1,101 @@
+/*
+*	Texture.h -- mipmapped texture storage and sampling. Every mip level is stored in Z-order
+*				 (Morton order), so texels that are close in 2D are close in memory whichever
+*				 direction a triangle walks across the texture, and a bilinear footprint rarely
+*				 spans more than one cache line.
+*/
+
+#pragma once
+#include "SIMD.h"
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <cstdint>
+
+namespace SoftwareRasterizer
+{
+    /**
+    *  \brief Texture filtering. NEAREST takes the closest texel of the closest mip level,
+    *         BILINEAR blends the four closest texels of the closest level, and TRILINEAR blends
+    *         bilinear samples of the two levels on either side of the LOD.
+    */
+    enum class TEXTURE_FILTER { NEAREST, BILINEAR, TRILINEAR };
+
+    class Texture
+    {
+    public:
+        Texture();
+
+        /*!
+        *  \brief Builds the mip chain from an 8-bit image with 1, 3 or 4 channels, keeping the
+        *         image's channel order (BGR as OpenCV loads it). Gray images are expanded to
+        *         three equal channels and images without alpha get an opaque one. Sides that
+        *         are not powers of two are resized up to the next power of two, so texture
+        *         coordinates can wrap with a mask.
+        */
+        void Create(const cv::Mat& img);
+
+        bool Empty() const { return m_Levels.empty(); }
+        int Width(int level = 0) const { return m_Levels[level].w; }
+        int Height(int level = 0) const { return m_Levels[level].h; }
+        int Levels() const { return (int)m_Levels.size(); }
+
+        /*!
+        *  \brief Level of detail for a pixel, from the screen-space derivatives of its texture
+        *         coordinates: log2 of the number of level 0 texels a one pixel step in x or y
+        *         covers, whichever is larger. The result is not clamped to the mip chain.
+        */
+        float Lod(float dudx, float dvdx, float dudy, float dvdy) const;
+        float8 Lod8(float8 dudx, float8 dvdx, float8 dudy, float8 dvdy) const;
+
+        /*!
+        *  \brief Samples eight texture coordinates at once. Coordinates wrap around (repeat),
+        *         and v = 0 is the bottom row of the image as in .obj files. lod is clamped to
+        *         the mip chain.
+        *
+        * \param [out] out Channels 0..3 of the filtered texels, in [0, 1].
+        */
+        void Sample8(float8 u, float8 v, float8 lod, TEXTURE_FILTER filter, float8 out[4]) const;
+
+        /*!
+        *  \brief Samples a single texture coordinate, exactly as one lane of Sample8() would.
+        */
+        cv::Vec4f Sample(float u, float v, float lod, TEXTURE_FILTER filter) const;
+
+        /*!
+        *  \brief Unfiltered texel (x, y) of a level, y = 0 being the top row of the image.
+        */
+        cv::Vec4f Texel(int level, int x, int y) const;
+
+    private:
+        struct MipLevel
+        {
+            int w, h;
+            size_t offset;                  // first texel in m_Texels
+            size_t swizzleX, swizzleY;      // first entries in m_SwizzleX and m_SwizzleY
+        };
+        std::vector<MipLevel> m_Levels;
+
+        // Texels as four packed bytes, level after level, each level in Morton order.
+        std::vector<uint32_t> m_Texels;
+
+        // Morton order interleaves the bits of x and y, so a texel's index within its level is
+        // m_SwizzleX[x] | m_SwizzleY[y], with one entry per column and row of each level.
+        std::vector<uint32_t> m_SwizzleX, m_SwizzleY;
+
+        uint32_t Fetch(int level, int x, int y) const
+        {
+            const MipLevel& l = m_Levels[level];
+            return m_Texels[l.offset + (m_SwizzleX[l.swizzleX + x] | m_SwizzleY[l.swizzleY + y])];
+        }
+
+        /*!
+        *  \brief Filters the first count lanes of u, v on one mip level per lane. Texel
+        *         addressing is scalar per lane; coordinate and blend math is 8 wide.
+        */
+        void FilterLevel(const float* u, const float* v, const int* level, bool bilinear, int count,
+            float8 out[4]) const;
+
+        void Sample(const float* u, const float* v, const float* lod, TEXTURE_FILTER filter, int count,
+            float8 out[4]) const;
+    };
+}
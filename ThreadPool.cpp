@@ -0,0 +1,66 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace SoftwareRasterizer
+{
+    ThreadPool::ThreadPool(unsigned int threads) : threadCount(threads), running(0), stopping(false)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 0; i < threadCount; ++i)
+            workers.push_back(std::thread(&ThreadPool::Work, this));
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool& ThreadPool::Loading()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    void ThreadPool::Submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    void ThreadPool::Work()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            std::function<void()> task = std::move(tasks.front());
+            tasks.pop_front();
+            running++;
+
+            // Share the machine among the tasks running and waiting now.
+            unsigned int busy = std::min(running + (unsigned int)tasks.size(), threadCount);
+            lock.unlock();
+#ifdef _OPENMP
+            omp_set_num_threads(std::max(1, omp_get_num_procs() / (int)busy));
+#endif
+            task();
+            lock.lock();
+            running--;
+        }
+    }
+}
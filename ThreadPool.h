@@ -0,0 +1,57 @@
+/*
+*	ThreadPool.h -- a fixed set of worker threads running queued tasks in submission order.
+*					Loading uses one shared pool, so any number of models load with no more
+*					threads than the machine has, and OpenMP regions inside a task split the
+*					machine with the other running tasks instead of each taking all of it.
+*/
+
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SoftwareRasterizer
+{
+    class ThreadPool
+    {
+    public:
+        /*!
+        *  \brief Starts threads workers, or one per hardware thread if threads is 0.
+        */
+        explicit ThreadPool(unsigned int threads = 0);
+
+        /*!
+        *  \brief Finishes every queued task, then stops the workers.
+        */
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /*!
+        *  \brief Queues task to run on the next free worker.
+        */
+        void Submit(std::function<void()> task);
+
+        unsigned int Threads() const { return threadCount; }
+
+        /*!
+        *  \brief The pool models and their textures are loaded on.
+        */
+        static ThreadPool& Loading();
+
+    private:
+        void Work();
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<std::function<void()>> tasks;
+        unsigned int threadCount;
+        unsigned int running;
+        bool stopping;
+        std::vector<std::thread> workers;
+    };
+}
@@ -0,0 +1,425 @@
+#include "TileBinner.h"
+#include "SIMD.h"
+#include <algorithm>
+#include <cmath>
+
+namespace SoftwareRasterizer
+{
+    BinnedTriangle::BinnedTriangle(const Triangle& tri, const float* col, unsigned int modelID,
+        unsigned int triangleID, const Material* material) : tri(tri), modelID(modelID), triangleID(triangleID),
+        material(material), texture(material ? material->GetTexture(TEXTURE_TYPE::DIFFUSE) : nullptr), visible(true)
+    {
+        this->col[0] = col[0];
+        this->col[1] = col[1];
+        this->col[2] = col[2];
+    }
+
+    BinnedLine::BinnedLine(const glm::vec3& p1, const glm::vec3& p2, const float* col, unsigned int modelID)
+        : modelID(modelID), minX(0), maxX(-1), minY(0), maxY(-1), visible(true)
+    {
+        p[0] = p1;
+        p[1] = p2;
+        this->col[0] = col[0];
+        this->col[1] = col[1];
+        this->col[2] = col[2];
+    }
+
+    /*!
+    *  \brief Fills a region of a CV_32FC3 image with one color. Three vectors hold the color
+    *         pattern repeated over 24 floats, i.e. 8 pixels, so full runs are plain stores.
+    */
+    static void clearColorRect(cv::Mat& img, const cv::Rect& region, const cv::Vec3f& color)
+    {
+        SR_ALIGN(32) float pattern[24];
+        for (int i = 0; i < 24; ++i)
+            pattern[i] = color[i % 3];
+        float8 p0 = load8(pattern), p1 = load8(pattern + 8), p2 = load8(pattern + 16);
+
+        for (int y = region.y; y < region.y + region.height; ++y)
+        {
+            float* row = img.ptr<float>(y) + region.x * 3;
+            int x = 0;
+            for (; x + 8 <= region.width; x += 8, row += 24)
+            {
+                storeu8(row, p0);
+                storeu8(row + 8, p1);
+                storeu8(row + 16, p2);
+            }
+            for (; x < region.width; ++x, row += 3)
+            {
+                row[0] = color[0];
+                row[1] = color[1];
+                row[2] = color[2];
+            }
+        }
+    }
+
+    TileBinner::TileBinner() : w(0), h(0), tilesX(0), tilesY(0), varyingCount(0), clearDepth(0),
+        deferred(false), multisampled(nullptr), specializedKernels(true), hiZEnabled(true),
+        hiZRejectedTiles(0) {}
+
+    void TileBinner::Reset(int w, int h, const cv::Vec3f& clearColor, float clearDepth, int varyingCount)
+    {
+        bool changed = w != this->w || h != this->h || clearDepth != this->clearDepth ||
+            clearColor[0] != this->clearColor[0] || clearColor[1] != this->clearColor[1] ||
+            clearColor[2] != this->clearColor[2];
+        this->w = w;
+        this->h = h;
+        this->clearColor = clearColor;
+        this->clearDepth = clearDepth;
+        tilesX = (w + TILE_SIZE - 1) / TILE_SIZE;
+        tilesY = (h + TILE_SIZE - 1) / TILE_SIZE;
+        m_Bins.resize(tilesX * tilesY);
+        m_LineBins.resize(tilesX * tilesY);
+        for (int i = 0; i < m_Bins.size(); ++i)
+        {
+            m_Bins[i].clear();
+            m_LineBins[i].clear();
+        }
+        m_Triangles.clear();
+        m_Lines.clear();
+        m_Varyings.clear();
+        this->varyingCount = varyingCount;
+        if (changed || m_TileClean.size() != m_Bins.size())
+            Invalidate();
+        hiZ.Reset(w, h, TILE_SIZE, clearDepth);
+    }
+
+    void TileBinner::Invalidate()
+    {
+        m_TileClean.assign(tilesX * tilesY, 0);
+    }
+
+    void TileBinner::Invalidate(const cv::Rect& region)
+    {
+        cv::Rect r = region & cv::Rect(0, 0, w, h);
+        if (r.width <= 0 || r.height <= 0)
+            return;
+        for (int ty = r.y / TILE_SIZE; ty <= (r.y + r.height - 1) / TILE_SIZE; ++ty)
+            for (int tx = r.x / TILE_SIZE; tx <= (r.x + r.width - 1) / TILE_SIZE; ++tx)
+                m_TileClean[ty * tilesX + tx] = 0;
+    }
+
+    cv::Rect TileBinner::TileRect(int t) const
+    {
+        cv::Rect tile((t % tilesX) * TILE_SIZE, (t / tilesX) * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+        tile.width = std::min(tile.width, w - tile.x);
+        tile.height = std::min(tile.height, h - tile.y);
+        return tile;
+    }
+
+    void TileBinner::Submit(const Triangle& tri, const float* col, unsigned int modelID,
+        unsigned int triangleID, const Material* material, const float* varyings)
+    {
+        m_Triangles.push_back(BinnedTriangle(tri, col, modelID, triangleID, material));
+        if (varyingCount)
+            m_Varyings.insert(m_Varyings.end(), varyings, varyings + 3 * (varyingCount + 1));
+    }
+
+    unsigned int TileBinner::Allocate(unsigned int count)
+    {
+        unsigned int first = (unsigned int)m_Triangles.size();
+        m_Triangles.resize(first + count);
+        m_Varyings.resize(m_Triangles.size() * 3 * (varyingCount + 1));
+        return first;
+    }
+
+    void TileBinner::SubmitLine(const glm::vec3& p1, const glm::vec3& p2, const float* col, unsigned int modelID)
+    {
+        m_Lines.push_back(BinnedLine(p1, p2, col, modelID));
+    }
+
+    unsigned int TileBinner::AllocateLines(unsigned int count)
+    {
+        unsigned int first = (unsigned int)m_Lines.size();
+        m_Lines.resize(first + count);
+        return first;
+    }
+
+    void TileBinner::BinTriangles(RASTER_ALGORITHM method, bool multisample)
+    {
+        // Triangle setup is independent per triangle, so it runs in parallel.
+#pragma omp parallel for
+        for (int i = 0; i < m_Triangles.size(); ++i)
+        {
+            BinnedTriangle& bt = m_Triangles[i];
+            if (!bt.visible)
+                continue;
+            if (method == RASTER_ALGORITHM::HALF_SPACE)
+            {
+                bt.visible = setupTriangle(bt.tri, w, h, bt.setup);
+                if (bt.visible && varyingCount)
+                    setupVaryings(bt.tri, GetVaryings(i), varyingCount);
+
+                // Samples reach less than half a pixel from the center, so at most one more
+                // column and row to the right and bottom have samples but no center inside.
+                if (bt.visible && multisample)
+                {
+                    bt.setup.maxX = std::min(bt.setup.maxX + 1, w - 1);
+                    bt.setup.maxY = std::min(bt.setup.maxY + 1, h - 1);
+                }
+            }
+            else
+            {
+                // The scanline walker covers whole-pixel vertex coordinates inclusively.
+                bt.setup.minX = std::max(int(bt.tri.getMinX()), 0);
+                bt.setup.maxX = std::min(int(bt.tri.getMaxX()), w - 1);
+                bt.setup.minY = std::max(int(bt.tri.getMinY()), 0);
+                bt.setup.maxY = std::min(int(bt.tri.getMaxY()), h - 1);
+                bt.visible = bt.setup.minX <= bt.setup.maxX && bt.setup.minY <= bt.setup.maxY;
+            }
+        }
+
+        // Binning is serial so every bin lists its triangles in submission order.
+        for (unsigned int i = 0; i < m_Triangles.size(); ++i)
+        {
+            const BinnedTriangle& bt = m_Triangles[i];
+            if (!bt.visible)
+                continue;
+            int tx0 = bt.setup.minX / TILE_SIZE;
+            int tx1 = bt.setup.maxX / TILE_SIZE;
+            int ty0 = bt.setup.minY / TILE_SIZE;
+            int ty1 = bt.setup.maxY / TILE_SIZE;
+            for (int ty = ty0; ty <= ty1; ++ty)
+                for (int tx = tx0; tx <= tx1; ++tx)
+                    m_Bins[ty * tilesX + tx].push_back(i);
+        }
+    }
+
+    void TileBinner::BinLines()
+    {
+        for (unsigned int i = 0; i < m_Lines.size(); ++i)
+        {
+            BinnedLine& line = m_Lines[i];
+            if (!line.visible)
+                continue;
+
+            // rasterizeLine() only draws pixels between the floors of the endpoints.
+            const glm::vec3& a = line.p[0];
+            const glm::vec3& b = line.p[1];
+            line.minX = std::max(int(std::floor(std::min(a.x, b.x))), 0);
+            line.maxX = std::min(int(std::floor(std::max(a.x, b.x))), w - 1);
+            line.minY = std::max(int(std::floor(std::min(a.y, b.y))), 0);
+            line.maxY = std::min(int(std::floor(std::max(a.y, b.y))), h - 1);
+            line.visible = line.minX <= line.maxX && line.minY <= line.maxY;
+            if (!line.visible)
+                continue;
+
+            // Skip tiles of the bounding box that the line passes well clear of: the line's
+            // implicit equation has the same sign at all four corners of the tile grown by a
+            // pixel.
+            float dx = b.x - a.x, dy = b.y - a.y;
+            for (int ty = line.minY / TILE_SIZE; ty <= line.maxY / TILE_SIZE; ++ty)
+            {
+                for (int tx = line.minX / TILE_SIZE; tx <= line.maxX / TILE_SIZE; ++tx)
+                {
+                    float x0 = tx * TILE_SIZE - 1.0f, x1 = (tx + 1) * TILE_SIZE + 1.0f;
+                    float y0 = ty * TILE_SIZE - 1.0f, y1 = (ty + 1) * TILE_SIZE + 1.0f;
+                    int positive = 0, negative = 0;
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        float e = ((c & 1 ? y1 : y0) - a.y) * dx - ((c & 2 ? x1 : x0) - a.x) * dy;
+                        positive += e > 0.0f;
+                        negative += e < 0.0f;
+                    }
+                    if (positive < 4 && negative < 4)
+                        m_LineBins[ty * tilesX + tx].push_back(i);
+                }
+            }
+        }
+    }
+
+    void TileBinner::Rasterize(cv::Mat& img, DepthBuffer& depth, bool wireframeOn, bool depthTest,
+        RASTER_ALGORITHM method, bool depthPrepass, cv::Mat* visibility, const FragmentProgram* program,
+        MultisampleTarget* multisample)
+    {
+        bool deferred = visibility && method == RASTER_ALGORITHM::HALF_SPACE;
+        if (method != RASTER_ALGORITHM::HALF_SPACE || deferred)
+            multisample = nullptr;
+        if (deferred != this->deferred || multisample != multisampled)
+            Invalidate();
+        this->deferred = deferred;
+        multisampled = multisample;
+        int samples = multisample ? multisample->Samples() : 1;
+        cv::Mat* target = deferred ? visibility : multisample ? &multisample->Color() : &img;
+        DepthBuffer& targetDepth = multisample ? multisample->Depth() : depth;
+
+        BinTriangles(method, multisample != nullptr);
+        BinLines();
+
+        // The color pass after a pre-pass tests through a copy of the depth buffer that shares
+        // its storage, so the caller's compare mode is never changed under other threads.
+        depthPrepass = depthPrepass && depthTest && !wireframeOn && method == RASTER_ALGORITHM::HALF_SPACE;
+        DepthBuffer equalDepth = targetDepth;
+        equalDepth.SetCompare(DEPTH_COMPARE::EQUAL);
+        DepthBuffer& colorDepth = depthPrepass ? equalDepth : targetDepth;
+
+        // The render state is the same for every triangle, so kernels are picked once here.
+        RasterKernel depthKernel(RASTER_OUTPUT::DEPTH_ONLY, false, true, targetDepth, specializedKernels, samples);
+        // With a visibility buffer the fragment program runs when tiles are resolved instead.
+        RasterKernel colorKernel(deferred ? RASTER_OUTPUT::VISIBILITY : RASTER_OUTPUT::COLOR, wireframeOn,
+            depthTest, colorDepth, specializedKernels, samples);
+        if (program && !deferred)
+            colorKernel = program->Kernel(wireframeOn, depthTest, colorDepth, samples);
+
+        // Each thread takes whole tiles. Tiles never share pixels, so writes need no locking.
+        HiZBuffer* tileHiZ = hiZEnabled ? &hiZ : nullptr;
+        unsigned int rejected = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:rejected)
+        for (int t = 0; t < m_Bins.size(); ++t)
+        {
+            cv::Rect tile = TileRect(t);
+
+            // Clear on first touch, by the thread about to draw the tile while it is in cache.
+            // Tiles that are still clean and receive nothing this frame are not touched at all.
+            const std::vector<unsigned int>& bin = m_Bins[t];
+            const std::vector<unsigned int>& lineBin = m_LineBins[t];
+            if (!m_TileClean[t])
+            {
+                clearColorRect(img, tile, clearColor);
+                depth.ClearRect(tile);
+                for (int s = 0; multisample && s < samples; ++s)
+                {
+                    clearColorRect(multisample->Color(), multisample->SampleRect(s, tile), clearColor);
+                    multisample->Depth().ClearRect(multisample->SampleRect(s, tile));
+                }
+                if (deferred)
+                {
+                    for (int y = tile.y; y < tile.y + tile.height; ++y)
+                        std::fill(visibility->ptr<unsigned int>(y) + tile.x,
+                            visibility->ptr<unsigned int>(y) + tile.x + tile.width, 0u);
+                }
+                m_TileClean[t] = 1;
+            }
+            if (!bin.empty() || !lineBin.empty())
+                m_TileClean[t] = 0;
+
+            if (depthPrepass)
+            {
+                for (int i = 0; i < bin.size(); ++i)
+                {
+                    const BinnedTriangle& bt = m_Triangles[bin[i]];
+                    if (!HiZCanPass(bt, tile, targetDepth))
+                    {
+                        rejected++;
+                        continue;
+                    }
+                    depthKernel.Draw(bt.setup, nullptr, targetDepth, nullptr, tile, tileHiZ);
+                }
+            }
+
+            for (int i = 0; i < bin.size(); ++i)
+            {
+                BinnedTriangle& bt = m_Triangles[bin[i]];
+                if (method == RASTER_ALGORITHM::HALF_SPACE)
+                {
+                    if (depthTest && !HiZCanPass(bt, tile, colorDepth))
+                    {
+                        rejected++;
+                        continue;
+                    }
+                    RasterPrimitive prim = { bt.col, bin[i] + 1, GetVaryings(bin[i]), bt.material, bt.texture };
+                    colorKernel.Draw(bt.setup, target, colorDepth, tile, tileHiZ, prim);
+                }
+                else
+                    bt.tri.Draw(img, depth, nullptr, bt.col, wireframeOn, depthTest, method, tile);
+            }
+
+            // Lines go into the visibility buffer to be shaded with the triangles, or straight
+            // into the color target, after the samples have been averaged.
+            if (multisample && !bin.empty())
+                multisample->Resolve(img, tile);
+            for (int i = 0; i < lineBin.size(); ++i)
+            {
+                const BinnedLine& line = m_Lines[lineBin[i]];
+                rasterizeLine(line.p[0], line.p[1], deferred ? *visibility : img, depth, line.col,
+                    TriangleCount() + lineBin[i] + 1, tile, depthTest);
+            }
+
+            // Shade what survived while the tile is still in cache.
+            if (deferred && (!bin.empty() || !lineBin.empty()))
+                ResolveTile(img, *visibility, tile, program);
+        }
+        hiZRejectedTiles = rejected;
+    }
+
+    bool TileBinner::HiZCanPass(const BinnedTriangle& bt, const cv::Rect& tile, const DepthBuffer& depth)
+    {
+        if (!hiZEnabled)
+            return true;
+        cv::Rect bounds = tile & cv::Rect(bt.setup.minX, bt.setup.minY,
+            bt.setup.maxX - bt.setup.minX + 1, bt.setup.maxY - bt.setup.minY + 1);
+        float lo, hi, zMin, zMax;
+        storedDepthRange(depth, bt.setup.minZ, bt.setup.maxZ, lo, hi);
+        hiZ.DepthRange(bounds, zMin, zMax);
+        return depth.CanPass(lo, hi, zMin, zMax);
+    }
+
+    void TileBinner::ResolveTile(cv::Mat& img, const cv::Mat& visibility, const cv::Rect& tile,
+        const FragmentProgram* program) const
+    {
+        const int B = RASTER_BLOCK_SIZE;
+        for (int by = tile.y; by < tile.y + tile.height; by += B)
+        {
+            for (int bx = tile.x; bx < tile.x + tile.width; bx += B)
+            {
+                int rows = std::min(B, tile.y + tile.height - by);
+                int cols = std::min(B, tile.x + tile.width - bx);
+
+                // Pixels nothing was drawn to keep the clear color. IDs past the triangles
+                // belong to lines, which are flat colored, as are triangles without a program,
+                // like the forward color kernel draws them. Triangle pixels left for the
+                // program are marked in pending, one bit per column.
+                int pending[B] = {};
+                for (int r = 0; r < rows; ++r)
+                {
+                    const unsigned int* ids = visibility.ptr<unsigned int>(by + r) + bx;
+                    cv::Vec3f* row = img.ptr<cv::Vec3f>(by + r) + bx;
+                    for (int c = 0; c < cols; ++c)
+                    {
+                        if (!ids[c])
+                            continue;
+                        if (ids[c] > m_Triangles.size())
+                        {
+                            const float* col = m_Lines[ids[c] - m_Triangles.size() - 1].col;
+                            row[c] = cv::Vec3f(col[0], col[1], col[2]);
+                        }
+                        else if (program)
+                            pending[r] |= 1 << c;
+                        else
+                        {
+                            const float* col = m_Triangles[ids[c] - 1].col;
+                            row[c] = cv::Vec3f(col[0], col[1], col[2]);
+                        }
+                    }
+                }
+
+                // Each triangle visible in the block is shaded once over all its pixels there,
+                // from its varying planes, so its quads see the same neighbours and derivatives
+                // as in forward drawing.
+                for (int r = 0; r < rows; ++r)
+                {
+                    while (pending[r])
+                    {
+                        int c = 0;
+                        while (!((pending[r] >> c) & 1))
+                            ++c;
+                        unsigned int id = visibility.ptr<unsigned int>(by + r)[bx + c];
+                        int masks[B] = {};
+                        for (int rr = r; rr < rows; ++rr)
+                        {
+                            const unsigned int* ids = visibility.ptr<unsigned int>(by + rr) + bx;
+                            for (int cc = 0; cc < cols; ++cc)
+                                if (((pending[rr] >> cc) & 1) && ids[cc] == id)
+                                    masks[rr] |= 1 << cc;
+                            pending[rr] &= ~masks[rr];
+                        }
+                        const BinnedTriangle& bt = m_Triangles[id - 1];
+                        RasterPrimitive prim = { bt.col, id, GetVaryings(id - 1), bt.material, bt.texture };
+                        program->ShadeBlock(prim, img, bx, by, masks);
+                    }
+                }
+            }
+        }
+    }
+}
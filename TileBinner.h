@@ -0,0 +1,237 @@
+/*
+*	TileBinner.h -- sorts screen-space triangles into fixed-size screen tiles and rasterizes the
+*					tiles in parallel. Each tile is owned by exactly one thread and draws its
+*					triangles in submission order, so no locking is needed and frames come out
+*					identical whatever the thread count. Color and depth targets are cleared lazily,
+*					one tile at a time by the thread that owns it, and only if the tile was drawn
+*					to since its last clear. In visibility buffer mode tiles rasterize only triangle
+*					IDs and depth, then each visible pixel is shaded exactly once. With a depth
+*					pre-pass, tiles lay down depth for all their triangles first and then draw
+*					color only where depth is equal, so hidden fragments are never shaded. With
+*					multisampling, tiles are drawn into per-sample color and depth and resolved
+*					into the color target as soon as they are done. Wireframe line segments are
+*					binned alongside the triangles and drawn after them, tile by tile.
+*/
+
+#pragma once
+#include "Triangle.h"
+#include "Rasterizer.h"
+#include "RasterKernel.h"
+#include "Shader.h"
+#include "HiZBuffer.h"
+#include "DepthBuffer.h"
+#include "Texture.h"
+#include "Multisample.h"
+#include "Line.h"
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace SoftwareRasterizer
+{
+    /**
+    *  \brief A triangle queued for rasterization, in pixel coordinates. Slots left with
+    *         visible == false (e.g. culled by the vertex stage) are skipped. modelID and
+    *         triangleID name the scene model and the model triangle it came from; clipped
+    *         triangles share the ID of their source triangle. material is what fragment
+    *         shaders see, and texture is its diffuse map, if it has one.
+    */
+    struct BinnedTriangle
+    {
+        Triangle tri;
+        TriangleSetup setup;
+        float col[3];
+        unsigned int modelID, triangleID;
+        const Material* material;
+        const Texture* texture;
+        bool visible;
+
+        BinnedTriangle() : tri(cv::Point(), cv::Point(), cv::Point()), modelID(0), triangleID(0),
+            material(nullptr), texture(nullptr), visible(false) {}
+        BinnedTriangle(const Triangle& tri, const float* col, unsigned int modelID = 0,
+            unsigned int triangleID = 0, const Material* material = nullptr);
+    };
+
+    /**
+    *  \brief A line segment queued for rasterization, in pixel coordinates with window depth.
+    *         Slots left with visible == false are skipped. modelID names the scene model it
+    *         came from. The bounding box is filled in when the line is binned.
+    */
+    struct BinnedLine
+    {
+        glm::vec3 p[2];
+        float col[3];
+        unsigned int modelID;
+        int minX, maxX, minY, maxY;
+        bool visible;
+
+        BinnedLine() : modelID(0), minX(0), maxX(-1), minY(0), maxY(-1), visible(false) {}
+        BinnedLine(const glm::vec3& p1, const glm::vec3& p2, const float* col, unsigned int modelID = 0);
+    };
+
+    class TileBinner
+    {
+    public:
+        // Tile edge length in pixels. Must be a multiple of the rasterizer's 8x8 block size.
+        static const int TILE_SIZE = 64;
+
+        TileBinner();
+
+        /*!
+        *  \brief Empties the triangle and line queues and all bins, and sizes the tile grid for a w x h
+        *         frame. Bin storage is kept between frames. clearColor and clearDepth (in the
+        *         depth buffer's stored units) are what each tile is cleared to before it is
+        *         drawn; the Hi-Z pyramid starts from clearDepth. Changing the size or either
+        *         clear value forces every tile to be cleared again. Every triangle queued until
+        *         the next reset carries varyingCount varyings per vertex, plus the vertex's 1/w
+        *         for perspective-correct interpolation.
+        */
+        void Reset(int w, int h, const cv::Vec3f& clearColor, float clearDepth, int varyingCount = 0);
+
+        /*!
+        *  \brief Marks the tiles overlapping region (or all tiles) as holding something other
+        *         than the clear values, e.g. after the targets were reallocated or drawn over
+        *         outside the binner.
+        */
+        void Invalidate(const cv::Rect& region);
+        void Invalidate();
+
+        /*!
+        *  \brief Queues a screen-space triangle. Triangles are drawn in the order submitted.
+        *         varyings holds the varyings of tri's three vertices, vertex after vertex,
+        *         each vertex's followed by its 1 / clip w.
+        */
+        void Submit(const Triangle& tri, const float* col, unsigned int modelID = 0,
+            unsigned int triangleID = 0, const Material* material = nullptr, const float* varyings = nullptr);
+
+        /*!
+        *  \brief Appends count empty slots to the queue and returns the index of the first.
+        *         Slots may then be filled from several threads at once, and are drawn in index
+        *         order regardless of which thread filled them.
+        */
+        unsigned int Allocate(unsigned int count);
+        BinnedTriangle& GetTriangle(unsigned int index) { return m_Triangles[index]; }
+
+        /*!
+        *  \brief Queues a screen-space line segment, drawn with rasterizeLine() after every
+        *         triangle in each tile, in the order submitted. Lines are always drawn forward
+        *         and single-sampled; with multisampling they go on top of the resolved tile
+        *         and are depth tested against depth only, not the samples.
+        */
+        void SubmitLine(const glm::vec3& p1, const glm::vec3& p2, const float* col, unsigned int modelID = 0);
+
+        /*!
+        *  \brief Line counterparts of Allocate() and GetTriangle().
+        */
+        unsigned int AllocateLines(unsigned int count);
+        BinnedLine& GetLine(unsigned int index) { return m_Lines[index]; }
+
+        /*!
+        *  \brief Varyings of a queued triangle, laid out as for Submit() until Rasterize() turns
+        *         them into plane equations (see setupVaryings()). nullptr without varyings.
+        */
+        float* GetVaryings(unsigned int index)
+        {
+            return varyingCount ? &m_Varyings[size_t(index) * 3 * (varyingCount + 1)] : nullptr;
+        }
+        const float* GetVaryings(unsigned int index) const
+        {
+            return varyingCount ? &m_Varyings[size_t(index) * 3 * (varyingCount + 1)] : nullptr;
+        }
+
+        /*!
+        *  \brief Sets up and bins every queued triangle and line, then clears and rasterizes all
+        *         tiles into the color (CV_32FC3) and depth targets.
+        *
+        * \param [in] depthPrepass Draw each tile with the depth-only kernel first, then again
+        *                         with an equal depth test. Applies to the filled half-space
+        *                         rasterizer with depth testing on; otherwise ignored.
+        * \param [in,out] visibility Optional CV_32SC1 visibility buffer the size of img. If
+        *                            given and method is HALF_SPACE, tiles are drawn deferred:
+        *                            the depth-tested triangles write their queue index + 1
+        *                            (0 where nothing was drawn) there instead of shading, and
+        *                            each covered pixel is shaded once afterwards. The scanline
+        *                            rasterizer always draws forward. Lines write their index
+        *                            past the triangles' instead.
+        * \param [in] program Optional fragment shader for half-space drawing, taking as many
+        *                     varyings as the binner was reset with. Otherwise triangles are
+        *                     filled with their flat color. With a visibility buffer it shades
+        *                     the visible pixels of each triangle in quads when the tile is
+        *                     resolved, from the same varying planes as forward drawing.
+        * \param [in,out] multisample Optional target the size of img for forward half-space
+        *                             drawing with multisample anti-aliasing. Tiles are drawn
+        *                             into its samples, its depth standing in for depth, and
+        *                             resolved into img. Its depth is cleared to its own clear
+        *                             value, which should match depth's.
+        */
+        void Rasterize(cv::Mat& img, DepthBuffer& depth, bool wireframeOn, bool depthTest,
+            RASTER_ALGORITHM method, bool depthPrepass = false, cv::Mat* visibility = nullptr,
+            const FragmentProgram* program = nullptr, MultisampleTarget* multisample = nullptr);
+
+        unsigned int TriangleCount() const { return (unsigned int)m_Triangles.size(); }
+        unsigned int LineCount() const { return (unsigned int)m_Lines.size(); }
+
+        /*!
+        *  \brief Whether Rasterize() draws with kernels specialized for its render state (the
+        *         default) or with the generic kernel that checks the state per block row.
+        */
+        void SetSpecializedKernels(bool specialized) { specializedKernels = specialized; }
+
+        /*!
+        *  \brief Whether Rasterize() rejects triangles against the Hi-Z pyramid (the default)
+        *         or leaves every fragment to the per-pixel depth test. The image is the same.
+        */
+        void SetHiZ(bool enabled) { hiZEnabled = enabled; }
+
+        // Triangle and tile pairs the last Rasterize() skipped by Hi-Z, without raster work.
+        unsigned int HiZRejectedTiles() const { return hiZRejectedTiles; }
+
+    private:
+        int w, h;
+        int tilesX, tilesY;
+        std::vector<BinnedTriangle> m_Triangles;
+
+        // 3 * (varyingCount + 1) floats per queued triangle, in the same order.
+        std::vector<float> m_Varyings;
+        int varyingCount;
+        std::vector<std::vector<unsigned int>> m_Bins;
+        std::vector<BinnedLine> m_Lines;
+        std::vector<std::vector<unsigned int>> m_LineBins;
+        HiZBuffer hiZ;
+        cv::Vec3f clearColor;
+        float clearDepth;
+
+        // One flag per tile, set while the tile still holds the clear values.
+        std::vector<unsigned char> m_TileClean;
+
+        // Whether the last frame was drawn through a visibility buffer, and the multisample
+        // target it was drawn through. Clean tiles only include a cleared visibility buffer or
+        // cleared samples if the same were used.
+        bool deferred;
+        MultisampleTarget* multisampled;
+        bool specializedKernels;
+        bool hiZEnabled;
+        unsigned int hiZRejectedTiles;
+
+        /*!
+        *  \brief Sets up and bins every queued triangle. Multisampled bounding boxes also take
+        *         in pixels with a covered sample but an uncovered center.
+        */
+        void BinTriangles(RASTER_ALGORITHM method, bool multisample);
+        /*!
+        *  \brief Bins every queued line into the tiles it passes through.
+        */
+        void BinLines();
+        /*!
+        *  \brief False if the triangle cannot pass depth's test anywhere under its bounding
+        *         box in the tile, going by the Hi-Z range there.
+        */
+        bool HiZCanPass(const BinnedTriangle& bt, const cv::Rect& tile, const DepthBuffer& depth);
+        /*!
+        *  \brief Shades the visible pixels of a tile drawn into the visibility buffer, through
+        *         program if there is one, 8x8 block by 8x8 block.
+        */
+        void ResolveTile(cv::Mat& img, const cv::Mat& visibility, const cv::Rect& tile,
+            const FragmentProgram* program) const;
+        cv::Rect TileRect(int t) const;
+    };
+}
@@ -4,33 +4,18 @@
 
 namespace SoftwareRasterizer
 {
-    float Triangle::getZ(glm::vec2 p)
-    {//see: https://www.scratchapixel.com/lessons/3d-basic-rendering/rasterization-practical-implementation/visibility-problem-depth-buffer-depth-interpolation
-     //this function assumes the third z coordinate (v[2].position.z) is unknown.
-        float lambda = glm::clamp((p.x - v[0].position.x) / (v[1].position.x - v[0].position.x), 0.0f, 1.0f);
-        return 1.0/((1.0 - lambda)/v[0].position.z + lambda/v[1].position.z);
-    }
-
-    glm::vec3 Triangle::getBarycenterCoords(glm::vec3 p)
+    bool Triangle::getDepthPlane(double& a, double& b, double& c) const
     {
-        glm::vec3 coefs = glm::vec3(0);
-        for (int i = 0; i < 2; ++i)
-        {
-            int idx_next = (i + 1) % 3;
-            int idx_next_next = (i + 2) % 3;
-
-            // Coefficients of barycentric coordinates (u,v,w) are of form P = uA + uB + wC.            
-            // These can be calculated by the norm of sides of a parallelogram containing the whole
-            // triangle and a parallelogram containing the adjacent side and current point P.            
-            coefs[i] = glm::cross(v[i].position - p, 
-                v[i].position - v[idx_next_next].position).length() / 
-                glm::cross(v[i].position-v[idx_next].position,
-                    v[i].position - v[idx_next_next].position).length();
-        }
-
-        // Since u + v + w = 1, the third coefficient may be calc'd w.r.t. the other two.
-        coefs[2] = 1.0 - coefs[0] - coefs[1];
-        return coefs;
+        // Window depth is affine in screen space, so it lies on the plane through the three
+        // vertices.
+        glm::dvec3 p0(v[0].position), p1(v[1].position), p2(v[2].position);
+        glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        if (n.z == 0)
+            return false;
+        a = -n.x / n.z;
+        b = -n.y / n.z;
+        c = p0.z - a * p0.x - b * p0.y;
+        return true;
     }
 
     glm::bvec3 Triangle::checkVertsInNDCbounds()
@@ -110,8 +95,25 @@ namespace SoftwareRasterizer
         return (v[2].position.z > max_z) ? v[2].position.z : max_z;
     }
 
-	void Triangle::Draw(cv::Mat& img, cv::Mat& imgZ, Material* mat, float* col, bool wireframeOn,
-        bool depthTest)
+    void Triangle::Draw(cv::Mat& img, DepthBuffer& depth, Material* mat, float* col, bool wireframeOn,
+        bool depthTest, RASTER_ALGORITHM method, cv::Rect clip)
+    {
+        if (clip.width <= 0 || clip.height <= 0)
+            clip = cv::Rect(0, 0, img.cols, img.rows);
+
+        if (method == RASTER_ALGORITHM::SCANLINE)
+        {
+            DrawScanline(img, depth, col, wireframeOn, depthTest, clip);
+            return;
+        }
+
+        TriangleSetup setup;
+        if (setupTriangle(*this, img.cols, img.rows, setup))
+            rasterizeHalfSpace(setup, img, depth, col, clip, wireframeOn, depthTest);
+    }
+
+	void Triangle::DrawScanline(cv::Mat& img, DepthBuffer& depth, float* col, bool wireframeOn,
+        bool depthTest, const cv::Rect& clip)
 	{
         // Get min/max dimensions, edge length of this triangle.
         int minX = getMinX();
@@ -208,30 +210,38 @@ namespace SoftwareRasterizer
             }
         }
 
-        // With scanline extrema marked, now shade pixels from x-min to x-max.
-        for (int i = 0; i < minMaxXVals.size(); ++i)
+        // Depth is stepped along each span from the triangle's depth plane. A triangle seen
+        // edge-on has none and keeps its first vertex's depth.
+        double zA = 0, zB = 0, zC = v[0].position.z;
+        getDepthPlane(zA, zB, zC);
+
+        // With scanline extrema marked, now shade pixels from x-min to x-max, keeping to the
+        // rows and columns of the clip rectangle.
+        int firstRow = std::max(clip.y - minY, 0);
+        int lastRow = std::min(clip.y + clip.height - minY, int(minMaxXVals.size()));
+        for (int i = firstRow; i < lastRow; ++i)
         {
             // Draw horizontal line for pixel color.
             cv::Vec3f* row = img.ptr<cv::Vec3f>(minY+i);
-            cv::Vec3f* rowZ = imgZ.ptr<cv::Vec3f>(minY+i);
-            for (int j = minMaxXVals[i][0]; j <= minMaxXVals[i][1]; ++j)
+            int first = std::max(minMaxXVals[i][0], clip.x);
+            int last = std::min(minMaxXVals[i][1], clip.x + clip.width - 1);
+            double z = zA * first + zB * (minY + i) + zC;
+            for (int j = first; j <= last; ++j, z += zA)
             {            
                 // Skip negative indices or interior values if in wireframe mode.
                 if (j < 0 || (wireframeOn && j > minMaxXVals[i][0] && j < minMaxXVals[i][1]))                
                     continue;                
 
                 // Compare this depth value to current depth at this pixel in zbuffer.
-                float interpDepth = getZ(glm::vec2(j, minY + i));
-                if (!depthTest || rowZ[j][2] > interpDepth)
+                float interpDepth = depth.ToStored(float(z));
+                if (!depthTest || depth.Test(interpDepth, depth.Get(j, minY + i)))
                 {
                     // Set output frame's pixel color.
                     if (img.channels() == 3) {
                         row[j] = cv::Vec3f(col[0], col[1], col[2]);
                     }
                     // Set z-buffer depth values.
-                    if (imgZ.channels() == 3) {
-                        rowZ[j] = cv::Vec3f(0.0f,0.0f,interpDepth);
-                    }
+                    depth.Set(j, minY + i, interpDepth);
                 }
             }       
         }
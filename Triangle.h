@@ -1,6 +1,8 @@
 #pragma once
 #include "Vertex.h"
 #include "Point.h"
+#include "Rasterizer.h"
+#include "DepthBuffer.h"
 #include <opencv2/opencv.hpp>
 
 namespace SoftwareRasterizer
@@ -21,8 +23,13 @@ namespace SoftwareRasterizer
         Triangle(Vertex v1, Vertex v2, Vertex v3, unsigned int mtlindex);
         Triangle(cv::Point p1, cv::Point p2, cv::Point p3);
 
-        void Draw(cv::Mat& img, cv::Mat& imgZ, Material* mat, float* col,
-            bool wireframeOn, bool depthTest);
+        /*!
+        *  \brief Rasterizes this screen-space triangle. If a clip rectangle is given, only pixels
+        *         inside it are written, which lets separate threads draw disjoint tiles.
+        */
+        void Draw(cv::Mat& img, DepthBuffer& depth, Material* mat, float* col,
+            bool wireframeOn, bool depthTest,
+            RASTER_ALGORITHM method = RASTER_ALGORITHM::HALF_SPACE, cv::Rect clip = cv::Rect());
 
         inline bool isCCW() {
             return glm::normalize(glm::cross(v[1].position - v[0].position,
@@ -40,7 +47,13 @@ namespace SoftwareRasterizer
          void setInNDCbounds(glm::bvec3 inNDC);
     private:
         glm::bvec3 inNDC;
-        float getZ(glm::vec2 p);
-        glm::vec3 getBarycenterCoords(glm::vec3 p);
+        void DrawScanline(cv::Mat& img, DepthBuffer& depth, float* col, bool wireframeOn, bool depthTest,
+            const cv::Rect& clip);
+
+        /*!
+        *  \brief Plane of window depth through the three vertices, z = a*x + b*y + c over
+        *         pixel coordinates. False if the triangle has no area in screen space.
+        */
+        bool getDepthPlane(double& a, double& b, double& c) const;
     };
 }
\ No newline at end of file
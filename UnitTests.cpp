@@ -3,10 +3,34 @@
 #include "Line.h"
 #include "Scene.h"
 #include "Model.h"
+#include "Triangle.h"
+#include "SIMD.h"
+#include "Texture.h"
+#include "AssetCache.h"
+#include "Shader.h"
+#include "Lighting.h"
+#include "TileBinner.h"
+#include "ObjParser.h"
+#include "MeshCache.h"
+#include "ModelLoader.h"
+#include "ThreadPool.h"
+#include "MeshOptimizer.h"
+#include "Clipper.h"
 
 #include <iostream>
 #include <vector>
+#include <map>
+#include <algorithm>
+#include <random>
+#include <fstream>
+#include <filesystem>
 #include <ctime>
+#include <chrono>
+#include <thread>
+#include <glm/gtc/matrix_transform.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace SoftwareRasterizer
 {
@@ -81,7 +105,2234 @@ namespace SoftwareRasterizer
 
 		return true;
 	}
-	
+
+	bool SoftwareRasterizerUnitTests::RasterAlgSpeedTest()
+	{
+		// Initialize variables and objects for tests.
+		srand(clock());
+		const int size = 1000;
+		cv::Mat img1, img2, view1, view2;
+		SoftwareRasterizer::DepthBuffer imgZ1, imgZ2;
+		clock_t clock1, clock2;
+		float color[3] = { 1,1,1 };
+		int numTriangles = 2000;
+		int numTests = 3;
+		double test1 = 0;
+		double test2 = 0;
+
+		// Generate an array of random screen-space triangles with random depths.
+		std::vector<SoftwareRasterizer::Triangle> triangles;
+		for (int i = 0; i < numTriangles; ++i) {
+			cv::Point p(rand() % size, rand() % size);
+			SoftwareRasterizer::Triangle tri(p, p + cv::Point(rand() % 100 - 50, rand() % 100 - 50),
+				p + cv::Point(rand() % 100 - 50, rand() % 100 - 50));
+			for (int j = 0; j < 3; ++j)
+				tri.v[j].position.z = 0.1f + 0.8f * float(rand()) / RAND_MAX;
+			triangles.push_back(tri);
+		}
+
+		// Run multiple tests of each triangle rasterizing algorithm and average the results.
+		for (int i = 0; i < numTests; ++i) {
+			img1 = cv::Mat(size, size, CV_32FC3, cv::Scalar(0, 0, 0));
+			imgZ1.Create(size, size, SoftwareRasterizer::DEPTH_FORMAT::FLOAT32);
+			imgZ1.Clear(1.0f);
+			clock1 = clock();
+			for (int i = 0; i < triangles.size(); ++i) { triangles[i].Draw(img1, imgZ1, nullptr, color, false, true, SoftwareRasterizer::RASTER_ALGORITHM::SCANLINE); }
+			clock2 = clock();
+			test1 += (double(clock2 - clock1) / CLOCKS_PER_SEC) / numTriangles;
+
+			img2 = cv::Mat(size, size, CV_32FC3, cv::Scalar(0, 0, 0));
+			imgZ2.Create(size, size, SoftwareRasterizer::DEPTH_FORMAT::FLOAT32);
+			imgZ2.Clear(1.0f);
+			clock1 = clock();
+			for (int i = 0; i < triangles.size(); ++i) { triangles[i].Draw(img2, imgZ2, nullptr, color, false, true, SoftwareRasterizer::RASTER_ALGORITHM::HALF_SPACE); }
+			clock2 = clock();
+			test2 += (double(clock2 - clock1) / CLOCKS_PER_SEC) / numTriangles;
+		}
+
+		// Count pixels covered by only one of the two algorithms.
+		int mismatched = 0;
+		for (int y = 0; y < size; ++y)
+			for (int x = 0; x < size; ++x)
+				if ((img1.at<cv::Vec3f>(y, x)[0] > 0) != (img2.at<cv::Vec3f>(y, x)[0] > 0))
+					mismatched++;
+
+		// Display times for completion.
+		std::cout << "time scanline: " << test1 / numTests << " sec per triangle\n";
+		std::cout << "time half-space (" << SoftwareRasterizer::SIMD_INSTRUCTION_SET << "): " << test2 / numTests << " sec per triangle\n";
+		std::cout << "pixels covered by only one algorithm: " << mismatched << "\n";
+
+		// Display all results visually.
+		imgZ1.Visualize(view1);
+		imgZ2.Visualize(view2);
+		cv::imshow("Scanline", view1);
+		cv::imshow("Half-space", view2);
+		cv::waitKey();
+
+		return true;
+	}
+
+	/*!
+	*  \brief Sets scene up as the render test does, at frame 30, with its projection in P.
+	*/
+	static void makeRenderTestScene(Scene& scene, glm::mat4& P)
+	{
+		scene.w = 800;
+		scene.h = 600;
+		scene.AddModel("models/face.obj");
+		scene.models[0].position = glm::vec3(-0.2f, 0.0f, -1.0f);
+		scene.models[0].rotation = glm::vec3(0.1f, 0.1f, 0.0f);
+		scene.AddModel("models/cube.obj");
+		scene.models[1].position = glm::vec3(0.15f, 0.0f, -1.0f);
+		scene.models[1].scale = 0.185f;
+		scene.models[1].rotation = glm::vec3(0.1f, 0.1f, 0.0f);
+		scene.camera.Update();
+		scene.frameCount = 30;
+		P = glm::perspective(45.0f, float(scene.w) / float(scene.h), 0.1f, 100.0f);
+	}
+
+	bool SoftwareRasterizerUnitTests::TileDeterminismTest()
+	{
+		// The same scene as the render test.
+		Scene scene;
+		glm::mat4 P;
+		makeRenderTestScene(scene, P);
+
+		// Render once on a single thread and once on every available thread.
+		bool passed = true;
+#ifdef _OPENMP
+		int maxThreads = omp_get_max_threads();
+		omp_set_num_threads(1);
+#endif
+		scene.RenderFrame(P);
+		cv::Mat reference = scene.frame.clone();
+		cv::Mat referenceZ = scene.frameZ.Data().clone();
+#ifdef _OPENMP
+		omp_set_num_threads(std::max(maxThreads, 4));
+#endif
+		for (int run = 0; run < 5; ++run)
+		{
+			scene.RenderFrame(P);
+			for (int y = 0; y < scene.h; ++y)
+			{
+				if (memcmp(reference.ptr(y), scene.frame.ptr(y), scene.w * sizeof(cv::Vec3f)) != 0 ||
+					memcmp(referenceZ.ptr(y), scene.frameZ.Data().ptr(y), scene.w * sizeof(float)) != 0)
+				{
+					passed = false;
+				}
+			}
+		}
+#ifdef _OPENMP
+		omp_set_num_threads(maxThreads);
+#endif
+
+		std::cout << "tiled rendering " << (passed ? "is" : "is NOT") << " deterministic across thread counts\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::DepthFormatTest()
+	{
+		// The same scene as the render test.
+		Scene scene;
+		glm::mat4 P;
+		makeRenderTestScene(scene, P);
+
+		// Render with a float32 depth buffer as the reference.
+		scene.RenderFrame(P);
+		cv::Mat reference = scene.frame.clone();
+
+		// Every other format and reversed-Z should resolve the same surfaces, up to precision
+		// where surfaces nearly touch.
+		const char* names[] = { "float32", "24-bit unorm + 8-bit stencil", "16-bit unorm" };
+		bool passed = true;
+		for (int r = 0; r < 2; ++r)
+		{
+			for (int f = 0; f < 3; ++f)
+			{
+				scene.depthFormat = SoftwareRasterizer::DEPTH_FORMAT(f);
+				scene.reversedZ = r == 1;
+				clock_t clock1 = clock();
+				scene.RenderFrame(P);
+				clock_t clock2 = clock();
+
+				int mismatched = 0;
+				for (int y = 0; y < scene.h; ++y)
+					for (int x = 0; x < scene.w; ++x)
+						if (reference.at<cv::Vec3f>(y, x) != scene.frame.at<cv::Vec3f>(y, x))
+							mismatched++;
+				if (mismatched * 100 > scene.w * scene.h)
+					passed = false;
+
+				std::cout << names[f] << (scene.reversedZ ? ", reversed-Z" : "") << ": " <<
+					double(clock2 - clock1) / CLOCKS_PER_SEC << " sec, " << mismatched <<
+					" pixels differ from float32\n";
+			}
+		}
+
+		// Depth is stored in the low 24 bits, so clearing stencil must not disturb it.
+		SoftwareRasterizer::DepthBuffer packed;
+		packed.Create(16, 16, SoftwareRasterizer::DEPTH_FORMAT::UNORM24_STENCIL8);
+		packed.Clear(0.5f, 0xA5);
+		packed.Set(3, 3, packed.ToStored(0.25f));
+		if (packed.GetStencil(3, 3) != 0xA5 || std::abs(packed.ToScene(packed.Get(3, 3)) - 0.25f) > 1e-6f)
+			passed = false;
+
+		std::cout << "depth formats " << (passed ? "agree" : "do NOT agree") << " with float32\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::VisibilityBufferTest()
+	{
+		// The same scene as the render test.
+		Scene scene;
+		glm::mat4 P;
+		makeRenderTestScene(scene, P);
+
+		// Shading every visible pixel once after the fact must give exactly the forward image,
+		// in both wireframe and filled mode and when switching back and forth, and with every
+		// fragment shader, which sees the same quads either way.
+		const SHADING_MODE shadings[] = { SHADING_MODE::FLAT, SHADING_MODE::FLAT, SHADING_MODE::FLAT,
+			SHADING_MODE::FLAT, SHADING_MODE::BLINN_PHONG, SHADING_MODE::NORMALS, SHADING_MODE::TEXCOORDS };
+		const char* shadingNames[] = { "flat", "flat", "flat", "flat", "Blinn-Phong", "normals", "texcoords" };
+		bool passed = true;
+		for (int i = 0; i < 7; ++i)
+		{
+			scene.wireframeOn = i == 2 || i == 3;
+			scene.shading = shadings[i];
+			scene.visibilityBufferOn = false;
+			clock_t clock1 = clock();
+			scene.RenderFrame(P);
+			clock_t clock2 = clock();
+			cv::Mat forward = scene.frame.clone();
+
+			scene.visibilityBufferOn = true;
+			scene.RenderFrame(P);
+			clock_t clock3 = clock();
+
+			int mismatched = 0, covered = 0;
+			for (int y = 0; y < scene.h; ++y)
+			{
+				for (int x = 0; x < scene.w; ++x)
+				{
+					if (forward.at<cv::Vec3f>(y, x) != scene.frame.at<cv::Vec3f>(y, x))
+						mismatched++;
+					if (scene.frameIDs.at<int>(y, x) != 0)
+						covered++;
+				}
+			}
+			if (mismatched != 0 || covered == 0)
+				passed = false;
+
+			std::cout << (scene.wireframeOn ? "wireframe" : shadingNames[i]) << ": forward " <<
+				double(clock2 - clock1) / CLOCKS_PER_SEC << " sec, visibility buffer " <<
+				double(clock3 - clock2) / CLOCKS_PER_SEC << " sec, " << covered << " pixels shaded, " <<
+				mismatched << " pixels differ\n";
+		}
+
+		std::cout << "visibility buffer " << (passed ? "matches" : "does NOT match") << " forward rendering\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::DepthPrepassTest()
+	{
+		// The same scene as the render test.
+		Scene scene;
+		glm::mat4 P;
+		makeRenderTestScene(scene, P);
+
+		// The pre-pass must resolve the same surfaces and leave the same depth, in every depth
+		// format. Only coplanar overlaps may differ, as the equal test lets the last one win.
+		const char* names[] = { "float32", "24-bit unorm + 8-bit stencil", "16-bit unorm" };
+		bool passed = true;
+		for (int f = 0; f < 3; ++f)
+		{
+			scene.depthFormat = SoftwareRasterizer::DEPTH_FORMAT(f);
+			scene.depthPrepass = false;
+			clock_t clock1 = clock();
+			scene.RenderFrame(P);
+			clock_t clock2 = clock();
+			cv::Mat forward = scene.frame.clone();
+			cv::Mat forwardZ = scene.frameZ.Data().clone();
+
+			scene.depthPrepass = true;
+			scene.RenderFrame(P);
+			clock_t clock3 = clock();
+
+			int mismatched = 0;
+			for (int y = 0; y < scene.h; ++y)
+				for (int x = 0; x < scene.w; ++x)
+					if (forward.at<cv::Vec3f>(y, x) != scene.frame.at<cv::Vec3f>(y, x))
+						mismatched++;
+			const cv::Mat& prepassZ = scene.frameZ.Data();
+			bool sameDepth = memcmp(forwardZ.data, prepassZ.data, forwardZ.total() * forwardZ.elemSize()) == 0;
+			if (!sameDepth || mismatched * 100 > scene.w * scene.h)
+				passed = false;
+
+			std::cout << names[f] << ": forward " << double(clock2 - clock1) / CLOCKS_PER_SEC <<
+				" sec, pre-pass " << double(clock3 - clock2) / CLOCKS_PER_SEC << " sec, " <<
+				mismatched << " pixels differ, depth " << (sameDepth ? "identical" : "differs") << "\n";
+		}
+
+		std::cout << "depth pre-pass " << (passed ? "matches" : "does NOT match") << " forward rendering\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::TextureSamplerTest()
+	{
+		// Non-square test image with a different pattern in every channel.
+		int w = 64, h = 32;
+		cv::Mat img(h, w, CV_8UC3);
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+				img.at<cv::Vec3b>(y, x) = cv::Vec3b((unsigned char)(x * 4), (unsigned char)(y * 8),
+					(unsigned char)((x ^ y) * 3));
+		SoftwareRasterizer::Texture texture;
+		texture.Create(img);
+		bool passed = texture.Levels() == 7 && texture.Width(6) == 1 && texture.Height(6) == 1;
+
+		// Level 0 holds the image and level 1 its 2x2 averages, whatever the storage order.
+		for (int y = 0; y < h; ++y)
+		{
+			for (int x = 0; x < w; ++x)
+			{
+				cv::Vec4f t = texture.Texel(0, x, y);
+				cv::Vec3b p = img.at<cv::Vec3b>(y, x);
+				for (int c = 0; c < 3; ++c)
+					passed &= std::abs(t[c] * 255.0f - p[c]) < 1e-3f;
+				passed &= t[3] == 1.0f;
+				if (x < w / 2 && y < h / 2)
+				{
+					cv::Vec4f m = texture.Texel(1, x, y);
+					for (int c = 0; c < 3; ++c)
+					{
+						int sum = img.at<cv::Vec3b>(2 * y, 2 * x)[c] + img.at<cv::Vec3b>(2 * y, 2 * x + 1)[c] +
+							img.at<cv::Vec3b>(2 * y + 1, 2 * x)[c] + img.at<cv::Vec3b>(2 * y + 1, 2 * x + 1)[c];
+						passed &= std::abs(m[c] * 255.0f - float((sum + 2) / 4)) < 1e-3f;
+					}
+				}
+			}
+		}
+
+		// Bilinear sampling at a texel center returns the texel; v = 0 is the bottom row.
+		for (int y = 0; y < h; y += 3)
+		{
+			for (int x = 0; x < w; x += 5)
+			{
+				float u = (x + 0.5f) / w, v = 1.0f - (y + 0.5f) / h;
+				cv::Vec4f s = texture.Sample(u, v, 0.0f, SoftwareRasterizer::TEXTURE_FILTER::BILINEAR);
+				cv::Vec4f t = texture.Texel(0, x, y);
+				cv::Vec4f wrapped = texture.Sample(u + 1.0f, v - 2.0f, 0.0f, SoftwareRasterizer::TEXTURE_FILTER::BILINEAR);
+				for (int c = 0; c < 4; ++c)
+					passed &= std::abs(s[c] - t[c]) < 1e-4f && std::abs(wrapped[c] - t[c]) < 1e-4f;
+			}
+		}
+
+		// Halfway between levels, trilinear is the average of bilinear on both.
+		cv::Vec4f l0 = texture.Sample(0.3f, 0.6f, 0.0f, SoftwareRasterizer::TEXTURE_FILTER::BILINEAR);
+		cv::Vec4f l1 = texture.Sample(0.3f, 0.6f, 1.0f, SoftwareRasterizer::TEXTURE_FILTER::BILINEAR);
+		cv::Vec4f tri = texture.Sample(0.3f, 0.6f, 0.5f, SoftwareRasterizer::TEXTURE_FILTER::TRILINEAR);
+		for (int c = 0; c < 4; ++c)
+			passed &= std::abs(tri[c] - 0.5f * (l0[c] + l1[c])) < 1e-4f;
+
+		// LOD is log2 of the texel footprint of a pixel step.
+		passed &= std::abs(texture.Lod(1.0f / w, 0.0f, 0.0f, 1.0f / h)) < 1e-5f;
+		passed &= std::abs(texture.Lod(4.0f / w, 0.0f, 0.0f, 1.0f / h) - 2.0f) < 1e-5f;
+
+		// The 8-wide sampler agrees with the single-coordinate one lane for lane.
+		const SoftwareRasterizer::TEXTURE_FILTER filters[] = { SoftwareRasterizer::TEXTURE_FILTER::NEAREST,
+			SoftwareRasterizer::TEXTURE_FILTER::BILINEAR, SoftwareRasterizer::TEXTURE_FILTER::TRILINEAR };
+		SR_ALIGN(32) float us[8], vs[8], lods[8], lanes[4][8];
+		for (int k = 0; k < 8; ++k)
+		{
+			us[k] = -1.3f + 0.77f * k;
+			vs[k] = 0.11f * k * k;
+			lods[k] = -1.0f + 0.9f * k;
+		}
+		for (int f = 0; f < 3; ++f)
+		{
+			SoftwareRasterizer::float8 out[4];
+			texture.Sample8(SoftwareRasterizer::load8(us), SoftwareRasterizer::load8(vs),
+				SoftwareRasterizer::load8(lods), filters[f], out);
+			for (int c = 0; c < 4; ++c)
+				SoftwareRasterizer::store8(lanes[c], out[c]);
+			for (int k = 0; k < 8; ++k)
+			{
+				cv::Vec4f s = texture.Sample(us[k], vs[k], lods[k], filters[f]);
+				for (int c = 0; c < 4; ++c)
+					passed &= s[c] == lanes[c][k];
+			}
+		}
+
+		// Other sizes are rounded up to powers of two, and gray images get three channels.
+		cv::Mat gray(20, 30, CV_8UC1, cv::Scalar(100));
+		SoftwareRasterizer::Texture grayTexture;
+		grayTexture.Create(gray);
+		cv::Vec4f g = grayTexture.Texel(0, 7, 9);
+		passed &= grayTexture.Width() == 32 && grayTexture.Height() == 32 && grayTexture.Levels() == 6;
+		passed &= std::abs(g[0] * 255.0f - 100.0f) < 1e-3f && g[0] == g[2] && g[3] == 1.0f;
+
+		// Throughput of trilinear sampling along a rotated, minified walk over the texture.
+		SoftwareRasterizer::float8 sum[4] = { SoftwareRasterizer::set1(0.0f), SoftwareRasterizer::set1(0.0f),
+			SoftwareRasterizer::set1(0.0f), SoftwareRasterizer::set1(0.0f) };
+		SoftwareRasterizer::float8 du = SoftwareRasterizer::ramp8() * 0.011f;
+		clock_t clock1 = clock();
+		const int samples = 1 << 20;
+		for (int i = 0; i < samples / 8; ++i)
+		{
+			SoftwareRasterizer::float8 out[4];
+			texture.Sample8(du + 0.0007f * i, du * 0.5f + 0.0013f * i, SoftwareRasterizer::set1(1.3f),
+				SoftwareRasterizer::TEXTURE_FILTER::TRILINEAR, out);
+			for (int c = 0; c < 4; ++c)
+				sum[c] = sum[c] + out[c];
+		}
+		clock_t clock2 = clock();
+		SoftwareRasterizer::store8(lanes[0], sum[0]);
+		std::cout << samples << " trilinear samples (" << SoftwareRasterizer::SIMD_INSTRUCTION_SET << "): " <<
+			double(clock2 - clock1) / CLOCKS_PER_SEC << " sec, checksum " << lanes[0][0] << "\n";
+
+		std::cout << "texture sampler " << (passed ? "passed" : "FAILED") << "\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::AssetCacheTest()
+	{
+		SoftwareRasterizer::AssetCache& cache = SoftwareRasterizer::AssetCache::Instance();
+		bool passed = true;
+
+		// Models loaded from the same file share one parsed material set.
+		unsigned int materialLoads = cache.MaterialLoads();
+		Scene scene;
+		scene.AddModel("models/face.obj");
+		scene.AddModel("models/cube.obj");
+		scene.AddModel("models/face.obj");
+		passed &= cache.MaterialLoads() - materialLoads == 2;
+		passed &= scene.models[0].m_Materials == scene.models[2].m_Materials;
+		passed &= scene.models[0].m_Materials != scene.models[1].m_Materials;
+
+		// A texture is decoded once while any handle to it is alive, and again after the last
+		// one was released.
+		cv::Mat img(16, 16, CV_8UC3, cv::Scalar(10, 20, 30));
+		std::string path = "asset_cache_test.ppm";
+		cv::imwrite(path, img);
+		unsigned int textureLoads = cache.TextureLoads();
+		{
+			std::shared_ptr<const SoftwareRasterizer::Texture> a = cache.LoadTexture(path);
+			std::shared_ptr<const SoftwareRasterizer::Texture> b = cache.LoadTexture("./" + path);
+			passed &= a && a == b && a->Width() == 16;
+		}
+		passed &= cache.TextureLoads() - textureLoads == 1;
+		passed &= cache.LoadTexture(path) && cache.TextureLoads() - textureLoads == 2;
+		passed &= !cache.LoadTexture("does_not_exist.ppm");
+		std::filesystem::remove(path);
+
+		std::cout << "asset cache " << (passed ? "shares" : "does NOT share") << " loaded assets\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::RenderStateKernelTest()
+	{
+		// The same scene as the render test.
+		Scene scene;
+		glm::mat4 P;
+		makeRenderTestScene(scene, P);
+
+		// Specialized kernels must draw exactly what the generic kernel draws, in every mode.
+		const char* formats[] = { "float32", "24-bit unorm + 8-bit stencil", "16-bit unorm" };
+		const char* modes[] = { "filled", "wireframe", "pre-pass", "visibility", "no depth test" };
+		const int frames = 5;
+		bool passed = true;
+		double genericTotal = 0.0, specializedTotal = 0.0;
+		for (int f = 0; f < 3; ++f)
+		{
+			for (int r = 0; r < 2; ++r)
+			{
+				for (int m = 0; m < 5; ++m)
+				{
+					scene.depthFormat = SoftwareRasterizer::DEPTH_FORMAT(f);
+					scene.reversedZ = r == 1;
+					scene.wireframeOn = m == 1;
+					scene.depthPrepass = m == 2;
+					scene.visibilityBufferOn = m == 3;
+					scene.depthTest = m != 4;
+
+					double seconds[2];
+					cv::Mat color[2], depth[2];
+					for (int s = 0; s < 2; ++s)
+					{
+						scene.specializedKernels = s == 1;
+						clock_t clock1 = clock();
+						for (int i = 0; i < frames; ++i)
+							scene.RenderFrame(P);
+						seconds[s] = double(clock() - clock1) / CLOCKS_PER_SEC / frames;
+						color[s] = scene.frame.clone();
+						depth[s] = scene.frameZ.Data().clone();
+					}
+					genericTotal += seconds[0];
+					specializedTotal += seconds[1];
+
+					bool same = memcmp(color[0].data, color[1].data, color[0].total() * color[0].elemSize()) == 0 &&
+						memcmp(depth[0].data, depth[1].data, depth[0].total() * depth[0].elemSize()) == 0;
+					if (!same)
+						passed = false;
+					std::cout << formats[f] << (r ? ", reversed" : "") << ", " << modes[m] << ": generic " <<
+						seconds[0] << " sec, specialized " << seconds[1] << " sec" << (same ? "" : ", OUTPUT DIFFERS") << "\n";
+				}
+			}
+		}
+		scene.specializedKernels = true;
+
+		std::cout << "average frame: generic " << genericTotal / 30 << " sec, specialized " <<
+			specializedTotal / 30 << " sec\n";
+		std::cout << "specialized kernels " << (passed ? "match" : "do NOT match") << " the generic kernel\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::ShaderPipelineTest()
+	{
+		// Same models and camera as the render test, drawn straight through a binner.
+		const int w = 800, h = 600;
+		std::vector<Model> models;
+		models.push_back(Model("models/face.obj"));
+		models[0].position = glm::vec3(-0.2f, 0.0f, -1.0f);
+		models[0].rotation = glm::vec3(0.1f, 0.1f, 0.0f);
+		models.push_back(Model("models/cube.obj"));
+		models[1].position = glm::vec3(0.15f, 0.0f, -1.0f);
+		models[1].scale = 0.185f;
+		models[1].rotation = glm::vec3(0.1f, 0.1f, 0.0f);
+		Camera camera;
+		camera.Update();
+		glm::mat4 P = glm::perspective(45.0f, float(w) / float(h), 0.1f, 100.0f);
+		glm::mat4 V = camera.getViewMatrix();
+		const int frameCount = 30, frames = 10;
+
+		TileBinner binner;
+		cv::Mat frame(h, w, CV_32FC3);
+		DepthBuffer depth;
+		depth.Create(w, h, DEPTH_FORMAT::FLOAT32);
+
+		// Built-in flat kernel.
+		clock_t clock1 = clock();
+		for (int f = 0; f < frames; ++f)
+		{
+			unsigned int rendered = 0;
+			binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), depth.ClearValue());
+			binner.Invalidate();
+			for (int i = 0; i < models.size(); ++i)
+				models[i].Draw(binner, P, V, w, h, frameCount, false, true, i, rendered);
+			binner.Rasterize(frame, depth, false, true, RASTER_ALGORITHM::HALF_SPACE);
+		}
+		clock_t clock2 = clock();
+		cv::Mat builtIn = frame.clone();
+
+		// The same through the shader pipeline, and a debug view with three varyings.
+		FlatFragmentShader flatShader;
+		NormalFragmentShader normalShader;
+		FragmentProgram flatProgram(flatShader), normalProgram(normalShader);
+		cv::Mat shaded;
+		double seconds[2];
+		for (int s = 0; s < 2; ++s)
+		{
+			clock_t start = clock();
+			for (int f = 0; f < frames; ++f)
+			{
+				unsigned int rendered = 0;
+				binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), depth.ClearValue(), s ? NormalVertexShader::VARYINGS : 0);
+				binner.Invalidate();
+				for (int i = 0; i < models.size(); ++i)
+				{
+					glm::mat4 M = models[i].ModelMatrix(frameCount);
+					if (s)
+						models[i].Draw(binner, NormalVertexShader(P, V, M), w, h, false, true, i, rendered);
+					else
+						models[i].Draw(binner, FlatVertexShader(P, V, M), w, h, false, true, i, rendered);
+				}
+				binner.Rasterize(frame, depth, false, true, RASTER_ALGORITHM::HALF_SPACE, false, nullptr,
+					s ? &normalProgram : &flatProgram);
+			}
+			seconds[s] = double(clock() - start) / CLOCKS_PER_SEC / frames;
+			if (!s)
+				shaded = frame.clone();
+		}
+
+		// Vertex shader positions are not computed exactly like the built-in transform's, so
+		// allow a few pixels along silhouettes to differ. Normal shading must cover the same
+		// pixels with normalized colors.
+		int mismatched = 0, uncovered = 0;
+		for (int y = 0; y < h; ++y)
+		{
+			for (int x = 0; x < w; ++x)
+			{
+				if (builtIn.at<cv::Vec3f>(y, x) != shaded.at<cv::Vec3f>(y, x))
+					mismatched++;
+				bool covered = builtIn.at<cv::Vec3f>(y, x) != cv::Vec3f(0.0f, 0.0f, 0.0f);
+				if (covered && frame.at<cv::Vec3f>(y, x) == cv::Vec3f(0.0f, 0.0f, 0.0f))
+					uncovered++;
+			}
+		}
+		bool passed = mismatched * 1000 <= w * h && uncovered * 1000 <= w * h;
+
+		std::cout << "built-in flat kernel: " << double(clock2 - clock1) / CLOCKS_PER_SEC / frames <<
+			" sec, flat shader: " << seconds[0] << " sec, normal shader: " << seconds[1] << " sec\n";
+		std::cout << mismatched << " pixels differ between flat shader and built-in kernel, " << uncovered <<
+			" covered pixels missing with normal shader\n";
+		std::cout << "shader pipeline " << (passed ? "matches" : "does NOT match") << " the built-in kernel\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::QuadShadingTest()
+	{
+		// Quad derivatives of a plane are its gradients, in every lane.
+		SR_ALIGN(32) float values[8], ddx[8], ddy[8];
+		for (int k = 0; k < 8; ++k)
+			values[k] = 0.75f * QUAD_OFFSET_X[k] - 1.5f * QUAD_OFFSET_Y[k] + 2.0f;
+		store8(ddx, quadDdx(load8(values)));
+		store8(ddy, quadDdy(load8(values)));
+		bool derivativesOk = true;
+		for (int k = 0; k < 8; ++k)
+			derivativesOk = derivativesOk && ddx[k] == 0.75f && ddy[k] == -1.5f;
+
+		// Shade eight fragments directly and compare with Blinn-Phong evaluated per pixel.
+		Material material;
+		material.diffuse = glm::vec3(1.0f, 0.5f, 0.25f);
+		material.specular = glm::vec3(0.5f, 0.5f, 0.5f);
+		material.emission = glm::vec3(0.0f, 0.0f, 0.1f);
+		material.roughness = 16.0f;
+		std::vector<Light> lights;
+		lights.push_back(Light::Directional(glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.8f)));
+		lights.push_back(Light::Point(glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0.5f, 0.25f, 0.0f), 0.5f));
+		glm::vec3 eye(0.0f, 0.0f, 2.0f), ambient(0.1f);
+		BlinnPhongFragmentShader shader(lights, eye, ambient);
+		Fragment8<BlinnPhongFragmentShader::VARYINGS> in;
+		in.x = in.y = 0;
+		in.mask = 0xFF;
+		in.material = &material;
+		in.texture = nullptr;
+		SR_ALIGN(32) float lanes[8][8];
+		for (int k = 0; k < 8; ++k)
+		{
+			float a = 0.2f * k;
+			glm::vec3 p(0.1f * k - 0.4f, 0.05f * k, 0.0f), n(std::sin(a), 0.0f, std::cos(a));
+			float v[8] = { p.x, p.y, p.z, n.x, n.y, n.z, 0.0f, 0.0f };
+			for (int i = 0; i < 8; ++i)
+				lanes[i][k] = v[i];
+		}
+		for (int i = 0; i < 8; ++i)
+			in.varyings[i] = load8(lanes[i]);
+		float8 color[3];
+		shader.Shade(in, color);
+		SR_ALIGN(32) float shaded[3][8];
+		for (int c = 0; c < 3; ++c)
+			store8(shaded[c], color[c]);
+		float maxError = 0.0f;
+		for (int k = 0; k < 8; ++k)
+		{
+			glm::vec3 p(lanes[0][k], lanes[1][k], lanes[2][k]), n(lanes[3][k], lanes[4][k], lanes[5][k]);
+			glm::vec3 v = glm::normalize(eye - p);
+			glm::vec3 expected = material.emission + material.diffuse * ambient;
+			for (const Light& light : lights)
+			{
+				glm::vec3 l = -light.direction;
+				float intensity = 1.0f;
+				if (light.type == LIGHT_TYPE::POINT)
+				{
+					l = light.position - p;
+					intensity = 1.0f / (1.0f + light.attenuation * glm::dot(l, l));
+					l = glm::normalize(l);
+				}
+				float nDotL = std::max(glm::dot(n, l), 0.0f);
+				float nDotH = std::max(glm::dot(n, glm::normalize(l + v)), 0.0f);
+				float s = material.roughness;
+				float power = nDotL > 0.0f ? nDotH / (s - (s - 1.0f) * nDotH) : 0.0f;
+				expected += light.color * intensity * (material.diffuse * nDotL + material.specular * power);
+			}
+			for (int c = 0; c < 3; ++c)
+				maxError = std::max(maxError, std::abs(shaded[c][k] - expected[2 - c]));
+		}
+		bool lightingOk = maxError < 1e-4f;
+
+		// Lighting the test scene must cover the same pixels as flat shading.
+		const int w = 800, h = 600;
+		std::vector<Model> models;
+		models.push_back(Model("models/face.obj"));
+		models[0].position = glm::vec3(-0.2f, 0.0f, -1.0f);
+		models[0].rotation = glm::vec3(0.1f, 0.1f, 0.0f);
+		models.push_back(Model("models/cube.obj"));
+		models[1].position = glm::vec3(0.15f, 0.0f, -1.0f);
+		models[1].scale = 0.185f;
+		models[1].rotation = glm::vec3(0.1f, 0.1f, 0.0f);
+		Camera camera;
+		camera.Update();
+		glm::mat4 P = glm::perspective(45.0f, float(w) / float(h), 0.1f, 100.0f);
+		glm::mat4 V = camera.getViewMatrix();
+		const int frameCount = 30, frames = 10;
+
+		TileBinner binner;
+		cv::Mat frame(h, w, CV_32FC3);
+		DepthBuffer depth;
+		depth.Create(w, h, DEPTH_FORMAT::FLOAT32);
+		unsigned int rendered = 0;
+		binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), depth.ClearValue());
+		binner.Invalidate();
+		for (int i = 0; i < models.size(); ++i)
+			models[i].Draw(binner, P, V, w, h, frameCount, false, true, i, rendered);
+		binner.Rasterize(frame, depth, false, true, RASTER_ALGORITHM::HALF_SPACE);
+		cv::Mat flat = frame.clone();
+
+		std::vector<Light> sceneLights;
+		sceneLights.push_back(Light::Directional(glm::vec3(0.5f, 0.6f, -1.0f), glm::vec3(0.5f)));
+		sceneLights.push_back(Light::Point(glm::vec3(0.6f, 0.0f, -0.6f), glm::vec3(0.4f, 0.3f, 0.2f), 4.0f));
+		BlinnPhongFragmentShader sceneShader(sceneLights, camera.position, glm::vec3(0.1f));
+		FragmentProgram program(sceneShader);
+		clock_t start = clock();
+		for (int f = 0; f < frames; ++f)
+		{
+			binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), depth.ClearValue(), BlinnPhongVertexShader::VARYINGS);
+			binner.Invalidate();
+			for (int i = 0; i < models.size(); ++i)
+				models[i].Draw(binner, BlinnPhongVertexShader(P, V, models[i].ModelMatrix(frameCount)), w, h, false,
+					true, i, rendered);
+			binner.Rasterize(frame, depth, false, true, RASTER_ALGORITHM::HALF_SPACE, false, nullptr, &program);
+		}
+		double seconds = double(clock() - start) / CLOCKS_PER_SEC / frames;
+		int uncovered = 0;
+		for (int y = 0; y < h; ++y)
+		{
+			for (int x = 0; x < w; ++x)
+			{
+				bool covered = flat.at<cv::Vec3f>(y, x) != cv::Vec3f(0.0f, 0.0f, 0.0f);
+				if (covered && frame.at<cv::Vec3f>(y, x) == cv::Vec3f(0.0f, 0.0f, 0.0f))
+					uncovered++;
+			}
+		}
+		bool coverageOk = uncovered * 1000 <= w * h;
+
+		std::cout << "quad derivatives " << (derivativesOk ? "match" : "do NOT match") << " plane gradients\n";
+		std::cout << "max Blinn-Phong error against per-pixel reference: " << maxError << "\n";
+		std::cout << "Blinn-Phong shading: " << seconds << " sec per frame, " << uncovered <<
+			" covered pixels missing\n";
+		return derivativesOk && lightingOk && coverageOk;
+	}
+
+	// Writes its two varyings unchanged, as red and green.
+	struct RawVaryingFragmentShader
+	{
+		static const int VARYINGS = 2;
+
+		SR_FORCEINLINE void Shade(const Fragment8<VARYINGS>& in, float8 color[3]) const
+		{
+			color[0] = set1(0.0f);
+			color[1] = in.varyings[1];
+			color[2] = in.varyings[0];
+		}
+	};
+
+	bool SoftwareRasterizerUnitTests::PerspectiveInterpolationTest()
+	{
+		// A floor receding from the camera, with texture coordinates equal to its x and z.
+		const int w = 800, h = 600;
+		glm::mat4 P = glm::perspective(45.0f, float(w) / float(h), 0.1f, 100.0f);
+		glm::vec3 corners[4] = { glm::vec3(-4.0f, -1.0f, -1.0f), glm::vec3(4.0f, -1.0f, -1.0f),
+			glm::vec3(4.0f, -1.0f, -40.0f), glm::vec3(-4.0f, -1.0f, -40.0f) };
+		const int quad[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+
+		TileBinner binner;
+		cv::Mat frame(h, w, CV_32FC3);
+		DepthBuffer depth;
+		depth.Create(w, h, DEPTH_FORMAT::FLOAT32);
+		Material material;
+		RawVaryingFragmentShader shader;
+		FragmentProgram program(shader);
+		const int frames = 10;
+		clock_t start = clock();
+		for (int f = 0; f < frames; ++f)
+		{
+			binner.Reset(w, h, cv::Vec3f(-1.0f, -1.0f, -1.0f), depth.ClearValue(), RawVaryingFragmentShader::VARYINGS);
+			binner.Invalidate();
+			for (int t = 0; t < 2; ++t)
+			{
+				Vertex v[3];
+				float varyings[3 * 3];
+				for (int q = 0; q < 3; ++q)
+				{
+					const glm::vec3& p = corners[quad[t][q]];
+					glm::vec4 c = P * glm::vec4(p, 1.0f);
+					v[q].position = glm::vec3((c.x / c.w + 1.0f) * 0.5f * w, (c.y / c.w + 1.0f) * 0.5f * h,
+						(c.z / c.w) * 0.5f + 0.5f);
+					varyings[3 * q] = p.x;
+					varyings[3 * q + 1] = p.z;
+					varyings[3 * q + 2] = 1.0f / c.w;
+				}
+				float col[3] = { 1.0f, 1.0f, 1.0f };
+				binner.Submit(Triangle(v[0], v[1], v[2], 0), col, 0, t, &material, varyings);
+			}
+			binner.Rasterize(frame, depth, false, true, RASTER_ALGORITHM::HALF_SPACE, false, nullptr, &program);
+		}
+		double seconds = double(clock() - start) / CLOCKS_PER_SEC / frames;
+
+		// Trace each covered pixel's center to the floor and compare with what was drawn.
+		// Errors are relative to the floor's extent along each axis.
+		double maxError = 0;
+		int covered = 0;
+		for (int y = 0; y < h; ++y)
+		{
+			for (int x = 0; x < w; ++x)
+			{
+				cv::Vec3f c = frame.at<cv::Vec3f>(y, x);
+				if (c[0] != 0.0f)
+					continue;
+				covered++;
+				glm::dvec3 d(((x + 0.5) / w * 2.0 - 1.0) / P[0][0], ((y + 0.5) / h * 2.0 - 1.0) / P[1][1], -1.0);
+				double s = -1.0 / d.y;
+				maxError = std::max(maxError, std::abs(c[2] - s * d.x) / 8.0);
+				maxError = std::max(maxError, std::abs(c[1] - s * d.z) / 39.0);
+			}
+		}
+		bool passed = covered > w * h / 4 && maxError < 1e-3;
+
+		std::cout << "perspective-correct varyings: " << seconds << " sec per frame, " << covered <<
+			" pixels, max relative error " << maxError << "\n";
+
+		// The same floor with a checkerboard diffuse map, lit by ambient light only, drawn
+		// forward and through a visibility buffer. Both interpolate from the same planes, so the
+		// texture coordinates, and the mip levels their derivatives pick as the floor recedes,
+		// must agree exactly.
+		cv::Mat checker(64, 64, CV_8UC3);
+		for (int y = 0; y < checker.rows; ++y)
+			for (int x = 0; x < checker.cols; ++x)
+				checker.at<cv::Vec3b>(y, x) = ((x / 8 + y / 8) & 1) ? cv::Vec3b(255, 255, 255) : cv::Vec3b(0, 0, 0);
+		std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+		texture->Create(checker);
+		Material textured;
+		textured.diffuse = glm::vec3(1.0f);
+		textured.specular = glm::vec3(0.0f);
+		textured.emission = glm::vec3(0.0f);
+		MaterialTexture map;
+		map.texture = texture;
+		map.type = TEXTURE_TYPE::DIFFUSE;
+		textured.textures.push_back(map);
+		std::vector<Light> noLights;
+		BlinnPhongFragmentShader litShader(noLights, glm::vec3(0.0f), glm::vec3(1.0f));
+		FragmentProgram litProgram(litShader);
+		const int N = BlinnPhongFragmentShader::VARYINGS;
+		cv::Mat forward, ids(h, w, CV_32SC1);
+		for (int deferred = 0; deferred < 2; ++deferred)
+		{
+			binner.Reset(w, h, cv::Vec3f(-1.0f, -1.0f, -1.0f), depth.ClearValue(), N);
+			binner.Invalidate();
+			for (int t = 0; t < 2; ++t)
+			{
+				Vertex v[3];
+				float varyings[3 * (N + 1)];
+				for (int q = 0; q < 3; ++q)
+				{
+					const glm::vec3& p = corners[quad[t][q]];
+					glm::vec4 c = P * glm::vec4(p, 1.0f);
+					v[q].position = glm::vec3((c.x / c.w + 1.0f) * 0.5f * w, (c.y / c.w + 1.0f) * 0.5f * h,
+						(c.z / c.w) * 0.5f + 0.5f);
+					const float attributes[N] = { p.x, p.y, p.z, 0.0f, 1.0f, 0.0f, p.x, p.z };
+					for (int k = 0; k < N; ++k)
+						varyings[(N + 1) * q + k] = attributes[k];
+					varyings[(N + 1) * q + N] = 1.0f / c.w;
+				}
+				float col[3] = { 1.0f, 1.0f, 1.0f };
+				binner.Submit(Triangle(v[0], v[1], v[2], 0), col, 0, t, &textured, varyings);
+			}
+			binner.Rasterize(frame, depth, false, true, RASTER_ALGORITHM::HALF_SPACE, false,
+				deferred ? &ids : nullptr, &litProgram);
+			if (!deferred)
+				forward = frame.clone();
+		}
+
+		// Far off, the checkers blur into gray in the coarser mip levels.
+		int differ = 0, gray = 0;
+		for (int y = 0; y < h; ++y)
+		{
+			for (int x = 0; x < w; ++x)
+			{
+				cv::Vec3f c = frame.at<cv::Vec3f>(y, x);
+				if (c != forward.at<cv::Vec3f>(y, x))
+					differ++;
+				if (c[0] > 0.25f && c[0] < 0.75f)
+					gray++;
+			}
+		}
+		passed &= differ == 0 && gray > 0;
+
+		std::cout << "textured floor: " << differ << " pixels differ between forward and visibility buffer, " <<
+			gray << " pixels from coarse mip levels\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::MultisampleTest()
+	{
+		// A white triangle on black: every pixel should resolve to the fraction of its sample
+		// positions inside the triangle. Samples lying exactly on an edge may go either way.
+		const int w = 256, h = 256;
+		glm::vec2 corners[3] = { glm::vec2(17.3f, 21.9f), glm::vec2(231.6f, 60.2f), glm::vec2(90.4f, 240.7f) };
+		bool passed = true;
+		for (int samples = 4; samples <= 8; samples += 4)
+		{
+			TileBinner binner;
+			cv::Mat frame(h, w, CV_32FC3);
+			DepthBuffer depth;
+			depth.Create(w, h, DEPTH_FORMAT::FLOAT32);
+			MultisampleTarget target;
+			target.Create(w, h, samples, DEPTH_FORMAT::FLOAT32);
+			binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), depth.ClearValue());
+			Vertex v[3];
+			for (int i = 0; i < 3; ++i)
+				v[i].position = glm::vec3(corners[i], 0.5f);
+			float col[3] = { 1.0f, 1.0f, 1.0f };
+			binner.Submit(Triangle(v[0], v[1], v[2], 0), col, 0, 0);
+			binner.Rasterize(frame, depth, false, true, RASTER_ALGORITHM::HALF_SPACE, false, nullptr, nullptr, &target);
+
+			// Vertices are snapped to 1/16 pixel like the rasterizer does.
+			glm::vec2 snapped[3];
+			for (int i = 0; i < 3; ++i)
+				snapped[i] = glm::floor(corners[i] * 16.0f + 0.5f) / 16.0f;
+			const float* pattern = samplePattern(samples);
+			int mismatched = 0, partial = 0;
+			for (int y = 0; y < h; ++y)
+			{
+				for (int x = 0; x < w; ++x)
+				{
+					int inside = 0;
+					for (int s = 0; s < samples; ++s)
+					{
+						glm::vec2 p(x + 0.5f + pattern[2 * s], y + 0.5f + pattern[2 * s + 1]);
+						int positive = 0;
+						for (int e = 0; e < 3; ++e)
+						{
+							glm::vec2 a = snapped[e], b = snapped[(e + 1) % 3];
+							if ((b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x) > 0.0f)
+								positive++;
+						}
+						if (positive == 0 || positive == 3)
+							inside++;
+					}
+					float c = frame.at<cv::Vec3f>(y, x)[0];
+					if (std::abs(c - float(inside) / samples) > 1e-5f)
+						mismatched++;
+					if (c > 0.0f && c < 1.0f)
+						partial++;
+				}
+			}
+			if (partial == 0 || mismatched * 50 > partial)
+				passed = false;
+			std::cout << samples << "x coverage: " << partial << " edge pixels, " << mismatched << " differ\n";
+		}
+
+		// The same scene as the render test.
+		Scene scene;
+		glm::mat4 P;
+		makeRenderTestScene(scene, P);
+
+		// The reference is rendered at 4x the resolution on each axis and box filtered.
+		const int scale = 4;
+		scene.w *= scale;
+		scene.h *= scale;
+		clock_t clock1 = clock();
+		scene.RenderFrame(P);
+		clock_t clock2 = clock();
+		cv::Mat reference(scene.h / scale, scene.w / scale, CV_32FC3, cv::Scalar(0, 0, 0));
+		for (int y = 0; y < scene.h; ++y)
+			for (int x = 0; x < scene.w; ++x)
+				for (int c = 0; c < 3; ++c)
+					reference.at<cv::Vec3f>(y / scale, x / scale)[c] += scene.frame.at<cv::Vec3f>(y, x)[c] / (scale * scale);
+		scene.w /= scale;
+		scene.h /= scale;
+		std::cout << "16x supersampled reference: " << double(clock2 - clock1) / CLOCKS_PER_SEC << " sec\n";
+
+		// More samples should get closer to the reference. Flat shading is the same across a
+		// triangle, so pixels fully inside one must match the single-sampled image exactly.
+		double previousError = 0;
+		cv::Mat single;
+		for (int samples = 1; samples <= 8; samples *= 2)
+		{
+			if (samples == 2)
+				continue;
+			scene.samples = samples;
+			const int frames = 5;
+			clock1 = clock();
+			for (int f = 0; f < frames; ++f)
+				scene.RenderFrame(P);
+			clock2 = clock();
+			if (samples == 1)
+				single = scene.frame.clone();
+
+			double error = 0;
+			int interiorMismatched = 0;
+			for (int y = 0; y < scene.h; ++y)
+			{
+				for (int x = 0; x < scene.w; ++x)
+				{
+					for (int c = 0; c < 3; ++c)
+						error += std::abs(scene.frame.at<cv::Vec3f>(y, x)[c] - reference.at<cv::Vec3f>(y, x)[c]);
+					if (x == 0 || y == 0 || x == scene.w - 1 || y == scene.h - 1)
+						continue;
+					bool interior = true;
+					for (int dy = -1; dy <= 1; ++dy)
+						for (int dx = -1; dx <= 1; ++dx)
+							if (single.at<cv::Vec3f>(y + dy, x + dx) != single.at<cv::Vec3f>(y, x))
+								interior = false;
+					if (interior && scene.frame.at<cv::Vec3f>(y, x) != single.at<cv::Vec3f>(y, x))
+						interiorMismatched++;
+				}
+			}
+			if ((samples > 1 && error >= previousError) || interiorMismatched != 0)
+				passed = false;
+			previousError = error;
+
+			std::cout << samples << "x: " << double(clock2 - clock1) / CLOCKS_PER_SEC / frames <<
+				" sec per frame, error " << error / (scene.w * scene.h) << " per pixel, " << interiorMismatched <<
+				" interior pixels differ\n";
+		}
+
+		std::cout << "multisampling " << (passed ? "converges" : "does NOT converge") << " to the supersampled image\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::WireframeEdgeTest()
+	{
+		// The same scene as the render test.
+		Scene scene;
+		glm::mat4 P;
+		makeRenderTestScene(scene, P);
+
+		// Every edge must be listed once, and every triangle side must name an edge between
+		// the same two positions.
+		bool passed = true;
+		for (int m = 0; m < scene.models.size(); ++m)
+		{
+			const Model& model = scene.models[m];
+			std::map<std::pair<std::vector<float>, std::vector<float>>, int> seen;
+			for (int e = 0; e < model.m_Edges.size(); ++e)
+			{
+				glm::vec3 a = model.m_Vertices[model.m_Edges[e].v[0]].position;
+				glm::vec3 b = model.m_Vertices[model.m_Edges[e].v[1]].position;
+				std::vector<float> ka = { a.x, a.y, a.z }, kb = { b.x, b.y, b.z };
+				if (kb < ka)
+					std::swap(ka, kb);
+				if (seen[std::make_pair(ka, kb)]++)
+					passed = false;
+			}
+			for (unsigned int t = 0; t < model.TriangleCount(); ++t)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					glm::vec3 a = model.m_Vertices[model.m_Indices[3 * t + k]].position;
+					glm::vec3 b = model.m_Vertices[model.m_Indices[3 * t + (k + 1) % 3]].position;
+					std::vector<float> ka = { a.x, a.y, a.z }, kb = { b.x, b.y, b.z };
+					if (kb < ka)
+						std::swap(ka, kb);
+					if (ka != kb && !seen.count(std::make_pair(ka, kb)))
+						passed = false;
+				}
+			}
+			std::cout << model.TriangleCount() << " triangles, " << 3 * model.TriangleCount() << " sides, " <<
+				model.EdgeCount() << " unique edges\n";
+		}
+
+		// Lines drawn tile by tile must hit exactly the pixels of drawing each line whole.
+		const int w = 800, h = 600;
+		TileBinner binner;
+		cv::Mat tiled(h, w, CV_32FC3), whole(h, w, CV_32FC3, cv::Scalar(0, 0, 0));
+		DepthBuffer tiledDepth, wholeDepth;
+		tiledDepth.Create(w, h, DEPTH_FORMAT::FLOAT32);
+		wholeDepth.Create(w, h, DEPTH_FORMAT::FLOAT32);
+		wholeDepth.Clear(1.0f);
+		binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), tiledDepth.ClearValue());
+		srand(7);
+		for (int i = 0; i < 500; ++i)
+		{
+			glm::vec3 a(rand() % 9000 / 10.0f - 50.0f, rand() % 7000 / 10.0f - 50.0f, rand() % 1000 / 1000.0f);
+			glm::vec3 b(rand() % 9000 / 10.0f - 50.0f, rand() % 7000 / 10.0f - 50.0f, rand() % 1000 / 1000.0f);
+			float col[3] = { float(i % 7) / 7.0f, float(i % 5) / 5.0f, 1.0f };
+			binner.SubmitLine(a, b, col);
+			rasterizeLine(a, b, whole, wholeDepth, col, 0, cv::Rect(0, 0, w, h), true);
+		}
+		binner.Rasterize(tiled, tiledDepth, true, true, RASTER_ALGORITHM::HALF_SPACE);
+		int mismatched = 0;
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+				if (tiled.at<cv::Vec3f>(y, x) != whole.at<cv::Vec3f>(y, x))
+					mismatched++;
+		if (mismatched != 0)
+			passed = false;
+		std::cout << "tiled lines: " << mismatched << " pixels differ from whole lines\n";
+
+		// A line passing behind a filled triangle is hidden where the triangle covers it.
+		binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), tiledDepth.ClearValue());
+		float red[3] = { 0.0f, 0.0f, 1.0f }, white[3] = { 1.0f, 1.0f, 1.0f };
+		Vertex corners[3];
+		corners[0].position = glm::vec3(300.0f, 200.0f, 0.3f);
+		corners[1].position = glm::vec3(500.0f, 200.0f, 0.3f);
+		corners[2].position = glm::vec3(400.0f, 400.0f, 0.3f);
+		binner.Submit(Triangle(corners[0], corners[1], corners[2], 0), red);
+		binner.SubmitLine(glm::vec3(100.0f, 250.5f, 0.6f), glm::vec3(700.0f, 250.5f, 0.6f), white);
+		binner.Rasterize(tiled, tiledDepth, false, true, RASTER_ALGORITHM::HALF_SPACE);
+		if (tiled.at<cv::Vec3f>(250, 200) != cv::Vec3f(1, 1, 1) || tiled.at<cv::Vec3f>(250, 400) != cv::Vec3f(0, 0, 1))
+			passed = false;
+
+		// Faces before any usemtl, or naming a material the .mtl file does not have, are drawn
+		// with the default material, filled and as edges.
+		std::ofstream("no_material.mtl") << "newmtl white\nKd 1 1 1\n";
+		std::ofstream("no_material.obj") << "mtllib no_material.mtl\nv -0.2 -0.2 -1\nv 0.2 -0.2 -1\nv 0 0.2 -1\n"
+			"v 0.3 0.2 -1\nf 1 2 3\nusemtl missing\nf 2 4 3\n";
+		{
+			Model bare("no_material.obj", false);
+			bare.rotation = glm::vec3(0.0f, 0.0f, 1.0f);
+			for (unsigned int t = 0; t < bare.TriangleCount(); ++t)
+				passed &= bare.m_TriangleMaterials[t] == ~0u;
+			Camera camera;
+			camera.Update();
+			const cv::Vec3f defaultColor(0.2f, 0.2f, 0.2f);
+			for (int wireframe = 0; wireframe < 2; ++wireframe)
+			{
+				unsigned int count = 0;
+				binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), tiledDepth.ClearValue());
+				binner.Invalidate();
+				if (wireframe)
+					bare.DrawEdges(binner, P, camera.getViewMatrix(), w, h, 0, false, true, 0, count);
+				else
+					bare.Draw(binner, P, camera.getViewMatrix(), w, h, 0, false, true, 0, count);
+				binner.Rasterize(tiled, tiledDepth, wireframe != 0, true, RASTER_ALGORITHM::HALF_SPACE);
+				int drawn = 0, wrong = 0;
+				for (int y = 0; y < h; ++y)
+				{
+					for (int x = 0; x < w; ++x)
+					{
+						cv::Vec3f c = tiled.at<cv::Vec3f>(y, x);
+						drawn += c == defaultColor;
+						wrong += c != defaultColor && c != cv::Vec3f(0, 0, 0);
+					}
+				}
+				passed &= drawn > 0 && wrong == 0;
+			}
+		}
+		std::filesystem::remove("no_material.obj");
+		std::filesystem::remove("no_material.mtl");
+
+		// Time the old outline wireframe, drawing every triangle, against the edge list.
+		const int frames = 10;
+		glm::mat4 V = scene.camera.getViewMatrix();
+		DepthBuffer depth;
+		depth.Create(w, h, DEPTH_FORMAT::FLOAT32);
+		clock_t clock1 = clock();
+		for (int f = 0; f < frames; ++f)
+		{
+			unsigned int count = 0;
+			binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), depth.ClearValue());
+			for (int m = 0; m < scene.models.size(); ++m)
+				scene.models[m].Draw(binner, P, V, w, h, scene.frameCount, false, true, m, count);
+			binner.Rasterize(tiled, depth, true, true, RASTER_ALGORITHM::HALF_SPACE);
+		}
+		clock_t clock2 = clock();
+		scene.wireframeOn = true;
+		for (int f = 0; f < frames; ++f)
+			scene.RenderFrame(P);
+		clock_t clock3 = clock();
+		int drawn = 0;
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+				if (scene.frame.at<cv::Vec3f>(y, x) != cv::Vec3f(0, 0, 0))
+					drawn++;
+		if (drawn == 0)
+			passed = false;
+
+		std::cout << "triangle outlines: " << double(clock2 - clock1) / CLOCKS_PER_SEC / frames <<
+			" sec per frame, edge list: " << double(clock3 - clock2) / CLOCKS_PER_SEC / frames << " sec per frame, " <<
+			drawn << " pixels drawn\n";
+		std::cout << "wireframe edges " << (passed ? "are" : "are NOT") << " drawn once and exactly\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::ObjParserTest()
+	{
+		bool passed = true;
+
+		// Numbers the float parser must read exactly like the C library.
+		const char* numbers[] = { "0", "-0.5", "+.25", "3.", "1e-3", "-7.07107e-01", "0.000000123456789", "1234567.125",
+			"12345678901234567890123", "3.4028235e38", "1e-45", "6.02214076E+23", "0.1000000000000000000000001" };
+		for (const char* number : numbers)
+		{
+			const char* p = number;
+			const char* end = number + strlen(number);
+			float parsed = parseObjFloat(p, end);
+			if (parsed != strtof(number, nullptr) || p != end)
+			{
+				std::cout << "parsed " << number << " as " << parsed << "\n";
+				passed = false;
+			}
+		}
+		const char* word = "  abc";
+		const char* p = word;
+		passed &= parseObjFloat(p, word + 5) == 0.0f && p == word + 2;
+
+		// A grid of quads, written a row at a time with the faces that close it, in every
+		// corner format and with relative indices, so faces refer back across chunks. A few
+		// lines end in CRLF, carry comments or use tabs, and the last face is one long polygon.
+		const int n = 400;
+		std::string path = "obj_parser_test.obj", mtlPath = "obj_parser_test.mtl";
+		FILE* file = fopen(mtlPath.c_str(), "w");
+		fprintf(file, "newmtl red\nKd 1 0 0\nnewmtl green\nKd 0 1 0\n");
+		fclose(file);
+		file = fopen(path.c_str(), "wb");
+		fprintf(file, "# obj parser test\nmtllib obj_parser_test.mtl\no grid\nusemtl red\n");
+		std::vector<ObjCorner> expectedCorners;
+		std::vector<unsigned int> expectedStarts;
+		unsigned int greenFrom = 0;
+		for (int y = 0; y < n; ++y)
+		{
+			const char* eol = y % 3 == 0 ? "\r\n" : "\n";
+			for (int x = 0; x < n; ++x)
+			{
+				fprintf(file, "v %.7g %.7g %.7g%s", (x - n / 2) * 0.0123457f, (y - n / 2) * -0.0098765f,
+					std::sin(x * 0.05f) * std::cos(y * 0.05f), eol);
+				fprintf(file, y % 5 == 0 ? "vt\t%.6f\t%.6f%s" : "vt %.6f %.6f%s", x / float(n - 1), y / float(n - 1), eol);
+				fprintf(file, "vn %.5e %.5e %.5e%s", 0.0f, -0.70710678f, 0.70710678f, eol);
+			}
+			if (y == n / 2)
+			{
+				fprintf(file, "usemtl green\n");
+				greenFrom = (unsigned int)expectedStarts.size();
+			}
+			if (y == 3 * n / 4)
+				fprintf(file, "usemtl missing\n");
+			for (int x = 0; y > 0 && x + 1 < n; ++x)
+			{
+				int quad[4] = { (y - 1) * n + x, (y - 1) * n + x + 1, y * n + x + 1, y * n + x };
+				int total = (y + 1) * n;
+				int format = (x + y) % 5;
+				expectedStarts.push_back((unsigned int)expectedCorners.size());
+				fprintf(file, "f");
+				for (int k = 0; k < 4; ++k)
+				{
+					int i = quad[k];
+					ObjCorner c = { i, i, i };
+					switch (format)
+					{
+					case 0: fprintf(file, " %d/%d/%d", i + 1, i + 1, i + 1); break;
+					case 1: fprintf(file, " %d/%d/%d", i - total, i - total, i - total); break;
+					case 2: fprintf(file, " %d//%d", i + 1, i - total); c.t = -1; break;
+					case 3: fprintf(file, " %d/%d", i - total, i + 1); c.n = -1; break;
+					default: fprintf(file, "\t%d", i + 1); c.t = c.n = -1; break;
+					}
+					expectedCorners.push_back(c);
+				}
+				fprintf(file, x % 7 == 0 ? " # quad%s" : "%s", eol);
+			}
+		}
+		expectedStarts.push_back((unsigned int)expectedCorners.size());
+		fprintf(file, "f");
+		for (int x = 0; x < n; ++x)
+		{
+			fprintf(file, " %d/%d/%d", x + 1, x + 1, x + 1);
+			ObjCorner c = { x, x, x };
+			expectedCorners.push_back(c);
+		}
+		fprintf(file, "\n");
+		expectedStarts.push_back((unsigned int)expectedCorners.size());
+		long bytes = ftell(file);
+		fclose(file);
+
+		// The reference: a line at a time with fgets, sscanf and strtok, like the loader this
+		// parser replaced, but with room for long lines and relative indices.
+		auto naiveParse = [](const std::string& path, ObjData& out)
+		{
+			FILE* file = fopen(path.c_str(), "r");
+			std::vector<char> line(1 << 16);
+			while (fgets(line.data(), (int)line.size(), file))
+			{
+				char header[16] = { 0 };
+				sscanf(line.data(), "%15s", header);
+				const char* args = line.data() + strspn(line.data(), " \t") + strlen(header);
+				if (strcmp(header, "v") == 0 || strcmp(header, "vn") == 0)
+				{
+					glm::vec3 v;
+					sscanf(args, "%f %f %f", &v.x, &v.y, &v.z);
+					(header[1] ? out.normals : out.positions).push_back(v);
+				}
+				else if (strcmp(header, "vt") == 0)
+				{
+					glm::vec2 uv;
+					sscanf(args, "%f %f", &uv.x, &uv.y);
+					out.texcoords.push_back(uv);
+				}
+				else if (strcmp(header, "f") == 0)
+				{
+					out.faceStarts.push_back((unsigned int)out.corners.size());
+					for (char* token = strtok(line.data() + 1, " \t\r\n"); token && token[0] != '#'; token = strtok(NULL, " \t\r\n"))
+					{
+						int v = 0, t = 0, n = 0;
+						if (sscanf(token, "%d/%d/%d", &v, &t, &n) < 2)
+							sscanf(token, "%d//%d", &v, &n);
+						auto resolve = [](int i, size_t count) { return i > 0 ? i - 1 : i < 0 ? int(count) + i : -1; };
+						ObjCorner c = { resolve(v, out.positions.size()), resolve(t, out.texcoords.size()),
+							resolve(n, out.normals.size()) };
+						out.corners.push_back(c);
+					}
+				}
+			}
+			out.faceStarts.push_back((unsigned int)out.corners.size());
+			fclose(file);
+		};
+
+		const int runs = 3;
+		ObjData obj, reference;
+		auto time0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < runs; ++r)
+			passed &= parseObj(path, obj);
+		auto time1 = std::chrono::steady_clock::now();
+		for (int r = 0; r < runs; ++r)
+		{
+			reference = ObjData();
+			naiveParse(path, reference);
+		}
+		auto time2 = std::chrono::steady_clock::now();
+
+		auto sameCorners = [](const std::vector<ObjCorner>& a, const std::vector<ObjCorner>& b)
+		{
+			if (a.size() != b.size())
+				return false;
+			for (size_t i = 0; i < a.size(); ++i)
+				if (a[i].v != b[i].v || a[i].t != b[i].t || a[i].n != b[i].n)
+					return false;
+			return true;
+		};
+		passed &= obj.positions == reference.positions && obj.texcoords == reference.texcoords &&
+			obj.normals == reference.normals;
+		passed &= sameCorners(obj.corners, expectedCorners) && sameCorners(reference.corners, expectedCorners);
+		passed &= obj.faceStarts == expectedStarts && reference.faceStarts == expectedStarts;
+		passed &= obj.materialSwitches.size() == 3 && obj.materialSwitches[0].name == "red" &&
+			obj.materialSwitches[0].firstFace == 0 && obj.materialSwitches[1].name == "green" &&
+			obj.materialSwitches[1].firstFace == greenFrom;
+		passed &= !parseObj("does_not_exist.obj", obj);
+
+		// The model fans every face into triangles and keeps the last material found. Loading
+		// reorders triangles, so they are compared as sorted lists of corner positions and
+		// material.
+		Model model(path, false);
+		unsigned int quads = (n - 1) * (n - 1);
+		passed &= model.TriangleCount() == 2 * quads + n - 2;
+		int red = model.m_Materials->Find("red"), green = model.m_Materials->Find("green");
+		std::vector<std::vector<float>> expectedTriangles, modelTriangles;
+		for (unsigned int f = 0; f + 1 < expectedStarts.size(); ++f)
+		{
+			for (unsigned int k = expectedStarts[f] + 1; k + 1 < expectedStarts[f + 1]; ++k)
+			{
+				std::vector<float> triangle;
+				for (unsigned int c : { expectedStarts[f], k, k + 1 })
+					for (int i = 0; i < 3; ++i)
+						triangle.push_back(obj.positions[expectedCorners[c].v][i]);
+				triangle.push_back(float(f < greenFrom ? red : green));
+				expectedTriangles.push_back(triangle);
+			}
+		}
+		for (unsigned int t = 0; t < model.TriangleCount(); ++t)
+		{
+			std::vector<float> triangle;
+			for (int k = 0; k < 3; ++k)
+				for (int i = 0; i < 3; ++i)
+					triangle.push_back(model.m_Vertices[model.m_Indices[3 * t + k]].position[i]);
+			triangle.push_back(float(model.m_TriangleMaterials[t]));
+			modelTriangles.push_back(triangle);
+		}
+		std::sort(expectedTriangles.begin(), expectedTriangles.end());
+		std::sort(modelTriangles.begin(), modelTriangles.end());
+		passed &= modelTriangles == expectedTriangles;
+
+		std::remove(path.c_str());
+		std::remove(mtlPath.c_str());
+
+		double parseTime = std::chrono::duration<double>(time1 - time0).count() / runs;
+		double naiveTime = std::chrono::duration<double>(time2 - time1).count() / runs;
+		std::cout << "OBJ parser: " << bytes / (1 << 20) << " MB in " << parseTime << " sec, line by line: " <<
+			naiveTime << " sec (" << naiveTime / parseTime << "x)\n";
+		std::cout << "OBJ parser " << (passed ? "matches" : "does NOT match") << " the reference\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::MeshCacheTest()
+	{
+		// Work on a copy of the face model, so it can be touched and edited.
+		std::string path = "mesh_cache_test.obj", mtlPath = "mesh_cache_test.mtl", cachePath = meshCachePath(path);
+		std::filesystem::copy_file("models/face.obj", path, std::filesystem::copy_options::overwrite_existing);
+		std::filesystem::copy_file("models/face.mtl", mtlPath, std::filesystem::copy_options::overwrite_existing);
+		std::filesystem::remove(cachePath);
+		bool passed = true;
+
+		// The first load writes the cache, the second reads exactly what was parsed.
+		Model parsed(path, false);
+		passed &= !std::filesystem::exists(cachePath);
+		Model written(path);
+		passed &= std::filesystem::exists(cachePath);
+		Model cached(path);
+		auto same = [](const Model& a, const Model& b)
+		{
+			return a.m_Vertices.size() == b.m_Vertices.size() &&
+				memcmp(a.m_Vertices.data(), b.m_Vertices.data(), a.m_Vertices.size() * sizeof(Vertex)) == 0 &&
+				a.m_Indices == b.m_Indices && a.m_TriangleMaterials == b.m_TriangleMaterials &&
+				a.m_Edges.size() == b.m_Edges.size() &&
+				memcmp(a.m_Edges.data(), b.m_Edges.data(), a.m_Edges.size() * sizeof(MeshEdge)) == 0 &&
+				a.m_TriangleEdges == b.m_TriangleEdges && a.m_PositionX == b.m_PositionX &&
+				a.bounds[0] == b.bounds[0] && a.bounds[1] == b.bounds[1];
+		};
+		passed &= same(parsed, cached);
+		passed &= readMeshCache(cachePath, path, cached);
+
+		// A new time stamp on the same contents keeps the cache; different contents of the
+		// same or another size do not.
+		std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::hours(1));
+		passed &= readMeshCache(cachePath, path, cached);
+		std::string text;
+		{
+			std::ifstream in(path, std::ios::binary);
+			text.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		}
+		size_t digit = text.find_first_of("123456789", text.find("\nv "));
+		std::string edited = text;
+		edited[digit] = edited[digit] == '9' ? '8' : '9';
+		std::ofstream(path, std::ios::binary) << edited;
+		passed &= !readMeshCache(cachePath, path, cached);
+		std::ofstream(path, std::ios::binary) << text << "# appended\n";
+		passed &= !readMeshCache(cachePath, path, cached);
+		std::ofstream(path, std::ios::binary) << text;
+		passed &= readMeshCache(cachePath, path, cached);
+
+		// A truncated cache is rejected, and the next load replaces it.
+		std::filesystem::resize_file(cachePath, std::filesystem::file_size(cachePath) / 2);
+		passed &= !readMeshCache(cachePath, path, cached);
+		Model rewritten(path);
+		passed &= same(parsed, rewritten) && readMeshCache(cachePath, path, cached);
+
+		// So is a cache whose header is intact but whose indices point past its vertices or
+		// edges.
+		Model corrupt = parsed;
+		corrupt.m_Indices[1] = (unsigned int)corrupt.m_Vertices.size();
+		passed &= writeMeshCache(cachePath, path, corrupt) && !readMeshCache(cachePath, path, cached);
+		corrupt = parsed;
+		corrupt.m_TriangleEdges[2] = (unsigned int)corrupt.m_Edges.size();
+		passed &= writeMeshCache(cachePath, path, corrupt) && !readMeshCache(cachePath, path, cached);
+		passed &= writeMeshCache(cachePath, path, parsed) && readMeshCache(cachePath, path, cached);
+
+		// Materials are found by name, so a reordered .mtl file keeps the cache.
+		std::ofstream(mtlPath, std::ios::app) << "\nnewmtl extra\nKd 0 0 1\n";
+		std::string reordered;
+		{
+			std::ifstream in(mtlPath, std::ios::binary);
+			std::string mtl((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+			size_t extra = mtl.find("\nnewmtl extra");
+			reordered = mtl.substr(extra + 1) + "\n" + mtl.substr(0, extra + 1);
+		}
+		std::ofstream(mtlPath, std::ios::binary) << reordered;
+		Model remapped(path);
+		passed &= remapped.m_Materials->Find("face") == 1;
+		for (unsigned int t = 0; t < remapped.TriangleCount(); ++t)
+			passed &= parsed.m_TriangleMaterials[t] == ~0u ? remapped.m_TriangleMaterials[t] == ~0u :
+				remapped.m_Materials->names[remapped.m_TriangleMaterials[t]] == parsed.m_Materials->names[parsed.m_TriangleMaterials[t]];
+
+		// A renamed material is not, so its triangles are not left without one.
+		std::string renamedMtl = reordered;
+		renamedMtl.replace(renamedMtl.find("newmtl face"), 11, "newmtl gone");
+		std::ofstream(mtlPath, std::ios::binary) << renamedMtl;
+		Model renamed(path, false);
+		passed &= renamed.m_Materials->Find("face") < 0 && !readMeshCache(cachePath, path, renamed);
+		std::ofstream(mtlPath, std::ios::binary) << reordered;
+
+		// Time parsing against reading the cache.
+		const int loads = 20;
+		clock_t clock1 = clock();
+		for (int i = 0; i < loads; ++i)
+			Model model(path, false);
+		clock_t clock2 = clock();
+		for (int i = 0; i < loads; ++i)
+			Model model(path);
+		clock_t clock3 = clock();
+
+		std::filesystem::remove(path);
+		std::filesystem::remove(mtlPath);
+		std::filesystem::remove(cachePath);
+
+		double parseTime = double(clock2 - clock1) / CLOCKS_PER_SEC / loads;
+		double cacheTime = double(clock3 - clock2) / CLOCKS_PER_SEC / loads;
+		std::cout << "parsing .OBJ: " << parseTime << " sec per load, reading .srmesh: " << cacheTime << " sec per load\n";
+		std::cout << "mesh cache " << (passed ? "reloads" : "does NOT reload") << " exactly what was parsed\n";
+		return passed;
+	}
+
+	/*!
+	*  \brief Writes name.obj, an n x n vertex grid of quads, and name.mtl with one material
+	*         using textures size x size texture maps name_0.ppm, name_1.ppm and so on.
+	*/
+	static void writeTexturedGrid(const std::string& name, int n, int size, int textures)
+	{
+		const char* maps[] = { "map_Kd", "map_Ks", "map_Ke", "map_Kn" };
+		FILE* file = fopen((name + ".mtl").c_str(), "w");
+		fprintf(file, "newmtl grid\nKd 1 1 1\n");
+		for (int t = 0; t < textures; ++t)
+		{
+			std::string texturePath = name + "_" + std::to_string(t) + ".ppm";
+			cv::Mat image(size, size, CV_8UC3);
+			for (int y = 0; y < image.rows; ++y)
+				for (int x = 0; x < image.cols; ++x)
+					image.at<cv::Vec3b>(y, x) = cv::Vec3b((unsigned char)x, (unsigned char)y, (unsigned char)((x ^ y) + t));
+			cv::imwrite(texturePath, image);
+			fprintf(file, "%s %s\n", maps[t % 4], texturePath.c_str());
+		}
+		fclose(file);
+		file = fopen((name + ".obj").c_str(), "w");
+		fprintf(file, "usemtl grid\n");
+		for (int y = 0; y < n; ++y)
+			for (int x = 0; x < n; ++x)
+				fprintf(file, "v %f %f %f\nvt %f %f\nvn 0 0 1\n", x / float(n - 1) - 0.5f, y / float(n - 1) - 0.5f,
+					0.05f * std::sin(x * 0.1f), x / float(n - 1), y / float(n - 1));
+		for (int y = 1; y < n; ++y)
+			for (int x = 1; x < n; ++x)
+				fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", (y - 1) * n + x, (y - 1) * n + x, (y - 1) * n + x,
+					(y - 1) * n + x + 1, (y - 1) * n + x + 1, (y - 1) * n + x + 1, y * n + x + 1, y * n + x + 1,
+					y * n + x + 1, y * n + x, y * n + x, y * n + x);
+		fclose(file);
+	}
+
+	bool SoftwareRasterizerUnitTests::ProgressiveLoadingTest()
+	{
+		// A textured grid, big enough to be handed over in many pieces.
+		std::string path = "progressive_loading_test.obj", mtlPath = "progressive_loading_test.mtl",
+			texturePath = "progressive_loading_test_0.ppm";
+		writeTexturedGrid("progressive_loading_test", 300, 256, 1);
+		std::filesystem::remove(meshCachePath(path));
+		bool passed = true;
+
+		// Previews are an eighth of the size in each direction.
+		std::shared_ptr<const Texture> full = AssetCache::Instance().LoadTexture(texturePath);
+		std::shared_ptr<const Texture> preview = AssetCache::Instance().LoadTexture(texturePath, true);
+		passed &= full && preview && full->Width() == 256 && preview->Width() == 32;
+
+		// Reading the file a piece at a time gives the same attributes and faces as at once.
+		ObjData whole, piece;
+		passed &= parseObj(path, whole);
+		ObjReader reader;
+		passed &= reader.Open(path);
+		std::vector<ObjCorner> corners;
+		int pieces = 0;
+		while (reader.Next(piece, 1 << 16))
+		{
+			corners.insert(corners.end(), piece.corners.begin(), piece.corners.end());
+			pieces++;
+		}
+		passed &= pieces > 1 && reader.Progress() == 1.0f && piece.positions == whole.positions &&
+			piece.texcoords == whole.texcoords && corners.size() == whole.corners.size();
+		for (size_t i = 0; i < corners.size() && i < whole.corners.size(); ++i)
+			passed &= corners[i].v == whole.corners[i].v && corners[i].t == whole.corners[i].t;
+
+		// A streamed model ends up exactly like one loaded at once, drawing partial geometry
+		// on the way. Frames are rendered as fast as the loader hands over pieces.
+		Model loaded(path, false);
+		Scene scene, reference;
+		scene.w = reference.w = 400;
+		scene.h = reference.h = 300;
+		glm::mat4 P = glm::perspective(45.0f, float(scene.w) / float(scene.h), 0.1f, 100.0f);
+		scene.LoadModel(path);
+		scene.models[0].position = glm::vec3(0.0f, 0.0f, -1.5f);
+		scene.models[0].rotation = glm::vec3(0.1f, 0.1f, 0.0f);
+		auto start = std::chrono::steady_clock::now();
+		double firstGeometry = -1.0;
+		int frames = 0, partialFrames = 0;
+		while (scene.UpdateLoading())
+		{
+			unsigned int triangles = scene.models[0].TriangleCount();
+			if (triangles > 0 && firstGeometry < 0.0)
+				firstGeometry = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			partialFrames += triangles > 0 && triangles < loaded.TriangleCount();
+			scene.wireframeOn = frames % 2 == 1;
+			scene.RenderFrame(P);
+			frames++;
+		}
+		double complete = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const Model& streamed = scene.models[0];
+		passed &= streamed.m_Vertices.size() == loaded.m_Vertices.size() &&
+			memcmp(streamed.m_Vertices.data(), loaded.m_Vertices.data(), loaded.m_Vertices.size() * sizeof(Vertex)) == 0 &&
+			streamed.m_Indices == loaded.m_Indices && streamed.m_TriangleMaterials == loaded.m_TriangleMaterials &&
+			streamed.m_TriangleEdges == loaded.m_TriangleEdges && streamed.m_PositionX == loaded.m_PositionX &&
+			streamed.bounds[0] == loaded.bounds[0] && streamed.bounds[1] == loaded.bounds[1];
+		passed &= streamed.m_Materials && streamed.m_Materials->materials[0].GetTexture(TEXTURE_TYPE::DIFFUSE) &&
+			streamed.m_Materials->materials[0].GetTexture(TEXTURE_TYPE::DIFFUSE)->Width() == 256;
+
+		reference.AddModel(path);
+		reference.models[0].position = scene.models[0].position;
+		reference.models[0].rotation = scene.models[0].rotation;
+		scene.wireframeOn = false;
+		scene.RenderFrame(P);
+		reference.RenderFrame(P);
+		int mismatched = 0;
+		for (int y = 0; y < scene.h; ++y)
+			for (int x = 0; x < scene.w; ++x)
+				mismatched += scene.frame.at<cv::Vec3f>(y, x) != reference.frame.at<cv::Vec3f>(y, x);
+		passed &= mismatched == 0;
+
+		// A missing file fails without taking anything down, and a loader dropped halfway
+		// stops.
+		{
+			ModelLoader missing("does_not_exist.obj");
+			Model empty;
+			while (!missing.Update(empty))
+				std::this_thread::yield();
+			passed &= missing.Failed() && empty.TriangleCount() == 0;
+			ModelLoader dropped(path, false, 1 << 12);
+		}
+
+		std::filesystem::remove(path);
+		std::filesystem::remove(mtlPath);
+		std::filesystem::remove(meshCachePath(path));
+		std::filesystem::remove(texturePath);
+
+		std::cout << "streamed in " << pieces << " pieces: first geometry after " << firstGeometry << " sec, complete after " <<
+			complete << " sec, " << frames << " frames drawn while loading (" << partialFrames << " partial), " <<
+			mismatched << " pixels differ once loaded\n";
+		std::cout << "progressive loading " << (passed ? "ends with" : "does NOT end with") << " the fully loaded model\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::ParallelLoadingTest()
+	{
+		// Models of different sizes, each with textures of its own.
+		const int count = 8;
+		std::vector<ModelDescriptor> descriptors;
+		for (int i = 0; i < count; ++i)
+		{
+			std::string name = "parallel_loading_test_" + std::to_string(i);
+			writeTexturedGrid(name, 60 + 20 * i, 512, 3);
+			std::filesystem::remove(meshCachePath(name + ".obj"));
+			descriptors.push_back(ModelDescriptor(name + ".obj", glm::vec3(float(i), 0.0f, -5.0f),
+				glm::vec3(0.1f * i, 0.1f, 0.0f), 0.5f + i));
+		}
+		bool passed = true;
+
+		// One after another, then all at once. Caches and textures are dropped in between,
+		// so both load everything from scratch.
+		std::vector<Model> serial;
+		double serialTime;
+		{
+			auto start = std::chrono::steady_clock::now();
+			Scene scene;
+			for (const ModelDescriptor& descriptor : descriptors)
+				scene.AddModel(descriptor.filename);
+			serialTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			serial = scene.models;
+		}
+		for (const ModelDescriptor& descriptor : descriptors)
+			std::filesystem::remove(meshCachePath(descriptor.filename));
+		for (Model& model : serial)
+			model.m_Materials.reset();
+
+		auto start = std::chrono::steady_clock::now();
+		Scene scene;
+		scene.AddModels(descriptors);
+		double parallelTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		// Models come out in descriptor order, placed as described, with full textures.
+		passed &= scene.models.size() == count;
+		for (int i = 0; i < count && i < scene.models.size(); ++i)
+		{
+			const Model& model = scene.models[i];
+			passed &= model.m_Indices == serial[i].m_Indices && model.m_Vertices.size() == serial[i].m_Vertices.size() &&
+				memcmp(model.m_Vertices.data(), serial[i].m_Vertices.data(), model.m_Vertices.size() * sizeof(Vertex)) == 0;
+			passed &= model.position == descriptors[i].position && model.rotation == descriptors[i].rotation &&
+				model.scale == descriptors[i].scale;
+			const Material& material = model.m_Materials->materials[0];
+			passed &= material.textures.size() == 3;
+			for (const MaterialTexture& map : material.textures)
+				passed &= map.texture && map.texture->Width() == 512;
+		}
+
+		for (const ModelDescriptor& descriptor : descriptors)
+		{
+			std::string name = descriptor.filename.substr(0, descriptor.filename.size() - 4);
+			std::filesystem::remove(descriptor.filename);
+			std::filesystem::remove(name + ".mtl");
+			std::filesystem::remove(meshCachePath(descriptor.filename));
+			for (int t = 0; t < 3; ++t)
+				std::filesystem::remove(name + "_" + std::to_string(t) + ".ppm");
+		}
+
+		// Models loading at the same time with one texture between them decode it once.
+		writeTexturedGrid("parallel_loading_atlas", 2, 2048, 1);
+		std::vector<std::unique_ptr<Model>> sharing(count);
+		unsigned int loadsBefore = AssetCache::Instance().TextureLoads();
+		{
+			ThreadPool pool(count);
+			for (int i = 0; i < count; ++i)
+			{
+				std::string name = "parallel_loading_test_" + std::to_string(i);
+				writeTexturedGrid(name, 20, 1, 0);
+				std::ofstream(name + ".mtl", std::ios::app) << "map_Kd parallel_loading_atlas_0.ppm\n";
+				pool.Submit([&sharing, i, name]() { sharing[i] = std::make_unique<Model>(name + ".obj", false); });
+			}
+		}
+		unsigned int sharedLoads = AssetCache::Instance().TextureLoads() - loadsBefore;
+		passed &= sharedLoads == 1;
+		for (int i = 0; i < count; ++i)
+		{
+			const Material& material = sharing[i]->m_Materials->materials[0];
+			passed &= material.textures.size() == 1 && material.textures[0].texture &&
+				material.textures[0].texture == sharing[0]->m_Materials->materials[0].textures[0].texture;
+			std::string name = "parallel_loading_test_" + std::to_string(i);
+			std::filesystem::remove(name + ".obj");
+			std::filesystem::remove(name + ".mtl");
+		}
+		std::filesystem::remove("parallel_loading_atlas.obj");
+		std::filesystem::remove("parallel_loading_atlas.mtl");
+		std::filesystem::remove("parallel_loading_atlas_0.ppm");
+
+		std::cout << count << " models sharing a texture at once: " << sharedLoads << " texture decodes\n";
+		std::cout << count << " models with " << 3 * count << " textures: " << serialTime <<
+			" sec one by one, " << parallelTime << " sec at once on " << ThreadPool::Loading().Threads() << " threads\n";
+		std::cout << "parallel loading " << (passed ? "gives" : "does NOT give") << " the same models in order\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::QuantizedVertexTest()
+	{
+		// Octahedral normals come back within a twentieth of a degree in every direction.
+		bool passed = true;
+		float worstNormal = 1.0f;
+		for (int i = 0; i < 10000; ++i)
+		{
+			float z = 1.0f - 2.0f * (i + 0.5f) / 10000.0f, angle = i * 2.39996323f;
+			float r = std::sqrt(1.0f - z * z);
+			glm::vec3 n(r * std::cos(angle), r * std::sin(angle), z);
+			int16_t packed[2];
+			octEncode(n, packed);
+			worstNormal = std::min(worstNormal, glm::dot(n, octDecode(packed)));
+		}
+		passed &= worstNormal > std::cos(glm::radians(0.05f));
+
+		// The render test scene, drawn with float and then quantized vertices.
+		Scene scene;
+		scene.w = 800;
+		scene.h = 600;
+		scene.AddModel("models/face.obj");
+		scene.models[0].position = glm::vec3(-0.2f, 0.0f, -1.0f);
+		scene.models[0].rotation = glm::vec3(0.1f, 0.1f, 0.0f);
+		scene.AddModel("models/cube.obj");
+		scene.models[1].position = glm::vec3(0.15f, 0.0f, -1.0f);
+		scene.models[1].scale = 0.185f;
+		scene.models[1].rotation = glm::vec3(0.1f, 0.1f, 0.0f);
+		scene.camera.Update();
+		scene.frameCount = 30;
+		glm::mat4 P = glm::perspective(45.0f, float(scene.w) / float(scene.h), 0.1f, 100.0f);
+		std::vector<std::vector<Vertex>> original;
+		for (const Model& model : scene.models)
+			original.push_back(model.m_Vertices);
+
+		// Decoded vertices are within half a quantization step of the originals.
+		const SHADING_MODE modes[] = { SHADING_MODE::FLAT, SHADING_MODE::BLINN_PHONG };
+		cv::Mat frames[2][2];
+		for (int format = 0; format < 2; ++format)
+		{
+			scene.vertexFormat = format ? VERTEX_FORMAT::QUANTIZED : VERTEX_FORMAT::FLOAT;
+			for (int m = 0; m < 2; ++m)
+			{
+				scene.shading = modes[m];
+				scene.RenderFrame(P);
+				frames[format][m] = scene.frame.clone();
+			}
+		}
+		for (int i = 0; i < scene.models.size(); ++i)
+		{
+			const Model& model = scene.models[i];
+			passed &= model.VertexFormat() == VERTEX_FORMAT::QUANTIZED && model.m_Vertices.empty() &&
+				model.VertexCount() == original[i].size();
+			glm::vec3 step = model.m_Quantization.positionScale;
+			for (unsigned int v = 0; v < model.VertexCount(); ++v)
+			{
+				Vertex decoded = model.GetVertex(v);
+				glm::vec3 error = glm::abs(decoded.position - original[i][v].position);
+				glm::vec2 uvError = glm::abs(glm::vec2(decoded.texcoord) - glm::vec2(original[i][v].texcoord));
+				glm::vec2 uvStep = model.m_Quantization.texcoordScale;
+				for (int c = 0; c < 3; ++c)
+					passed &= error[c] <= step[c] * 0.5f + 1e-6f;
+				for (int c = 0; c < 2; ++c)
+					passed &= uvError[c] <= uvStep[c] * 0.5f + 1e-6f;
+			}
+		}
+
+		// Images differ only where a triangle edge moved by a fraction of a pixel, and
+		// slightly in lighting.
+		for (int m = 0; m < 2; ++m)
+		{
+			int covered = 0, differing = 0;
+			float worst = 0.0f;
+			for (int y = 0; y < scene.h; ++y)
+			{
+				for (int x = 0; x < scene.w; ++x)
+				{
+					cv::Vec3f a = frames[0][m].at<cv::Vec3f>(y, x), b = frames[1][m].at<cv::Vec3f>(y, x);
+					covered += a != cv::Vec3f(0.0f, 0.0f, 0.0f);
+					float d = std::max(std::abs(a[0] - b[0]), std::max(std::abs(a[1] - b[1]), std::abs(a[2] - b[2])));
+					differing += d > 0.02f;
+					worst = std::max(worst, d);
+				}
+			}
+			passed &= covered > 0 && differing * 100 < covered;
+			std::cout << (m ? "Blinn-Phong" : "flat") << ": " << differing << " of " << covered <<
+				" covered pixels differ by more than 2%\n";
+		}
+
+		// Back to float gives the decoded values.
+		scene.models[0].SetVertexFormat(VERTEX_FORMAT::FLOAT);
+		passed &= scene.models[0].m_Vertices.size() == original[0].size() && scene.models[0].m_PackedVertices.empty() &&
+			scene.models[0].m_PositionX.size() == ((original[0].size() + 7) & ~size_t(7));
+
+		// The vertex stage on a large mesh, where it is limited by memory traffic.
+		writeTexturedGrid("quantized_vertex_test", 700, 16, 1);
+		Model grid("quantized_vertex_test.obj", false);
+		grid.position = glm::vec3(0.0f, 0.0f, -1.5f);
+		glm::mat4 V = scene.camera.getViewMatrix();
+		double times[2];
+		size_t bytes[2];
+		for (int format = 0; format < 2; ++format)
+		{
+			grid.SetVertexFormat(format ? VERTEX_FORMAT::QUANTIZED : VERTEX_FORMAT::FLOAT);
+			bytes[format] = format ? grid.m_PackedVertices.size() * sizeof(PackedVertex) + grid.m_PackedX.size() * 3 * sizeof(uint16_t) :
+				grid.m_Vertices.size() * sizeof(Vertex) + grid.m_PositionX.size() * 3 * sizeof(float);
+			TileBinner binner;
+			const int frames = 10;
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < frames; ++i)
+			{
+				binner.Reset(scene.w, scene.h, cv::Vec3f(0.0f, 0.0f, 0.0f), 1.0f);
+				unsigned int rendered = 0;
+				grid.Draw(binner, P, V, scene.w, scene.h, i, false, true, 0, rendered);
+			}
+			times[format] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / frames;
+		}
+		std::filesystem::remove("quantized_vertex_test.obj");
+		std::filesystem::remove("quantized_vertex_test.mtl");
+		std::filesystem::remove("quantized_vertex_test_0.ppm");
+
+		std::cout << "worst normal error: " << glm::degrees(std::acos(std::min(worstNormal, 1.0f))) << " degrees\n";
+		std::cout << grid.VertexCount() << " vertices: " << double(bytes[0]) / grid.VertexCount() << " bytes and " <<
+			times[0] << " sec per frame as floats, " << double(bytes[1]) / grid.VertexCount() << " bytes and " <<
+			times[1] << " sec quantized\n";
+		std::cout << "quantized vertices " << (passed ? "stay" : "do NOT stay") << " within their error bounds\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::MeshOptimizerTest()
+	{
+		// A grid loaded from file gets its triangles reordered for the vertex cache. The same
+		// triangles in random order serve as the worst case.
+		bool passed = true;
+		writeTexturedGrid("mesh_optimizer_test", 500, 16, 1);
+		Model optimized("mesh_optimizer_test.obj", false);
+		Model shuffled = optimized;
+		std::vector<unsigned int> order(shuffled.TriangleCount());
+		for (unsigned int i = 0; i < order.size(); ++i)
+			order[i] = i;
+		std::shuffle(order.begin(), order.end(), std::mt19937(7));
+		for (unsigned int i = 0; i < order.size(); ++i)
+		{
+			for (int k = 0; k < 3; ++k)
+				shuffled.m_Indices[3 * i + k] = optimized.m_Indices[3 * order[i] + k];
+			shuffled.m_TriangleMaterials[i] = optimized.m_TriangleMaterials[order[i]];
+		}
+		shuffled.BuildMeshlets();
+		float shuffledRatio = averageCacheMissRatio(shuffled.m_Indices.data(), shuffled.TriangleCount(), shuffled.m_Vertices.size());
+		float optimizedRatio = averageCacheMissRatio(optimized.m_Indices.data(), optimized.TriangleCount(), optimized.m_Vertices.size());
+
+		// Reordering the shuffled triangles again gets back to about the same reuse, and
+		// cutting into clusters for overdraw gives up little of it.
+		std::vector<unsigned int> reordered;
+		auto reorderStart = std::chrono::steady_clock::now();
+		optimizeVertexCache(reordered, shuffled.m_Indices.data(), shuffled.TriangleCount(), shuffled.m_Vertices.size());
+		double reorderTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - reorderStart).count();
+		float cacheRatio = averageCacheMissRatio(shuffled.m_Indices.data(), shuffled.TriangleCount(),
+			shuffled.m_Vertices.size(), reordered.data());
+		optimizeOverdraw(reordered, shuffled.m_Indices.data(), shuffled.m_Vertices.data(), shuffled.m_Vertices.size());
+		float overdrawRatio = averageCacheMissRatio(shuffled.m_Indices.data(), shuffled.TriangleCount(),
+			shuffled.m_Vertices.size(), reordered.data());
+		std::vector<unsigned int> sorted = reordered;
+		std::sort(sorted.begin(), sorted.end());
+		for (unsigned int i = 0; i < sorted.size(); ++i)
+			passed &= sorted[i] == i;
+		passed &= sorted.size() == shuffled.TriangleCount();
+		passed &= optimizedRatio < 0.8f && cacheRatio < 0.8f && overdrawRatio < 0.85f && shuffledRatio > 2.0f;
+
+		// Vertices are numbered in the order triangles first use them.
+		unsigned int nextVertex = 0;
+		for (unsigned int index : optimized.m_Indices)
+		{
+			passed &= index <= nextVertex;
+			nextVertex = std::max(nextVertex, index + 1);
+		}
+
+		// Both orders draw the same image, the optimized one faster.
+		Scene scene;
+		scene.w = 800;
+		scene.h = 600;
+		scene.models.push_back(shuffled);
+		scene.models[0].position = glm::vec3(0.0f, 0.0f, -1.2f);
+		scene.models[0].rotation = glm::vec3(0.3f, 0.2f, 0.0f);
+		scene.frameCount = 20;
+		glm::mat4 P = glm::perspective(45.0f, float(scene.w) / float(scene.h), 0.1f, 100.0f);
+		const int frames = 10;
+		double times[2];
+		cv::Mat images[2];
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			Model& model = scene.models[0];
+			if (pass == 1)
+			{
+				model.m_Indices = optimized.m_Indices;
+				model.m_TriangleMaterials = optimized.m_TriangleMaterials;
+				model.m_Vertices = optimized.m_Vertices;
+				model.m_PositionX = optimized.m_PositionX;
+				model.m_PositionY = optimized.m_PositionY;
+				model.m_PositionZ = optimized.m_PositionZ;
+				model.BuildMeshlets();
+			}
+			scene.RenderFrame(P);
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < frames; ++i)
+				scene.RenderFrame(P);
+			times[pass] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / frames;
+			images[pass] = scene.frame.clone();
+		}
+		int mismatched = 0;
+		for (int y = 0; y < scene.h; ++y)
+			for (int x = 0; x < scene.w; ++x)
+				mismatched += images[0].at<cv::Vec3f>(y, x) != images[1].at<cv::Vec3f>(y, x);
+		passed &= mismatched == 0;
+
+		std::filesystem::remove("mesh_optimizer_test.obj");
+		std::filesystem::remove("mesh_optimizer_test.mtl");
+		std::filesystem::remove("mesh_optimizer_test_0.ppm");
+
+		std::cout << "cache misses per triangle: " << shuffledRatio << " shuffled, " << optimizedRatio << " loaded, " <<
+			cacheRatio << " reordered in " << reorderTime << " sec, " << overdrawRatio << " after overdraw clustering\n";
+		std::cout << optimized.TriangleCount() << " triangles: " << times[0] << " sec per frame shuffled, " << times[1] <<
+			" sec optimized, " << mismatched << " pixels differ\n";
+		return passed;
+	}
+
+	/*!
+	*  \brief Writes name.obj, a closed sphere of the given radius with stacks x slices quads
+	*         wound counter-clockwise seen from outside, and an empty name.mtl.
+	*/
+	static void writeSphere(const std::string& name, float radius, int stacks, int slices)
+	{
+		FILE* file = fopen((name + ".mtl").c_str(), "w");
+		fprintf(file, "newmtl sphere\nKd 1 1 1\n");
+		fclose(file);
+		file = fopen((name + ".obj").c_str(), "w");
+		fprintf(file, "usemtl sphere\nv 0 %f 0\n", radius);
+		for (int i = 1; i < stacks; ++i)
+		{
+			float theta = glm::radians(180.0f * i / stacks);
+			for (int j = 0; j < slices; ++j)
+			{
+				float phi = glm::radians(360.0f * j / slices);
+				fprintf(file, "v %f %f %f\n", radius * std::sin(theta) * std::cos(phi), radius * std::cos(theta),
+					radius * std::sin(theta) * std::sin(phi));
+			}
+		}
+		fprintf(file, "v 0 %f 0\n", -radius);
+		auto vertex = [slices](int i, int j) { return 2 + (i - 1) * slices + j % slices; };
+		int last = 2 + (stacks - 1) * slices;
+		for (int j = 0; j < slices; ++j)
+		{
+			fprintf(file, "f 1 %d %d\n", vertex(1, j + 1), vertex(1, j));
+			fprintf(file, "f %d %d %d\n", last, vertex(stacks - 1, j), vertex(stacks - 1, j + 1));
+			for (int i = 1; i < stacks - 1; ++i)
+				fprintf(file, "f %d %d %d %d\n", vertex(i, j), vertex(i, j + 1), vertex(i + 1, j + 1), vertex(i + 1, j));
+		}
+		fclose(file);
+	}
+
+	bool SoftwareRasterizerUnitTests::MeshletTest()
+	{
+		// The render test scene, a sphere and a model behind the camera, drawn with and without
+		// meshlet culling, with face culling off and for both winding orders.
+		bool passed = true;
+		writeSphere("meshlet_test", 1.0f, 100, 200);
+		Scene scene;
+		scene.w = 800;
+		scene.h = 600;
+		scene.AddModel("models/face.obj");
+		scene.models[0].position = glm::vec3(-0.2f, 0.0f, -1.0f);
+		scene.models[0].rotation = glm::vec3(0.1f, 0.1f, 0.0f);
+		scene.AddModel("models/cube.obj");
+		scene.models[1].position = glm::vec3(0.15f, 0.0f, -1.0f);
+		scene.models[1].scale = 0.185f;
+		scene.models[1].rotation = glm::vec3(0.1f, 0.1f, 0.0f);
+		scene.AddModel("meshlet_test.obj");
+		scene.models[2].position = glm::vec3(0.0f, 0.25f, -1.5f);
+		scene.models[2].scale = 0.2f;
+		scene.models[2].rotation = glm::vec3(0.1f, 0.1f, 0.0f);
+		scene.AddModel("models/face.obj");
+		scene.models[3].position = glm::vec3(0.0f, 0.0f, 1.0f);
+		scene.models[3].rotation = glm::vec3(0.1f, 0.1f, 0.0f);
+		scene.camera.Update();
+		scene.frameCount = 30;
+		glm::mat4 P = glm::perspective(45.0f, float(scene.w) / float(scene.h), 0.1f, 100.0f);
+		for (const Model& model : scene.models)
+			passed &= model.m_Meshlets.size() == (model.TriangleCount() + MESHLET_TRIANGLES - 1) / MESHLET_TRIANGLES;
+
+		// Every image is the same with culling. The model behind the camera loses all of its
+		// meshlets, and with face culling the sphere well over a third, on either side.
+		const SHADING_MODE modes[] = { SHADING_MODE::FLAT, SHADING_MODE::BLINN_PHONG };
+		const bool cullFaces[] = { false, true, true }, frontFaceCCWs[] = { true, true, false };
+		int mismatched = 0;
+		for (int c = 0; c < 3; ++c)
+		{
+			scene.cullFace = cullFaces[c];
+			scene.frontFaceCCW = frontFaceCCWs[c];
+			for (int m = 0; m < 2; ++m)
+			{
+				scene.shading = modes[m];
+				cv::Mat frames[2];
+				for (int culling = 0; culling < 2; ++culling)
+				{
+					scene.meshletCulling = culling == 1;
+					scene.RenderFrame(P);
+					frames[culling] = scene.frame.clone();
+					const Model& sphere = scene.models[2];
+					if (!culling)
+						passed &= sphere.CulledMeshlets() == 0;
+					else if (!cullFaces[c])
+						passed &= sphere.BackfacingMeshlets() == 0;
+					else
+						passed &= sphere.BackfacingMeshlets() * 10 > sphere.m_Meshlets.size() * 3;
+					if (culling)
+						passed &= scene.models[3].CulledMeshlets() == scene.models[3].m_Meshlets.size();
+				}
+				for (int y = 0; y < scene.h; ++y)
+					for (int x = 0; x < scene.w; ++x)
+						mismatched += frames[0].at<cv::Vec3f>(y, x) != frames[1].at<cv::Vec3f>(y, x);
+			}
+		}
+		passed &= mismatched == 0;
+
+		// The vertex stage and triangle setup of a large sphere with face culling.
+		writeSphere("meshlet_test", 1.0f, 400, 800);
+		Model sphere("meshlet_test.obj", false);
+		sphere.position = glm::vec3(0.0f, 0.0f, -3.0f);
+		sphere.rotation = glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::mat4 V = scene.camera.getViewMatrix();
+		double times[2];
+		unsigned int backfacing = 0;
+		for (int culling = 0; culling < 2; ++culling)
+		{
+			sphere.meshletCulling = culling == 1;
+			TileBinner binner;
+			const int frames = 10;
+			auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < frames; ++i)
+			{
+				binner.Reset(scene.w, scene.h, cv::Vec3f(0.0f, 0.0f, 0.0f), 1.0f);
+				unsigned int rendered = 0;
+				sphere.Draw(binner, P, V, scene.w, scene.h, 0, true, true, 0, rendered);
+			}
+			times[culling] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / frames;
+			backfacing = sphere.BackfacingMeshlets();
+		}
+		std::filesystem::remove("meshlet_test.obj");
+		std::filesystem::remove("meshlet_test.mtl");
+		passed &= backfacing * 10 > sphere.m_Meshlets.size() * 4;
+
+		std::cout << mismatched << " pixels differ with meshlet culling\n";
+		std::cout << sphere.TriangleCount() << " sphere triangles in " << sphere.m_Meshlets.size() << " meshlets, " <<
+			backfacing << " culled by facing: " << times[0] << " sec per frame without culling, " << times[1] << " sec with\n";
+		return passed;
+	}
+
+	/*!
+	*  \brief Writes name.obj with the single triangle a, b, c and name.mtl with a white material.
+	*/
+	static void writeTriangle(const std::string& name, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		std::ofstream(name + ".mtl") << "newmtl white\nKd 1 1 1\n";
+		std::ofstream(name + ".obj") << "mtllib " << name << ".mtl\nusemtl white\nv " << a.x << " " << a.y << " " <<
+			a.z << "\nv " << b.x << " " << b.y << " " << b.z << "\nv " << c.x << " " << c.y << " " << c.z << "\nf 1 2 3\n";
+	}
+
+	bool SoftwareRasterizerUnitTests::ClipperTest()
+	{
+		// One triangle reaching behind the camera, one reaching far past the guard band on the
+		// right, and two that are clipped away entirely: behind the camera and past the far plane.
+		const int w = 800, h = 600;
+		glm::mat4 P = glm::perspective(45.0f, float(w) / float(h), 0.1f, 100.0f);
+		Camera camera;
+		camera.Update();
+		glm::mat4 V = camera.getViewMatrix();
+		const glm::vec3 triangles[4][3] = {
+			{ glm::vec3(-0.3f, -0.2f, -1.0f), glm::vec3(0.3f, -0.2f, -1.0f), glm::vec3(0.0f, 0.3f, 0.5f) },
+			{ glm::vec3(-0.2f, -0.3f, -1.0f), glm::vec3(-0.2f, 0.3f, -1.0f), glm::vec3(60.0f, 0.0f, -1.0f) },
+			{ glm::vec3(-0.3f, -0.2f, 0.5f), glm::vec3(0.3f, -0.2f, 0.5f), glm::vec3(0.0f, 0.3f, 0.5f) },
+			{ glm::vec3(-30.0f, -20.0f, -200.0f), glm::vec3(30.0f, -20.0f, -200.0f), glm::vec3(0.0f, 30.0f, -200.0f) } };
+		const unsigned int planes[4] = { CLIP_NEAR, CLIP_GUARD_RIGHT, CLIP_NEAR, CLIP_FAR };
+		const int expectedCounts[4] = { 4, 4, 0, 0 };
+		float guardX, guardY;
+		guardBandScale(w, h, guardX, guardY);
+		bool passed = true;
+
+		TileBinner binner;
+		cv::Mat frame(h, w, CV_32FC3);
+		DepthBuffer depth;
+		depth.Create(w, h, DEPTH_FORMAT::FLOAT32);
+		int clippedCounts[4], covered[4], ambiguous[4], mismatched[4];
+		for (int t = 0; t < 4; ++t)
+		{
+			writeTriangle("clipper_test", triangles[t][0], triangles[t][1], triangles[t][2]);
+			Model model("clipper_test.obj", false);
+			model.rotation = glm::vec3(0.0f, 1.0f, 0.0f);
+			glm::mat4 MVP = P * V * model.ModelMatrix(0);
+
+			// The clipper on its own: the vertex count, and every vertex inside the plane.
+			ClipVertex poly[MAX_CLIP_VERTICES] = {};
+			glm::dvec3 clip[3];
+			for (int q = 0; q < 3; ++q)
+			{
+				poly[q].position = MVP * glm::vec4(model.m_Vertices[model.m_Indices[q]].position, 1.0f);
+				clip[q] = glm::dvec3(poly[q].position.x, poly[q].position.y, poly[q].position.w);
+			}
+			double z[3] = { poly[0].position.z, poly[1].position.z, poly[2].position.z };
+			clippedCounts[t] = clipPolygon(poly, 3, planes[t], guardX, guardY);
+			passed &= clippedCounts[t] == expectedCounts[t];
+			for (int k = 0; k < clippedCounts[t]; ++k)
+			{
+				const glm::vec4& c = poly[k].position;
+				passed &= c.z >= -c.w * 1.0001f && c.z <= c.w * 1.0001f && c.x <= guardX * c.w * 1.0001f;
+			}
+
+			// The whole pipeline against the exact coverage of the unclipped triangle. A pixel
+			// center is covered where the ray through it meets the triangle in front of the near
+			// plane and behind the far one. The triangle's edges and the near and far lines are
+			// where linear functions of the ray vanish; centers within snapping distance of one
+			// may go either way.
+			binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), depth.ClearValue());
+			binner.Invalidate();
+			unsigned int rendered = 0;
+			model.Draw(binner, P, V, w, h, 0, false, true, 0, rendered);
+			binner.Rasterize(frame, depth, false, true, RASTER_ALGORITHM::HALF_SPACE);
+			auto cross = [](const glm::dvec3& a, const glm::dvec3& b)
+			{
+				return glm::dvec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+			};
+			auto dot = [](const glm::dvec3& a, const glm::dvec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; };
+			// Edge functions, then window depth minus -1, and 1 minus window depth.
+			glm::dvec3 lines[5] = { cross(clip[1], clip[2]), cross(clip[2], clip[0]), cross(clip[0], clip[1]) };
+			double det = dot(clip[0], lines[0]);
+			for (int q = 0; q < 3; ++q)
+				lines[q] = lines[q] / det;
+			glm::dvec3 depthLine = lines[0] * z[0] + lines[1] * z[1] + lines[2] * z[2];
+			lines[3] = depthLine + glm::dvec3(0.0, 0.0, 1.0);
+			lines[4] = glm::dvec3(0.0, 0.0, 1.0) - depthLine;
+			covered[t] = ambiguous[t] = mismatched[t] = 0;
+			for (int y = 0; y < h; ++y)
+			{
+				for (int x = 0; x < w; ++x)
+				{
+					glm::dvec3 ray((x + 0.5) / w * 2.0 - 1.0, (y + 0.5) / h * 2.0 - 1.0, 1.0);
+					bool inside = true, edge = false;
+					for (int l = 0; l < 5; ++l)
+					{
+						double value = dot(lines[l], ray);
+						double gradient = std::sqrt(std::pow(lines[l].x * 2.0 / w, 2) + std::pow(lines[l].y * 2.0 / h, 2));
+						inside &= value >= 0.0;
+						edge |= std::abs(value) < gradient / 16.0;
+					}
+					bool drawn = frame.at<cv::Vec3f>(y, x) != cv::Vec3f(0.0f, 0.0f, 0.0f);
+					covered[t] += drawn;
+					if (edge)
+						ambiguous[t]++;
+					else
+						mismatched[t] += drawn != inside;
+				}
+			}
+			passed &= mismatched[t] == 0 && (expectedCounts[t] ? covered[t] > 1000 : covered[t] == 0);
+		}
+		std::filesystem::remove("clipper_test.obj");
+		std::filesystem::remove("clipper_test.mtl");
+
+		const char* names[4] = { "near plane", "guard band", "behind the camera", "past the far plane" };
+		for (int t = 0; t < 4; ++t)
+			std::cout << names[t] << ": " << clippedCounts[t] << " vertices after clipping, " << covered[t] <<
+				" pixels drawn, " << mismatched[t] << " differ from the exact coverage (" << ambiguous[t] << " on edges)\n";
+		return passed;
+	}
+
+	bool SoftwareRasterizerUnitTests::HiZTest()
+	{
+		// A square occluder and a smaller triangle it hides, for each compare mode: the hidden
+		// triangle is nearer the far plane with LESS, nearer the camera with GREATER.
+		const int w = 800, h = 600;
+		glm::mat4 P = glm::perspective(45.0f, float(w) / float(h), 0.1f, 100.0f);
+		Camera camera;
+		camera.Update();
+		glm::mat4 V = camera.getViewMatrix();
+		const DEPTH_COMPARE compares[2] = { DEPTH_COMPARE::LESS, DEPTH_COMPARE::GREATER };
+		const char* names[2] = { "less", "greater" };
+		bool passed = true;
+		for (int c = 0; c < 2; ++c)
+		{
+			float occluderZ = c ? -4.0f : -1.0f, hiddenZ = c ? -1.0f : -4.0f;
+			float s = -0.5f * occluderZ;
+			std::ofstream("hiz_test_occluder.mtl") << "newmtl white\nKd 1 1 1\n";
+			std::ofstream("hiz_test_occluder.obj") << "mtllib hiz_test_occluder.mtl\nusemtl white\nv " << -s << " " << -s <<
+				" " << occluderZ << "\nv " << s << " " << -s << " " << occluderZ << "\nv " << s << " " << s << " " <<
+				occluderZ << "\nv " << -s << " " << s << " " << occluderZ << "\nf 1 2 3 4\n";
+			float t = -0.3f * hiddenZ;
+			writeTriangle("hiz_test_hidden", glm::vec3(-t, -t, hiddenZ), glm::vec3(t, -t, hiddenZ), glm::vec3(0.0f, t, hiddenZ));
+			std::vector<Model> models;
+			models.push_back(Model("hiz_test_occluder.obj", false));
+			models.push_back(Model("hiz_test_hidden.obj", false));
+			for (Model& model : models)
+				model.rotation = glm::vec3(0.0f, 1.0f, 0.0f);
+
+			for (int r = 0; r < 2; ++r)
+			{
+				DepthBuffer depth;
+				depth.Create(w, h, DEPTH_FORMAT::FLOAT32, compares[c], r == 1);
+				depth.SetClearValue(c ? 0.0f : 1.0f);
+
+				// With Hi-Z, without it, and the occluder alone.
+				TileBinner binner;
+				cv::Mat color[3], depths[3];
+				unsigned int rejected[3];
+				for (int pass = 0; pass < 3; ++pass)
+				{
+					cv::Mat frame(h, w, CV_32FC3);
+					binner.SetHiZ(pass != 1);
+					binner.Reset(w, h, cv::Vec3f(0.0f, 0.0f, 0.0f), depth.ClearValue());
+					binner.Invalidate();
+					unsigned int rendered = 0;
+					for (int m = 0; m < (pass == 2 ? 1 : 2); ++m)
+						models[m].Draw(binner, P, V, w, h, 0, false, true, m, rendered);
+					binner.Rasterize(frame, depth, false, true, RASTER_ALGORITHM::HALF_SPACE);
+					color[pass] = frame;
+					depths[pass] = depth.Data().clone();
+					rejected[pass] = binner.HiZRejectedTiles();
+				}
+				bool same = true;
+				for (int pass = 1; pass < 3; ++pass)
+					same &= memcmp(color[0].data, color[pass].data, color[0].total() * color[0].elemSize()) == 0 &&
+						memcmp(depths[0].data, depths[pass].data, depths[0].total() * depths[0].elemSize()) == 0;
+				int covered = 0;
+				for (int y = 0; y < h; ++y)
+					for (int x = 0; x < w; ++x)
+						covered += color[0].at<cv::Vec3f>(y, x) != cv::Vec3f(0.0f, 0.0f, 0.0f);
+				passed &= same && covered > 0 && rejected[0] > 0 && rejected[1] == 0 && rejected[2] == 0;
+				std::cout << names[c] << (r ? ", reversed-Z" : "") << ": hidden triangle rejected in " << rejected[0] <<
+					" tiles, frame " << (same ? "identical" : "DIFFERENT") << " without Hi-Z and without the hidden triangle\n";
+			}
+		}
+		for (const char* file : { "hiz_test_occluder.obj", "hiz_test_occluder.mtl", "hiz_test_hidden.obj", "hiz_test_hidden.mtl" })
+			std::filesystem::remove(file);
+		return passed;
+	}
 
 	bool SoftwareRasterizerUnitTests::RenderTest()
 	{
@@ -5,6 +5,28 @@ namespace SoftwareRasterizer
 	{
 	public:
 		bool LineAlgSpeedTest();
+		bool RasterAlgSpeedTest();
+		bool TileDeterminismTest();
+		bool DepthFormatTest();
+		bool VisibilityBufferTest();
+		bool DepthPrepassTest();
+		bool TextureSamplerTest();
+		bool AssetCacheTest();
+		bool RenderStateKernelTest();
+		bool ShaderPipelineTest();
+		bool QuadShadingTest();
+		bool PerspectiveInterpolationTest();
+		bool MultisampleTest();
+		bool WireframeEdgeTest();
+		bool ObjParserTest();
+		bool MeshCacheTest();
+		bool ProgressiveLoadingTest();
+		bool ParallelLoadingTest();
+		bool QuantizedVertexTest();
+		bool MeshOptimizerTest();
+		bool MeshletTest();
+		bool ClipperTest();
+		bool HiZTest();
 		bool RenderTest();
 	};
 }
\ No newline at end of file
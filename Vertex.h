@@ -3,6 +3,9 @@
 
 namespace SoftwareRasterizer
 {
+    // Most floats a vertex shader can pass on to the fragment shader.
+    const int MAX_VARYINGS = 16;
+
     struct Vertex
     {
         glm::vec3 position;
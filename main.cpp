@@ -4,6 +4,7 @@
 #include <glm/glm.hpp>
 #include <iostream>
 #include <string>
+#include <vector>
 
 int main(int argc, char** argv) 
 {
@@ -27,27 +28,26 @@ int main(int argc, char** argv)
 		scene.w = std::stoi(argv[1]);
 		scene.h = std::stoi(argv[2]);
 		
-		// Load models with appropriate transforms.
-		int modelCounter = 0;
+		// Load models with appropriate transforms, all at once in the background. They show
+		// up as they arrive, in argument order. Missing trailing values keep the previous
+		// model's.
+		std::vector<SoftwareRasterizer::ModelDescriptor> descriptors;
 		glm::vec3 pos(0);
 		glm::vec3 rot(0);
 		float scaleVal = 1;
-		for (int i = 0; i < argc; i += 10)
+		for (int i = 3; i < argc; i += 8)
 		{
-			if (argc >= i+7)
-				pos = glm::vec3(std::stoi(argv[4+i]), std::stoi(argv[5+i]), std::stoi(argv[6+i]));
-			if (argc >= i+8)
-				scaleVal = std::stof(argv[7+i]);
-			if (argc >= i+11)
-				rot = glm::vec3(std::stof(argv[8+i]), std::stof(argv[9+i]), std::stof(argv[10+i]));
+			if (argc > i+3)
+				pos = glm::vec3(std::stof(argv[i+1]), std::stof(argv[i+2]), std::stof(argv[i+3]));
+			if (argc > i+4)
+				scaleVal = std::stof(argv[i+4]);
+			if (argc > i+7)
+				rot = glm::vec3(std::stof(argv[i+5]), std::stof(argv[i+6]), std::stof(argv[i+7]));
 
-			std::cout << "Loading object file " << argv[3+i] << std::endl;
-			scene.AddModel(argv[3+i]);
-			scene.models[modelCounter].position = pos;
-			scene.models[modelCounter].rotation = rot;
-			scene.models[modelCounter].scale = scaleVal;
-			modelCounter++;
+			std::cout << "Loading object file " << argv[i] << std::endl;
+			descriptors.push_back(SoftwareRasterizer::ModelDescriptor(argv[i], pos, rot, scaleVal));
 		}
+		scene.LoadModels(descriptors);
 
 		// Draw scene.
 		scene.Draw();